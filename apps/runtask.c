@@ -46,29 +46,26 @@
 #include <sys/stat.h>
 #include <dirent.h>
 
+#include "../lib/termbg.h"
 #include "../lib/termgfx.h"
 
-#define MAX_VARIABLES 128
 #define MAX_LABELS 256
-#define MAX_FUNCTIONS 64
 #define MAX_FUNCTION_PARAMS 8
-#define MAX_SCOPES 16
 #define MAX_INCLUDE_DEPTH 16
 #define MAX_INCLUDES_PER_FILE 32
 #define MAX_TASK_SEARCH_DEPTH 32
+#define MAX_RANGE_LENGTH (1 << 24)
 
 typedef struct Value Value;
 
 static char *xstrdup(const char *s);
+static void *grow_buffer(void *data, size_t *cap, size_t needed, size_t elem_size);
 static void set_initial_argv0(const char *argv0);
 static void free_value(Value *value);
 static bool copy_value(Value *dest, const Value *src);
-static bool parse_expression(const char **cursor, Value *out, const char *terminators, int line, int debug);
 static bool value_as_double(const Value *value, double *out);
 static char *value_to_string(const Value *value);
-static bool evaluate_expression_statement(const char *expr, int line, int debug);
 static bool parse_boolean_literal(const char *expr, bool *out, const char **end_out);
-static bool evaluate_truthy_expression(const char *expr, int line, int debug, bool *out);
 static bool set_echo_enabled(bool enabled);
 static void restore_terminal_settings(void);
 static bool parse_label_definition(const char *line, char *out_name, size_t name_size);
@@ -85,61 +82,76 @@ typedef enum {
     VALUE_ARRAY
 } ValueType;
 
+/* Arrays whose elements are all ints or all floats are stored packed; any
+   other element forces the boxed Value layout. Empty arrays take the layout
+   of their first element. */
+typedef enum {
+    ARRAY_BOXED = 0,
+    ARRAY_INTS,
+    ARRAY_FLOATS
+} ArrayLayout;
+
 struct Value {
     ValueType type;
+    ArrayLayout array_layout;
     long long int_val;
     double float_val;
     char *str_val;
     bool owns_string;
-    Value *array_val;
+    union {
+        Value *array_val;       // ARRAY_BOXED
+        long long *array_ints;  // ARRAY_INTS
+        double *array_floats;   // ARRAY_FLOATS
+    };
     size_t array_len;
     bool owns_array;
 };
 
 typedef struct {
     char name[64];
+    int name_id;        // index into variable_names
     ValueType type;
+    ArrayLayout array_layout;
     long long int_val;
     double float_val;
     char *str_val;
-    Value *array_val;
+    union {
+        Value *array_val;
+        long long *array_ints;
+        double *array_floats;
+    };
     size_t array_len;
 } Variable;
 
+static void take_variable_array(Variable *var, Value *out);
+
+/* Variable names are interned once into dense ids so scopes can hash a small
+   integer instead of comparing strings. Ids are never released. */
+typedef struct {
+    char **names;
+    size_t count;
+    size_t names_cap;
+    int *table;         // open addressing, name id + 1 (0 = empty)
+    size_t table_cap;   // power of two
+} NameTable;
+
+/* Open-addressing table keyed by name id. Variables are allocated one by one
+   so pointers handed out stay valid when the table is rehashed. */
 typedef struct {
-    Variable vars[MAX_VARIABLES];
+    Variable **slots;   // NULL = empty
+    size_t capacity;    // power of two, 0 until the first insert
     size_t count;
 } VariableScope;
 
-static VariableScope scopes[MAX_SCOPES];
+static NameTable variable_names;
+static VariableScope *scopes = NULL;
+static size_t scope_cap = 0;
 static size_t scope_depth = 0; // includes global scope
-static VariableScope static_scopes[MAX_FUNCTIONS];
+static VariableScope *static_scopes = NULL; // indexed by function index
+static size_t static_scope_count = 0;
+static size_t static_scope_cap = 0;
 static int current_function_index = -1;
-
-typedef struct {
-    bool result;
-    bool true_branch_done;
-    bool else_encountered;
-    bool else_branch_done;
-    bool expects_end;
-    int indent;
-    int line_number;
-} IfContext;
-
-typedef struct {
-    int for_line_pc;
-    int body_start_pc;
-    int indent;
-    char condition[256];
-    char step[128];
-} ForContext;
-
-typedef struct {
-    int while_line_pc;
-    int body_start_pc;
-    int indent;
-    char condition[256];
-} WhileContext;
+static unsigned long variable_generation = 1; // bumped when name lookups may resolve differently
 
 #define MAX_REF_INDICES 4
 
@@ -829,6 +841,86 @@ restore:
     return success;
 }
 
+static size_t hash_variable_name(const char *name) {
+    size_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; ++p) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash;
+}
+
+static void rehash_variable_names(size_t new_cap) {
+    int *table = (int *)calloc(new_cap, sizeof(int));
+    if (!table) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t id = 0; id < variable_names.count; ++id) {
+        size_t i = hash_variable_name(variable_names.names[id]) & (new_cap - 1);
+        while (table[i] != 0) {
+            i = (i + 1) & (new_cap - 1);
+        }
+        table[i] = (int)id + 1;
+    }
+    free(variable_names.table);
+    variable_names.table = table;
+    variable_names.table_cap = new_cap;
+}
+
+// Returns the id for name, interning it when intern is set; -1 if absent.
+static int lookup_variable_name(const char *name, bool intern) {
+    if (!name || !*name) {
+        return -1;
+    }
+    if (variable_names.table_cap > 0) {
+        size_t mask = variable_names.table_cap - 1;
+        for (size_t i = hash_variable_name(name) & mask; variable_names.table[i] != 0; i = (i + 1) & mask) {
+            int id = variable_names.table[i] - 1;
+            if (strcmp(variable_names.names[id], name) == 0) {
+                return id;
+            }
+        }
+    }
+    if (!intern) {
+        return -1;
+    }
+
+    if ((variable_names.count + 1) * 4 > variable_names.table_cap * 3) {
+        rehash_variable_names(variable_names.table_cap ? variable_names.table_cap * 2 : 64);
+    }
+    variable_names.names = (char **)grow_buffer(variable_names.names, &variable_names.names_cap,
+                                                variable_names.count + 1, sizeof(char *));
+    int id = (int)variable_names.count;
+    variable_names.names[variable_names.count++] = xstrdup(name);
+    size_t mask = variable_names.table_cap - 1;
+    size_t i = hash_variable_name(name) & mask;
+    while (variable_names.table[i] != 0) {
+        i = (i + 1) & mask;
+    }
+    variable_names.table[i] = id + 1;
+    return id;
+}
+
+static const char *variable_name(int name_id) {
+    if (name_id < 0 || (size_t)name_id >= variable_names.count) {
+        return "";
+    }
+    return variable_names.names[name_id];
+}
+
+static void free_variable_names(void) {
+    for (size_t i = 0; i < variable_names.count; ++i) {
+        free(variable_names.names[i]);
+    }
+    free(variable_names.names);
+    free(variable_names.table);
+    memset(&variable_names, 0, sizeof(variable_names));
+}
+
+static size_t scope_hash_index(int name_id, size_t capacity) {
+    return ((size_t)(unsigned)name_id * 2654435761u) & (capacity - 1);
+}
+
 static VariableScope *current_scope(void) {
     if (scope_depth == 0) {
         return NULL;
@@ -836,68 +928,134 @@ static VariableScope *current_scope(void) {
     return &scopes[scope_depth - 1];
 }
 
-static VariableScope *current_static_scope(void) {
-    if (current_function_index < 0 || current_function_index >= (int)(sizeof(static_scopes) / sizeof(static_scopes[0]))) {
+static VariableScope *current_static_scope(bool create) {
+    if (current_function_index < 0) {
         return NULL;
     }
-    return &static_scopes[current_function_index];
+    size_t index = (size_t)current_function_index;
+    if (index >= static_scope_count) {
+        if (!create) {
+            return NULL;
+        }
+        static_scopes = (VariableScope *)grow_buffer(static_scopes, &static_scope_cap, index + 1, sizeof(VariableScope));
+        memset(&static_scopes[static_scope_count], 0, (index + 1 - static_scope_count) * sizeof(VariableScope));
+        static_scope_count = index + 1;
+    }
+    return &static_scopes[index];
 }
 
-static Variable *find_variable_in_scope(VariableScope *scope, const char *name) {
-    if (!scope || !name) {
+static Variable *find_variable_in_scope(const VariableScope *scope, int name_id) {
+    if (!scope || scope->count == 0 || name_id < 0) {
         return NULL;
     }
-    for (size_t i = 0; i < scope->count; ++i) {
-        if (strcmp(scope->vars[i].name, name) == 0) {
-            return &scope->vars[i];
+    size_t mask = scope->capacity - 1;
+    for (size_t i = scope_hash_index(name_id, scope->capacity); scope->slots[i]; i = (i + 1) & mask) {
+        if (scope->slots[i]->name_id == name_id) {
+            return scope->slots[i];
         }
     }
     return NULL;
 }
 
+static void scope_place(VariableScope *scope, Variable *var) {
+    size_t mask = scope->capacity - 1;
+    size_t i = scope_hash_index(var->name_id, scope->capacity);
+    while (scope->slots[i]) {
+        i = (i + 1) & mask;
+    }
+    scope->slots[i] = var;
+}
+
+static Variable *scope_insert(VariableScope *scope, int name_id) {
+    if ((scope->count + 1) * 4 > scope->capacity * 3) {
+        size_t old_cap = scope->capacity;
+        Variable **old_slots = scope->slots;
+        size_t new_cap = old_cap ? old_cap * 2 : 8;
+        scope->slots = (Variable **)calloc(new_cap, sizeof(Variable *));
+        if (!scope->slots) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+        scope->capacity = new_cap;
+        for (size_t i = 0; i < old_cap; ++i) {
+            if (old_slots[i]) {
+                scope_place(scope, old_slots[i]);
+            }
+        }
+        free(old_slots);
+    }
+
+    Variable *var = (Variable *)calloc(1, sizeof(Variable));
+    if (!var) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(var->name, sizeof(var->name), "%s", variable_name(name_id));
+    var->name_id = name_id;
+    var->type = VALUE_UNSET;
+    scope_place(scope, var);
+    scope->count++;
+    variable_generation++;
+    return var;
+}
+
+// Frees the scope's variables but keeps its table for the next push.
 static void clear_scope(VariableScope *scope) {
-    if (!scope) {
+    if (!scope || scope->count == 0) {
         return;
     }
-    for (size_t i = 0; i < scope->count; ++i) {
-        if (scope->vars[i].type == VALUE_STRING && scope->vars[i].str_val) {
-            free(scope->vars[i].str_val);
-            scope->vars[i].str_val = NULL;
+    for (size_t i = 0; i < scope->capacity; ++i) {
+        Variable *var = scope->slots[i];
+        if (!var) {
+            continue;
         }
-        if (scope->vars[i].type == VALUE_ARRAY && scope->vars[i].array_val) {
-            for (size_t j = 0; j < scope->vars[i].array_len; ++j) {
-                free_value(&scope->vars[i].array_val[j]);
-            }
-            free(scope->vars[i].array_val);
-            scope->vars[i].array_val = NULL;
-            scope->vars[i].array_len = 0;
+        if (var->type == VALUE_STRING && var->str_val) {
+            free(var->str_val);
         }
-        scope->vars[i].type = VALUE_UNSET;
+        if (var->type == VALUE_ARRAY) {
+            Value storage;
+            take_variable_array(var, &storage);
+            free_value(&storage);
+        }
+        free(var);
+        scope->slots[i] = NULL;
     }
     scope->count = 0;
 }
 
+static void release_scope(VariableScope *scope) {
+    clear_scope(scope);
+    free(scope->slots);
+    memset(scope, 0, sizeof(*scope));
+}
+
 static void init_static_scopes(void) {
-    for (size_t i = 0; i < MAX_FUNCTIONS; ++i) {
+    for (size_t i = 0; i < static_scope_count; ++i) {
         clear_scope(&static_scopes[i]);
     }
+    variable_generation++;
 }
 
-static void init_scopes(void) {
-    for (size_t i = 0; i < MAX_SCOPES; ++i) {
-        scopes[i].count = 0;
+static void reserve_scopes(size_t needed) {
+    size_t old_cap = scope_cap;
+    scopes = (VariableScope *)grow_buffer(scopes, &scope_cap, needed, sizeof(VariableScope));
+    if (scope_cap > old_cap) {
+        memset(&scopes[old_cap], 0, (scope_cap - old_cap) * sizeof(VariableScope));
     }
+}
+
+static void init_scopes(void) {
+    reserve_scopes(1);
+    clear_scope(&scopes[0]);
     scope_depth = 1; // global scope
+    variable_generation++;
 }
 
-static bool push_scope(void) {
-    if (scope_depth >= MAX_SCOPES) {
-        fprintf(stderr, "Variable scope limit reached (%d)\n", MAX_SCOPES);
-        return false;
-    }
-    scopes[scope_depth].count = 0;
+static void push_scope(void) {
+    reserve_scopes(scope_depth + 1);
+    clear_scope(&scopes[scope_depth]);
     scope_depth++;
-    return true;
+    variable_generation++;
 }
 
 static void pop_scope(void) {
@@ -907,10 +1065,11 @@ static void pop_scope(void) {
     VariableScope *scope = &scopes[scope_depth - 1];
     clear_scope(scope);
     scope_depth--;
+    variable_generation++;
 }
 
-static Variable *find_variable(const char *name, bool create) {
-    if (!name || !*name) {
+static Variable *find_variable_id(int name_id, bool create) {
+    if (name_id < 0) {
         return NULL;
     }
 
@@ -920,12 +1079,12 @@ static Variable *find_variable(const char *name, bool create) {
     }
 
     bool in_function_scope = scope_depth > 1;
-    Variable *found = find_variable_in_scope(scope, name);
+    Variable *found = find_variable_in_scope(scope, name_id);
     if (found) {
         return found;
     }
 
-    Variable *static_var = find_variable_in_scope(current_static_scope(), name);
+    Variable *static_var = find_variable_in_scope(current_static_scope(false), name_id);
     if (static_var) {
         return static_var;
     }
@@ -933,14 +1092,14 @@ static Variable *find_variable(const char *name, bool create) {
     if (!in_function_scope || !create) {
         for (size_t depth = scope_depth; depth > 1; --depth) {
             VariableScope *parent = &scopes[depth - 2];
-            found = find_variable_in_scope(parent, name);
+            found = find_variable_in_scope(parent, name_id);
             if (found) {
                 return found;
             }
         }
 
         if (scope_depth > 0) {
-            found = find_variable_in_scope(&scopes[0], name);
+            found = find_variable_in_scope(&scopes[0], name_id);
             if (found) {
                 return found;
             }
@@ -950,50 +1109,82 @@ static Variable *find_variable(const char *name, bool create) {
     if (!create) {
         return NULL;
     }
+    return scope_insert(scope, name_id);
+}
 
-    if (scope->count >= MAX_VARIABLES) {
-        fprintf(stderr, "Variable limit reached in scope (%d)\n", MAX_VARIABLES);
-        return NULL;
-    }
-
-    Variable *var = &scope->vars[scope->count++];
-    memset(var, 0, sizeof(*var));
-    strncpy(var->name, name, sizeof(var->name) - 1);
-    var->name[sizeof(var->name) - 1] = '\0';
-    var->type = VALUE_UNSET;
-    var->array_val = NULL;
-    var->array_len = 0;
-    return var;
+static Variable *find_variable(const char *name, bool create) {
+    return find_variable_id(lookup_variable_name(name, create), create);
 }
 
-static Variable *find_static_variable(const char *name, bool create) {
-    if (!name || !*name) {
+static Variable *find_static_variable_id(int name_id, bool create) {
+    if (name_id < 0) {
         return NULL;
     }
 
-    VariableScope *scope = current_static_scope();
+    VariableScope *scope = current_static_scope(create);
     if (!scope) {
         return NULL;
     }
 
-    Variable *existing = find_variable_in_scope(scope, name);
+    Variable *existing = find_variable_in_scope(scope, name_id);
     if (existing || !create) {
         return existing;
     }
+    return scope_insert(scope, name_id);
+}
 
-    if (scope->count >= MAX_VARIABLES) {
-        fprintf(stderr, "Variable limit reached in static scope (%d)\n", MAX_VARIABLES);
-        return NULL;
+// The integer view of a float value. Casting a double outside the long long
+// range is undefined, so saturate instead; NaN maps to 0.
+static long long float_to_int(double value) {
+    if (isnan(value)) {
+        return 0;
     }
+    if (value < (double)LLONG_MIN) {
+        return LLONG_MIN;
+    }
+    if (value >= -(double)LLONG_MIN) {
+        return LLONG_MAX;
+    }
+    return (long long)value;
+}
 
-    Variable *var = &scope->vars[scope->count++];
-    memset(var, 0, sizeof(*var));
-    strncpy(var->name, name, sizeof(var->name) - 1);
-    var->name[sizeof(var->name) - 1] = '\0';
-    var->type = VALUE_UNSET;
+// Moves a variable's array storage into an owning Value so the Value helpers
+// can resize or release it; put_variable_array() moves it back.
+static void take_variable_array(Variable *var, Value *out) {
+    memset(out, 0, sizeof(*out));
+    out->type = VALUE_ARRAY;
+    out->owns_array = true;
+    if (var->type != VALUE_ARRAY) {
+        return;
+    }
+    out->array_layout = var->array_layout;
+    out->array_len = var->array_len;
+    if (var->array_layout == ARRAY_INTS) {
+        out->array_ints = var->array_ints;
+    } else if (var->array_layout == ARRAY_FLOATS) {
+        out->array_floats = var->array_floats;
+    } else {
+        out->array_val = var->array_val;
+    }
+    var->array_layout = ARRAY_BOXED;
     var->array_val = NULL;
     var->array_len = 0;
-    return var;
+}
+
+static void put_variable_array(Variable *var, Value *array) {
+    var->type = VALUE_ARRAY;
+    var->array_layout = array->array_layout;
+    var->array_len = array->array_len;
+    if (array->array_layout == ARRAY_INTS) {
+        var->array_ints = array->array_ints;
+    } else if (array->array_layout == ARRAY_FLOATS) {
+        var->array_floats = array->array_floats;
+    } else {
+        var->array_val = array->array_val;
+    }
+    var->int_val = 0;
+    var->float_val = 0.0;
+    memset(array, 0, sizeof(*array));
 }
 
 static void assign_variable(Variable *var, const Value *value) {
@@ -1004,13 +1195,10 @@ static void assign_variable(Variable *var, const Value *value) {
         free(var->str_val);
         var->str_val = NULL;
     }
-    if (var->type == VALUE_ARRAY && var->array_val) {
-        for (size_t i = 0; i < var->array_len; ++i) {
-            free_value(&var->array_val[i]);
-        }
-        free(var->array_val);
-        var->array_val = NULL;
-        var->array_len = 0;
+    if (var->type == VALUE_ARRAY) {
+        Value storage;
+        take_variable_array(var, &storage);
+        free_value(&storage);
     }
     var->type = value->type;
     if (value->type == VALUE_INT) {
@@ -1018,62 +1206,146 @@ static void assign_variable(Variable *var, const Value *value) {
         var->float_val = (double)value->int_val;
     } else if (value->type == VALUE_FLOAT) {
         var->float_val = value->float_val;
-        var->int_val = (long long)value->float_val;
+        var->int_val = float_to_int(value->float_val);
     } else if (value->type == VALUE_STRING) {
         var->str_val = value->str_val ? xstrdup(value->str_val) : xstrdup("");
     } else if (value->type == VALUE_ARRAY) {
-        var->array_len = value->array_len;
-        if (value->array_len > 0) {
-            var->array_val = (Value *)calloc(value->array_len, sizeof(Value));
-            if (!var->array_val) {
-                perror("calloc");
-                exit(EXIT_FAILURE);
-            }
-            for (size_t i = 0; i < value->array_len; ++i) {
-                copy_value(&var->array_val[i], &value->array_val[i]);
-            }
-        }
-        var->int_val = 0;
-        var->float_val = 0.0;
+        Value copy;
+        memset(&copy, 0, sizeof(copy));
+        copy_value(&copy, value);
+        put_variable_array(var, &copy);
     } else {
         var->int_val = 0;
         var->float_val = 0.0;
     }
 }
 
-static bool set_array_element(Variable *var, size_t index, const Value *value) {
-    if (!var || !value) {
-        return false;
+// Reads element index of an array without copying: boxed elements are
+// borrowed, packed ones are returned as plain numbers.
+static Value array_element(const Value *array, size_t index) {
+    Value element;
+    memset(&element, 0, sizeof(element));
+    if (array->array_layout == ARRAY_INTS) {
+        element.type = VALUE_INT;
+        element.int_val = array->array_ints[index];
+        element.float_val = (double)element.int_val;
+    } else if (array->array_layout == ARRAY_FLOATS) {
+        element.type = VALUE_FLOAT;
+        element.float_val = array->array_floats[index];
+        element.int_val = float_to_int(element.float_val);
+    } else {
+        element = array->array_val[index];
+        element.owns_string = false;
+        element.owns_array = false;
     }
+    return element;
+}
 
-    if (var->type != VALUE_ARRAY) {
-        Value tmp;
-        memset(&tmp, 0, sizeof(tmp));
-        tmp.type = VALUE_ARRAY;
-        tmp.array_len = 0;
-        tmp.array_val = NULL;
-        tmp.owns_array = true;
-        assign_variable(var, &tmp);
-        free_value(&tmp);
+// Converts a packed array to boxed Values, e.g. before storing a string in it.
+static void box_array(Value *array) {
+    if (array->array_layout == ARRAY_BOXED) {
+        return;
+    }
+    Value *boxed = NULL;
+    if (array->array_len > 0) {
+        boxed = (Value *)calloc(array->array_len, sizeof(Value));
+        if (!boxed) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < array->array_len; ++i) {
+            boxed[i] = array_element(array, i);
+        }
+    }
+    if (array->array_layout == ARRAY_INTS) {
+        free(array->array_ints);
+    } else {
+        free(array->array_floats);
     }
+    array->array_layout = ARRAY_BOXED;
+    array->array_val = boxed;
+}
 
-    if (index >= var->array_len) {
-        size_t new_len = index + 1;
-        Value *resized = (Value *)realloc(var->array_val, new_len * sizeof(Value));
+// Switches an owned boxed array to the packed layout if every element is an
+// int, or every element is a float.
+static void pack_array(Value *array) {
+    if (array->type != VALUE_ARRAY || array->array_layout != ARRAY_BOXED || !array->owns_array ||
+        array->array_len == 0) {
+        return;
+    }
+    ValueType element_type = array->array_val[0].type;
+    if (element_type != VALUE_INT && element_type != VALUE_FLOAT) {
+        return;
+    }
+    for (size_t i = 1; i < array->array_len; ++i) {
+        if (array->array_val[i].type != element_type) {
+            return;
+        }
+    }
+
+    Value *boxed = array->array_val;
+    if (element_type == VALUE_INT) {
+        long long *ints = (long long *)malloc(array->array_len * sizeof(long long));
+        if (!ints) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < array->array_len; ++i) {
+            ints[i] = boxed[i].int_val;
+        }
+        array->array_layout = ARRAY_INTS;
+        array->array_ints = ints;
+    } else {
+        double *floats = (double *)malloc(array->array_len * sizeof(double));
+        if (!floats) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < array->array_len; ++i) {
+            floats[i] = boxed[i].float_val;
+        }
+        array->array_layout = ARRAY_FLOATS;
+        array->array_floats = floats;
+    }
+    free(boxed);
+}
+
+// Stores a number into a packed (or empty) array at index, appending when
+// index == array_len. Returns false if the array has to be boxed instead.
+static bool store_packed_element(Value *array, size_t index, const Value *source) {
+    if (index > array->array_len || (source->type != VALUE_INT && source->type != VALUE_FLOAT)) {
+        return false;
+    }
+    ArrayLayout layout = source->type == VALUE_INT ? ARRAY_INTS : ARRAY_FLOATS;
+    if (array->array_len == 0 && array->array_layout == ARRAY_BOXED) {
+        free(array->array_val);
+        array->array_val = NULL;
+        array->array_layout = layout;
+    }
+    if (array->array_layout != layout) {
+        return false;
+    }
+
+    size_t elem_size = layout == ARRAY_INTS ? sizeof(long long) : sizeof(double);
+    if (index == array->array_len) {
+        void *data = layout == ARRAY_INTS ? (void *)array->array_ints : (void *)array->array_floats;
+        void *resized = realloc(data, (index + 1) * elem_size);
         if (!resized) {
             perror("realloc");
             return false;
         }
-        for (size_t i = var->array_len; i < new_len; ++i) {
-            memset(&resized[i], 0, sizeof(Value));
-            resized[i].type = VALUE_UNSET;
+        if (layout == ARRAY_INTS) {
+            array->array_ints = (long long *)resized;
+        } else {
+            array->array_floats = (double *)resized;
         }
-        var->array_val = resized;
-        var->array_len = new_len;
+        array->array_len = index + 1;
+    }
+    if (layout == ARRAY_INTS) {
+        array->array_ints[index] = source->int_val;
+    } else {
+        array->array_floats[index] = source->float_val;
     }
-
-    free_value(&var->array_val[index]);
-    copy_value(&var->array_val[index], value);
     return true;
 }
 
@@ -1085,15 +1357,20 @@ static void free_value(Value *value) {
         free(value->str_val);
         value->str_val = NULL;
     }
-    if (value->type == VALUE_ARRAY && value->owns_array && value->array_val) {
-        for (size_t i = 0; i < value->array_len; ++i) {
-            free_value(&value->array_val[i]);
+    if (value->type == VALUE_ARRAY && value->owns_array) {
+        if (value->array_layout == ARRAY_INTS) {
+            free(value->array_ints);
+        } else if (value->array_layout == ARRAY_FLOATS) {
+            free(value->array_floats);
+        } else if (value->array_val) {
+            for (size_t i = 0; i < value->array_len; ++i) {
+                free_value(&value->array_val[i]);
+            }
+            free(value->array_val);
         }
-        free(value->array_val);
-        value->array_val = NULL;
-        value->array_len = 0;
     }
     value->type = VALUE_UNSET;
+    value->array_layout = ARRAY_BOXED;
     value->owns_string = false;
     value->owns_array = false;
     value->int_val = 0;
@@ -1110,6 +1387,7 @@ static bool copy_value(Value *dest, const Value *src) {
     free_value(dest);
 
     dest->type = src->type;
+    dest->array_layout = ARRAY_BOXED;
     dest->owns_string = false;
     dest->owns_array = false;
     dest->str_val = NULL;
@@ -1126,16 +1404,31 @@ static bool copy_value(Value *dest, const Value *src) {
     } else if (src->type == VALUE_INT) {
         dest->float_val = (double)src->int_val;
     } else if (src->type == VALUE_FLOAT) {
-        dest->int_val = (long long)src->float_val;
+        dest->int_val = float_to_int(src->float_val);
     } else if (src->type == VALUE_ARRAY) {
         dest->array_len = src->array_len;
-        if (src->array_len > 0) {
+        dest->array_layout = src->array_layout;
+        dest->owns_array = true;
+        if (src->array_layout == ARRAY_INTS) {
+            dest->array_ints = (long long *)malloc((src->array_len ? src->array_len : 1) * sizeof(long long));
+            if (!dest->array_ints) {
+                perror("malloc");
+                exit(EXIT_FAILURE);
+            }
+            memcpy(dest->array_ints, src->array_ints, src->array_len * sizeof(long long));
+        } else if (src->array_layout == ARRAY_FLOATS) {
+            dest->array_floats = (double *)malloc((src->array_len ? src->array_len : 1) * sizeof(double));
+            if (!dest->array_floats) {
+                perror("malloc");
+                exit(EXIT_FAILURE);
+            }
+            memcpy(dest->array_floats, src->array_floats, src->array_len * sizeof(double));
+        } else if (src->array_len > 0) {
             dest->array_val = (Value *)calloc(src->array_len, sizeof(Value));
             if (!dest->array_val) {
                 perror("calloc");
                 exit(EXIT_FAILURE);
             }
-            dest->owns_array = true;
             for (size_t i = 0; i < src->array_len; ++i) {
                 copy_value(&dest->array_val[i], &src->array_val[i]);
             }
@@ -1159,7 +1452,14 @@ static Value variable_to_value(const Variable *var) {
         v.str_val = var->str_val;
         v.owns_string = false;
     } else if (var->type == VALUE_ARRAY) {
-        v.array_val = var->array_val;
+        v.array_layout = var->array_layout;
+        if (var->array_layout == ARRAY_INTS) {
+            v.array_ints = var->array_ints;
+        } else if (var->array_layout == ARRAY_FLOATS) {
+            v.array_floats = var->array_floats;
+        } else {
+            v.array_val = var->array_val;
+        }
         v.array_len = var->array_len;
         v.owns_array = false;
     } else {
@@ -1169,7 +1469,8 @@ static Value variable_to_value(const Variable *var) {
     return v;
 }
 
-static const Value *walk_indices(const Value *root, const VariableRef *ref, int line, int debug) {
+// Packed elements have no Value of their own; they are materialised in scratch.
+static const Value *walk_indices(const Value *root, const VariableRef *ref, Value *scratch, int line, int debug) {
     const Value *current = root;
     for (size_t i = 0; i < ref->index_count; ++i) {
         size_t idx = ref->indices[i];
@@ -1179,7 +1480,12 @@ static const Value *walk_indices(const Value *root, const VariableRef *ref, int
             }
             return NULL;
         }
-        current = &current->array_val[idx];
+        if (current->array_layout == ARRAY_BOXED) {
+            current = &current->array_val[idx];
+        } else {
+            *scratch = array_element(current, idx);
+            current = scratch;
+        }
     }
     return current;
 }
@@ -1203,6 +1509,7 @@ static bool ensure_value_array_capacity(Value *value, size_t index) {
     if (!ensure_value_array(value)) {
         return false;
     }
+    box_array(value);
     if (index >= value->array_len) {
         size_t new_len = index + 1;
         Value *resized = (Value *)realloc(value->array_val, new_len * sizeof(Value));
@@ -1227,6 +1534,10 @@ static bool set_value_at_path(Value *value, const size_t *indices, size_t depth,
         return true;
     }
 
+    if (depth == 1 && value->type == VALUE_ARRAY && store_packed_element(value, indices[0], source)) {
+        return true;
+    }
+
     if (!ensure_value_array_capacity(value, indices[0])) {
         return false;
     }
@@ -1255,16 +1566,18 @@ static bool set_variable_from_ref(Variable *var, const VariableRef *ref, const V
         free_value(&tmp);
     }
 
-    if (!set_array_element(var, ref->indices[0], &(Value){ .type = VALUE_UNSET })) {
-        return false;
-    }
-
+    Value array;
+    take_variable_array(var, &array);
+    bool ok;
     if (ref->index_count == 1) {
-        return set_array_element(var, ref->indices[0], value);
+        ok = set_value_at_path(&array, ref->indices, 1, value);
+    } else {
+        // A nested write replaces whatever the first index held.
+        ok = set_value_at_path(&array, ref->indices, 1, &(Value){ .type = VALUE_UNSET }) &&
+             set_value_at_path(&array, ref->indices, ref->index_count, value);
     }
-
-    Value *slot = &var->array_val[ref->indices[0]];
-    return set_value_at_path(slot, &ref->indices[1], ref->index_count - 1, value);
+    put_variable_array(var, &array);
+    return ok;
 }
 
 static bool resolve_variable_reference(const VariableRef *ref, Value *out, int line, int debug) {
@@ -1280,7 +1593,8 @@ static bool resolve_variable_reference(const VariableRef *ref, Value *out, int l
     }
 
     Value root = variable_to_value(var);
-    const Value *target = walk_indices(&root, ref, line, debug);
+    Value scratch;
+    const Value *target = walk_indices(&root, ref, &scratch, line, debug);
     if (!target) {
         memset(out, 0, sizeof(*out));
         out->type = VALUE_UNSET;
@@ -1292,12 +1606,23 @@ static bool resolve_variable_reference(const VariableRef *ref, Value *out, int l
 }
 
 static void cleanup_variables(void) {
-    while (scope_depth > 0) {
-        pop_scope();
-    }
-    init_scopes();
-    init_static_scopes();
+    for (size_t i = 0; i < scope_cap; ++i) {
+        release_scope(&scopes[i]);
+    }
+    for (size_t i = 0; i < static_scope_count; ++i) {
+        release_scope(&static_scopes[i]);
+    }
+    free(scopes);
+    free(static_scopes);
+    scopes = NULL;
+    static_scopes = NULL;
+    scope_cap = 0;
+    scope_depth = 0;
+    static_scope_count = 0;
+    static_scope_cap = 0;
     current_function_index = -1;
+    free_variable_names();
+    variable_generation++;
 }
 
 static bool is_token_delim(char c, const char *delims) {
@@ -1461,379 +1786,479 @@ static bool convert_value_to_index(const Value *value, size_t *index_out, int li
     return true;
 }
 
-static bool evaluate_index_expression(const char *expr, size_t *index_out, int line, int debug) {
-    if (!expr || !index_out) {
-        return false;
-    }
-
-    const char *cursor = expr;
-    Value idx_value;
-    if (!parse_expression(&cursor, &idx_value, NULL, line, debug)) {
-        return false;
+static ValueType detect_numeric_type(const char *token, long long *out_int, double *out_float) {
+    if (!token || !*token) {
+        return VALUE_UNSET;
     }
-
-    while (isspace((unsigned char)*cursor)) {
-        cursor++;
+    errno = 0;
+    char *endptr = NULL;
+    long long iv = strtoll(token, &endptr, 10);
+    if (errno == 0 && endptr && *endptr == '\0') {
+        if (out_int) {
+            *out_int = iv;
+        }
+        if (out_float) {
+            *out_float = (double)iv;
+        }
+        return VALUE_INT;
     }
-    if (*cursor != '\0') {
-        if (debug) {
-            fprintf(stderr, "Line %d: invalid array index expression\n", line);
+    errno = 0;
+    endptr = NULL;
+    double dv = strtod(token, &endptr);
+    if (errno == 0 && endptr && *endptr == '\0') {
+        if (out_float) {
+            *out_float = dv;
         }
-        free_value(&idx_value);
-        return false;
+        if (out_int) {
+            *out_int = float_to_int(dv);
+        }
+        return VALUE_FLOAT;
     }
+    return VALUE_UNSET;
+}
 
-    size_t idx = 0;
-    bool ok = convert_value_to_index(&idx_value, &idx, line, debug);
-    free_value(&idx_value);
-    if (!ok) {
-        return false;
-    }
+/* Vector built-ins, evaluated through apply_array_builtin(); their array
+   results are always packed. */
+typedef enum {
+    ARRAY_FN_RANGE = 0,
+    ARRAY_FN_SLICE,
+    ARRAY_FN_SUM,
+    ARRAY_FN_MIN,
+    ARRAY_FN_MAX,
+    ARRAY_FN_VADD,
+    ARRAY_FN_VMUL,
+    ARRAY_FN_MAP,
+    ARRAY_FN_COUNT
+} ArrayBuiltin;
+
+static const struct {
+    const char *name;
+    int min_args;
+    int max_args;
+} array_builtins[ARRAY_FN_COUNT] = {
+    [ARRAY_FN_RANGE] = {"RANGE", 2, 3},
+    [ARRAY_FN_SLICE] = {"SLICE", 2, 3},
+    [ARRAY_FN_SUM] = {"SUM", 1, 1},
+    [ARRAY_FN_MIN] = {"MIN", 1, 1},
+    [ARRAY_FN_MAX] = {"MAX", 1, 1},
+    [ARRAY_FN_VADD] = {"VADD", 2, 2},
+    [ARRAY_FN_VMUL] = {"VMUL", 2, 2},
+    [ARRAY_FN_MAP] = {"MAP", 2, 2},
+};
 
-    *index_out = idx;
-    return true;
+// Returns the built-in whose "NAME(" starts text, or -1.
+static int match_array_builtin(const char *text) {
+    for (int i = 0; i < ARRAY_FN_COUNT; ++i) {
+        size_t len = strlen(array_builtins[i].name);
+        if (strncmp(text, array_builtins[i].name, len) == 0 && text[len] == '(') {
+            return i;
+        }
+    }
+    return -1;
 }
 
-static bool parse_variable_reference_token(const char *token, VariableRef *ref, int line, int debug) {
-    if (!token || !ref || token[0] != '$') {
-        return false;
-    }
-
-    memset(ref, 0, sizeof(*ref));
-    token++;
-    size_t name_len = 0;
-    while (*token && *token != '[') {
-        if (!isalnum((unsigned char)*token) && *token != '_') {
-            return false;
+/* A number or numeric array seen as one int64 or float64 run. Packed arrays
+   are borrowed; boxed ones are converted into a temporary buffer. A scalar
+   has stride 0 so it broadcasts against arrays. */
+typedef struct {
+    size_t len;
+    size_t stride;
+    const long long *ints;   // every element is an int
+    const double *floats;    // otherwise
+    void *owned;
+    long long scalar_int;
+    double scalar_float;
+} NumericView;
+
+static bool numeric_view(const Value *value, NumericView *view) {
+    memset(view, 0, sizeof(*view));
+    if (value->type == VALUE_INT || value->type == VALUE_FLOAT || value->type == VALUE_STRING) {
+        ValueType type = value->type;
+        if (type == VALUE_STRING) {
+            type = value->str_val ? detect_numeric_type(value->str_val, &view->scalar_int, &view->scalar_float) : VALUE_UNSET;
+        } else {
+            view->scalar_int = value->int_val;
+            view->scalar_float = value->float_val;
         }
-        if (name_len + 1 >= sizeof(ref->name)) {
+        if (type == VALUE_INT) {
+            view->ints = &view->scalar_int;
+        } else if (type == VALUE_FLOAT) {
+            view->floats = &view->scalar_float;
+        } else {
             return false;
         }
-        ref->name[name_len++] = *token++;
+        view->len = 1;
+        return true;
     }
-    ref->name[name_len] = '\0';
-    if (name_len == 0) {
+    if (value->type != VALUE_ARRAY) {
         return false;
     }
 
-    while (*token == '[') {
-        if (ref->index_count >= MAX_REF_INDICES) {
-            if (debug) {
-                fprintf(stderr, "Line %d: too many array dimensions (max %d)\n", line, MAX_REF_INDICES);
-            }
-            return false;
-        }
+    view->len = value->array_len;
+    view->stride = 1;
+    if (value->array_layout == ARRAY_INTS) {
+        view->ints = value->array_ints;
+        return true;
+    }
+    if (value->array_layout == ARRAY_FLOATS) {
+        view->floats = value->array_floats;
+        return true;
+    }
 
-        token++;
-        const char *end = strchr(token, ']');
-        if (!end) {
+    bool all_int = true;
+    for (size_t i = 0; i < value->array_len; ++i) {
+        ValueType type = value->array_val[i].type;
+        if (type != VALUE_INT && type != VALUE_FLOAT) {
             return false;
         }
-
-        size_t expr_len = (size_t)(end - token);
-        char *expr = (char *)malloc(expr_len + 1);
-        if (!expr) {
+        all_int = all_int && type == VALUE_INT;
+    }
+    size_t count = value->array_len ? value->array_len : 1;
+    if (all_int) {
+        long long *ints = (long long *)malloc(count * sizeof(long long));
+        if (!ints) {
             perror("malloc");
             exit(EXIT_FAILURE);
         }
-        memcpy(expr, token, expr_len);
-        expr[expr_len] = '\0';
-
-        size_t idx = 0;
-        bool ok = evaluate_index_expression(expr, &idx, line, debug);
-        free(expr);
-        if (!ok) {
-            return false;
+        for (size_t i = 0; i < value->array_len; ++i) {
+            ints[i] = value->array_val[i].int_val;
+        }
+        view->ints = ints;
+        view->owned = ints;
+    } else {
+        double *floats = (double *)malloc(count * sizeof(double));
+        if (!floats) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < value->array_len; ++i) {
+            floats[i] = value->array_val[i].type == VALUE_INT ? (double)value->array_val[i].int_val
+                                                              : value->array_val[i].float_val;
         }
+        view->floats = floats;
+        view->owned = floats;
+    }
+    return true;
+}
 
-        ref->indices[ref->index_count++] = idx;
-        token = end + 1;
+static double numeric_view_at(const NumericView *view, size_t i) {
+    return view->ints ? (double)view->ints[i * view->stride] : view->floats[i * view->stride];
+}
+
+static Value make_packed_array(ArrayLayout layout, size_t len) {
+    Value result;
+    memset(&result, 0, sizeof(result));
+    result.type = VALUE_ARRAY;
+    result.array_layout = layout;
+    result.array_len = len;
+    result.owns_array = true;
+    size_t count = len ? len : 1;
+    if (layout == ARRAY_INTS) {
+        result.array_ints = (long long *)malloc(count * sizeof(long long));
+    } else {
+        result.array_floats = (double *)malloc(count * sizeof(double));
+    }
+    if (layout == ARRAY_INTS ? !result.array_ints : !result.array_floats) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
     }
+    return result;
+}
 
-    if (*token != '\0') {
+static bool array_builtin_range(const NumericView *args, int argc, Value *out, int line, int debug) {
+    bool all_int = true;
+    for (int i = 0; i < argc; ++i) {
+        if (args[i].stride != 0) {
+            if (debug) fprintf(stderr, "Line %d: RANGE() expects numbers\n", line);
+            return false;
+        }
+        all_int = all_int && args[i].ints;
+    }
+    double start = numeric_view_at(&args[0], 0);
+    double stop = numeric_view_at(&args[1], 0);
+    double step = argc > 2 ? numeric_view_at(&args[2], 0) : 1.0;
+    if (step == 0.0 || !isfinite(start) || !isfinite(stop) || !isfinite(step)) {
+        if (debug) fprintf(stderr, "Line %d: RANGE() needs a finite, non-zero step\n", line);
+        return false;
+    }
+    double span = ceil((stop - start) / step);
+    size_t len = span > 0.0 ? (size_t)span : 0;
+    if (span > (double)MAX_RANGE_LENGTH) {
+        if (debug) fprintf(stderr, "Line %d: RANGE() longer than %d elements\n", line, MAX_RANGE_LENGTH);
         return false;
     }
 
+    if (all_int) {
+        long long first = args[0].ints[0];
+        long long delta = argc > 2 ? args[2].ints[0] : 1;
+        *out = make_packed_array(ARRAY_INTS, len);
+        for (size_t i = 0; i < len; ++i) {
+            out->array_ints[i] = first + (long long)i * delta;
+        }
+    } else {
+        *out = make_packed_array(ARRAY_FLOATS, len);
+        for (size_t i = 0; i < len; ++i) {
+            out->array_floats[i] = start + (double)i * step;
+        }
+    }
     return true;
 }
 
-static ValueType detect_numeric_type(const char *token, long long *out_int, double *out_float) {
-    if (!token || !*token) {
-        return VALUE_UNSET;
+static bool array_builtin_slice(const Value *args, int argc, Value *out, int line, int debug) {
+    const Value *array = &args[0];
+    if (array->type != VALUE_ARRAY) {
+        if (debug) fprintf(stderr, "Line %d: SLICE() expects an array\n", line);
+        return false;
     }
-    errno = 0;
-    char *endptr = NULL;
-    long long iv = strtoll(token, &endptr, 10);
-    if (errno == 0 && endptr && *endptr == '\0') {
-        if (out_int) {
-            *out_int = iv;
+    long long bounds[2] = {0, (long long)array->array_len};
+    for (int i = 1; i < argc; ++i) {
+        NumericView view;
+        if (!numeric_view(&args[i], &view) || view.stride != 0 || !view.ints) {
+            if (debug) fprintf(stderr, "Line %d: SLICE() bounds must be integers\n", line);
+            return false;
         }
-        if (out_float) {
-            *out_float = (double)iv;
+        bounds[i - 1] = view.ints[0];
+    }
+    for (int i = 0; i < 2; ++i) {
+        if (bounds[i] < 0) {
+            bounds[i] = 0;
+        } else if (bounds[i] > (long long)array->array_len) {
+            bounds[i] = (long long)array->array_len;
         }
-        return VALUE_INT;
     }
-    errno = 0;
-    endptr = NULL;
-    double dv = strtod(token, &endptr);
-    if (errno == 0 && endptr && *endptr == '\0') {
-        if (out_float) {
-            *out_float = dv;
+    size_t start = (size_t)bounds[0];
+    size_t len = bounds[1] > bounds[0] ? (size_t)(bounds[1] - bounds[0]) : 0;
+
+    if (array->array_layout == ARRAY_INTS) {
+        *out = make_packed_array(ARRAY_INTS, len);
+        memcpy(out->array_ints, array->array_ints + start, len * sizeof(long long));
+        return true;
+    }
+    if (array->array_layout == ARRAY_FLOATS) {
+        *out = make_packed_array(ARRAY_FLOATS, len);
+        memcpy(out->array_floats, array->array_floats + start, len * sizeof(double));
+        return true;
+    }
+    Value result;
+    memset(&result, 0, sizeof(result));
+    result.type = VALUE_ARRAY;
+    result.owns_array = true;
+    if (len > 0) {
+        result.array_val = (Value *)calloc(len, sizeof(Value));
+        if (!result.array_val) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
         }
-        if (out_int) {
-            *out_int = (long long)dv;
+        result.array_len = len;
+        for (size_t i = 0; i < len; ++i) {
+            copy_value(&result.array_val[i], &array->array_val[start + i]);
         }
-        return VALUE_FLOAT;
     }
-    return VALUE_UNSET;
+    pack_array(&result);
+    *out = result;
+    return true;
 }
 
-static bool parse_value_from_string(const char *text, Value *out, int line, int debug) {
-    if (!text || !out) {
+static bool array_builtin_reduce(ArrayBuiltin fn, const NumericView *view, Value *out, int line, int debug) {
+    if (view->len == 0 && fn != ARRAY_FN_SUM) {
+        if (debug) fprintf(stderr, "Line %d: %s() of an empty array\n", line, array_builtins[fn].name);
         return false;
     }
+    memset(out, 0, sizeof(*out));
+    if (view->ints) {
+        long long acc = view->len ? view->ints[0] : 0;
+        bool overflow = false;
+        for (size_t i = 1; i < view->len && !overflow; ++i) {
+            long long x = view->ints[i * view->stride];
+            if (fn == ARRAY_FN_SUM) {
+                overflow = __builtin_add_overflow(acc, x, &acc);
+            } else if (fn == ARRAY_FN_MIN ? x < acc : x > acc) {
+                acc = x;
+            }
+        }
+        if (!overflow) {
+            out->type = VALUE_INT;
+            out->int_val = acc;
+            out->float_val = (double)acc;
+            return true;
+        }
+    }
+    // Float arrays, and integer sums that no longer fit in a long long.
+    double acc = view->len ? numeric_view_at(view, 0) : 0.0;
+    for (size_t i = 1; i < view->len; ++i) {
+        double x = numeric_view_at(view, i);
+        if (fn == ARRAY_FN_SUM) {
+            acc += x;
+        } else if (fn == ARRAY_FN_MIN ? x < acc : x > acc) {
+            acc = x;
+        }
+    }
+    out->type = VALUE_FLOAT;
+    out->float_val = acc;
+    out->int_val = float_to_int(acc);
+    return true;
+}
 
-    const char *cursor = text;
-    if (!parse_expression(&cursor, out, "", line, debug)) {
+static bool array_builtin_elementwise(ArrayBuiltin fn, const NumericView *a, const NumericView *b, Value *out,
+                                      int line, int debug) {
+    if (a->stride == 0 && b->stride == 0) {
+        if (debug) fprintf(stderr, "Line %d: %s() expects at least one array\n", line, array_builtins[fn].name);
         return false;
     }
-
-    while (isspace((unsigned char)*cursor)) {
-        cursor++;
+    if (a->stride != 0 && b->stride != 0 && a->len != b->len) {
+        if (debug) fprintf(stderr, "Line %d: %s() array lengths differ (%zu and %zu)\n", line, array_builtins[fn].name, a->len, b->len);
+        return false;
     }
-
-    if (*cursor != '\0') {
+    size_t len = a->stride != 0 ? a->len : b->len;
+    bool add = fn == ARRAY_FN_VADD;
+    if (a->ints && b->ints) {
+        *out = make_packed_array(ARRAY_INTS, len);
+        bool overflow = false;
+        for (size_t i = 0; i < len && !overflow; ++i) {
+            long long x = a->ints[i * a->stride];
+            long long y = b->ints[i * b->stride];
+            overflow = add ? __builtin_add_overflow(x, y, &out->array_ints[i])
+                           : __builtin_mul_overflow(x, y, &out->array_ints[i]);
+        }
+        if (!overflow) {
+            return true;
+        }
+        // An element left the long long range; redo the whole result as floats.
         free_value(out);
-        return false;
     }
-
+    *out = make_packed_array(ARRAY_FLOATS, len);
+    for (size_t i = 0; i < len; ++i) {
+        double x = numeric_view_at(a, i);
+        double y = numeric_view_at(b, i);
+        out->array_floats[i] = add ? x + y : x * y;
+    }
     return true;
 }
 
-static bool parse_array_literal(const char **cursor, Value *out, int line, int debug) {
-    if (!cursor || !out || !*cursor || **cursor != '{') {
+static bool array_builtin_map(const NumericView *view, const Value *fn_value, Value *out, int line, int debug) {
+    static const struct {
+        const char *name;
+        double (*fn)(double);
+        bool int_result;   // packs into ints (rounding functions)
+    } maps[] = {
+        {"sin", sin, false}, {"cos", cos, false}, {"tan", tan, false},
+        {"sqrt", sqrt, false}, {"exp", exp, false}, {"log", log, false},
+        {"abs", fabs, false}, {"floor", floor, true}, {"ceil", ceil, true},
+        {"round", round, true},
+    };
+    const char *name = fn_value->type == VALUE_STRING && fn_value->str_val ? fn_value->str_val : "";
+    size_t map = 0;
+    while (map < sizeof(maps) / sizeof(maps[0]) && !equals_ignore_case(maps[map].name, name)) {
+        map++;
+    }
+    if (map == sizeof(maps) / sizeof(maps[0])) {
+        if (debug) fprintf(stderr, "Line %d: MAP() has no function '%s'\n", line, name);
         return false;
     }
-
-    const char *s = *cursor;
-    s++; // skip '{'
-
-    size_t cap = 4;
-    size_t len = 0;
-    Value *elements = NULL;
-    if (cap > 0) {
-        elements = (Value *)calloc(cap, sizeof(Value));
-        if (!elements) {
-            perror("calloc");
-            exit(EXIT_FAILURE);
-        }
+    if (view->stride == 0) {
+        if (debug) fprintf(stderr, "Line %d: MAP() expects an array\n", line);
+        return false;
     }
 
-    while (1) {
-        while (isspace((unsigned char)*s)) {
-            s++;
+    bool int_layout = view->ints && (maps[map].int_result || maps[map].fn == fabs);
+    bool fits = true;
+    if (int_layout) {
+        *out = make_packed_array(ARRAY_INTS, view->len);
+        for (size_t i = 0; i < view->len && fits; ++i) {
+            long long x = view->ints[i];
+            if (maps[map].fn == fabs && x < 0) {
+                fits = x != LLONG_MIN;
+                x = fits ? -x : x;
+            }
+            out->array_ints[i] = x;
         }
-        if (*s == '}') {
-            s++;
-            break;
+    } else if (maps[map].int_result) {
+        int_layout = true;
+        *out = make_packed_array(ARRAY_INTS, view->len);
+        for (size_t i = 0; i < view->len && fits; ++i) {
+            double x = maps[map].fn(view->floats[i]);
+            // -(double)LLONG_MIN is 2^63, the first value past LLONG_MAX; NaN fails both tests.
+            fits = x >= (double)LLONG_MIN && x < -(double)LLONG_MIN;
+            out->array_ints[i] = fits ? (long long)x : 0;
         }
-
-        Value element;
-        if (!parse_expression(&s, &element, ",}", line, debug)) {
-            if (debug) {
-                fprintf(stderr, "Line %d: invalid array element\n", line);
-            }
-            if (elements) {
-                for (size_t i = 0; i < len; ++i) {
-                    free_value(&elements[i]);
-                }
-                free(elements);
-            }
-            return false;
+    }
+    if (int_layout) {
+        if (fits) {
+            return true;
         }
+        // A result left the long long range; redo the whole array as floats.
+        free_value(out);
+    }
+    *out = make_packed_array(ARRAY_FLOATS, view->len);
+    for (size_t i = 0; i < view->len; ++i) {
+        out->array_floats[i] = maps[map].fn(numeric_view_at(view, i));
+    }
+    return true;
+}
 
-        if (len >= cap) {
-            cap = (cap == 0) ? 4 : cap * 2;
-            Value *tmp = (Value *)realloc(elements, cap * sizeof(Value));
-            if (!tmp) {
-                perror("realloc");
-                for (size_t i = 0; i < len; ++i) {
-                    free_value(&elements[i]);
-                }
-                free(elements);
-                exit(EXIT_FAILURE);
-            }
-            elements = tmp;
-        }
-        copy_value(&elements[len], &element);
-        free_value(&element);
-        len++;
+static bool apply_array_builtin(int fn, const Value *args, int argc, Value *out, int line, int debug) {
+    if (fn == ARRAY_FN_SLICE) {
+        return array_builtin_slice(args, argc, out, line, debug);
+    }
 
-        while (isspace((unsigned char)*s)) {
-            s++;
-        }
-        if (*s == ',') {
-            s++;
-            continue;
-        }
-        if (*s == '}') {
-            s++;
+    NumericView views[3];
+    int numeric_argc = fn == ARRAY_FN_MAP ? 1 : argc;
+    bool ok = true;
+    int viewed = 0;
+    for (; viewed < numeric_argc; ++viewed) {
+        if (!numeric_view(&args[viewed], &views[viewed])) {
+            if (debug) fprintf(stderr, "Line %d: %s() expects numbers or numeric arrays\n", line, array_builtins[fn].name);
+            ok = false;
             break;
         }
-        if (debug) {
-            fprintf(stderr, "Line %d: expected ',' or '}' in array literal\n", line);
-        }
-        for (size_t i = 0; i < len; ++i) {
-            free_value(&elements[i]);
+    }
+    if (ok) {
+        switch ((ArrayBuiltin)fn) {
+            case ARRAY_FN_RANGE:
+                ok = array_builtin_range(views, argc, out, line, debug);
+                break;
+            case ARRAY_FN_SUM:
+            case ARRAY_FN_MIN:
+            case ARRAY_FN_MAX:
+                ok = array_builtin_reduce((ArrayBuiltin)fn, &views[0], out, line, debug);
+                break;
+            case ARRAY_FN_VADD:
+            case ARRAY_FN_VMUL:
+                ok = array_builtin_elementwise((ArrayBuiltin)fn, &views[0], &views[1], out, line, debug);
+                break;
+            case ARRAY_FN_MAP:
+                ok = array_builtin_map(&views[0], &args[1], out, line, debug);
+                break;
+            default:
+                ok = false;
+                break;
         }
-        free(elements);
-        return false;
     }
-
-    Value result;
-    memset(&result, 0, sizeof(result));
-    result.type = VALUE_ARRAY;
-    result.array_val = elements;
-    result.array_len = len;
-    result.owns_array = true;
-    *out = result;
-    *cursor = s;
-    return true;
+    for (int i = 0; i < viewed; ++i) {
+        free(views[i].owned);
+    }
+    return ok;
 }
 
-static bool parse_value_token(const char **p, Value *out, const char *delims, int line, int debug) {
-    if (!p || !out) {
+static bool value_as_double(const Value *value, double *out) {
+    if (!value || !out) {
         return false;
     }
-
-    while (isspace((unsigned char)**p)) {
-        (*p)++;
+    if (value->type == VALUE_INT) {
+        *out = (double)value->int_val;
+        return true;
     }
-
-    if (**p == '{') {
-        return parse_array_literal(p, out, line, debug);
+    if (value->type == VALUE_FLOAT) {
+        *out = value->float_val;
+        return true;
     }
-
-    const char *s = *p;
-    if (strncmp(s, "LEN(", 4) == 0) {
-        s += 4;
-        Value target;
-        if (!parse_expression(&s, &target, ")", line, debug)) {
-            if (debug) {
-                fprintf(stderr, "Line %d: invalid LEN() argument\n", line);
-            }
-            return false;
-        }
-        while (isspace((unsigned char)*s)) {
-            s++;
-        }
-        if (*s != ')') {
-            free_value(&target);
-            if (debug) {
-                fprintf(stderr, "Line %d: expected ')' to close LEN()\n", line);
-            }
-            return false;
-        }
-        Value result;
-        memset(&result, 0, sizeof(result));
-        result.type = VALUE_INT;
-        if (target.type == VALUE_ARRAY) {
-            result.int_val = (long long)target.array_len;
-            result.float_val = (double)target.array_len;
-        } else if (target.type == VALUE_STRING && target.str_val) {
-            result.int_val = (long long)strlen(target.str_val);
-            result.float_val = (double)result.int_val;
-        } else {
-            char *tmp = value_to_string(&target);
-            result.int_val = (long long)strlen(tmp);
-            result.float_val = (double)result.int_val;
-            free(tmp);
-        }
-        free_value(&target);
-        *out = result;
-        *p = s + 1;
-        return true;
-    }
-
-    char *token = NULL;
-    bool quoted = false;
-    if (!parse_token(p, &token, &quoted, delims)) {
-        if (debug) {
-            fprintf(stderr, "Line %d: failed to parse value\n", line);
-        }
-        return false;
-    }
-    Value result;
-    memset(&result, 0, sizeof(result));
-    if (quoted) {
-        result.type = VALUE_STRING;
-        result.str_val = token;
-        result.owns_string = true;
-    } else if (token[0] == '$') {
-        VariableRef ref;
-        if (!parse_variable_reference_token(token, &ref, line, debug)) {
-            if (debug) {
-                fprintf(stderr, "Line %d: invalid variable name '%s'\n", line, token);
-            }
-            free(token);
-            return false;
-        }
-        free(token);
-
-        if (!resolve_variable_reference(&ref, &result, line, debug)) {
-            result.type = VALUE_UNSET;
-            result.int_val = 0;
-            result.float_val = 0.0;
-            result.str_val = NULL;
-            result.owns_string = false;
-        }
-    } else {
-        long long iv = 0;
-        double fv = 0.0;
-        ValueType vt = detect_numeric_type(token, &iv, &fv);
-        if (vt == VALUE_INT) {
-            result.type = VALUE_INT;
-            result.int_val = iv;
-            result.float_val = (double)iv;
-            result.str_val = NULL;
-            result.owns_string = false;
-            free(token);
-        } else if (vt == VALUE_FLOAT) {
-            result.type = VALUE_FLOAT;
-            result.float_val = fv;
-            result.int_val = (long long)fv;
-            result.str_val = NULL;
-            result.owns_string = false;
-            free(token);
-        } else {
-            result.type = VALUE_STRING;
-            result.str_val = token;
-            result.owns_string = true;
-        }
-    }
-    *out = result;
-    return true;
-}
-
-static bool value_as_double(const Value *value, double *out) {
-    if (!value || !out) {
-        return false;
-    }
-    if (value->type == VALUE_INT) {
-        *out = (double)value->int_val;
-        return true;
-    }
-    if (value->type == VALUE_FLOAT) {
-        *out = value->float_val;
-        return true;
-    }
-    if (value->type == VALUE_STRING && value->str_val) {
-        errno = 0;
-        char *endptr = NULL;
-        double dv = strtod(value->str_val, &endptr);
-        if (errno == 0 && endptr && *endptr == '\0') {
-            *out = dv;
-            return true;
+    if (value->type == VALUE_STRING && value->str_val) {
+        errno = 0;
+        char *endptr = NULL;
+        double dv = strtod(value->str_val, &endptr);
+        if (errno == 0 && endptr && *endptr == '\0') {
+            *out = dv;
+            return true;
         }
     }
     return false;
@@ -1856,7 +2281,8 @@ static char *value_to_string(const Value *value) {
         size_t len = 0;
         buf[len++] = '{';
         for (size_t i = 0; i < value->array_len; ++i) {
-            char *elem = value_to_string(&value->array_val[i]);
+            Value element = array_element(value, i);
+            char *elem = value_to_string(&element);
             size_t elem_len = strlen(elem);
             size_t needed = len + (i > 0 ? 2 : 0) + elem_len + 2;
             if (needed > cap) {
@@ -1931,7 +2357,7 @@ static bool value_add_inplace(Value *acc, const Value *term) {
         } else {
             result.type = VALUE_FLOAT;
             result.float_val = acc_num + term_num;
-            result.int_val = (long long)result.float_val;
+            result.int_val = float_to_int(result.float_val);
         }
         free_value(acc);
         *acc = result;
@@ -1977,7 +2403,7 @@ static bool value_negate(Value *value) {
 
     if (value->type == VALUE_FLOAT) {
         value->float_val = -value->float_val;
-        value->int_val = (long long)value->float_val;
+        value->int_val = float_to_int(value->float_val);
         return true;
     }
 
@@ -2004,7 +2430,7 @@ static bool value_negate(Value *value) {
             value->str_val = NULL;
             value->type = VALUE_FLOAT;
             value->float_val = -fv;
-            value->int_val = (long long)value->float_val;
+            value->int_val = float_to_int(value->float_val);
             return true;
         }
         return false;
@@ -2022,90 +2448,6 @@ static bool value_negate(Value *value) {
     return false;
 }
 
-static bool parse_expression(const char **cursor, Value *out, const char *terminators, int line, int debug) {
-    if (!cursor || !out) {
-        return false;
-    }
-
-    Value accumulator;
-    memset(&accumulator, 0, sizeof(accumulator));
-    bool have_term = false;
-    char pending_op = '+';
-
-    const char *delims = "+-";
-    char delim_buf[64];
-    if (terminators && *terminators) {
-        size_t term_len = strlen(terminators);
-        if (term_len > sizeof(delim_buf) - 3) {
-            term_len = sizeof(delim_buf) - 3;
-        }
-        delim_buf[0] = '+';
-        delim_buf[1] = '-';
-        memcpy(&delim_buf[2], terminators, term_len);
-        delim_buf[term_len + 2] = '\0';
-        delims = delim_buf;
-    }
-
-    while (1) {
-        while (isspace((unsigned char)**cursor)) {
-            (*cursor)++;
-        }
-
-        char current_op = have_term ? pending_op : '+';
-        if (!have_term && (**cursor == '+' || **cursor == '-')) {
-            current_op = **cursor;
-            (*cursor)++;
-            while (isspace((unsigned char)**cursor)) {
-                (*cursor)++;
-            }
-        }
-
-        Value term;
-        if (!parse_value_token(cursor, &term, delims, line, debug)) {
-            free_value(&accumulator);
-            return false;
-        }
-
-        if (current_op == '-') {
-            if (!value_negate(&term)) {
-                if (debug) {
-                    fprintf(stderr, "Line %d: unable to apply '-' to value\n", line);
-                }
-                free_value(&term);
-                free_value(&accumulator);
-                return false;
-            }
-        }
-
-        if (!value_add_inplace(&accumulator, &term)) {
-            free_value(&term);
-            free_value(&accumulator);
-            return false;
-        }
-        free_value(&term);
-        have_term = true;
-        pending_op = '+';
-
-        while (isspace((unsigned char)**cursor)) {
-            (*cursor)++;
-        }
-        if (**cursor == '+' || **cursor == '-') {
-            pending_op = **cursor;
-            (*cursor)++;
-            continue;
-        }
-        break;
-    }
-
-    if (!have_term) {
-        free_value(&accumulator);
-        return false;
-    }
-
-    *out = accumulator;
-    return true;
-}
-
 static bool evaluate_comparison(const Value *lhs, const Value *rhs, const char *op, bool *out_result, int line, int debug) {
     if (!lhs || !rhs || !op || !out_result) {
         return false;
@@ -2249,3740 +2591,4824 @@ static bool parse_boolean_literal(const char *expr, bool *out, const char **end_
     return true;
 }
 
-static bool evaluate_truthy_expression(const char *expr, int line, int debug, bool *out) {
-    if (!expr || !out) {
-        return false;
+static void copy_trimmed_segment(const char *start, const char *end, char *dest, size_t size) {
+    if (!start || !end || !dest || size == 0 || end < start) {
+        return;
     }
 
-    const char *cursor = expr;
-    Value value;
-    if (!parse_expression(&cursor, &value, NULL, line, debug)) {
-        return false;
+    while (start < end && isspace((unsigned char)*start)) {
+        start++;
     }
-
-    while (isspace((unsigned char)*cursor)) {
-        cursor++;
+    while (end > start && isspace((unsigned char)*(end - 1))) {
+        end--;
     }
 
-    if (*cursor != '\0') {
-        free_value(&value);
-        return false;
+    size_t len = (size_t)(end - start);
+    if (len >= size) {
+        len = size - 1;
     }
+    memcpy(dest, start, len);
+    dest[len] = '\0';
+}
 
-    bool truthy = false;
-    switch (value.type) {
-        case VALUE_INT:
-            truthy = (value.int_val != 0);
-            break;
-        case VALUE_FLOAT:
-            truthy = (value.float_val != 0.0);
-            break;
-        case VALUE_STRING:
-            truthy = value.str_val && value.str_val[0] != '\0';
-            break;
-        case VALUE_ARRAY:
-            truthy = value.array_len > 0;
-            break;
-        case VALUE_UNSET:
-        default:
-            truthy = false;
-            break;
-    }
+/* --- Compiled task programs ---
+   A task is compiled once after loading. Expressions and conditions become
+   postfix code that runs on a small value stack, with literals parsed and
+   variable names interned into slots up front. Statements become a flat
+   instruction array whose IF/ELSE, WHILE, FOR, GOTO and EVAL targets are
+   resolved to instruction indexes. The compile_* functions are the only
+   expression grammar: text that only exists at run time (captured RUN output,
+   index expressions in RUN arguments and TO targets) is compiled into
+   runtime_program and evaluated by the same program_eval().
+*/
 
-    free_value(&value);
-    *out = truthy;
-    return true;
-}
+typedef enum {
+    EXPR_END = 0,
+    EXPR_FAIL,      // text that did not compile; evaluation always fails
+    EXPR_CONST,     // push constants[arg]
+    EXPR_VAR,       // pop `count` indices, push slots[arg] (or one of its elements)
+    EXPR_LEN,
+    EXPR_BUILTIN,   // pop `count` arguments, push apply_array_builtin(arg, ...)
+    EXPR_ARRAY,     // pop `count` elements, push them as an array
+    EXPR_NEG,
+    EXPR_ADD,
+    EXPR_COMPARE,   // pop rhs and lhs, push comparison_ops[arg] as 0/1
+    EXPR_AND,
+    EXPR_OR,
+    EXPR_TRUTHY
+} ExprOpcode;
 
-static bool parse_comparison_condition(const char **cursor, bool *out, int line, int debug) {
-    if (!cursor || !out) {
-        return false;
-    }
+typedef struct {
+    ExprOpcode op;
+    int arg;
+    int count;
+} ExprOp;
 
-    Value lhs;
-    if (!parse_expression(cursor, &lhs, "<>!=", line, debug)) {
-        return false;
-    }
+static const char *const comparison_ops[] = { "==", "!=", ">=", "<=", ">", "<" };
 
-    while (isspace((unsigned char)**cursor)) {
-        (*cursor)++;
-    }
+typedef enum {
+    OP_NOP = 0,
+    OP_JUMP,            // target
+    OP_JUMP_IF_FALSE,   // d = condition, target
+    OP_JUMP_IF_TRUE,    // d = condition, target
+    OP_ASSIGN,          // a = slot, b/c = index list, d = value, target on failure
+    OP_ASSIGN_STATIC,   // as OP_ASSIGN, into the function's static scope
+    OP_EXPR,            // d = expression evaluated for its diagnostics, target on failure
+    OP_STEP,            // a = slot, b = +1/-1, target on failure
+    OP_INPUT,           // a = slot, b = wait for Enter
+    OP_PRINT,           // b/c = term list
+    OP_CALL,            // a = function, b/c = argument list, d = return slot or -1
+    OP_RETURN,          // d = value or -1
+    OP_FUNCTION_END,    // a = function
+    OP_ECHO,            // a = enable
+    OP_WAIT,            // a = milliseconds
+    OP_GOTO_VAR,        // a = slot holding the label name
+    OP_SYS,             // text = command line
+    OP_RUN,             // text = command line
+    OP_CLEAR
+} OpCode;
 
-    char op[3] = { 0 };
-    if ((*cursor)[0] == '=' && (*cursor)[1] == '=') {
-        op[0] = '=';
-        op[1] = '=';
-        (*cursor) += 2;
-    } else if ((*cursor)[0] == '!' && (*cursor)[1] == '=') {
-        op[0] = '!';
-        op[1] = '=';
-        (*cursor) += 2;
-    } else if ((*cursor)[0] == '>' && (*cursor)[1] == '=') {
-        op[0] = '>';
-        op[1] = '=';
-        (*cursor) += 2;
-    } else if ((*cursor)[0] == '<' && (*cursor)[1] == '=') {
-        op[0] = '<';
-        op[1] = '=';
-        (*cursor) += 2;
-    } else if ((*cursor)[0] == '>') {
-        op[0] = '>';
-        (*cursor) += 1;
-    } else if ((*cursor)[0] == '<') {
-        op[0] = '<';
-        (*cursor) += 1;
-    } else {
-        if (debug) {
-            fprintf(stderr, "IF: invalid or missing operator at %d\n", line);
-        }
-        free_value(&lhs);
-        return false;
-    }
+typedef struct {
+    OpCode op;
+    int line;           // script index, for diagnostics
+    bool trace;         // first instruction of its line (-d tracing)
+    int a;
+    int b;
+    int c;
+    int d;
+    int target;
+    const char *text;
+} Instruction;
 
-    Value rhs;
-    if (!parse_expression(cursor, &rhs, NULL, line, debug)) {
-        free_value(&lhs);
-        return false;
-    }
+typedef struct {
+    int name_id;        // -1 for an empty name, which never resolves
+    Variable *read_var;
+    unsigned long read_generation;
+    Variable *write_var;
+    unsigned long write_generation;
+} VariableSlot;
 
-    bool cond_result = false;
-    if (!evaluate_comparison(&lhs, &rhs, op, &cond_result, line, debug)) {
-        cond_result = false;
+typedef struct {
+    Instruction *code;
+    int code_count;
+    size_t code_cap;
+    ExprOp *expr;
+    int expr_count;
+    size_t expr_cap;
+    Value *constants;
+    int constant_count;
+    size_t constant_cap;
+    VariableSlot *slots;
+    int slot_count;
+    size_t slot_cap;
+    int *slot_by_name;   // per interned name id: slot index + 1 (0 = none yet)
+    size_t slot_by_name_cap;
+    int *lists;          // expression offsets for index, argument and PRINT lists
+    int list_count;
+    size_t list_cap;
+    int *line_start;     // per script line: first instruction, before loop tails
+    int *line_body;      // per script line: the line's own first instruction
+    int *line_end;       // per script line: instruction after the line
+    bool lookup_only;    // resolve names without interning new ones
+} TaskProgram;
+
+static Value *program_stack = NULL;
+static size_t program_stack_cap = 0;
+
+static void *grow_buffer(void *data, size_t *cap, size_t needed, size_t elem_size) {
+    if (needed <= *cap) {
+        return data;
+    }
+    size_t new_cap = (*cap == 0) ? 16 : *cap;
+    while (new_cap < needed) {
+        new_cap *= 2;
+    }
+    void *tmp = realloc(data, new_cap * elem_size);
+    if (!tmp) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
     }
+    *cap = new_cap;
+    return tmp;
+}
 
-    free_value(&lhs);
-    free_value(&rhs);
-    *out = cond_result;
-    return true;
+static void program_emit_expr(TaskProgram *prog, ExprOpcode op, int arg, int count) {
+    prog->expr = (ExprOp *)grow_buffer(prog->expr, &prog->expr_cap, (size_t)prog->expr_count + 1, sizeof(ExprOp));
+    prog->expr[prog->expr_count].op = op;
+    prog->expr[prog->expr_count].arg = arg;
+    prog->expr[prog->expr_count].count = count;
+    prog->expr_count++;
 }
 
-static bool parse_conjunction_condition(const char **cursor, bool *out, int line, int debug) {
-    if (!cursor || !out) {
-        return false;
-    }
+// Takes ownership of *value.
+static void program_emit_constant(TaskProgram *prog, Value *value) {
+    prog->constants = (Value *)grow_buffer(prog->constants, &prog->constant_cap, (size_t)prog->constant_count + 1, sizeof(Value));
+    prog->constants[prog->constant_count] = *value;
+    memset(value, 0, sizeof(*value));
+    program_emit_expr(prog, EXPR_CONST, prog->constant_count++, 0);
+}
 
-    bool result = false;
-    if (!parse_comparison_condition(cursor, &result, line, debug)) {
-        return false;
-    }
+static int program_intern_slot(TaskProgram *prog, const char *name) {
+    int name_id = lookup_variable_name(name, !prog->lookup_only);
+    if (name_id >= 0 && (size_t)name_id < prog->slot_by_name_cap && prog->slot_by_name[name_id] > 0) {
+        return prog->slot_by_name[name_id] - 1;
+    }
+    prog->slots = (VariableSlot *)grow_buffer(prog->slots, &prog->slot_cap, (size_t)prog->slot_count + 1, sizeof(VariableSlot));
+    VariableSlot *slot = &prog->slots[prog->slot_count];
+    memset(slot, 0, sizeof(*slot));
+    slot->name_id = name_id;
+    if (name_id >= 0) {
+        size_t old_cap = prog->slot_by_name_cap;
+        prog->slot_by_name = (int *)grow_buffer(prog->slot_by_name, &prog->slot_by_name_cap, (size_t)name_id + 1, sizeof(int));
+        memset(prog->slot_by_name + old_cap, 0, (prog->slot_by_name_cap - old_cap) * sizeof(int));
+        prog->slot_by_name[name_id] = prog->slot_count + 1;
+    }
+    return prog->slot_count++;
+}
 
-    while (1) {
-        const char *p = *cursor;
-        while (isspace((unsigned char)*p)) {
-            p++;
-        }
+static int program_add_list(TaskProgram *prog, const int *items, int count) {
+    prog->lists = (int *)grow_buffer(prog->lists, &prog->list_cap, (size_t)(prog->list_count + count) + 1, sizeof(int));
+    int offset = prog->list_count;
+    for (int i = 0; i < count; ++i) {
+        prog->lists[prog->list_count++] = items[i];
+    }
+    return offset;
+}
 
-        const char *after_keyword = NULL;
-        if (!match_keyword(p, "AND", &after_keyword)) {
-            *cursor = p;
-            break;
-        }
+static int program_fail_expression(TaskProgram *prog) {
+    int start = prog->expr_count;
+    program_emit_expr(prog, EXPR_FAIL, 0, 0);
+    program_emit_expr(prog, EXPR_END, 0, 0);
+    return start;
+}
 
-        *cursor = after_keyword;
-        bool rhs = false;
-        if (!parse_comparison_condition(cursor, &rhs, line, debug)) {
-            return false;
+/* Scope lookups are cached per slot and revalidated against
+   variable_generation, which changes whenever a scope is pushed or popped or
+   a variable is created. Reads and writes resolve differently inside
+   functions, so each has its own cache entry. */
+static Variable *program_slot_variable(TaskProgram *prog, int slot_index, bool create) {
+    VariableSlot *slot = &prog->slots[slot_index];
+    if (create) {
+        if (slot->write_generation != variable_generation) {
+            slot->write_var = find_variable_id(slot->name_id, true);
+            slot->write_generation = variable_generation;
         }
-        result = result && rhs;
+        return slot->write_var;
     }
-
-    *out = result;
-    return true;
+    if (slot->read_generation != variable_generation) {
+        slot->read_var = find_variable_id(slot->name_id, false);
+        slot->read_generation = variable_generation;
+    }
+    return slot->read_var;
 }
 
-static bool parse_condition(const char **cursor, bool *out, int line, int debug) {
-    if (!cursor || !out) {
+static bool compile_expression(TaskProgram *prog, const char **cursor, const char *terminators, int line, int debug);
+
+static bool compile_index_expression(TaskProgram *prog, const char *expr, int line, int debug) {
+    const char *cursor = expr;
+    if (!compile_expression(prog, &cursor, NULL, line, debug)) {
         return false;
     }
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor != '\0') {
+        if (debug) {
+            fprintf(stderr, "Line %d: invalid array index expression\n", line);
+        }
+        return false;
+    }
+    return true;
+}
 
-    bool result = false;
-    if (!parse_conjunction_condition(cursor, &result, line, debug)) {
+/* Compiles a $NAME[index]... token. With index_list set, each index becomes
+   its own expression whose offset is stored there (assignment targets);
+   otherwise the indices are emitted inline ahead of an EXPR_VAR. */
+static bool compile_variable_reference(TaskProgram *prog, const char *token, int *slot_out, int *index_list, int *index_count,
+                                       int line, int debug) {
+    if (!token || token[0] != '$') {
         return false;
     }
 
-    while (1) {
-        const char *p = *cursor;
-        while (isspace((unsigned char)*p)) {
-            p++;
-        }
-
-        const char *after_keyword = NULL;
-        if (!match_keyword(p, "OR", &after_keyword)) {
-            *cursor = p;
-            break;
+    char name[sizeof(((VariableRef *)0)->name)];
+    token++;
+    size_t name_len = 0;
+    while (*token && *token != '[') {
+        if (!isalnum((unsigned char)*token) && *token != '_') {
+            return false;
         }
-
-        *cursor = after_keyword;
-        bool rhs = false;
-        if (!parse_conjunction_condition(cursor, &rhs, line, debug)) {
+        if (name_len + 1 >= sizeof(name)) {
             return false;
         }
-        result = result || rhs;
+        name[name_len++] = *token++;
     }
-
-    while (isspace((unsigned char)**cursor)) {
-        (*cursor)++;
+    name[name_len] = '\0';
+    if (name_len == 0) {
+        return false;
     }
 
-    *out = result;
-    return true;
-}
+    int count = 0;
+    while (*token == '[') {
+        if (count >= MAX_REF_INDICES) {
+            if (debug) {
+                fprintf(stderr, "Line %d: too many array dimensions (max %d)\n", line, MAX_REF_INDICES);
+            }
+            return false;
+        }
 
-static void note_branch_progress(IfContext *stack, int *sp) {
-    if (!stack || !sp || *sp <= 0) {
-        return;
-    }
-    IfContext *ctx = &stack[*sp - 1];
-    if (ctx->expects_end) {
-        return;
-    }
-    if (!ctx->true_branch_done) {
-        ctx->true_branch_done = true;
-        return;
-    }
-    if (ctx->else_encountered && !ctx->else_branch_done) {
-        ctx->else_branch_done = true;
-        (*sp)--;
-    }
-}
+        token++;
+        const char *end = strchr(token, ']');
+        if (!end) {
+            return false;
+        }
 
-static void finalize_skipped_branch(IfContext *stack, int *sp, int context_index, bool skipping_true_branch) {
-    if (!stack || !sp || *sp <= 0) {
-        return;
-    }
-    if (context_index < 0 || context_index != *sp - 1) {
-        return;
-    }
-    IfContext *ctx = &stack[*sp - 1];
-    if (skipping_true_branch) {
-        ctx->true_branch_done = true;
-    } else {
-        ctx->else_branch_done = true;
-        if (!ctx->expects_end) {
-            (*sp)--;
+        size_t expr_len = (size_t)(end - token);
+        char *expr = (char *)malloc(expr_len + 1);
+        if (!expr) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(expr, token, expr_len);
+        expr[expr_len] = '\0';
+
+        int start = prog->expr_count;
+        bool ok = compile_index_expression(prog, expr, line, debug);
+        free(expr);
+        if (!ok) {
+            return false;
         }
+        if (index_list) {
+            program_emit_expr(prog, EXPR_END, 0, 0);
+            index_list[count] = start;
+        }
+        count++;
+        token = end + 1;
     }
-}
 
-static void copy_trimmed_segment(const char *start, const char *end, char *dest, size_t size) {
-    if (!start || !end || !dest || size == 0 || end < start) {
-        return;
+    if (*token != '\0') {
+        return false;
     }
 
-    while (start < end && isspace((unsigned char)*start)) {
-        start++;
+    int slot = program_intern_slot(prog, name);
+    if (slot_out) {
+        *slot_out = slot;
     }
-    while (end > start && isspace((unsigned char)*(end - 1))) {
-        end--;
+    if (index_count) {
+        *index_count = count;
     }
-
-    size_t len = (size_t)(end - start);
-    if (len >= size) {
-        len = size - 1;
+    if (!index_list) {
+        program_emit_expr(prog, EXPR_VAR, slot, count);
     }
-    memcpy(dest, start, len);
-    dest[len] = '\0';
+    return true;
 }
 
-static bool evaluate_expression_statement(const char *expr, int line, int debug) {
-    if (!expr) {
+static bool compile_array_literal(TaskProgram *prog, const char **cursor, int line, int debug) {
+    if (!cursor || !*cursor || **cursor != '{') {
         return false;
     }
 
-    const char *cursor = expr;
-    while (isspace((unsigned char)*cursor)) {
-        cursor++;
-    }
-    if (*cursor == '\0') {
-        return true;
-    }
+    const char *s = *cursor;
+    s++; // skip '{'
 
-    Value value;
-    if (!parse_expression(&cursor, &value, NULL, line, debug)) {
+    int len = 0;
+    while (1) {
+        while (isspace((unsigned char)*s)) {
+            s++;
+        }
+        if (*s == '}') {
+            s++;
+            break;
+        }
+
+        if (!compile_expression(prog, &s, ",}", line, debug)) {
+            if (debug) {
+                fprintf(stderr, "Line %d: invalid array element\n", line);
+            }
+            return false;
+        }
+        len++;
+
+        while (isspace((unsigned char)*s)) {
+            s++;
+        }
+        if (*s == ',') {
+            s++;
+            continue;
+        }
+        if (*s == '}') {
+            s++;
+            break;
+        }
+        if (debug) {
+            fprintf(stderr, "Line %d: expected ',' or '}' in array literal\n", line);
+        }
         return false;
     }
-    while (isspace((unsigned char)*cursor)) {
-        cursor++;
-    }
-    if (*cursor != '\0' && debug) {
-        fprintf(stderr, "Expression: unexpected characters at %d\n", line);
-    }
 
-    free_value(&value);
+    program_emit_expr(prog, EXPR_ARRAY, 0, len);
+    *cursor = s;
     return true;
 }
 
-static bool process_assignment_statement(const char *statement, int line, int debug) {
-    if (!statement) {
-        return false;
+static bool compile_value_token(TaskProgram *prog, const char **p, const char *delims, int line, int debug) {
+    while (isspace((unsigned char)**p)) {
+        (*p)++;
     }
 
-    const char *cursor = statement;
-    char *var_token = NULL;
-    bool quoted = false;
-    if (!parse_token(&cursor, &var_token, &quoted, "=") || quoted) {
-        if (debug) fprintf(stderr, "Assignment: expected variable at line %d\n", line);
-        free(var_token);
-        return false;
+    if (**p == '{') {
+        return compile_array_literal(prog, p, line, debug);
     }
 
-    VariableRef ref;
-    if (!parse_variable_reference_token(var_token, &ref, line, debug)) {
-        if (debug) fprintf(stderr, "Assignment: invalid variable name at line %d\n", line);
-        free(var_token);
-        return false;
+    const char *s = *p;
+    if (strncmp(s, "LEN(", 4) == 0) {
+        s += 4;
+        if (!compile_expression(prog, &s, ")", line, debug)) {
+            if (debug) {
+                fprintf(stderr, "Line %d: invalid LEN() argument\n", line);
+            }
+            return false;
+        }
+        while (isspace((unsigned char)*s)) {
+            s++;
+        }
+        if (*s != ')') {
+            if (debug) {
+                fprintf(stderr, "Line %d: expected ')' to close LEN()\n", line);
+            }
+            return false;
+        }
+        program_emit_expr(prog, EXPR_LEN, 0, 0);
+        *p = s + 1;
+        return true;
     }
-    free(var_token);
 
-    while (isspace((unsigned char)*cursor)) {
-        cursor++;
-    }
-    if (*cursor != '=') {
-        if (debug) fprintf(stderr, "Assignment: expected '=' at line %d\n", line);
-        return false;
-    }
-    cursor++;
-    while (isspace((unsigned char)*cursor)) {
-        cursor++;
+    int builtin = match_array_builtin(s);
+    if (builtin >= 0) {
+        const char *name = array_builtins[builtin].name;
+        s += strlen(name) + 1;
+        int argc = 0;
+        while (1) {
+            if (argc == array_builtins[builtin].max_args || !compile_expression(prog, &s, ",)", line, debug)) {
+                if (debug) {
+                    fprintf(stderr, "Line %d: invalid %s() argument\n", line, name);
+                }
+                return false;
+            }
+            argc++;
+            while (isspace((unsigned char)*s)) {
+                s++;
+            }
+            if (*s != ',') {
+                break;
+            }
+            s++;
+        }
+        if (*s != ')') {
+            if (debug) {
+                fprintf(stderr, "Line %d: expected ')' to close %s()\n", line, name);
+            }
+            return false;
+        }
+        if (argc < array_builtins[builtin].min_args) {
+            if (debug) {
+                fprintf(stderr, "Line %d: too few arguments to %s()\n", line, name);
+            }
+            return false;
+        }
+        program_emit_expr(prog, EXPR_BUILTIN, builtin, argc);
+        *p = s + 1;
+        return true;
     }
 
-    Value value;
-    if (!parse_expression(&cursor, &value, NULL, line, debug)) {
+    char *token = NULL;
+    bool quoted = false;
+    if (!parse_token(p, &token, &quoted, delims)) {
+        if (debug) {
+            fprintf(stderr, "Line %d: failed to parse value\n", line);
+        }
         return false;
     }
-    while (isspace((unsigned char)*cursor)) {
-        cursor++;
-    }
-    if (*cursor != '\0' && debug) {
-        fprintf(stderr, "Assignment: unexpected characters at %d\n", line);
-    }
-
-    Variable *var = find_variable(ref.name, true);
-    if (var) {
-        if (!set_variable_from_ref(var, &ref, &value) && debug) {
-            fprintf(stderr, "Assignment: failed to set variable at line %d\n", line);
+    Value result;
+    memset(&result, 0, sizeof(result));
+    if (quoted) {
+        result.type = VALUE_STRING;
+        result.str_val = token;
+        result.owns_string = true;
+    } else if (token[0] == '$') {
+        if (!compile_variable_reference(prog, token, NULL, NULL, NULL, line, debug)) {
+            if (debug) {
+                fprintf(stderr, "Line %d: invalid variable name '%s'\n", line, token);
+            }
+            free(token);
+            return false;
+        }
+        free(token);
+        return true;
+    } else {
+        long long iv = 0;
+        double fv = 0.0;
+        ValueType vt = detect_numeric_type(token, &iv, &fv);
+        if (vt == VALUE_INT) {
+            result.type = VALUE_INT;
+            result.int_val = iv;
+            result.float_val = (double)iv;
+            free(token);
+        } else if (vt == VALUE_FLOAT) {
+            result.type = VALUE_FLOAT;
+            result.float_val = fv;
+            result.int_val = float_to_int(fv);
+            free(token);
+        } else {
+            result.type = VALUE_STRING;
+            result.str_val = token;
+            result.owns_string = true;
         }
     }
-    free_value(&value);
+    program_emit_constant(prog, &result);
     return true;
 }
 
-static bool apply_increment_step(const char *expr, int line, int debug) {
-    if (!expr) {
-        return false;
-    }
-
-    char trimmed[128];
-    copy_trimmed_segment(expr, expr + strlen(expr), trimmed, sizeof(trimmed));
+static bool compile_expression(TaskProgram *prog, const char **cursor, const char *terminators, int line, int debug) {
+    bool have_term = false;
+    char pending_op = '+';
 
-    if (strchr(trimmed, '=')) {
-        if (process_assignment_statement(trimmed, line, debug)) {
-            return true;
-        }
-        if (debug) {
-            fprintf(stderr, "FOR: failed to evaluate step assignment at line %d\n", line);
+    const char *delims = "+-";
+    char delim_buf[64];
+    if (terminators && *terminators) {
+        size_t term_len = strlen(terminators);
+        if (term_len > sizeof(delim_buf) - 3) {
+            term_len = sizeof(delim_buf) - 3;
         }
-        return false;
+        delim_buf[0] = '+';
+        delim_buf[1] = '-';
+        memcpy(&delim_buf[2], terminators, term_len);
+        delim_buf[term_len + 2] = '\0';
+        delims = delim_buf;
     }
 
-    const char *cursor = trimmed;
-    if (*cursor == '$') {
-        cursor++;
-    }
+    while (1) {
+        while (isspace((unsigned char)**cursor)) {
+            (*cursor)++;
+        }
 
-    char name[64];
-    size_t len = 0;
-    bool too_long = false;
-    while (isalnum((unsigned char)*cursor) || *cursor == '_') {
-        if (len + 1 >= sizeof(name)) {
-            too_long = true;
-        } else {
-            name[len++] = *cursor;
+        char current_op = have_term ? pending_op : '+';
+        if (!have_term && (**cursor == '+' || **cursor == '-')) {
+            current_op = **cursor;
+            (*cursor)++;
+            while (isspace((unsigned char)**cursor)) {
+                (*cursor)++;
+            }
         }
-        cursor++;
-    }
-    name[len] = '\0';
 
-    while (isspace((unsigned char)*cursor)) {
-        cursor++;
-    }
+        if (!compile_value_token(prog, cursor, delims, line, debug)) {
+            return false;
+        }
+        if (current_op == '-') {
+            program_emit_expr(prog, EXPR_NEG, 0, 0);
+        }
+        if (have_term) {
+            program_emit_expr(prog, EXPR_ADD, 0, 0);
+        }
+        have_term = true;
+        pending_op = '+';
 
-    bool increment = false;
-    if (strncmp(cursor, "++", 2) == 0) {
-        increment = true;
-        cursor += 2;
-    } else if (strncmp(cursor, "--", 2) == 0) {
-        increment = false;
-        cursor += 2;
-    } else {
-        bool ok = evaluate_expression_statement(trimmed, line, debug);
-        if (!ok && debug) {
-            fprintf(stderr, "FOR: unsupported step at line %d\n", line);
+        while (isspace((unsigned char)**cursor)) {
+            (*cursor)++;
+        }
+        if (**cursor == '+' || **cursor == '-') {
+            pending_op = **cursor;
+            (*cursor)++;
+            continue;
         }
-        return ok;
+        break;
     }
 
-    while (isspace((unsigned char)*cursor)) {
-        cursor++;
-    }
-    if (*cursor != '\0') {
-        if (debug) fprintf(stderr, "FOR: unexpected characters after step at line %d\n", line);
-        return false;
-    }
+    return have_term;
+}
 
-    if (len == 0 || too_long) {
-        if (debug) fprintf(stderr, "FOR: invalid step variable at line %d\n", line);
-        return false;
+/* Compiles one expression ending at the first unparsed character and
+   returns its offset, or -1 with nothing emitted if it does not parse. */
+static int compile_expression_text(TaskProgram *prog, const char **cursor, const char *terminators, int line, int debug) {
+    int start = prog->expr_count;
+    if (!compile_expression(prog, cursor, terminators, line, debug)) {
+        prog->expr_count = start;
+        return -1;
     }
+    program_emit_expr(prog, EXPR_END, 0, 0);
+    return start;
+}
 
-    Variable *var = find_variable(name, true);
-    if (!var) {
+static bool compile_comparison_condition(TaskProgram *prog, const char **cursor, int line, int debug) {
+    if (!compile_expression(prog, cursor, "<>!=", line, debug)) {
         return false;
     }
 
-    if (var->type == VALUE_STRING && var->str_val) {
-        free(var->str_val);
-        var->str_val = NULL;
-    }
-
-    long long current = 0;
-    if (var->type == VALUE_INT) {
-        current = var->int_val;
-    } else if (var->type == VALUE_FLOAT) {
-        current = (long long)var->float_val;
+    while (isspace((unsigned char)**cursor)) {
+        (*cursor)++;
     }
 
-    if (increment) {
-        current++;
+    int op = -1;
+    if ((*cursor)[0] == '=' && (*cursor)[1] == '=') {
+        op = 0;
+        (*cursor) += 2;
+    } else if ((*cursor)[0] == '!' && (*cursor)[1] == '=') {
+        op = 1;
+        (*cursor) += 2;
+    } else if ((*cursor)[0] == '>' && (*cursor)[1] == '=') {
+        op = 2;
+        (*cursor) += 2;
+    } else if ((*cursor)[0] == '<' && (*cursor)[1] == '=') {
+        op = 3;
+        (*cursor) += 2;
+    } else if ((*cursor)[0] == '>') {
+        op = 4;
+        (*cursor) += 1;
+    } else if ((*cursor)[0] == '<') {
+        op = 5;
+        (*cursor) += 1;
     } else {
-        current--;
+        if (debug) {
+            fprintf(stderr, "IF: invalid or missing operator at %d\n", line);
+        }
+        return false;
     }
 
-    var->type = VALUE_INT;
-    var->int_val = current;
-    var->float_val = (double)current;
+    if (!compile_expression(prog, cursor, NULL, line, debug)) {
+        return false;
+    }
+    program_emit_expr(prog, EXPR_COMPARE, op, 0);
     return true;
 }
 
-static bool evaluate_condition_string(const char *expr, int line, int debug, bool *out) {
-    if (!expr || !out) {
+static bool compile_conjunction_condition(TaskProgram *prog, const char **cursor, int line, int debug) {
+    if (!compile_comparison_condition(prog, cursor, line, debug)) {
         return false;
     }
 
-    bool result = false;
-    const char *cursor = expr;
-    bool condition_parsed = false;
-
-    if (parse_boolean_literal(expr, &result, &cursor)) {
-        condition_parsed = true;
-    } else if (parse_condition(&cursor, &result, line, debug)) {
-        condition_parsed = true;
-    } else if (evaluate_truthy_expression(expr, line, debug, &result)) {
-        condition_parsed = true;
-    }
+    while (1) {
+        const char *p = *cursor;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
 
-    if (condition_parsed) {
-        while (isspace((unsigned char)*cursor)) {
-            cursor++;
+        const char *after_keyword = NULL;
+        if (!match_keyword(p, "AND", &after_keyword)) {
+            *cursor = p;
+            break;
         }
-        if (*cursor != '\0') {
-            if (debug) fprintf(stderr, "Condition: unexpected trailing characters at line %d\n", line);
+
+        *cursor = after_keyword;
+        if (!compile_comparison_condition(prog, cursor, line, debug)) {
             return false;
         }
-    } else {
-        return false;
+        program_emit_expr(prog, EXPR_AND, 0, 0);
     }
-    *out = result;
     return true;
 }
 
-static void print_help(void) {
-    printf("\nRuntask Help\n");
-    printf("============\n\n");
-    printf("Commands:\n");
-    printf("  SET $VAR = value\n");
-    printf("    Store integers, floats, strings, or arrays in a variable. Arrays use\n");
-    printf("    braces: {1, 2, 3} or {\"a\", \"b\"}. Access elements with\n");
-    printf("    $VAR[index].\n");
-    printf("  INPUT $VAR [-wait on|off]\n");
-    printf("    Read input into $VAR. Default waits for Enter. OFF captures the first key\n");
-    printf("    press.\n");
-    printf("  IF (<lhs> op <rhs>):\n");
-    printf("    Begin a block terminated by END. Chain with AND/OR. Use ELSE for an\n");
-    printf("    alternate branch.\n");
-    printf("  WHILE(<condition>):\n");
-    printf("    Repeat a block terminated by END while the condition remains true.\n");
-    printf("  FOR (init; cond; step)\n");
-    printf("    Loop with inline init/condition/step terminated by END. Supports $VAR++/--\n");
-    printf("    as well as assignment-style steps (e.g., $I=$I+2).\n");
-    printf("  PRINT expr\n");
-    printf("    Print literals and variables (use '+' to concatenate). Supports array\n");
-    printf("    elements (e.g., PRINT $ARR[0]) and LEN($ARR).\n");
-    printf("  FUNCTION name($A, $B):\n");
-    printf("    Define a callable block. Body ends when indentation returns to the\n");
-    printf("    function's column or the file ends.\n");
-    printf("  EVAL name(args...) [TO $VAR]\n");
-    printf("    Invoke a FUNCTION. Optionally store RETURN value into $VAR.\n");
-    printf("  RETURN [value]\n");
-    printf("    Exit the current FUNCTION with an optional return value.\n");
-    printf("  WAIT milliseconds\n");
-    printf("    Wait for <milliseconds>.\n");
-    printf("  ECHO ON|OFF\n");
-    printf("    Toggle terminal echo so key presses are hidden or shown.\n");
-    printf("  GOTO label\n");
-    printf("    Jump to the line marked with @label (literal or in $VAR).\n");
-    printf("  RUN [BLOCKING|NONBLOCKING] <cmd [args...]>\n");
-    printf("    Execute from ./apps, ./commands, or ./utilities; otherwise fall back to\n");
-    printf("    PATH. Default is BLOCKING. If the command contains '/', it's executed as\n");
-    printf("    given and run from that directory.\n");
-    printf("    Append 'TO $VAR' to capture stdout into $VAR (blocking mode only).\n");
-    printf("  SYS <shell command>\n");
-    printf("    Pass everything after SYS directly to the system shell. A plain cd command\n");
-    printf("    changes runtask's working directory for following TASK commands.\n");
-    printf("  CLEAR\n");
-    printf("    Clear the screen.\n\n");
-    printf("Usage:\n");
-    printf("  ./runtask taskfile [-d]\n\n");
-    printf("Notes:\n");
-    printf("- Task files are loaded from anywhere under 'tasks/' automatically\n");
-    printf("  (e.g., runtask screen.task or runtask examples/colors.task).\n");
-    printf("- Place executables in ./apps, ./commands, or ./utilities and make them\n");
-    printf("  executable.\n");
-    printf("- External commands available in PATH are also accepted.\n\n");
-    printf("Compilation:\n");
-    printf("  gcc -std=c11 -Wall -Wextra -Werror -Wpedantic -O2 -o runtask apps/runtask.c\n\n");
-}
+static bool compile_condition_chain(TaskProgram *prog, const char **cursor, int line, int debug) {
+    if (!compile_conjunction_condition(prog, cursor, line, debug)) {
+        return false;
+    }
 
+    while (1) {
+        const char *p = *cursor;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
 
-typedef enum {
-    TASK_TERM_BUILTIN_ERROR = -1,
-    TASK_TERM_BUILTIN_NOT_HANDLED = 0,
-    TASK_TERM_BUILTIN_HANDLED = 1
-} TaskTermBuiltinResult;
+        const char *after_keyword = NULL;
+        if (!match_keyword(p, "OR", &after_keyword)) {
+            *cursor = p;
+            break;
+        }
 
-static bool task_parse_long_arg(const char *arg, const char *name, long min_value, long max_value, long *out_value,
-                                int line) {
-    if (!arg || !out_value) {
-        return false;
+        *cursor = after_keyword;
+        if (!compile_conjunction_condition(prog, cursor, line, debug)) {
+            return false;
+        }
+        program_emit_expr(prog, EXPR_OR, 0, 0);
     }
+    return true;
+}
 
-    char *endptr = NULL;
-    errno = 0;
-    long value = strtol(arg, &endptr, 10);
-    if (errno != 0 || endptr == arg || *endptr != '\0') {
-        fprintf(stderr, "RUN: invalid integer for %s at line %d: '%s'\n", name, line, arg);
-        return false;
-    }
-    if (value < min_value || value > max_value) {
-        fprintf(stderr, "RUN: %s must be between %ld and %ld at line %d.\n", name, min_value, max_value, line);
-        return false;
+/* Compiles a condition as IF, WHILE and FOR read it: an integer literal, a
+   comparison chain joined with AND/OR, or an expression tested for
+   truthiness. The result evaluates to 0 or 1; text that is none of these
+   compiles to a condition that always fails. *trailing reports characters
+   left after the condition. */
+static int compile_condition(TaskProgram *prog, const char *text, bool *trailing, int line, int debug) {
+    int start = prog->expr_count;
+    const char *cursor = text;
+    bool literal = false;
+    if (parse_boolean_literal(text, &literal, &cursor)) {
+        Value value;
+        memset(&value, 0, sizeof(value));
+        value.type = VALUE_INT;
+        value.int_val = literal ? 1 : 0;
+        value.float_val = (double)value.int_val;
+        program_emit_constant(prog, &value);
+    } else if (compile_condition_chain(prog, &cursor, line, debug)) {
+        // comparison chain compiled in place
+    } else {
+        prog->expr_count = start;
+        const char *truthy_cursor = text;
+        bool ok = compile_expression(prog, &truthy_cursor, NULL, line, debug);
+        while (ok && isspace((unsigned char)*truthy_cursor)) {
+            truthy_cursor++;
+        }
+        if (ok && *truthy_cursor == '\0') {
+            program_emit_expr(prog, EXPR_TRUTHY, 0, 0);
+        } else {
+            prog->expr_count = start;
+            *trailing = false;
+            return program_fail_expression(prog);
+        }
     }
+    program_emit_expr(prog, EXPR_END, 0, 0);
 
-    *out_value = value;
-    return true;
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    *trailing = (*cursor != '\0');
+    return start;
 }
 
-static bool task_term_resolve_color(long color, long r, long g, long b, uint8_t *r_out, uint8_t *g_out,
-                                    uint8_t *b_out, int line) {
-    if (!r_out || !g_out || !b_out) {
-        return false;
+static bool value_is_truthy(const Value *value) {
+    switch (value->type) {
+        case VALUE_INT:
+            return value->int_val != 0;
+        case VALUE_FLOAT:
+            return value->float_val != 0.0;
+        case VALUE_STRING:
+            return value->str_val && value->str_val[0] != '\0';
+        case VALUE_ARRAY:
+            return value->array_len > 0;
+        case VALUE_UNSET:
+        default:
+            return false;
     }
+}
 
-    if (r >= 0 && g >= 0 && b >= 0) {
-        *r_out = (uint8_t)r;
-        *g_out = (uint8_t)g;
-        *b_out = (uint8_t)b;
-        return true;
+// Values pushed for constants and variables borrow their storage; copy it
+// before the source can change.
+static void value_take_ownership(Value *value) {
+    if (value->type == VALUE_STRING && !value->owns_string) {
+        value->str_val = xstrdup(value->str_val ? value->str_val : "");
+        value->owns_string = true;
+    } else if (value->type == VALUE_ARRAY && !value->owns_array) {
+        Value copy;
+        memset(&copy, 0, sizeof(copy));
+        copy_value(&copy, value);
+        *value = copy;
     }
+}
 
-    if (termgfx_color_from_index((int)color, r_out, g_out, b_out) != 0) {
-        fprintf(stderr, "RUN: failed to resolve _TERM color at line %d.\n", line);
-        return false;
-    }
-    return true;
+static Value make_int_value(long long v) {
+    Value value;
+    memset(&value, 0, sizeof(value));
+    value.type = VALUE_INT;
+    value.int_val = v;
+    value.float_val = (double)v;
+    return value;
 }
 
-static TaskTermBuiltinResult try_run_builtin_term_command(char **argv_heap, int argcnt, int line, int debug,
-                                                          bool capture_output, Variable *capture_var,
-                                                          const VariableRef *capture_ref) {
-    if (!argv_heap || argcnt <= 0 || !argv_heap[0]) {
-        return TASK_TERM_BUILTIN_NOT_HANDLED;
+static bool program_eval(TaskProgram *prog, int expr, Value *out, int line, int debug) {
+    if (expr < 0) {
+        return false;
     }
 
-    if (equals_ignore_case(argv_heap[0], "_TERM_SPRITE_LOAD")) {
-        const char *file = NULL;
-        for (int i = 1; i < argcnt; i++) {
-            if (strcmp(argv_heap[i], "-file") == 0) {
-                if (++i >= argcnt) {
-                    fprintf(stderr, "RUN: _TERM_SPRITE_LOAD missing value for -file at line %d.\n", line);
-                    return TASK_TERM_BUILTIN_ERROR;
-                }
-                file = argv_heap[i];
-            } else {
-                return TASK_TERM_BUILTIN_NOT_HANDLED;
-            }
-        }
-        if (!file) {
-            fprintf(stderr, "RUN: _TERM_SPRITE_LOAD missing -file at line %d.\n", line);
-            return TASK_TERM_BUILTIN_ERROR;
-        }
-
-        char *literal = NULL;
-        if (termgfx_sprite_load_literal(file, &literal) != 0) {
-            return TASK_TERM_BUILTIN_ERROR;
-        }
-
-        if (capture_output) {
-            if (!capture_var || !capture_ref) {
-                free(literal);
-                return TASK_TERM_BUILTIN_ERROR;
-            }
-            Value value;
-            memset(&value, 0, sizeof(value));
-            if (!parse_value_from_string(literal, &value, line, debug)) {
-                value.type = VALUE_STRING;
-                value.str_val = literal;
-                value.owns_string = true;
-                literal = NULL;
-            }
-            bool ok = set_variable_from_ref(capture_var, capture_ref, &value);
-            free_value(&value);
-            free(literal);
-            if (!ok) {
-                return TASK_TERM_BUILTIN_ERROR;
-            }
-        } else {
-            if (printf("%s\n", literal) < 0) {
-                perror("RUN: _TERM_SPRITE_LOAD printf");
-                free(literal);
-                return TASK_TERM_BUILTIN_ERROR;
+    size_t sp = 0;
+    bool ok = true;
+    for (const ExprOp *op = &prog->expr[expr]; ok && op->op != EXPR_END; ++op) {
+        program_stack = (Value *)grow_buffer(program_stack, &program_stack_cap, sp + 1, sizeof(Value));
+        Value *stack = program_stack;
+        switch (op->op) {
+            case EXPR_FAIL:
+                ok = false;
+                break;
+            case EXPR_CONST: {
+                Value value = prog->constants[op->arg];
+                value.owns_string = false;
+                value.owns_array = false;
+                stack[sp++] = value;
+                break;
             }
-            free(literal);
-        }
-        if (debug) {
-            fprintf(stderr, "RUN: accelerated _TERM_SPRITE_LOAD\n");
-        }
-        return TASK_TERM_BUILTIN_HANDLED;
-    }
-
-    if (capture_output) {
-        return TASK_TERM_BUILTIN_NOT_HANDLED;
-    }
-
-    if (equals_ignore_case(argv_heap[0], "_TERM_SPRITE")) {
-        long origin_x = -1;
-        long origin_y = -1;
-        long layer = 1;
-        long width = -1;
-        long height = -1;
-        const char *file = NULL;
-        const char *sprite_literal = NULL;
-        const char *data = NULL;
-
-        for (int i = 1; i < argcnt; i++) {
-            if (strcmp(argv_heap[i], "-x") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-x", 0, INT_MAX, &origin_x, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
+            case EXPR_VAR: {
+                VariableRef ref;
+                ref.index_count = (size_t)op->count;
+                size_t base = sp - ref.index_count;
+                for (size_t i = 0; ok && i < ref.index_count; ++i) {
+                    ok = convert_value_to_index(&stack[base + i], &ref.indices[i], line, debug);
                 }
-            } else if (strcmp(argv_heap[i], "-y") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-y", 0, INT_MAX, &origin_y, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
+                while (sp > base) {
+                    free_value(&stack[--sp]);
                 }
-            } else if (strcmp(argv_heap[i], "-layer") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-layer", 1, 16, &layer, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
+                if (!ok) {
+                    break;
                 }
-            } else if (strcmp(argv_heap[i], "-file") == 0) {
-                if (++i >= argcnt) {
-                    fprintf(stderr, "RUN: _TERM_SPRITE missing value for -file at line %d.\n", line);
-                    return TASK_TERM_BUILTIN_ERROR;
+                Value value;
+                memset(&value, 0, sizeof(value));
+                Variable *var = program_slot_variable(prog, op->arg, false);
+                if (var) {
+                    Value root = variable_to_value(var);
+                    Value scratch;
+                    const Value *target = walk_indices(&root, &ref, &scratch, line, debug);
+                    if (target) {
+                        value = *target;
+                        value.owns_string = false;
+                        value.owns_array = false;
+                    }
                 }
-                file = argv_heap[i];
-            } else if (strcmp(argv_heap[i], "-sprite") == 0) {
-                if (++i >= argcnt) {
-                    fprintf(stderr, "RUN: _TERM_SPRITE missing value for -sprite at line %d.\n", line);
-                    return TASK_TERM_BUILTIN_ERROR;
+                stack[sp++] = value;
+                break;
+            }
+            case EXPR_LEN: {
+                Value *target = &stack[sp - 1];
+                long long len = 0;
+                if (target->type == VALUE_ARRAY) {
+                    len = (long long)target->array_len;
+                } else if (target->type == VALUE_STRING && target->str_val) {
+                    len = (long long)strlen(target->str_val);
+                } else {
+                    char *tmp = value_to_string(target);
+                    len = (long long)strlen(tmp);
+                    free(tmp);
                 }
-                sprite_literal = argv_heap[i];
-            } else if (strcmp(argv_heap[i], "-data") == 0) {
-                if (++i >= argcnt) {
-                    fprintf(stderr, "RUN: _TERM_SPRITE missing value for -data at line %d.\n", line);
-                    return TASK_TERM_BUILTIN_ERROR;
+                free_value(target);
+                *target = make_int_value(len);
+                break;
+            }
+            case EXPR_BUILTIN: {
+                size_t base = sp - (size_t)op->count;
+                Value result;
+                memset(&result, 0, sizeof(result));
+                ok = apply_array_builtin(op->arg, &stack[base], op->count, &result, line, debug);
+                while (sp > base) {
+                    free_value(&stack[--sp]);
                 }
-                data = argv_heap[i];
-            } else if (strcmp(argv_heap[i], "-width") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-width", 1, INT_MAX, &width, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
+                stack[sp++] = result;
+                break;
+            }
+            case EXPR_ARRAY: {
+                size_t len = (size_t)op->count;
+                size_t base = sp - len;
+                Value result;
+                memset(&result, 0, sizeof(result));
+                result.type = VALUE_ARRAY;
+                result.owns_array = true;
+                if (len > 0) {
+                    result.array_val = (Value *)calloc(len, sizeof(Value));
+                    if (!result.array_val) {
+                        perror("calloc");
+                        exit(EXIT_FAILURE);
+                    }
+                    result.array_len = len;
+                    for (size_t i = 0; i < len; ++i) {
+                        copy_value(&result.array_val[i], &stack[base + i]);
+                    }
+                    pack_array(&result);
                 }
-            } else if (strcmp(argv_heap[i], "-height") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-height", 1, INT_MAX, &height, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
+                while (sp > base) {
+                    free_value(&stack[--sp]);
                 }
-            } else {
-                return TASK_TERM_BUILTIN_NOT_HANDLED;
+                stack[sp++] = result;
+                break;
+            }
+            case EXPR_NEG:
+                if (!value_negate(&stack[sp - 1])) {
+                    if (debug) {
+                        fprintf(stderr, "Line %d: unable to apply '-' to value\n", line);
+                    }
+                    ok = false;
+                }
+                break;
+            case EXPR_ADD:
+                ok = value_add_inplace(&stack[sp - 2], &stack[sp - 1]);
+                free_value(&stack[--sp]);
+                break;
+            case EXPR_COMPARE: {
+                bool result = false;
+                if (!evaluate_comparison(&stack[sp - 2], &stack[sp - 1], comparison_ops[op->arg], &result, line, debug)) {
+                    result = false;
+                }
+                free_value(&stack[--sp]);
+                free_value(&stack[sp - 1]);
+                stack[sp - 1] = make_int_value(result ? 1 : 0);
+                break;
+            }
+            case EXPR_AND:
+            case EXPR_OR: {
+                bool lhs = stack[sp - 2].int_val != 0;
+                bool rhs = stack[sp - 1].int_val != 0;
+                sp--;
+                stack[sp - 1] = make_int_value((op->op == EXPR_AND ? (lhs && rhs) : (lhs || rhs)) ? 1 : 0);
+                break;
+            }
+            case EXPR_TRUTHY: {
+                bool truthy = value_is_truthy(&stack[sp - 1]);
+                free_value(&stack[sp - 1]);
+                stack[sp - 1] = make_int_value(truthy ? 1 : 0);
+                break;
             }
+            case EXPR_END:
+            default:
+                break;
         }
+    }
 
-        if (origin_x < 0 || origin_y < 0 || (file == NULL && sprite_literal == NULL && data == NULL)) {
-            fprintf(stderr, "RUN: _TERM_SPRITE missing required arguments at line %d.\n", line);
-            return TASK_TERM_BUILTIN_ERROR;
-        }
-        if ((file != NULL) + (sprite_literal != NULL) + (data != NULL) > 1) {
-            fprintf(stderr, "RUN: _TERM_SPRITE accepts only one of -file, -sprite, or -data at line %d.\n", line);
-            return TASK_TERM_BUILTIN_ERROR;
+    if (!ok || sp != 1) {
+        while (sp > 0) {
+            free_value(&program_stack[--sp]);
         }
+        return false;
+    }
+    *out = program_stack[0];
+    return true;
+}
 
-        int rc;
-        if (sprite_literal) {
-            rc = termgfx_sprite_literal(origin_x, origin_y, sprite_literal, layer);
-        } else if (data) {
-            if (width <= 0 || height <= 0) {
-                fprintf(stderr, "RUN: _TERM_SPRITE -data requires -width and -height at line %d.\n", line);
-                return TASK_TERM_BUILTIN_ERROR;
-            }
-            rc = termgfx_sprite_data(origin_x, origin_y, width, height, data, layer);
-        } else {
-            rc = termgfx_sprite_file(origin_x, origin_y, file, layer);
-        }
-        if (debug) {
-            fprintf(stderr, "RUN: accelerated _TERM_SPRITE\n");
-        }
-        return rc == 0 ? TASK_TERM_BUILTIN_HANDLED : TASK_TERM_BUILTIN_ERROR;
+static bool program_test(TaskProgram *prog, int expr, int line, int debug) {
+    Value value;
+    if (!program_eval(prog, expr, &value, line, debug)) {
+        return false;
     }
+    bool result = value_is_truthy(&value);
+    free_value(&value);
+    return result;
+}
 
-    if (equals_ignore_case(argv_heap[0], "_TERM_RENDER")) {
-        long layer = 0;
-        for (int i = 1; i < argcnt; i++) {
-            if (strcmp(argv_heap[i], "--render") == 0) {
-                continue;
-            }
-            if (strcmp(argv_heap[i], "-layer") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-layer", 1, 16, &layer, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
-                }
-                continue;
-            }
-            return TASK_TERM_BUILTIN_NOT_HANDLED;
+static bool program_resolve_indices(TaskProgram *prog, int list, int count, VariableRef *ref, int line, int debug) {
+    memset(ref, 0, sizeof(*ref));
+    for (int i = 0; i < count; ++i) {
+        Value index;
+        if (!program_eval(prog, prog->lists[list + i], &index, line, debug)) {
+            return false;
         }
-        if (debug) {
-            fprintf(stderr, "RUN: accelerated _TERM_RENDER\n");
+        bool ok = convert_value_to_index(&index, &ref->indices[i], line, debug);
+        free_value(&index);
+        if (!ok) {
+            return false;
         }
-        return termgfx_render(layer) == 0 ? TASK_TERM_BUILTIN_HANDLED : TASK_TERM_BUILTIN_ERROR;
     }
+    ref->index_count = (size_t)count;
+    return true;
+}
 
-    if (equals_ignore_case(argv_heap[0], "_TERM_CLEAN")) {
-        long x = -1;
-        long y = -1;
-        long width = -1;
-        long height = -1;
-        long layer = 1;
-        for (int i = 1; i < argcnt; i++) {
-            if (strcmp(argv_heap[i], "-x") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-x", 0, INT_MAX, &x, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
-                }
-            } else if (strcmp(argv_heap[i], "-y") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-y", 0, INT_MAX, &y, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
-                }
-            } else if (strcmp(argv_heap[i], "-width") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-width", 1, INT_MAX, &width, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
-                }
-            } else if (strcmp(argv_heap[i], "-height") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-height", 1, INT_MAX, &height, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
-                }
-            } else if (strcmp(argv_heap[i], "-layer") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-layer", 1, 16, &layer, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
-                }
-            } else {
-                return TASK_TERM_BUILTIN_NOT_HANDLED;
-            }
-        }
-        if (x < 0 || y < 0 || width <= 0 || height <= 0) {
-            fprintf(stderr, "RUN: _TERM_CLEAN missing geometry at line %d.\n", line);
-            return TASK_TERM_BUILTIN_ERROR;
-        }
-        if (debug) {
-            fprintf(stderr, "RUN: accelerated _TERM_CLEAN\n");
+static void free_task_program(TaskProgram *prog) {
+    for (int i = 0; i < prog->constant_count; ++i) {
+        free_value(&prog->constants[i]);
+    }
+    free(prog->code);
+    free(prog->expr);
+    free(prog->constants);
+    free(prog->slots);
+    free(prog->slot_by_name);
+    free(prog->lists);
+    free(prog->line_start);
+    free(prog->line_body);
+    free(prog->line_end);
+    memset(prog, 0, sizeof(*prog));
+    free(program_stack);
+    program_stack = NULL;
+    program_stack_cap = 0;
+}
+
+static TaskProgram runtime_program = { .lookup_only = true };
+
+/* Drops the expressions, constants and slots of a program that only holds
+   expressions, keeping its buffers for the next compile. */
+static void program_reset_expressions(TaskProgram *prog) {
+    for (int i = 0; i < prog->constant_count; ++i) {
+        free_value(&prog->constants[i]);
+    }
+    for (int i = 0; i < prog->slot_count; ++i) {
+        int name_id = prog->slots[i].name_id;
+        if (name_id >= 0 && (size_t)name_id < prog->slot_by_name_cap) {
+            prog->slot_by_name[name_id] = 0;
         }
-        return termgfx_clear(x, y, width, height, layer) == 0 ? TASK_TERM_BUILTIN_HANDLED : TASK_TERM_BUILTIN_ERROR;
     }
+    prog->expr_count = 0;
+    prog->constant_count = 0;
+    prog->slot_count = 0;
+    prog->list_count = 0;
+}
 
-    if (equals_ignore_case(argv_heap[0], "_TERM_PIXEL") || equals_ignore_case(argv_heap[0], "_TERM_RECT")) {
-        bool is_rect = equals_ignore_case(argv_heap[0], "_TERM_RECT");
-        long x = -1;
-        long y = -1;
-        long width = -1;
-        long height = -1;
-        long layer = 1;
-        long color = 16;
-        long r = -1;
-        long g = -1;
-        long b = -1;
+/* Compiles and evaluates text as one complete expression. *trailing is set
+   when an expression parsed but characters were left after it. The result
+   owns its storage. */
+static bool evaluate_runtime_expression(const char *text, Value *out, bool *trailing, int line, int debug) {
+    *trailing = false;
+    program_reset_expressions(&runtime_program);
+    const char *cursor = text;
+    int expr = compile_expression_text(&runtime_program, &cursor, NULL, line, debug);
+    if (expr < 0) {
+        return false;
+    }
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor != '\0') {
+        *trailing = true;
+        return false;
+    }
+    if (!program_eval(&runtime_program, expr, out, line, debug)) {
+        return false;
+    }
+    value_take_ownership(out);
+    return true;
+}
 
-        for (int i = 1; i < argcnt; i++) {
-            if (strcmp(argv_heap[i], "-x") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-x", 0, INT_MAX, &x, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
-                }
-            } else if (strcmp(argv_heap[i], "-y") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-y", 0, INT_MAX, &y, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
-                }
-            } else if (strcmp(argv_heap[i], "-width") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-width", 1, INT_MAX, &width, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
-                }
-            } else if (strcmp(argv_heap[i], "-height") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-height", 1, INT_MAX, &height, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
-                }
-            } else if (strcmp(argv_heap[i], "-layer") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-layer", 1, 16, &layer, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
-                }
-            } else if (strcmp(argv_heap[i], "-color") == 0) {
-                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-color", 0, 18, &color, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
-                }
-                r = -1;
-                g = -1;
-                b = -1;
-            } else if (strcmp(argv_heap[i], "-rgb") == 0) {
-                if (i + 3 >= argcnt ||
-                    !task_parse_long_arg(argv_heap[i + 1], "red", 0, 255, &r, line) ||
-                    !task_parse_long_arg(argv_heap[i + 2], "green", 0, 255, &g, line) ||
-                    !task_parse_long_arg(argv_heap[i + 3], "blue", 0, 255, &b, line)) {
-                    return TASK_TERM_BUILTIN_ERROR;
-                }
-                i += 3;
-            } else {
-                return TASK_TERM_BUILTIN_NOT_HANDLED;
-            }
-        }
-
-        if (x < 0 || y < 0 || (is_rect && (width <= 0 || height <= 0))) {
-            fprintf(stderr, "RUN: %s missing required geometry at line %d.\n", is_rect ? "_TERM_RECT" : "_TERM_PIXEL", line);
-            return TASK_TERM_BUILTIN_ERROR;
-        }
-
-        uint8_t rr = 0;
-        uint8_t gg = 0;
-        uint8_t bb = 0;
-        if (!task_term_resolve_color(color, r, g, b, &rr, &gg, &bb, line)) {
-            return TASK_TERM_BUILTIN_ERROR;
-        }
+static bool evaluate_index_expression(const char *expr, size_t *index_out, int line, int debug) {
+    if (!expr || !index_out) {
+        return false;
+    }
 
-        if (debug) {
-            fprintf(stderr, "RUN: accelerated %s\n", is_rect ? "_TERM_RECT" : "_TERM_PIXEL");
-        }
-        if (is_rect) {
-            return termgfx_rect(x, y, width, height, rr, gg, bb, layer) == 0 ? TASK_TERM_BUILTIN_HANDLED : TASK_TERM_BUILTIN_ERROR;
+    Value idx_value;
+    bool trailing = false;
+    if (!evaluate_runtime_expression(expr, &idx_value, &trailing, line, debug)) {
+        if (trailing && debug) {
+            fprintf(stderr, "Line %d: invalid array index expression\n", line);
         }
-        return termgfx_pixel(x, y, rr, gg, bb, layer) == 0 ? TASK_TERM_BUILTIN_HANDLED : TASK_TERM_BUILTIN_ERROR;
+        return false;
     }
 
-    return TASK_TERM_BUILTIN_NOT_HANDLED;
-}
+    size_t idx = 0;
+    bool ok = convert_value_to_index(&idx_value, &idx, line, debug);
+    free_value(&idx_value);
+    if (!ok) {
+        return false;
+    }
 
-static char *trim(char *s) {
-    while (isspace((unsigned char)*s)) s++;
-    if (!*s) return s;
-    char *e = s + strlen(s) - 1;
-    while (e > s && isspace((unsigned char)*e)) e--;
-    e[1] = '\0';
-    return s;
+    *index_out = idx;
+    return true;
 }
 
-static int brace_balance_delta(const char *s) {
-    bool in_string = false;
-    bool escape = false;
-    int delta = 0;
+static bool parse_variable_reference_token(const char *token, VariableRef *ref, int line, int debug) {
+    if (!token || !ref || token[0] != '$') {
+        return false;
+    }
 
-    for (; *s; ++s) {
-        if (escape) {
-            escape = false;
-            continue;
-        }
-        if (*s == '\\') {
-            escape = true;
-            continue;
-        }
-        if (*s == '"') {
-            in_string = !in_string;
-            continue;
-        }
-        if (in_string) {
-            continue;
+    memset(ref, 0, sizeof(*ref));
+    token++;
+    size_t name_len = 0;
+    while (*token && *token != '[') {
+        if (!isalnum((unsigned char)*token) && *token != '_') {
+            return false;
         }
-        if (*s == '{') {
-            delta++;
-        } else if (*s == '}') {
-            delta--;
+        if (name_len + 1 >= sizeof(ref->name)) {
+            return false;
         }
+        ref->name[name_len++] = *token++;
     }
-
-    return delta;
-}
-
-static void delay_ms(int ms) {
-    int elapsed = 0;
-    while (elapsed < ms && !stop) {
-        int slice = (ms - elapsed > 50) ? 50 : (ms - elapsed);
-        struct timespec ts = { .tv_sec = slice / 1000, .tv_nsec = (slice % 1000) * 1000000L };
-        thrd_sleep(&ts, NULL);
-        elapsed += slice;
+    ref->name[name_len] = '\0';
+    if (name_len == 0) {
+        return false;
     }
-}
 
-typedef enum {
-    LINE_COMMAND = 0,
-    LINE_LABEL,
-    LINE_FUNCTION
-} LineType;
-
-#define SCRIPT_TEXT_MAX 8192
-#define SCRIPT_MAX_LINES 1024
-
-typedef struct {
-    int source_line;   // original file line number for diagnostics
-    LineType type;
-    int indent;        // leading whitespace count for block handling
-    char text[SCRIPT_TEXT_MAX];
-} ScriptLine;
+    while (*token == '[') {
+        if (ref->index_count >= MAX_REF_INDICES) {
+            if (debug) {
+                fprintf(stderr, "Line %d: too many array dimensions (max %d)\n", line, MAX_REF_INDICES);
+            }
+            return false;
+        }
 
-typedef struct {
-    char name[64];
-    int index;        // index into script array
-} Label;
+        token++;
+        const char *end = strchr(token, ']');
+        if (!end) {
+            return false;
+        }
 
-typedef struct {
-    char name[64];
-    int definition_pc;   // index where FUNCTION line is located
-    int start_pc;        // first executable line inside function
-    int end_pc;          // first line after the function block
-    int indent;          // indent level of the definition line
-    int param_count;
-    char params[MAX_FUNCTION_PARAMS][sizeof(((Variable *)0)->name)];
-} FunctionDef;
+        size_t expr_len = (size_t)(end - token);
+        char *expr = (char *)malloc(expr_len + 1);
+        if (!expr) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(expr, token, expr_len);
+        expr[expr_len] = '\0';
 
-typedef struct {
-    int return_pc;
-    int function_end_pc;
-    bool has_return_target;
-    char return_target[sizeof(((Variable *)0)->name)];
-    bool has_return_value;
-    Value return_value;
-    int saved_if_sp;
-    int saved_for_sp;
-    int saved_while_sp;
-    bool saved_skipping_block;
-    int saved_skip_indent;
-    int saved_skip_context_index;
-    bool saved_skip_for_true_branch;
-    bool saved_skip_progress_pending;
-    bool saved_skip_consumed_first;
-    int function_index;
-    int previous_function_index;
-} CallFrame;
+        size_t idx = 0;
+        bool ok = evaluate_index_expression(expr, &idx, line, debug);
+        free(expr);
+        if (!ok) {
+            return false;
+        }
 
-static void normalize_label_name(const char *input, char *output, size_t size) {
-    if (!input || !output || size == 0) {
-        return;
-    }
-    size_t i = 0;
-    for (; input[i] && i + 1 < size; ++i) {
-        output[i] = (char)toupper((unsigned char)input[i]);
+        ref->indices[ref->index_count++] = idx;
+        token = end + 1;
     }
-    output[i] = '\0';
-}
 
-static int find_label_index(const Label *labels, int label_count, const char *name) {
-    if (!labels || !name) {
-        return -1;
-    }
-    for (int i = 0; i < label_count; ++i) {
-        if (equals_ignore_case(labels[i].name, name)) {
-            return i;
-        }
+    if (*token != '\0') {
+        return false;
     }
-    return -1;
-}
 
-static int find_function_index(const FunctionDef *functions, int function_count, const char *name) {
-    if (!functions || !name) {
-        return -1;
-    }
-    for (int i = 0; i < function_count; ++i) {
-        if (equals_ignore_case(functions[i].name, name)) {
-            return i;
-        }
-    }
-    return -1;
+    return true;
 }
 
-static bool parse_function_definition(const char *line, FunctionDef *out) {
-    if (!line || !out) {
-        return false;
-    }
-    const char *cursor = line;
-    if (!match_keyword(cursor, "FUNCTION", &cursor)) {
-        return false;
-    }
-    while (isspace((unsigned char)*cursor)) {
-        cursor++;
-    }
-    const char *name_start = cursor;
-    while (*cursor && (isalnum((unsigned char)*cursor) || *cursor == '_')) {
-        cursor++;
-    }
-    size_t name_len = (size_t)(cursor - name_start);
-    if (name_len == 0 || name_len >= sizeof(out->name)) {
+static bool parse_value_from_string(const char *text, Value *out, int line, int debug) {
+    if (!text || !out) {
         return false;
     }
-    memcpy(out->name, name_start, name_len);
-    out->name[name_len] = '\0';
 
-    while (isspace((unsigned char)*cursor)) {
-        cursor++;
-    }
-    if (*cursor != '(') {
-        return false;
-    }
-    cursor++;
+    bool trailing = false;
+    return evaluate_runtime_expression(text, out, &trailing, line, debug);
+}
 
-    out->param_count = 0;
-    while (1) {
-        while (isspace((unsigned char)*cursor)) {
-            cursor++;
-        }
-        if (*cursor == ')') {
-            cursor++;
-            break;
-        }
-        if (out->param_count >= MAX_FUNCTION_PARAMS) {
-            return false;
-        }
-        const char *param_start = cursor;
-        while (*cursor && *cursor != ',' && *cursor != ')') {
-            cursor++;
-        }
-        size_t param_len = (size_t)(cursor - param_start);
-        if (param_len == 0 || param_len >= sizeof(out->params[0])) {
-            return false;
-        }
-        char token[sizeof(out->params[0])];
-        memcpy(token, param_start, param_len);
-        token[param_len] = '\0';
-        char name_buf[sizeof(out->params[0])];
-        if (!parse_variable_name_token(token, name_buf, sizeof(name_buf))) {
-            return false;
-        }
-        snprintf(out->params[out->param_count], sizeof(out->params[0]), "%s", name_buf);
-        out->param_count++;
+static void print_help(void) {
+    printf("\nRuntask Help\n");
+    printf("============\n\n");
+    printf("Commands:\n");
+    printf("  SET $VAR = value\n");
+    printf("    Store integers, floats, strings, or arrays in a variable. Arrays use\n");
+    printf("    braces: {1, 2, 3} or {\"a\", \"b\"}. Access elements with\n");
+    printf("    $VAR[index].\n");
+    printf("  INPUT $VAR [-wait on|off]\n");
+    printf("    Read input into $VAR. Default waits for Enter. OFF captures the first key\n");
+    printf("    press.\n");
+    printf("  IF (<lhs> op <rhs>):\n");
+    printf("    Begin a block terminated by END. Chain with AND/OR. Use ELSE for an\n");
+    printf("    alternate branch.\n");
+    printf("  WHILE(<condition>):\n");
+    printf("    Repeat a block terminated by END while the condition remains true.\n");
+    printf("  FOR (init; cond; step)\n");
+    printf("    Loop with inline init/condition/step terminated by END. Supports $VAR++/--\n");
+    printf("    as well as assignment-style steps (e.g., $I=$I+2).\n");
+    printf("  PRINT expr\n");
+    printf("    Print literals and variables (use '+' to concatenate). Supports array\n");
+    printf("    elements (e.g., PRINT $ARR[0]) and LEN($ARR).\n");
+    printf("  Array built-ins (usable in any expression):\n");
+    printf("    RANGE(start, stop[, step]), SLICE($ARR, start[, end]), SUM($ARR),\n");
+    printf("    MIN($ARR), MAX($ARR), VADD(a, b), VMUL(a, b) and MAP($ARR, \"sin\").\n");
+    printf("    VADD/VMUL work element-wise and accept a number for either side. MAP\n");
+    printf("    applies sin, cos, tan, sqrt, exp, log, abs, floor, ceil or round.\n");
+    printf("  FUNCTION name($A, $B):\n");
+    printf("    Define a callable block. Body ends when indentation returns to the\n");
+    printf("    function's column or the file ends.\n");
+    printf("  EVAL name(args...) [TO $VAR]\n");
+    printf("    Invoke a FUNCTION. Optionally store RETURN value into $VAR.\n");
+    printf("  RETURN [value]\n");
+    printf("    Exit the current FUNCTION with an optional return value.\n");
+    printf("  WAIT milliseconds\n");
+    printf("    Wait for <milliseconds>.\n");
+    printf("  ECHO ON|OFF\n");
+    printf("    Toggle terminal echo so key presses are hidden or shown.\n");
+    printf("  GOTO label\n");
+    printf("    Jump to the line marked with @label (literal or in $VAR).\n");
+    printf("  RUN [BLOCKING|NONBLOCKING] <cmd [args...]>\n");
+    printf("    Execute from ./apps, ./commands, or ./utilities; otherwise fall back to\n");
+    printf("    PATH. Default is BLOCKING. If the command contains '/', it's executed as\n");
+    printf("    given and run from that directory.\n");
+    printf("    Append 'TO $VAR' to capture stdout into $VAR (blocking mode only).\n");
+    printf("  SYS <shell command>\n");
+    printf("    Pass everything after SYS directly to the system shell. A plain cd command\n");
+    printf("    changes runtask's working directory for following TASK commands.\n");
+    printf("  CLEAR\n");
+    printf("    Clear the screen.\n\n");
+    printf("Usage:\n");
+    printf("  ./runtask taskfile [-d]\n\n");
+    printf("Notes:\n");
+    printf("- Task files are loaded from anywhere under 'tasks/' automatically\n");
+    printf("  (e.g., runtask screen.task or runtask examples/colors.task).\n");
+    printf("- Place executables in ./apps, ./commands, or ./utilities and make them\n");
+    printf("  executable.\n");
+    printf("- External commands available in PATH are also accepted.\n\n");
+    printf("Compilation:\n");
+    printf("  gcc -std=c11 -Wall -Wextra -Werror -Wpedantic -O2 -o runtask apps/runtask.c\n\n");
+}
 
-        while (isspace((unsigned char)*cursor)) {
-            cursor++;
-        }
-        if (*cursor == ',') {
-            cursor++;
-            continue;
-        }
-        if (*cursor == ')') {
-            cursor++;
-            break;
-        }
+
+typedef enum {
+    TASK_TERM_BUILTIN_ERROR = -1,
+    TASK_TERM_BUILTIN_NOT_HANDLED = 0,
+    TASK_TERM_BUILTIN_HANDLED = 1
+} TaskTermBuiltinResult;
+
+static bool task_parse_long_arg(const char *arg, const char *name, long min_value, long max_value, long *out_value,
+                                int line) {
+    if (!arg || !out_value) {
         return false;
     }
 
-    while (isspace((unsigned char)*cursor)) {
-        cursor++;
-    }
-    if (*cursor != ':') {
+    char *endptr = NULL;
+    errno = 0;
+    long value = strtol(arg, &endptr, 10);
+    if (errno != 0 || endptr == arg || *endptr != '\0') {
+        fprintf(stderr, "RUN: invalid integer for %s at line %d: '%s'\n", name, line, arg);
         return false;
     }
-    cursor++;
-    while (isspace((unsigned char)*cursor)) {
-        cursor++;
+    if (value < min_value || value > max_value) {
+        fprintf(stderr, "RUN: %s must be between %ld and %ld at line %d.\n", name, min_value, max_value, line);
+        return false;
     }
-    return *cursor == '\0';
-}
 
-static FunctionDef *find_function_by_definition(FunctionDef *functions, int function_count, int pc) {
-    if (!functions) {
-        return NULL;
-    }
-    for (int i = 0; i < function_count; ++i) {
-        if (functions[i].definition_pc == pc) {
-            return &functions[i];
-        }
-    }
-    return NULL;
+    *out_value = value;
+    return true;
 }
 
-static bool record_script_line(const char *line, int indent, int source_line, ScriptLine *script, int script_cap, int *count, Label *labels, int *label_count, FunctionDef *functions, int *function_count) {
-    if (!line || !script || !count || !labels || !label_count || !functions || !function_count) {
+static bool task_term_resolve_color(long color, long r, long g, long b, uint8_t *r_out, uint8_t *g_out,
+                                    uint8_t *b_out, int line) {
+    if (!r_out || !g_out || !b_out) {
         return false;
     }
 
-    if (*count >= script_cap) {
-        fprintf(stderr, "Error: script too long (max %d lines)\n", script_cap);
+    if (r >= 0 && g >= 0 && b >= 0) {
+        *r_out = (uint8_t)r;
+        *g_out = (uint8_t)g;
+        *b_out = (uint8_t)b;
+        return true;
+    }
+
+    if (termgfx_color_from_index((int)color, r_out, g_out, b_out) != 0) {
+        fprintf(stderr, "RUN: failed to resolve _TERM color at line %d.\n", line);
         return false;
     }
+    return true;
+}
 
-    FunctionDef def_tmp;
-    bool is_function = parse_function_definition(line, &def_tmp);
-    if (is_function) {
-        script[*count].source_line = source_line;
-        script[*count].type = LINE_FUNCTION;
-        script[*count].indent = indent;
-        strncpy(script[*count].text, line, sizeof(script[*count].text) - 1);
-        script[*count].text[sizeof(script[*count].text) - 1] = '\0';
-
-        def_tmp.definition_pc = *count;
-        def_tmp.start_pc = *count + 1;
-        def_tmp.end_pc = -1;
-        def_tmp.indent = indent;
+static TaskTermBuiltinResult try_run_builtin_term_command(char **argv_heap, int argcnt, int line, int debug,
+                                                          bool capture_output, Variable *capture_var,
+                                                          const VariableRef *capture_ref) {
+    if (!argv_heap || argcnt <= 0 || !argv_heap[0]) {
+        return TASK_TERM_BUILTIN_NOT_HANDLED;
+    }
 
-        int existing = find_function_index(functions, *function_count, def_tmp.name);
-        if (existing >= 0) {
-            functions[existing] = def_tmp;
-        } else if (*function_count < MAX_FUNCTIONS) {
-            functions[*function_count] = def_tmp;
-            (*function_count)++;
-        } else {
-            fprintf(stderr, "Error: too many functions (max %d)\n", MAX_FUNCTIONS);
+    if (equals_ignore_case(argv_heap[0], "_TERM_SPRITE_LOAD")) {
+        const char *file = NULL;
+        for (int i = 1; i < argcnt; i++) {
+            if (strcmp(argv_heap[i], "-file") == 0) {
+                if (++i >= argcnt) {
+                    fprintf(stderr, "RUN: _TERM_SPRITE_LOAD missing value for -file at line %d.\n", line);
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+                file = argv_heap[i];
+            } else {
+                return TASK_TERM_BUILTIN_NOT_HANDLED;
+            }
+        }
+        if (!file) {
+            fprintf(stderr, "RUN: _TERM_SPRITE_LOAD missing -file at line %d.\n", line);
+            return TASK_TERM_BUILTIN_ERROR;
         }
 
-        (*count)++;
-        return true;
-    }
-
-    if (*line == '@') {
-        char label_name[64];
-        if (!parse_label_definition(line, label_name, sizeof(label_name))) {
-            fprintf(stderr, "Error: invalid label definition at line %d: %s\n", source_line, line);
-            return false;
+        char *literal = NULL;
+        if (termgfx_sprite_load_literal(file, &literal) != 0) {
+            return TASK_TERM_BUILTIN_ERROR;
         }
-        script[*count].source_line = source_line;
-        script[*count].type = LINE_LABEL;
-        script[*count].indent = indent;
-        strncpy(script[*count].text, line, sizeof(script[*count].text) - 1);
-        script[*count].text[sizeof(script[*count].text) - 1] = '\0';
 
-        char normalized[64];
-        normalize_label_name(label_name, normalized, sizeof(normalized));
-        int existing = find_label_index(labels, *label_count, normalized);
-        if (existing >= 0) {
-            labels[existing].index = *count;
+        if (capture_output) {
+            if (!capture_var || !capture_ref) {
+                free(literal);
+                return TASK_TERM_BUILTIN_ERROR;
+            }
+            Value value;
+            memset(&value, 0, sizeof(value));
+            if (!parse_value_from_string(literal, &value, line, debug)) {
+                value.type = VALUE_STRING;
+                value.str_val = literal;
+                value.owns_string = true;
+                literal = NULL;
+            }
+            bool ok = set_variable_from_ref(capture_var, capture_ref, &value);
+            free_value(&value);
+            free(literal);
+            if (!ok) {
+                return TASK_TERM_BUILTIN_ERROR;
+            }
         } else {
-            if (*label_count >= MAX_LABELS) {
-                fprintf(stderr, "Error: too many labels (max %d)\n", MAX_LABELS);
-            } else {
-                snprintf(labels[*label_count].name, sizeof(labels[*label_count].name), "%s", normalized);
-                labels[*label_count].index = *count;
-                (*label_count)++;
+            if (printf("%s\n", literal) < 0) {
+                perror("RUN: _TERM_SPRITE_LOAD printf");
+                free(literal);
+                return TASK_TERM_BUILTIN_ERROR;
             }
+            free(literal);
         }
-        (*count)++;
-        return true;
+        if (debug) {
+            fprintf(stderr, "RUN: accelerated _TERM_SPRITE_LOAD\n");
+        }
+        return TASK_TERM_BUILTIN_HANDLED;
     }
 
-    script[*count].source_line = source_line;
-    script[*count].type = LINE_COMMAND;
-    script[*count].indent = indent;
-    strncpy(script[*count].text, line, sizeof(script[*count].text) - 1);
-    script[*count].text[sizeof(script[*count].text) - 1] = '\0';
-    (*count)++;
-    return true;
-}
-
-static void apply_return_value(const CallFrame *frame) {
-    if (!frame || !frame->has_return_target) {
-        return;
-    }
-    Value tmp;
-    memset(&tmp, 0, sizeof(tmp));
-    if (frame->has_return_value) {
-        copy_value(&tmp, &frame->return_value);
-    } else {
-        tmp.type = VALUE_UNSET;
-    }
-    Variable *dest = find_variable(frame->return_target, true);
-    if (dest) {
-        assign_variable(dest, &tmp);
+    if (capture_output) {
+        return TASK_TERM_BUILTIN_NOT_HANDLED;
     }
-    free_value(&tmp);
-}
 
-static bool parse_label_definition(const char *line, char *out_name, size_t name_size) {
-    if (!line) {
-        return false;
-    }
-    const char *cursor = line;
-    while (isspace((unsigned char)*cursor)) {
-        cursor++;
-    }
-    if (*cursor != '@') {
-        return false;
-    }
-    cursor++;
-    size_t len = 0;
-    while (*cursor && !isspace((unsigned char)*cursor) && *cursor != ':') {
-        if (len + 1 >= name_size) {
-            return false;
-        }
-        out_name[len++] = *cursor++;
-    }
-    if (len == 0) {
-        return false;
-    }
-    out_name[len] = '\0';
-    if (*cursor == ':') {
-        cursor++;
-    }
-    while (isspace((unsigned char)*cursor)) {
-        cursor++;
-    }
-    if (*cursor != '\0') {
-        return false;
-    }
-    return true;
-}
-
-static bool load_task_file(const char *task_path, const char *task_dir, ScriptLine *script, int script_cap, int *script_count, Label *labels, int *label_count, FunctionDef *functions, int *function_count, int depth, int debug) {
-    typedef struct {
-        char text[SCRIPT_TEXT_MAX];
-        int indent;
-        int source_line;
-    } PendingLine;
-
-    typedef struct {
-        char path[PATH_MAX];
-        int source_line;
-    } IncludeRequest;
-
-    if (!task_path || !script || !script_count || !labels || !label_count || !functions || !function_count) {
-        return false;
-    }
-
-    (void)debug;
-
-    if (depth >= MAX_INCLUDE_DEPTH) {
-        fprintf(stderr, "Error: include nesting too deep at '%s'\n", task_path);
-        return false;
-    }
-
-    FILE *fp = fopen(task_path, "r");
-    if (!fp) {
-        fprintf(stderr, "Error: Could not open task file '%s'\n", task_path);
-        return false;
-    }
+    if (equals_ignore_case(argv_heap[0], "_TERM_SPRITE")) {
+        long origin_x = -1;
+        long origin_y = -1;
+        long layer = 1;
+        long width = -1;
+        long height = -1;
+        const char *file = NULL;
+        const char *sprite_literal = NULL;
+        const char *data = NULL;
 
-    char dirbuf[PATH_MAX];
-    const char *base_dir = task_dir;
-    if (!base_dir || !*base_dir) {
-        if (task_dirname(task_path, dirbuf, sizeof(dirbuf)) == 0) {
-            base_dir = dirbuf;
-        } else {
-            base_dir = ".";
+        for (int i = 1; i < argcnt; i++) {
+            if (strcmp(argv_heap[i], "-x") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-x", 0, INT_MAX, &origin_x, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+            } else if (strcmp(argv_heap[i], "-y") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-y", 0, INT_MAX, &origin_y, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+            } else if (strcmp(argv_heap[i], "-layer") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-layer", 1, 16, &layer, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+            } else if (strcmp(argv_heap[i], "-file") == 0) {
+                if (++i >= argcnt) {
+                    fprintf(stderr, "RUN: _TERM_SPRITE missing value for -file at line %d.\n", line);
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+                file = argv_heap[i];
+            } else if (strcmp(argv_heap[i], "-sprite") == 0) {
+                if (++i >= argcnt) {
+                    fprintf(stderr, "RUN: _TERM_SPRITE missing value for -sprite at line %d.\n", line);
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+                sprite_literal = argv_heap[i];
+            } else if (strcmp(argv_heap[i], "-data") == 0) {
+                if (++i >= argcnt) {
+                    fprintf(stderr, "RUN: _TERM_SPRITE missing value for -data at line %d.\n", line);
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+                data = argv_heap[i];
+            } else if (strcmp(argv_heap[i], "-width") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-width", 1, INT_MAX, &width, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+            } else if (strcmp(argv_heap[i], "-height") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-height", 1, INT_MAX, &height, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+            } else {
+                return TASK_TERM_BUILTIN_NOT_HANDLED;
+            }
         }
-    }
-
-    PendingLine *pending_lines = (PendingLine *)calloc((size_t)script_cap, sizeof(PendingLine));
-    if (!pending_lines) {
-        perror("calloc");
-        fclose(fp);
-        return false;
-    }
 
-    IncludeRequest includes[MAX_INCLUDES_PER_FILE];
-    int include_count = 0;
-    int pending_count = 0;
-
-    char linebuf[256];
-    char combined[SCRIPT_TEXT_MAX];
-    int brace_balance = 0;
-    bool combining = false;
-    int pending_indent = 0;
-    int pending_source_line = 0;
-    int file_line = 0;
-
-    while (fgets(linebuf, sizeof(linebuf), fp)) {
-        file_line++;
-        char *line = trim(linebuf);
-        int indent = (int)(line - linebuf);
-        if (indent < 0) {
-            indent = 0;
+        if (origin_x < 0 || origin_y < 0 || (file == NULL && sprite_literal == NULL && data == NULL)) {
+            fprintf(stderr, "RUN: _TERM_SPRITE missing required arguments at line %d.\n", line);
+            return TASK_TERM_BUILTIN_ERROR;
         }
-        if (!*line) {
-            continue;
+        if ((file != NULL) + (sprite_literal != NULL) + (data != NULL) > 1) {
+            fprintf(stderr, "RUN: _TERM_SPRITE accepts only one of -file, -sprite, or -data at line %d.\n", line);
+            return TASK_TERM_BUILTIN_ERROR;
         }
 
-        if (!combining) {
-            snprintf(combined, sizeof(combined), "%s", line);
-            brace_balance = brace_balance_delta(combined);
-            combining = (brace_balance > 0);
-            pending_indent = indent;
-            pending_source_line = file_line;
-            if (combining) {
-                continue;
+        int rc;
+        if (sprite_literal) {
+            rc = termgfx_sprite_literal(origin_x, origin_y, sprite_literal, layer);
+        } else if (data) {
+            if (width <= 0 || height <= 0) {
+                fprintf(stderr, "RUN: _TERM_SPRITE -data requires -width and -height at line %d.\n", line);
+                return TASK_TERM_BUILTIN_ERROR;
             }
+            rc = termgfx_sprite_data(origin_x, origin_y, width, height, data, layer);
         } else {
-            size_t cur_len = strlen(combined);
-            size_t add_len = strlen(line);
-            if (cur_len + 1 + add_len >= sizeof(combined)) {
-                fprintf(stderr, "Error: combined line too long near source line %d\n", pending_source_line);
-                continue;
-            }
-            combined[cur_len] = ' ';
-            memcpy(combined + cur_len + 1, line, add_len + 1);
-            brace_balance += brace_balance_delta(line);
-            if (brace_balance > 0) {
-                continue;
-            }
-            combining = false;
-            indent = pending_indent;
-            line = combined;
+            rc = termgfx_sprite_file(origin_x, origin_y, file, layer);
         }
-
-        int effective_line = pending_source_line ? pending_source_line : file_line;
-
-        if (brace_balance < 0) {
-            fprintf(stderr, "Error: unmatched closing brace at line %d\n", file_line);
-            brace_balance = 0;
-            combining = false;
-            continue;
+        if (debug) {
+            fprintf(stderr, "RUN: accelerated _TERM_SPRITE\n");
         }
+        return rc == 0 ? TASK_TERM_BUILTIN_HANDLED : TASK_TERM_BUILTIN_ERROR;
+    }
 
-        if (strncmp(line, "INCLUDE", 7) == 0 && (line[7] == '\0' || isspace((unsigned char)line[7]))) {
-            const char *after = line + 7;
-            while (isspace((unsigned char)*after)) {
-                after++;
-            }
-            char *include_target = NULL;
-            const char *cursor = after;
-            if (!parse_string_literal(&cursor, &include_target)) {
-                fprintf(stderr, "Error: invalid INCLUDE path at line %d\n", effective_line);
-                continue;
-            }
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
-            }
-            if (*cursor != '\0') {
-                fprintf(stderr, "Error: unexpected characters after INCLUDE path at line %d\n", effective_line);
-                free(include_target);
+    if (equals_ignore_case(argv_heap[0], "_TERM_RENDER")) {
+        long layer = 0;
+        for (int i = 1; i < argcnt; i++) {
+            if (strcmp(argv_heap[i], "--render") == 0) {
                 continue;
             }
-
-            char resolved[PATH_MAX];
-            if (resolve_task_path(include_target, base_dir, resolved, sizeof(resolved)) != 0) {
-                fprintf(stderr, "Error: could not resolve INCLUDE '%s' at line %d\n", include_target, effective_line);
-                free(include_target);
+            if (strcmp(argv_heap[i], "-layer") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-layer", 1, 16, &layer, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
                 continue;
             }
-            free(include_target);
+            return TASK_TERM_BUILTIN_NOT_HANDLED;
+        }
+        if (debug) {
+            fprintf(stderr, "RUN: accelerated _TERM_RENDER\n");
+        }
+        return termgfx_render(layer) == 0 ? TASK_TERM_BUILTIN_HANDLED : TASK_TERM_BUILTIN_ERROR;
+    }
 
-            if (include_count >= MAX_INCLUDES_PER_FILE) {
-                fprintf(stderr, "Error: too many INCLUDE directives in '%s' (max %d)\n", task_path, MAX_INCLUDES_PER_FILE);
-                continue;
+    if (equals_ignore_case(argv_heap[0], "_TERM_CLEAN")) {
+        long x = -1;
+        long y = -1;
+        long width = -1;
+        long height = -1;
+        long layer = 1;
+        for (int i = 1; i < argcnt; i++) {
+            if (strcmp(argv_heap[i], "-x") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-x", 0, INT_MAX, &x, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+            } else if (strcmp(argv_heap[i], "-y") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-y", 0, INT_MAX, &y, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+            } else if (strcmp(argv_heap[i], "-width") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-width", 1, INT_MAX, &width, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+            } else if (strcmp(argv_heap[i], "-height") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-height", 1, INT_MAX, &height, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+            } else if (strcmp(argv_heap[i], "-layer") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-layer", 1, 16, &layer, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+            } else {
+                return TASK_TERM_BUILTIN_NOT_HANDLED;
             }
-
-            snprintf(includes[include_count].path, sizeof(includes[include_count].path), "%s", resolved);
-            includes[include_count].source_line = effective_line;
-            include_count++;
-            continue;
         }
-
-        if (pending_count >= script_cap) {
-            fprintf(stderr, "Error: script too long (max %d lines)\n", script_cap);
-            free(pending_lines);
-            fclose(fp);
-            return false;
+        if (x < 0 || y < 0 || width <= 0 || height <= 0) {
+            fprintf(stderr, "RUN: _TERM_CLEAN missing geometry at line %d.\n", line);
+            return TASK_TERM_BUILTIN_ERROR;
         }
-
-        pending_lines[pending_count].source_line = effective_line;
-        pending_lines[pending_count].indent = indent;
-        strncpy(pending_lines[pending_count].text, line, sizeof(pending_lines[pending_count].text) - 1);
-        pending_lines[pending_count].text[sizeof(pending_lines[pending_count].text) - 1] = '\0';
-        pending_count++;
+        if (debug) {
+            fprintf(stderr, "RUN: accelerated _TERM_CLEAN\n");
+        }
+        return termgfx_clear(x, y, width, height, layer) == 0 ? TASK_TERM_BUILTIN_HANDLED : TASK_TERM_BUILTIN_ERROR;
     }
 
-    fclose(fp);
-
-    for (int i = 0; i < include_count; ++i) {
-        char include_dir[PATH_MAX];
-        const char *include_base = base_dir;
-        if (task_dirname(includes[i].path, include_dir, sizeof(include_dir)) == 0) {
-            include_base = include_dir;
-        }
-        if (!load_task_file(includes[i].path, include_base, script, script_cap, script_count, labels, label_count, functions, function_count, depth + 1, debug)) {
-            free(pending_lines);
-            return false;
-        }
-    }
-
-    for (int i = 0; i < pending_count; ++i) {
-        if (!record_script_line(pending_lines[i].text, pending_lines[i].indent, pending_lines[i].source_line, script, script_cap, script_count, labels, label_count, functions, function_count)) {
-            free(pending_lines);
-            return false;
-        }
-    }
-
-    free(pending_lines);
-    return true;
-}
-
-/* Portable strdup replacement to stay ISO C compliant under -std=c11 -pedantic */
-static char *xstrdup(const char *s) {
-    size_t len = strlen(s) + 1;
-    char *p = (char*)malloc(len);
-    if (!p) { perror("malloc"); exit(EXIT_FAILURE); }
-    memcpy(p, s, len);
-    return p;
-}
-
-/* --- Heap-based argv tokenizer supporting quotes and backslash escapes ---
-   - Splits by whitespace.
-   - Supports "double quoted" and 'single quoted' args.
-   - Supports backslash escapes inside double quotes and unquoted text.
-   - Returns a NULL-terminated argv array; *out_argc has argc.
-   - Caller must free with free_argv().
-*/
-static char **split_args_heap(const char *cmdline, int *out_argc) {
-    char **argv = NULL;
-    int argc = 0, cap = 0;
-
-    const char *p = cmdline;
-    while (*p) {
-        // skip leading spaces
-        while (isspace((unsigned char)*p)) p++;
-        if (!*p) break;
-
-        bool in_sq = false, in_dq = false;
-        // grow token buffer dynamically to avoid truncation
-        size_t tcap = 64, ti = 0;
-        char *token = (char*)malloc(tcap);
-        if (!token) { perror("malloc"); exit(EXIT_FAILURE); }
+    if (equals_ignore_case(argv_heap[0], "_TERM_PIXEL") || equals_ignore_case(argv_heap[0], "_TERM_RECT")) {
+        bool is_rect = equals_ignore_case(argv_heap[0], "_TERM_RECT");
+        long x = -1;
+        long y = -1;
+        long width = -1;
+        long height = -1;
+        long layer = 1;
+        long color = 16;
+        long r = -1;
+        long g = -1;
+        long b = -1;
 
-        while (*p) {
-            if (!in_dq && *p == '\'') { in_sq = !in_sq; p++; continue; }
-            if (!in_sq && *p == '"')  { in_dq = !in_dq; p++; continue; }
-            if (!in_sq && *p == '\\') {
-                p++;
-                if (*p) {
-                    if (ti + 1 >= tcap) { tcap *= 2; token = (char*)realloc(token, tcap); if (!token) { perror("realloc"); exit(EXIT_FAILURE); } }
-                    token[ti++] = *p++;
+        for (int i = 1; i < argcnt; i++) {
+            if (strcmp(argv_heap[i], "-x") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-x", 0, INT_MAX, &x, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
                 }
-                continue;
+            } else if (strcmp(argv_heap[i], "-y") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-y", 0, INT_MAX, &y, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+            } else if (strcmp(argv_heap[i], "-width") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-width", 1, INT_MAX, &width, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+            } else if (strcmp(argv_heap[i], "-height") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-height", 1, INT_MAX, &height, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+            } else if (strcmp(argv_heap[i], "-layer") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-layer", 1, 16, &layer, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+            } else if (strcmp(argv_heap[i], "-color") == 0) {
+                if (++i >= argcnt || !task_parse_long_arg(argv_heap[i], "-color", 0, 18, &color, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+                r = -1;
+                g = -1;
+                b = -1;
+            } else if (strcmp(argv_heap[i], "-rgb") == 0) {
+                if (i + 3 >= argcnt ||
+                    !task_parse_long_arg(argv_heap[i + 1], "red", 0, 255, &r, line) ||
+                    !task_parse_long_arg(argv_heap[i + 2], "green", 0, 255, &g, line) ||
+                    !task_parse_long_arg(argv_heap[i + 3], "blue", 0, 255, &b, line)) {
+                    return TASK_TERM_BUILTIN_ERROR;
+                }
+                i += 3;
+            } else {
+                return TASK_TERM_BUILTIN_NOT_HANDLED;
             }
-            if (!in_sq && !in_dq && isspace((unsigned char)*p)) break;
+        }
 
-            if (ti + 1 >= tcap) { tcap *= 2; token = (char*)realloc(token, tcap); if (!token) { perror("realloc"); exit(EXIT_FAILURE); } }
-            token[ti++] = *p++;
+        if (x < 0 || y < 0 || (is_rect && (width <= 0 || height <= 0))) {
+            fprintf(stderr, "RUN: %s missing required geometry at line %d.\n", is_rect ? "_TERM_RECT" : "_TERM_PIXEL", line);
+            return TASK_TERM_BUILTIN_ERROR;
         }
-        if (in_sq || in_dq) {
-            // Unmatched quotes: close them implicitly
-            // (Alternative: error out. Here we just proceed.)
+
+        uint8_t rr = 0;
+        uint8_t gg = 0;
+        uint8_t bb = 0;
+        if (!task_term_resolve_color(color, r, g, b, &rr, &gg, &bb, line)) {
+            return TASK_TERM_BUILTIN_ERROR;
         }
-        if (ti + 1 >= tcap) { tcap += 1; token = (char*)realloc(token, tcap); if (!token) { perror("realloc"); exit(EXIT_FAILURE); } }
-        token[ti] = '\0';
 
-        if (argc == cap) {
-            cap = cap ? cap * 2 : 8;
-            char **newv = (char**)realloc(argv, (size_t)(cap + 1) * sizeof(char *));
-            if (!newv) { perror("realloc"); exit(EXIT_FAILURE); }
-            argv = newv;
+        if (debug) {
+            fprintf(stderr, "RUN: accelerated %s\n", is_rect ? "_TERM_RECT" : "_TERM_PIXEL");
         }
-        argv[argc++] = token;
+        if (is_rect) {
+            return termgfx_rect(x, y, width, height, rr, gg, bb, layer) == 0 ? TASK_TERM_BUILTIN_HANDLED : TASK_TERM_BUILTIN_ERROR;
+        }
+        return termgfx_pixel(x, y, rr, gg, bb, layer) == 0 ? TASK_TERM_BUILTIN_HANDLED : TASK_TERM_BUILTIN_ERROR;
     }
 
-    if (!argv) {
-        argv = (char**)malloc(2 * sizeof(char *));
-        if (!argv) { perror("malloc"); exit(EXIT_FAILURE); }
-        argv[0] = NULL;
-        if (out_argc) *out_argc = 0;
-        return argv;
-    }
-    argv[argc] = NULL;
-    if (out_argc) *out_argc = argc;
-    return argv;
+    return TASK_TERM_BUILTIN_NOT_HANDLED;
 }
 
-static void free_argv(char **argv) {
-    if (!argv) return;
-    for (char **p = argv; *p; ++p) free(*p);
-    free(argv);
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    if (!*s) return s;
+    char *e = s + strlen(s) - 1;
+    while (e > s && isspace((unsigned char)*e)) e--;
+    e[1] = '\0';
+    return s;
 }
 
-static bool sys_line_is_plain_cd(const char *cmdline) {
-    if (!cmdline) {
-        return false;
-    }
-
-    while (isspace((unsigned char)*cmdline)) {
-        cmdline++;
-    }
-
-    if (cmdline[0] != 'c' || cmdline[1] != 'd') {
-        return false;
-    }
-    if (cmdline[2] != '\0' && !isspace((unsigned char)cmdline[2])) {
-        return false;
-    }
+static int brace_balance_delta(const char *s) {
+    bool in_string = false;
+    bool escape = false;
+    int delta = 0;
 
-    bool in_sq = false;
-    bool in_dq = false;
-    bool escaped = false;
-    for (const char *p = cmdline + 2; *p; ++p) {
-        if (escaped) {
-            escaped = false;
+    for (; *s; ++s) {
+        if (escape) {
+            escape = false;
             continue;
         }
-        if (!in_sq && *p == '\\') {
-            escaped = true;
+        if (*s == '\\') {
+            escape = true;
             continue;
         }
-        if (!in_dq && *p == '\'') {
-            in_sq = !in_sq;
+        if (*s == '"') {
+            in_string = !in_string;
             continue;
         }
-        if (!in_sq && *p == '"') {
-            in_dq = !in_dq;
+        if (in_string) {
             continue;
         }
-        if (!in_sq && !in_dq && strchr(";&|<>()`", *p)) {
-            return false;
+        if (*s == '{') {
+            delta++;
+        } else if (*s == '}') {
+            delta--;
         }
     }
 
-    return true;
+    return delta;
 }
 
-static bool handle_sys_cd_command(const char *cmdline, int line, int debug) {
-    if (!sys_line_is_plain_cd(cmdline)) {
-        return false;
+static void delay_ms(int ms) {
+    int elapsed = 0;
+    while (elapsed < ms && !stop) {
+        int slice = (ms - elapsed > 50) ? 50 : (ms - elapsed);
+        struct timespec ts = { .tv_sec = slice / 1000, .tv_nsec = (slice % 1000) * 1000000L };
+        thrd_sleep(&ts, NULL);
+        elapsed += slice;
     }
+}
 
-    int argc = 0;
-    char **argv = split_args_heap(cmdline, &argc);
-    if (argc <= 0 || strcmp(argv[0], "cd") != 0) {
-        free_argv(argv);
-        return false;
-    }
+typedef enum {
+    LINE_COMMAND = 0,
+    LINE_LABEL,
+    LINE_FUNCTION
+} LineType;
 
-    if (argc > 2) {
-        fprintf(stderr, "SYS: cd accepts at most one path at line %d\n", line);
-        free_argv(argv);
-        return true;
-    }
+#define SCRIPT_TEXT_MAX 8192 // longest logical line after joining braces
 
-    char old_cwd[PATH_MAX];
-    if (!getcwd(old_cwd, sizeof(old_cwd))) {
-        old_cwd[0] = '\0';
-    }
+typedef struct {
+    int source_line;   // original file line number for diagnostics
+    LineType type;
+    int indent;        // leading whitespace count for block handling
+    size_t text_offset; // into TaskScript.text
+    char *text;        // set by finish_task_script() once loading is done
+} ScriptLine;
 
-    const char *target = NULL;
-    if (argc == 1) {
-        target = getenv("HOME");
-        if (!target || !*target) {
-            target = ".";
-        }
-    } else if (strcmp(argv[1], "-") == 0) {
-        target = getenv("OLDPWD");
-        if (!target || !*target) {
-            fprintf(stderr, "SYS: OLDPWD is not set at line %d\n", line);
-            free_argv(argv);
-            return true;
-        }
-    } else {
-        target = argv[1];
-    }
-
-    if (chdir(target) != 0) {
-        fprintf(stderr, "SYS: cd failed for '%s' at line %d: %s\n", target, line, strerror(errno));
-        free_argv(argv);
-        return true;
-    }
-
-    char new_cwd[PATH_MAX];
-    if (getcwd(new_cwd, sizeof(new_cwd))) {
-        cache_task_workdir(new_cwd);
-        if (old_cwd[0] != '\0') {
-            if (setenv("OLDPWD", old_cwd, 1) != 0) {
-                perror("SYS: setenv OLDPWD");
-            }
-        }
-        if (setenv("PWD", new_cwd, 1) != 0) {
-            perror("SYS: setenv PWD");
-        }
-        if (debug) {
-            fprintf(stderr, "SYS: cwd changed to %s\n", new_cwd);
-        }
-    } else {
-        perror("SYS: getcwd");
-        cache_task_workdir(target);
-    }
+/* Line texts are packed back to back into one arena while the task and its
+   includes load; lines keep offsets because the arena moves as it grows. */
+typedef struct {
+    ScriptLine *lines;
+    int count;
+    size_t line_cap;
+    char *text;
+    size_t text_len;
+    size_t text_cap;
+} TaskScript;
 
-    free_argv(argv);
-    return true;
-}
+typedef struct {
+    char name[64];
+    int index;        // index into script array
+} Label;
 
-static void run_sys_command(const char *cmdline, int line, int debug) {
-    if (!cmdline || !*cmdline) {
-        if (debug) {
-            fprintf(stderr, "SYS: missing command at line %d\n", line);
-        }
-        return;
-    }
+typedef struct {
+    char name[64];
+    int definition_pc;   // index where FUNCTION line is located
+    int start_pc;        // first executable line inside function
+    int end_pc;          // first line after the function block
+    int indent;          // indent level of the definition line
+    int param_count;
+    char params[MAX_FUNCTION_PARAMS][sizeof(((Variable *)0)->name)];
+    int param_ids[MAX_FUNCTION_PARAMS];
+} FunctionDef;
 
-    ensure_task_workdir();
+typedef struct {
+    int return_ip;
+    bool has_return_target;
+    int return_target;       // name id
+    bool has_return_value;
+    Value return_value;
+    int function_index;
+    int previous_function_index;
+} CallFrame;
 
-    if (handle_sys_cd_command(cmdline, line, debug)) {
+static void normalize_label_name(const char *input, char *output, size_t size) {
+    if (!input || !output || size == 0) {
         return;
     }
-
-    if (debug) {
-        fprintf(stderr, "SYS: /bin/sh -c %s\n", cmdline);
+    size_t i = 0;
+    for (; input[i] && i + 1 < size; ++i) {
+        output[i] = (char)toupper((unsigned char)input[i]);
     }
+    output[i] = '\0';
+}
 
-    int status = system(cmdline);
-    if (status == -1) {
-        perror("SYS: system");
-        return;
+static int find_label_index(const Label *labels, int label_count, const char *name) {
+    if (!labels || !name) {
+        return -1;
     }
-
-    if (debug) {
-        if (WIFEXITED(status)) {
-            fprintf(stderr, "SYS: exited with %d\n", WEXITSTATUS(status));
-        } else if (WIFSIGNALED(status)) {
-            fprintf(stderr, "SYS: killed by signal %d\n", WTERMSIG(status));
+    for (int i = 0; i < label_count; ++i) {
+        if (equals_ignore_case(labels[i].name, name)) {
+            return i;
         }
     }
+    return -1;
 }
 
-typedef struct {
-    const char *cursor;
-} InlineMathParser;
-
-static void inline_math_skip_ws(InlineMathParser *parser) {
-    if (!parser) {
-        return;
+static int find_function_index(const FunctionDef *functions, int function_count, const char *name) {
+    if (!functions || !name) {
+        return -1;
     }
-    while (parser->cursor && isspace((unsigned char)*parser->cursor)) {
-        parser->cursor++;
+    for (int i = 0; i < function_count; ++i) {
+        if (equals_ignore_case(functions[i].name, name)) {
+            return i;
+        }
     }
+    return -1;
 }
 
-static bool inline_math_parse_expression(InlineMathParser *parser, double *out);
-
-static bool inline_math_parse_number(InlineMathParser *parser, double *out) {
-    if (!parser || !out) {
+static bool parse_function_definition(const char *line, FunctionDef *out) {
+    if (!line || !out) {
         return false;
     }
-    inline_math_skip_ws(parser);
-    if (!parser->cursor) {
+    const char *cursor = line;
+    if (!match_keyword(cursor, "FUNCTION", &cursor)) {
         return false;
     }
-    errno = 0;
-    char *endptr = NULL;
-    double value = strtod(parser->cursor, &endptr);
-    if (errno != 0 || endptr == parser->cursor) {
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    const char *name_start = cursor;
+    while (*cursor && (isalnum((unsigned char)*cursor) || *cursor == '_')) {
+        cursor++;
+    }
+    size_t name_len = (size_t)(cursor - name_start);
+    if (name_len == 0 || name_len >= sizeof(out->name)) {
         return false;
     }
-    parser->cursor = endptr;
-    *out = value;
-    return true;
-}
+    memcpy(out->name, name_start, name_len);
+    out->name[name_len] = '\0';
 
-static bool inline_math_parse_factor(InlineMathParser *parser, double *out) {
-    if (!parser || !out) {
-        return false;
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
     }
-    inline_math_skip_ws(parser);
-    if (!parser->cursor) {
+    if (*cursor != '(') {
         return false;
     }
-    char ch = *parser->cursor;
-    if (ch == '+') {
-        parser->cursor++;
-        return inline_math_parse_factor(parser, out);
-    }
-    if (ch == '-') {
-        parser->cursor++;
-        if (!inline_math_parse_factor(parser, out)) {
-            return false;
+    cursor++;
+
+    out->param_count = 0;
+    while (1) {
+        while (isspace((unsigned char)*cursor)) {
+            cursor++;
         }
-        *out = -*out;
-        return true;
-    }
-    if (ch == '(') {
-        parser->cursor++;
-        if (!inline_math_parse_expression(parser, out)) {
-            return false;
+        if (*cursor == ')') {
+            cursor++;
+            break;
         }
-        inline_math_skip_ws(parser);
-        if (*parser->cursor != ')') {
+        if (out->param_count >= MAX_FUNCTION_PARAMS) {
             return false;
         }
-        parser->cursor++;
-        return true;
-    }
-    return inline_math_parse_number(parser, out);
-}
-
-static bool inline_math_parse_term(InlineMathParser *parser, double *out) {
-    if (!inline_math_parse_factor(parser, out)) {
-        return false;
-    }
-    while (1) {
-        inline_math_skip_ws(parser);
-        char op = *parser->cursor;
-        if (op != '*' && op != '/') {
-            break;
+        const char *param_start = cursor;
+        while (*cursor && *cursor != ',' && *cursor != ')') {
+            cursor++;
         }
-        parser->cursor++;
-        double rhs = 0.0;
-        if (!inline_math_parse_factor(parser, &rhs)) {
+        size_t param_len = (size_t)(cursor - param_start);
+        if (param_len == 0 || param_len >= sizeof(out->params[0])) {
             return false;
         }
-        if (op == '*') {
-            *out *= rhs;
-        } else {
-            if (rhs == 0.0) {
-                return false;
-            }
-            *out /= rhs;
+        char token[sizeof(out->params[0])];
+        memcpy(token, param_start, param_len);
+        token[param_len] = '\0';
+        char name_buf[sizeof(out->params[0])];
+        if (!parse_variable_name_token(token, name_buf, sizeof(name_buf))) {
+            return false;
         }
-    }
-    return true;
-}
+        snprintf(out->params[out->param_count], sizeof(out->params[0]), "%s", name_buf);
+        out->param_ids[out->param_count] = lookup_variable_name(name_buf, true);
+        out->param_count++;
 
-static bool inline_math_parse_expression(InlineMathParser *parser, double *out) {
-    if (!inline_math_parse_term(parser, out)) {
-        return false;
-    }
-    while (1) {
-        inline_math_skip_ws(parser);
-        char op = *parser->cursor;
-        if (op != '+' && op != '-') {
-            break;
+        while (isspace((unsigned char)*cursor)) {
+            cursor++;
         }
-        parser->cursor++;
-        double rhs = 0.0;
-        if (!inline_math_parse_term(parser, &rhs)) {
-            return false;
+        if (*cursor == ',') {
+            cursor++;
+            continue;
         }
-        if (op == '+') {
-            *out += rhs;
-        } else {
-            *out -= rhs;
+        if (*cursor == ')') {
+            cursor++;
+            break;
         }
+        return false;
     }
-    return true;
-}
 
-static bool inline_math_evaluate(const char *text, double *out) {
-    if (!text || !out) {
-        return false;
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
     }
-    InlineMathParser parser = { .cursor = text };
-    if (!inline_math_parse_expression(&parser, out)) {
+    if (*cursor != ':') {
         return false;
     }
-    inline_math_skip_ws(&parser);
-    return *parser.cursor == '\0';
+    cursor++;
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    return *cursor == '\0';
 }
 
-static bool looks_like_math_expression(const char *token) {
-    if (!token || !*token) {
+static size_t append_script_text(TaskScript *script, const char *text) {
+    size_t len = strlen(text) + 1;
+    script->text = (char *)grow_buffer(script->text, &script->text_cap, script->text_len + len, 1);
+    size_t offset = script->text_len;
+    memcpy(script->text + offset, text, len);
+    script->text_len += len;
+    return offset;
+}
+
+static void finish_task_script(TaskScript *script) {
+    for (int i = 0; i < script->count; ++i) {
+        script->lines[i].text = script->text + script->lines[i].text_offset;
+    }
+}
+
+static void free_task_script(TaskScript *script) {
+    free(script->lines);
+    free(script->text);
+    memset(script, 0, sizeof(*script));
+}
+
+static bool record_script_line(size_t text_offset, int indent, int source_line, TaskScript *script, Label *labels, int *label_count, FunctionDef **functions, int *function_count, size_t *function_cap) {
+    if (!script || !labels || !label_count || !functions || !function_count || !function_cap) {
         return false;
     }
-    bool has_digit = false;
-    bool has_operator = false;
-    for (const char *p = token; *p; ++p) {
-        unsigned char ch = (unsigned char)*p;
-        if (isdigit(ch)) {
-            has_digit = true;
-            continue;
+
+    const char *line = script->text + text_offset;
+    script->lines = (ScriptLine *)grow_buffer(script->lines, &script->line_cap, (size_t)script->count + 1, sizeof(ScriptLine));
+    int pc = script->count;
+    ScriptLine *entry = &script->lines[pc];
+    entry->source_line = source_line;
+    entry->indent = indent;
+    entry->text_offset = text_offset;
+    entry->text = NULL;
+
+    FunctionDef def_tmp;
+    bool is_function = parse_function_definition(line, &def_tmp);
+    if (is_function) {
+        entry->type = LINE_FUNCTION;
+
+        def_tmp.definition_pc = pc;
+        def_tmp.start_pc = pc + 1;
+        def_tmp.end_pc = -1;
+        def_tmp.indent = indent;
+
+        int existing = find_function_index(*functions, *function_count, def_tmp.name);
+        if (existing >= 0) {
+            (*functions)[existing] = def_tmp;
+        } else {
+            *functions = (FunctionDef *)grow_buffer(*functions, function_cap, (size_t)*function_count + 1, sizeof(FunctionDef));
+            (*functions)[*function_count] = def_tmp;
+            (*function_count)++;
         }
-        if (ch == '+' || ch == '-' || ch == '*' || ch == '/') {
-            has_operator = true;
-            continue;
+
+        script->count++;
+        return true;
+    }
+
+    if (*line == '@') {
+        char label_name[64];
+        if (!parse_label_definition(line, label_name, sizeof(label_name))) {
+            fprintf(stderr, "Error: invalid label definition at line %d: %s\n", source_line, line);
+            return false;
         }
-        if (ch == '.' || ch == '(' || ch == ')' || isspace(ch)) {
-            continue;
+        entry->type = LINE_LABEL;
+
+        char normalized[64];
+        normalize_label_name(label_name, normalized, sizeof(normalized));
+        int existing = find_label_index(labels, *label_count, normalized);
+        if (existing >= 0) {
+            labels[existing].index = pc;
+        } else {
+            if (*label_count >= MAX_LABELS) {
+                fprintf(stderr, "Error: too many labels (max %d)\n", MAX_LABELS);
+            } else {
+                snprintf(labels[*label_count].name, sizeof(labels[*label_count].name), "%s", normalized);
+                labels[*label_count].index = pc;
+                (*label_count)++;
+            }
         }
-        return false;
+        script->count++;
+        return true;
     }
-    return has_digit && has_operator;
+
+    entry->type = LINE_COMMAND;
+    script->count++;
+    return true;
 }
 
-static char *try_evaluate_math_token(const char *token) {
-    if (!looks_like_math_expression(token)) {
-        return NULL;
+static void apply_return_value(const CallFrame *frame) {
+    if (!frame || !frame->has_return_target) {
+        return;
     }
-    double value = 0.0;
-    if (!inline_math_evaluate(token, &value)) {
-        return NULL;
+    Value tmp;
+    memset(&tmp, 0, sizeof(tmp));
+    if (frame->has_return_value) {
+        copy_value(&tmp, &frame->return_value);
+    } else {
+        tmp.type = VALUE_UNSET;
     }
-    double integral_part = 0.0;
-    double fractional = modf(value, &integral_part);
-    if (fabs(fractional) < 1e-9 && integral_part >= (double)LLONG_MIN && integral_part <= (double)LLONG_MAX) {
-        char buf[64];
-        snprintf(buf, sizeof(buf), "%lld", (long long)integral_part);
-        return xstrdup(buf);
+    Variable *dest = find_variable_id(frame->return_target, true);
+    if (dest) {
+        assign_variable(dest, &tmp);
     }
-    char buf[64];
-    snprintf(buf, sizeof(buf), "%.15g", value);
-    return xstrdup(buf);
+    free_value(&tmp);
 }
 
-static void append_chunk(char **buffer, size_t *length, size_t *capacity, const char *chunk, size_t chunk_len) {
-    if (!chunk || chunk_len == 0) {
-        return;
+static bool parse_label_definition(const char *line, char *out_name, size_t name_size) {
+    if (!line) {
+        return false;
     }
-
-    size_t needed = *length + chunk_len + 1;
-    if (*capacity < needed) {
-        size_t new_cap = (*capacity == 0) ? needed : *capacity;
-        while (new_cap < needed) {
-            if (new_cap > SIZE_MAX / 2) {
-                new_cap = needed;
-                break;
-            }
-            new_cap *= 2;
-        }
-        char *tmp = (char *)realloc(*buffer, new_cap);
-        if (!tmp) {
-            perror("realloc");
-            free(*buffer);
-            exit(EXIT_FAILURE);
+    const char *cursor = line;
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor != '@') {
+        return false;
+    }
+    cursor++;
+    size_t len = 0;
+    while (*cursor && !isspace((unsigned char)*cursor) && *cursor != ':') {
+        if (len + 1 >= name_size) {
+            return false;
         }
-        *buffer = tmp;
-        *capacity = new_cap;
+        out_name[len++] = *cursor++;
     }
-    memcpy(*buffer + *length, chunk, chunk_len);
-    *length += chunk_len;
-    (*buffer)[*length] = '\0';
+    if (len == 0) {
+        return false;
+    }
+    out_name[len] = '\0';
+    if (*cursor == ':') {
+        cursor++;
+    }
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor != '\0') {
+        return false;
+    }
+    return true;
 }
 
-static void expand_argv_variables(char **argv, int argc, int line, int debug) {
-    if (!argv) {
-        return;
+static bool load_task_file(const char *task_path, const char *task_dir, TaskScript *script, Label *labels, int *label_count, FunctionDef **functions, int *function_count, size_t *function_cap, int depth, int debug) {
+    // Held back until the file's includes are loaded; text is already in the arena.
+    typedef struct {
+        size_t text_offset;
+        int indent;
+        int source_line;
+    } PendingLine;
+
+    typedef struct {
+        char path[PATH_MAX];
+        int source_line;
+    } IncludeRequest;
+
+    if (!task_path || !script || !labels || !label_count || !functions || !function_count || !function_cap) {
+        return false;
     }
-    for (int i = 0; i < argc; ++i) {
-        char *token = argv[i];
-        if (!token) {
-            continue;
-        }
-        if (!strchr(token, '$')) {
-            continue;
+
+    (void)debug;
+
+    if (depth >= MAX_INCLUDE_DEPTH) {
+        fprintf(stderr, "Error: include nesting too deep at '%s'\n", task_path);
+        return false;
+    }
+
+    FILE *fp = fopen(task_path, "r");
+    if (!fp) {
+        fprintf(stderr, "Error: Could not open task file '%s'\n", task_path);
+        return false;
+    }
+
+    char dirbuf[PATH_MAX];
+    const char *base_dir = task_dir;
+    if (!base_dir || !*base_dir) {
+        if (task_dirname(task_path, dirbuf, sizeof(dirbuf)) == 0) {
+            base_dir = dirbuf;
+        } else {
+            base_dir = ".";
         }
+    }
 
-        char *result = NULL;
-        size_t res_len = 0;
-        size_t res_cap = 0;
-        const char *cursor = token;
-        bool substituted = false;
+    PendingLine *pending_lines = NULL;
+    size_t pending_cap = 0;
+    IncludeRequest includes[MAX_INCLUDES_PER_FILE];
+    int include_count = 0;
+    int pending_count = 0;
 
-        while (*cursor) {
-            const char *dollar = strchr(cursor, '$');
-            if (!dollar) {
-                append_chunk(&result, &res_len, &res_cap, cursor, strlen(cursor));
-                break;
-            }
+    char linebuf[256];
+    char combined[SCRIPT_TEXT_MAX];
+    int brace_balance = 0;
+    bool combining = false;
+    int pending_indent = 0;
+    int pending_source_line = 0;
+    int file_line = 0;
 
-            append_chunk(&result, &res_len, &res_cap, cursor, (size_t)(dollar - cursor));
+    while (fgets(linebuf, sizeof(linebuf), fp)) {
+        file_line++;
+        char *line = trim(linebuf);
+        int indent = (int)(line - linebuf);
+        if (indent < 0) {
+            indent = 0;
+        }
+        if (!*line) {
+            continue;
+        }
 
-            const char *scan = dollar + 1;
-            if (*scan == '\0') {
-                append_chunk(&result, &res_len, &res_cap, "$", 1);
-                cursor = scan;
+        if (!combining) {
+            snprintf(combined, sizeof(combined), "%s", line);
+            brace_balance = brace_balance_delta(combined);
+            combining = (brace_balance > 0);
+            pending_indent = indent;
+            pending_source_line = file_line;
+            if (combining) {
                 continue;
             }
-
-            if (!isalnum((unsigned char)*scan) && *scan != '_') {
-                append_chunk(&result, &res_len, &res_cap, "$", 1);
-                cursor = scan;
+        } else {
+            size_t cur_len = strlen(combined);
+            size_t add_len = strlen(line);
+            if (cur_len + 1 + add_len >= sizeof(combined)) {
+                fprintf(stderr, "Error: combined line too long near source line %d\n", pending_source_line);
                 continue;
             }
-
-            while (isalnum((unsigned char)*scan) || *scan == '_') {
-                scan++;
+            combined[cur_len] = ' ';
+            memcpy(combined + cur_len + 1, line, add_len + 1);
+            brace_balance += brace_balance_delta(line);
+            if (brace_balance > 0) {
+                continue;
             }
+            combining = false;
+            indent = pending_indent;
+            line = combined;
+        }
 
-            while (*scan == '[') {
-                const char *closing = strchr(scan + 1, ']');
-                if (!closing) {
-                    if (debug) {
-                        fprintf(stderr, "RUN: missing closing ']' in '%s' at line %d\n", token, line);
-                    }
-                    append_chunk(&result, &res_len, &res_cap, "$", 1);
-                    cursor = scan + 1;
-                    continue;
-                }
-                scan = closing + 1;
-            }
+        int effective_line = pending_source_line ? pending_source_line : file_line;
 
-            size_t ref_len = (size_t)(scan - dollar);
-            char *ref_token = (char *)malloc(ref_len + 1);
-            if (!ref_token) {
-                perror("malloc");
-                free(result);
-                exit(EXIT_FAILURE);
-            }
-            memcpy(ref_token, dollar, ref_len);
-            ref_token[ref_len] = '\0';
+        if (brace_balance < 0) {
+            fprintf(stderr, "Error: unmatched closing brace at line %d\n", file_line);
+            brace_balance = 0;
+            combining = false;
+            continue;
+        }
 
-            VariableRef ref;
-            if (!parse_variable_reference_token(ref_token, &ref, line, debug)) {
-                if (debug) {
-                    fprintf(stderr, "RUN: invalid variable reference '%s' at line %d\n", ref_token, line);
-                }
-                free(ref_token);
-                append_chunk(&result, &res_len, &res_cap, "$", 1);
-                cursor = dollar + 1;
+        if (strncmp(line, "INCLUDE", 7) == 0 && (line[7] == '\0' || isspace((unsigned char)line[7]))) {
+            const char *after = line + 7;
+            while (isspace((unsigned char)*after)) {
+                after++;
+            }
+            char *include_target = NULL;
+            const char *cursor = after;
+            if (!parse_string_literal(&cursor, &include_target)) {
+                fprintf(stderr, "Error: invalid INCLUDE path at line %d\n", effective_line);
                 continue;
             }
-            free(ref_token);
-
-            Value value;
-            memset(&value, 0, sizeof(value));
-            if (!resolve_variable_reference(&ref, &value, line, debug)) {
-                if (debug) {
-                    fprintf(stderr, "RUN: undefined variable '%s' at line %d\n", ref.name, line);
-                }
-                value.type = VALUE_UNSET;
+            while (isspace((unsigned char)*cursor)) {
+                cursor++;
             }
-
-            char *replacement = value_to_string(&value);
-            if (!replacement) {
-                replacement = xstrdup("");
+            if (*cursor != '\0') {
+                fprintf(stderr, "Error: unexpected characters after INCLUDE path at line %d\n", effective_line);
+                free(include_target);
+                continue;
             }
-            append_chunk(&result, &res_len, &res_cap, replacement, strlen(replacement));
-            free(replacement);
-            substituted = true;
-            cursor = scan;
-        }
 
-        if (substituted) {
-            if (!result) {
-                result = xstrdup("");
+            char resolved[PATH_MAX];
+            if (resolve_task_path(include_target, base_dir, resolved, sizeof(resolved)) != 0) {
+                fprintf(stderr, "Error: could not resolve INCLUDE '%s' at line %d\n", include_target, effective_line);
+                free(include_target);
+                continue;
             }
-            free(argv[i]);
-            argv[i] = result;
-            char *evaluated = try_evaluate_math_token(argv[i]);
-            if (evaluated) {
-                free(argv[i]);
-                argv[i] = evaluated;
+            free(include_target);
+
+            if (include_count >= MAX_INCLUDES_PER_FILE) {
+                fprintf(stderr, "Error: too many INCLUDE directives in '%s' (max %d)\n", task_path, MAX_INCLUDES_PER_FILE);
+                continue;
             }
-        } else {
-            free(result);
+
+            snprintf(includes[include_count].path, sizeof(includes[include_count].path), "%s", resolved);
+            includes[include_count].source_line = effective_line;
+            include_count++;
+            continue;
         }
+
+        pending_lines = (PendingLine *)grow_buffer(pending_lines, &pending_cap, (size_t)pending_count + 1, sizeof(PendingLine));
+        pending_lines[pending_count].source_line = effective_line;
+        pending_lines[pending_count].indent = indent;
+        pending_lines[pending_count].text_offset = append_script_text(script, line);
+        pending_count++;
     }
-}
 
-/* Resolve executable path:
-   - If argv0 contains '/', use as-is.
-   - Else try "apps/argv0", then "commands/argv0", then "utilities/argv0".
-   - If found and executable, write into resolved (size bytes) and return 0; else -1.
-*/
-static int resolve_exec_path(const char *argv0, char *resolved, size_t size) {
-    if (!argv0 || !*argv0) return -1;
+    fclose(fp);
 
-    if (strchr(argv0, '/')) {
-        // explicit relative/absolute path
-        if (build_from_base(argv0, resolved, size) != 0) return -1;
-        if (access(resolved, X_OK) != 0) return -1;
-        return 0;
+    for (int i = 0; i < include_count; ++i) {
+        char include_dir[PATH_MAX];
+        const char *include_base = base_dir;
+        if (task_dirname(includes[i].path, include_dir, sizeof(include_dir)) == 0) {
+            include_base = include_dir;
+        }
+        if (!load_task_file(includes[i].path, include_base, script, labels, label_count, functions, function_count, function_cap, depth + 1, debug)) {
+            free(pending_lines);
+            return false;
+        }
     }
 
-    const char *dirs[] = { "apps", "commands", "utilities" };
-    for (size_t i = 0; i < sizeof(dirs)/sizeof(dirs[0]); ++i) {
-        char candidate[PATH_MAX];
-        if (snprintf(candidate, sizeof(candidate), "%s/%s", dirs[i], argv0) >= (int)sizeof(candidate))
-            continue;
-        if (build_from_base(candidate, resolved, size) != 0)
-            continue;
-        if (access(resolved, X_OK) == 0) {
-            return 0;
+    for (int i = 0; i < pending_count; ++i) {
+        if (!record_script_line(pending_lines[i].text_offset, pending_lines[i].indent, pending_lines[i].source_line, script, labels, label_count, functions, function_count, function_cap)) {
+            free(pending_lines);
+            return false;
         }
     }
-    return -1;
+
+    free(pending_lines);
+    return true;
 }
 
-int main(int argc, char *argv[]) {
-    signal(SIGINT, sigint_handler);
+/* Portable strdup replacement to stay ISO C compliant under -std=c11 -pedantic */
+static char *xstrdup(const char *s) {
+    size_t len = strlen(s) + 1;
+    char *p = (char*)malloc(len);
+    if (!p) { perror("malloc"); exit(EXIT_FAILURE); }
+    memcpy(p, s, len);
+    return p;
+}
 
-    atexit(restore_terminal_settings);
+/* --- Heap-based argv tokenizer supporting quotes and backslash escapes ---
+   - Splits by whitespace.
+   - Supports "double quoted" and 'single quoted' args.
+   - Supports backslash escapes inside double quotes and unquoted text.
+   - Returns a NULL-terminated argv array; *out_argc has argc.
+   - Caller must free with free_argv().
+*/
+static char **split_args_heap(const char *cmdline, int *out_argc) {
+    char **argv = NULL;
+    int argc = 0, cap = 0;
 
-    set_initial_argv0((argc > 0) ? argv[0] : NULL);
-    init_scopes();
-    init_static_scopes();
-    current_function_index = -1;
+    const char *p = cmdline;
+    while (*p) {
+        // skip leading spaces
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p) break;
 
-    // Initialize base directory cache for resolving bundled executables.
-    (void)get_base_dir();
+        bool in_sq = false, in_dq = false;
+        // grow token buffer dynamically to avoid truncation
+        size_t tcap = 64, ti = 0;
+        char *token = (char*)malloc(tcap);
+        if (!token) { perror("malloc"); exit(EXIT_FAILURE); }
 
-    if (argc >= 2 && strcmp(argv[1], "-help") == 0) {
-        print_help();
-        return 0;
-    }
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s taskfile [-d]\n", argv[0]);
-        return 1;
-    }
-    int debug = 0;
-    for (int i = 2; i < argc; i++) {
-        if (strcmp(argv[i], "-d") == 0) { debug = 1; break; }
-    }
+        while (*p) {
+            if (!in_dq && *p == '\'') { in_sq = !in_sq; p++; continue; }
+            if (!in_sq && *p == '"')  { in_dq = !in_dq; p++; continue; }
+            if (!in_sq && *p == '\\') {
+                p++;
+                if (*p) {
+                    if (ti + 1 >= tcap) { tcap *= 2; token = (char*)realloc(token, tcap); if (!token) { perror("realloc"); exit(EXIT_FAILURE); } }
+                    token[ti++] = *p++;
+                }
+                continue;
+            }
+            if (!in_sq && !in_dq && isspace((unsigned char)*p)) break;
 
-    char cwd[PATH_MAX];
-    if (!getcwd(cwd, sizeof(cwd))) {
-        perror("getcwd");
-        return 1;
-    }
+            if (ti + 1 >= tcap) { tcap *= 2; token = (char*)realloc(token, tcap); if (!token) { perror("realloc"); exit(EXIT_FAILURE); } }
+            token[ti++] = *p++;
+        }
+        if (in_sq || in_dq) {
+            // Unmatched quotes: close them implicitly
+            // (Alternative: error out. Here we just proceed.)
+        }
+        if (ti + 1 >= tcap) { tcap += 1; token = (char*)realloc(token, tcap); if (!token) { perror("realloc"); exit(EXIT_FAILURE); } }
+        token[ti] = '\0';
 
-    char task_path[PATH_MAX];
-    if (resolve_task_path(argv[1], cwd, task_path, sizeof(task_path)) != 0) {
-        fprintf(stderr, "Error: could not resolve task path for '%s'\n", argv[1]);
-        return 1;
+        if (argc == cap) {
+            cap = cap ? cap * 2 : 8;
+            char **newv = (char**)realloc(argv, (size_t)(cap + 1) * sizeof(char *));
+            if (!newv) { perror("realloc"); exit(EXIT_FAILURE); }
+            argv = newv;
+        }
+        argv[argc++] = token;
     }
 
-    char task_directory[PATH_MAX];
-    task_directory[0] = '\0';
-    if (task_dirname(task_path, task_directory, sizeof(task_directory)) == 0) {
-        if (chdir(task_directory) != 0) {
-            fprintf(stderr, "Warning: failed to change directory to '%s': %s\n", task_directory, strerror(errno));
-        } else {
-            char resolved_task_dir[PATH_MAX];
-            if (getcwd(resolved_task_dir, sizeof(resolved_task_dir))) {
-                cache_task_workdir(resolved_task_dir);
-            } else {
-                cache_task_workdir(task_directory);
-            }
-        }
+    if (!argv) {
+        argv = (char**)malloc(2 * sizeof(char *));
+        if (!argv) { perror("malloc"); exit(EXIT_FAILURE); }
+        argv[0] = NULL;
+        if (out_argc) *out_argc = 0;
+        return argv;
     }
+    argv[argc] = NULL;
+    if (out_argc) *out_argc = argc;
+    return argv;
+}
 
-    ScriptLine *script = (ScriptLine *)calloc(SCRIPT_MAX_LINES, sizeof(ScriptLine));
-    if (!script) {
-        perror("calloc");
-        return 1;
+static void free_argv(char **argv) {
+    if (!argv) return;
+    for (char **p = argv; *p; ++p) free(*p);
+    free(argv);
+}
+
+static bool sys_line_is_plain_cd(const char *cmdline) {
+    if (!cmdline) {
+        return false;
     }
-    Label labels[MAX_LABELS];
-    FunctionDef functions[MAX_FUNCTIONS];
-    memset(labels, 0, sizeof(labels));
-    memset(functions, 0, sizeof(functions));
-    int label_count = 0;
-    int function_count = 0;
-    int count = 0;
-    int script_cap = SCRIPT_MAX_LINES;
-    if (!load_task_file(task_path, task_directory, script, script_cap, &count, labels, &label_count, functions, &function_count, 0, debug)) {
-        free(script);
-        return 1;
+
+    while (isspace((unsigned char)*cmdline)) {
+        cmdline++;
     }
 
-    for (int i = 0; i < function_count; ++i) {
-        int end_pc = count;
-        int indent = functions[i].indent;
-        int start_pc = functions[i].start_pc;
-        if (start_pc < 0) {
-            start_pc = functions[i].definition_pc + 1;
-        }
-        for (int pc = start_pc; pc < count; ++pc) {
-            if (script[pc].indent <= indent && script[pc].type != LINE_LABEL) {
-                end_pc = pc;
-                break;
-            }
-        }
-        functions[i].start_pc = start_pc;
-        functions[i].end_pc = end_pc;
+    if (cmdline[0] != 'c' || cmdline[1] != 'd') {
+        return false;
+    }
+    if (cmdline[2] != '\0' && !isspace((unsigned char)cmdline[2])) {
+        return false;
     }
 
-    IfContext if_stack[64];
-    int if_sp = 0;
-    ForContext for_stack[64];
-    int for_sp = 0;
-    WhileContext while_stack[64];
-    int while_sp = 0;
-    CallFrame call_stack[16];
-    int call_sp = 0;
-    bool skipping_block = false;
-    int skip_indent = 0;
-    int skip_context_index = -1;
-    bool skip_for_true_branch = false;
-    bool skip_progress_pending = false;
-    bool skip_consumed_first = false;
-
-    // Run
-    for (int pc = 0; pc < count && !stop; pc++) {
-        if (debug) {
-            if (script[pc].type == LINE_LABEL) {
-                fprintf(stderr, "Encountered label at line %d: %s\n", script[pc].source_line, script[pc].text);
-            } else {
-                fprintf(stderr, "Executing line %d: %s\n", script[pc].source_line, script[pc].text);
-            }
-        }
-
-        char *command = script[pc].text;
-        bool pc_changed = false;
-
-        if (call_sp > 0) {
-            CallFrame *frame = &call_stack[call_sp - 1];
-            if (pc >= frame->function_end_pc) {
-                current_function_index = frame->previous_function_index;
-                pop_scope();
-                apply_return_value(frame);
-                if (frame->has_return_value) {
-                    free_value(&frame->return_value);
-                }
-                if_sp = frame->saved_if_sp;
-                for_sp = frame->saved_for_sp;
-                while_sp = frame->saved_while_sp;
-                skipping_block = frame->saved_skipping_block;
-                skip_indent = frame->saved_skip_indent;
-                skip_context_index = frame->saved_skip_context_index;
-                skip_for_true_branch = frame->saved_skip_for_true_branch;
-                skip_progress_pending = frame->saved_skip_progress_pending;
-                skip_consumed_first = frame->saved_skip_consumed_first;
-                call_sp--;
-                pc = frame->return_pc;
-                pc_changed = true;
-                continue;
-            }
+    bool in_sq = false;
+    bool in_dq = false;
+    bool escaped = false;
+    for (const char *p = cmdline + 2; *p; ++p) {
+        if (escaped) {
+            escaped = false;
+            continue;
         }
-
-        if (skipping_block) {
-            int current_indent = script[pc].indent;
-            if (script[pc].type == LINE_LABEL) {
-                if (current_indent > skip_indent) {
-                    continue;
-                }
-                if (skip_progress_pending) {
-                    finalize_skipped_branch(if_stack, &if_sp, skip_context_index, skip_for_true_branch);
-                    skip_progress_pending = false;
-                }
-                skipping_block = false;
-                skip_context_index = -1;
-                skip_for_true_branch = false;
-                skip_consumed_first = false;
-            } else if (command && current_indent <= skip_indent &&
-                       strncmp(command, "ELSE", 4) == 0 && (command[4] == '\0' || isspace((unsigned char)command[4]))) {
-                if (skip_progress_pending) {
-                    finalize_skipped_branch(if_stack, &if_sp, skip_context_index, skip_for_true_branch);
-                    skip_progress_pending = false;
-                }
-                skipping_block = false;
-                skip_context_index = -1;
-                skip_for_true_branch = false;
-                skip_consumed_first = false;
-            } else if (!skip_consumed_first) {
-                skip_consumed_first = true;
-                continue;
-            } else if (current_indent > skip_indent) {
-                continue;
-            } else {
-                if (skip_progress_pending) {
-                    finalize_skipped_branch(if_stack, &if_sp, skip_context_index, skip_for_true_branch);
-                    skip_progress_pending = false;
-                }
-                skipping_block = false;
-                skip_context_index = -1;
-                skip_for_true_branch = false;
-                skip_consumed_first = false;
-            }
+        if (!in_sq && *p == '\\') {
+            escaped = true;
+            continue;
         }
-
-        if (script[pc].type == LINE_FUNCTION) {
-            FunctionDef *fn = find_function_by_definition(functions, function_count, pc);
-            if (fn && fn->end_pc > pc) {
-                pc = fn->end_pc - 1;
-                pc_changed = true;
-            }
+        if (!in_dq && *p == '\'') {
+            in_sq = !in_sq;
             continue;
         }
-
-        if (script[pc].type == LINE_LABEL) {
+        if (!in_sq && *p == '"') {
+            in_dq = !in_dq;
             continue;
         }
-
-        if (if_sp > 0) {
-            IfContext *ctx = &if_stack[if_sp - 1];
-            if (!ctx->expects_end && ctx->true_branch_done && !ctx->else_encountered) {
-                if (!(strncmp(command, "ELSE", 4) == 0 && (command[4] == '\0' || isspace((unsigned char)command[4])))) {
-                    if_sp--;
-                }
-            }
+        if (!in_sq && !in_dq && strchr(";&|<>()`", *p)) {
+            return false;
         }
+    }
 
-        if (strncmp(command, "IF", 2) == 0 && (command[2] == '\0' || isspace((unsigned char)command[2]) || command[2] == '(')) {
-        const char *after_if = command + 2;
-        while (isspace((unsigned char)*after_if)) {
-            after_if++;
-        }
+    return true;
+}
 
-        const char *colon = strrchr(after_if, ':');
-        if (!colon) {
-            if (debug) fprintf(stderr, "IF: expected ':' before END-delimited block at %d\n", script[pc].source_line);
-            continue;
-        }
+static bool handle_sys_cd_command(const char *cmdline, int line, int debug) {
+    if (!sys_line_is_plain_cd(cmdline)) {
+        return false;
+    }
 
-        const char *cond_end = colon;
-        while (cond_end > after_if && isspace((unsigned char)*(cond_end - 1))) {
-            cond_end--;
-        }
+    int argc = 0;
+    char **argv = split_args_heap(cmdline, &argc);
+    if (argc <= 0 || strcmp(argv[0], "cd") != 0) {
+        free_argv(argv);
+        return false;
+    }
 
-        if (cond_end <= after_if) {
-            if (debug) fprintf(stderr, "IF: missing condition before ':' at %d\n", script[pc].source_line);
-            continue;
-        }
+    if (argc > 2) {
+        fprintf(stderr, "SYS: cd accepts at most one path at line %d\n", line);
+        free_argv(argv);
+        return true;
+    }
 
-        char cond_buf[256];
-        size_t cond_len = (size_t)(cond_end - after_if);
-        if (cond_len >= sizeof(cond_buf)) {
-            if (debug) fprintf(stderr, "IF: condition too long at %d\n", script[pc].source_line);
-            continue;
-        }
-        memcpy(cond_buf, after_if, cond_len);
-        cond_buf[cond_len] = '\0';
+    char old_cwd[PATH_MAX];
+    if (!getcwd(old_cwd, sizeof(old_cwd))) {
+        old_cwd[0] = '\0';
+    }
 
-        size_t start_off = 0;
-        size_t end_off = cond_len;
-        while (start_off < end_off && isspace((unsigned char)cond_buf[start_off])) {
-            start_off++;
-        }
-        while (end_off > start_off && isspace((unsigned char)cond_buf[end_off - 1])) {
-            end_off--;
-        }
-        while (end_off > start_off && cond_buf[start_off] == '(' && cond_buf[end_off - 1] == ')') {
-            start_off++;
-            end_off--;
-            while (start_off < end_off && isspace((unsigned char)cond_buf[start_off])) {
-                start_off++;
-            }
-            while (end_off > start_off && isspace((unsigned char)cond_buf[end_off - 1])) {
-                end_off--;
-            }
+    const char *target = NULL;
+    if (argc == 1) {
+        target = getenv("HOME");
+        if (!target || !*target) {
+            target = ".";
         }
-
-        if (start_off >= end_off) {
-            if (debug) fprintf(stderr, "IF: empty condition after trimming at %d\n", script[pc].source_line);
-            continue;
+    } else if (strcmp(argv[1], "-") == 0) {
+        target = getenv("OLDPWD");
+        if (!target || !*target) {
+            fprintf(stderr, "SYS: OLDPWD is not set at line %d\n", line);
+            free_argv(argv);
+            return true;
         }
+    } else {
+        target = argv[1];
+    }
 
-        memmove(cond_buf, cond_buf + start_off, end_off - start_off);
-        cond_buf[end_off - start_off] = '\0';
-
-        const char *cursor = cond_buf;
-        bool cond_result = false;
-        bool condition_parsed = false;
-        if (parse_boolean_literal(cond_buf, &cond_result, &cursor)) {
-            condition_parsed = true;
-        } else if (parse_condition(&cursor, &cond_result, script[pc].source_line, debug)) {
-            condition_parsed = true;
-        } else if (evaluate_truthy_expression(cond_buf, script[pc].source_line, debug, &cond_result)) {
-            condition_parsed = true;
-        }
+    if (chdir(target) != 0) {
+        fprintf(stderr, "SYS: cd failed for '%s' at line %d: %s\n", target, line, strerror(errno));
+        free_argv(argv);
+        return true;
+    }
 
-        if (condition_parsed) {
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
-            }
-            if (*cursor != '\0' && debug) {
-                fprintf(stderr, "IF: unexpected characters in condition at %d\n", script[pc].source_line);
+    char new_cwd[PATH_MAX];
+    if (getcwd(new_cwd, sizeof(new_cwd))) {
+        cache_task_workdir(new_cwd);
+        if (old_cwd[0] != '\0') {
+            if (setenv("OLDPWD", old_cwd, 1) != 0) {
+                perror("SYS: setenv OLDPWD");
             }
         }
-
-        const char *after_colon = colon + 1;
-        while (isspace((unsigned char)*after_colon)) {
-            after_colon++;
-        }
-        if (*after_colon != '\0' && debug) {
-            fprintf(stderr, "IF: unexpected characters after ':' at %d\n", script[pc].source_line);
+        if (setenv("PWD", new_cwd, 1) != 0) {
+            perror("SYS: setenv PWD");
         }
-            if (if_sp >= (int)(sizeof(if_stack) / sizeof(if_stack[0]))) {
-                if (debug) fprintf(stderr, "IF: nesting limit reached at line %d\n", script[pc].source_line);
-                continue;
-            }
-            IfContext ctx = { .result = cond_result, .true_branch_done = false, .else_encountered = false, .else_branch_done = false, .expects_end = true, .indent = script[pc].indent, .line_number = script[pc].source_line };
-            if_stack[if_sp++] = ctx;
-            if (!cond_result) {
-                skipping_block = true;
-                skip_indent = script[pc].indent;
-                skip_context_index = if_sp - 1;
-                skip_for_true_branch = true;
-                skip_progress_pending = true;
-                skip_consumed_first = false;
-            }
-            continue;
+        if (debug) {
+            fprintf(stderr, "SYS: cwd changed to %s\n", new_cwd);
         }
-        else if (strncmp(command, "WHILE", 5) == 0 && (command[5] == '\0' || isspace((unsigned char)command[5]) || command[5] == '(')) {
-            if (while_sp >= (int)(sizeof(while_stack) / sizeof(while_stack[0]))) {
-                if (debug) fprintf(stderr, "WHILE: nesting limit reached at line %d\n", script[pc].source_line);
-                continue;
-            }
-
-            const char *after_while = command + 5;
-            while (isspace((unsigned char)*after_while)) {
-                after_while++;
-            }
-
-            const char *colon = strrchr(after_while, ':');
-            if (!colon) {
-                if (debug) fprintf(stderr, "WHILE: expected ':' before END-delimited block at %d\n", script[pc].source_line);
-                continue;
-            }
-
-            const char *cond_end = colon;
-            while (cond_end > after_while && isspace((unsigned char)*(cond_end - 1))) {
-                cond_end--;
-            }
-
-            if (cond_end <= after_while) {
-                if (debug) fprintf(stderr, "WHILE: missing condition before ':' at %d\n", script[pc].source_line);
-                continue;
-            }
-
-            char cond_buf[256];
-            size_t cond_len = (size_t)(cond_end - after_while);
-            if (cond_len >= sizeof(cond_buf)) {
-                if (debug) fprintf(stderr, "WHILE: condition too long at %d\n", script[pc].source_line);
-                continue;
-            }
-            memcpy(cond_buf, after_while, cond_len);
-            cond_buf[cond_len] = '\0';
-
-            size_t start_off = 0;
-            size_t end_off = cond_len;
-            while (start_off < end_off && isspace((unsigned char)cond_buf[start_off])) {
-                start_off++;
-            }
-            while (end_off > start_off && isspace((unsigned char)cond_buf[end_off - 1])) {
-                end_off--;
-            }
-            while (end_off > start_off && cond_buf[start_off] == '(' && cond_buf[end_off - 1] == ')') {
-                start_off++;
-                end_off--;
-                while (start_off < end_off && isspace((unsigned char)cond_buf[start_off])) {
-                    start_off++;
-                }
-                while (end_off > start_off && isspace((unsigned char)cond_buf[end_off - 1])) {
-                    end_off--;
-                }
-            }
+    } else {
+        perror("SYS: getcwd");
+        cache_task_workdir(target);
+    }
 
-            if (start_off >= end_off) {
-                if (debug) fprintf(stderr, "WHILE: empty condition after trimming at %d\n", script[pc].source_line);
-                continue;
-            }
+    free_argv(argv);
+    return true;
+}
 
-            memmove(cond_buf, cond_buf + start_off, end_off - start_off);
-            cond_buf[end_off - start_off] = '\0';
+static void run_sys_command(const char *cmdline, int line, int debug) {
+    if (!cmdline || !*cmdline) {
+        if (debug) {
+            fprintf(stderr, "SYS: missing command at line %d\n", line);
+        }
+        return;
+    }
 
-            const char *cursor = cond_buf;
-            bool cond_result = false;
-            bool condition_parsed = false;
-            if (parse_boolean_literal(cond_buf, &cond_result, &cursor)) {
-                condition_parsed = true;
-            } else if (parse_condition(&cursor, &cond_result, script[pc].source_line, debug)) {
-                condition_parsed = true;
-            } else if (evaluate_truthy_expression(cond_buf, script[pc].source_line, debug, &cond_result)) {
-                condition_parsed = true;
-            }
+    ensure_task_workdir();
 
-            if (condition_parsed) {
-                while (isspace((unsigned char)*cursor)) {
-                    cursor++;
-                }
-                if (*cursor != '\0' && debug) {
-                    fprintf(stderr, "WHILE: unexpected characters in condition at %d\n", script[pc].source_line);
-                }
-            }
+    if (handle_sys_cd_command(cmdline, line, debug)) {
+        return;
+    }
 
-            const char *after_colon = colon + 1;
-            while (isspace((unsigned char)*after_colon)) {
-                after_colon++;
-            }
-            if (*after_colon != '\0' && debug) {
-                fprintf(stderr, "WHILE: unexpected characters after ':' at %d\n", script[pc].source_line);
-            }
+    if (debug) {
+        fprintf(stderr, "SYS: /bin/sh -c %s\n", cmdline);
+    }
 
-            if (!cond_result) {
-                skipping_block = true;
-                skip_indent = script[pc].indent;
-                skip_context_index = -1;
-                skip_for_true_branch = false;
-                skip_progress_pending = false;
-                skip_consumed_first = false;
-                note_branch_progress(if_stack, &if_sp);
-                continue;
-            }
+    int status = system(cmdline);
+    if (status == -1) {
+        perror("SYS: system");
+        return;
+    }
 
-            WhileContext wctx;
-            wctx.while_line_pc = pc;
-            wctx.body_start_pc = pc + 1;
-            wctx.indent = script[pc].indent;
-            snprintf(wctx.condition, sizeof(wctx.condition), "%s", cond_buf);
-            while_stack[while_sp++] = wctx;
-            note_branch_progress(if_stack, &if_sp);
+    if (debug) {
+        if (WIFEXITED(status)) {
+            fprintf(stderr, "SYS: exited with %d\n", WEXITSTATUS(status));
+        } else if (WIFSIGNALED(status)) {
+            fprintf(stderr, "SYS: killed by signal %d\n", WTERMSIG(status));
         }
-        else if (strncmp(command, "FOR", 3) == 0 && (command[3] == '\0' || isspace((unsigned char)command[3]))) {
-            if (for_sp >= (int)(sizeof(for_stack) / sizeof(for_stack[0]))) {
-                if (debug) fprintf(stderr, "FOR: nesting limit reached at line %d\n", script[pc].source_line);
-                continue;
-            }
-
-            const char *cursor = command + 3;
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
-            }
+    }
+}
 
-            const char *line_end = cursor + strlen(cursor);
-            while (line_end > cursor && isspace((unsigned char)*(line_end - 1))) {
-                line_end--;
-            }
+typedef struct {
+    const char *cursor;
+} InlineMathParser;
 
-            bool has_colon = false;
-            if (line_end > cursor && *(line_end - 1) == ':') {
-                has_colon = true;
-                line_end--;
-                while (line_end > cursor && isspace((unsigned char)*(line_end - 1))) {
-                    line_end--;
-                }
-            }
+static void inline_math_skip_ws(InlineMathParser *parser) {
+    if (!parser) {
+        return;
+    }
+    while (parser->cursor && isspace((unsigned char)*parser->cursor)) {
+        parser->cursor++;
+    }
+}
 
-            if (line_end == cursor) {
-                if (debug) fprintf(stderr, "FOR: expected loop body after header at line %d\n", script[pc].source_line);
-                continue;
-            }
+static bool inline_math_parse_expression(InlineMathParser *parser, double *out);
 
-            bool has_paren = false;
-            if (*cursor == '(') {
-                has_paren = true;
-                cursor++;
-            }
+static bool inline_math_parse_number(InlineMathParser *parser, double *out) {
+    if (!parser || !out) {
+        return false;
+    }
+    inline_math_skip_ws(parser);
+    if (!parser->cursor) {
+        return false;
+    }
+    errno = 0;
+    char *endptr = NULL;
+    double value = strtod(parser->cursor, &endptr);
+    if (errno != 0 || endptr == parser->cursor) {
+        return false;
+    }
+    parser->cursor = endptr;
+    *out = value;
+    return true;
+}
 
-            const char *first_semi = strchr(cursor, ';');
-            if (!first_semi) {
-                if (debug) fprintf(stderr, "FOR: missing first ';' at line %d\n", script[pc].source_line);
-                continue;
-            }
-            const char *second_semi = strchr(first_semi + 1, ';');
-            if (!second_semi) {
-                if (debug) fprintf(stderr, "FOR: missing second ';' at line %d\n", script[pc].source_line);
-                continue;
-            }
+static bool inline_math_parse_factor(InlineMathParser *parser, double *out) {
+    if (!parser || !out) {
+        return false;
+    }
+    inline_math_skip_ws(parser);
+    if (!parser->cursor) {
+        return false;
+    }
+    char ch = *parser->cursor;
+    if (ch == '+') {
+        parser->cursor++;
+        return inline_math_parse_factor(parser, out);
+    }
+    if (ch == '-') {
+        parser->cursor++;
+        if (!inline_math_parse_factor(parser, out)) {
+            return false;
+        }
+        *out = -*out;
+        return true;
+    }
+    if (ch == '(') {
+        parser->cursor++;
+        if (!inline_math_parse_expression(parser, out)) {
+            return false;
+        }
+        inline_math_skip_ws(parser);
+        if (*parser->cursor != ')') {
+            return false;
+        }
+        parser->cursor++;
+        return true;
+    }
+    return inline_math_parse_number(parser, out);
+}
 
-            const char *step_end = line_end;
-            if (has_paren) {
-                const char *closing = strchr(second_semi + 1, ')');
-                if (!closing) {
-                    if (debug) fprintf(stderr, "FOR: missing closing ')' at line %d\n", script[pc].source_line);
-                    continue;
-                }
-                step_end = closing;
-                if (has_colon && closing >= line_end) {
-                    if (debug) fprintf(stderr, "FOR: ':' must appear after ')' at line %d\n", script[pc].source_line);
-                    continue;
-                }
-            } else {
-                while (step_end > second_semi + 1 && isspace((unsigned char)*(step_end - 1))) {
-                    step_end--;
-                }
+static bool inline_math_parse_term(InlineMathParser *parser, double *out) {
+    if (!inline_math_parse_factor(parser, out)) {
+        return false;
+    }
+    while (1) {
+        inline_math_skip_ws(parser);
+        char op = *parser->cursor;
+        if (op != '*' && op != '/') {
+            break;
+        }
+        parser->cursor++;
+        double rhs = 0.0;
+        if (!inline_math_parse_factor(parser, &rhs)) {
+            return false;
+        }
+        if (op == '*') {
+            *out *= rhs;
+        } else {
+            if (rhs == 0.0) {
+                return false;
             }
+            *out /= rhs;
+        }
+    }
+    return true;
+}
 
+static bool inline_math_parse_expression(InlineMathParser *parser, double *out) {
+    if (!inline_math_parse_term(parser, out)) {
+        return false;
+    }
+    while (1) {
+        inline_math_skip_ws(parser);
+        char op = *parser->cursor;
+        if (op != '+' && op != '-') {
+            break;
+        }
+        parser->cursor++;
+        double rhs = 0.0;
+        if (!inline_math_parse_term(parser, &rhs)) {
+            return false;
+        }
+        if (op == '+') {
+            *out += rhs;
+        } else {
+            *out -= rhs;
+        }
+    }
+    return true;
+}
 
-            char init_buf[256];
-            char cond_buf[256];
-            char step_buf[128];
-            memset(init_buf, 0, sizeof(init_buf));
-            memset(cond_buf, 0, sizeof(cond_buf));
-            memset(step_buf, 0, sizeof(step_buf));
+static bool inline_math_evaluate(const char *text, double *out) {
+    if (!text || !out) {
+        return false;
+    }
+    InlineMathParser parser = { .cursor = text };
+    if (!inline_math_parse_expression(&parser, out)) {
+        return false;
+    }
+    inline_math_skip_ws(&parser);
+    return *parser.cursor == '\0';
+}
 
-            copy_trimmed_segment(cursor, first_semi, init_buf, sizeof(init_buf));
-            copy_trimmed_segment(first_semi + 1, second_semi, cond_buf, sizeof(cond_buf));
-            copy_trimmed_segment(second_semi + 1, step_end, step_buf, sizeof(step_buf));
+static bool looks_like_math_expression(const char *token) {
+    if (!token || !*token) {
+        return false;
+    }
+    bool has_digit = false;
+    bool has_operator = false;
+    for (const char *p = token; *p; ++p) {
+        unsigned char ch = (unsigned char)*p;
+        if (isdigit(ch)) {
+            has_digit = true;
+            continue;
+        }
+        if (ch == '+' || ch == '-' || ch == '*' || ch == '/') {
+            has_operator = true;
+            continue;
+        }
+        if (ch == '.' || ch == '(' || ch == ')' || isspace(ch)) {
+            continue;
+        }
+        return false;
+    }
+    return has_digit && has_operator;
+}
 
-            if (init_buf[0] != '\0') {
-                if (!process_assignment_statement(init_buf, script[pc].source_line, debug) &&
-                    !evaluate_expression_statement(init_buf, script[pc].source_line, debug)) {
-                    continue;
-                }
-            }
+static char *try_evaluate_math_token(const char *token) {
+    if (!looks_like_math_expression(token)) {
+        return NULL;
+    }
+    double value = 0.0;
+    if (!inline_math_evaluate(token, &value)) {
+        return NULL;
+    }
+    double integral_part = 0.0;
+    double fractional = modf(value, &integral_part);
+    if (fabs(fractional) < 1e-9 && integral_part >= (double)LLONG_MIN && integral_part <= (double)LLONG_MAX) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%lld", (long long)integral_part);
+        return xstrdup(buf);
+    }
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.15g", value);
+    return xstrdup(buf);
+}
 
-            bool cond_ok = true;
-            if (cond_buf[0] != '\0') {
-                cond_ok = false;
-                if (!evaluate_condition_string(cond_buf, script[pc].source_line, debug, &cond_ok)) {
-                    continue;
-                }
+static void append_chunk(char **buffer, size_t *length, size_t *capacity, const char *chunk, size_t chunk_len) {
+    if (!chunk || chunk_len == 0) {
+        return;
+    }
+
+    size_t needed = *length + chunk_len + 1;
+    if (*capacity < needed) {
+        size_t new_cap = (*capacity == 0) ? needed : *capacity;
+        while (new_cap < needed) {
+            if (new_cap > SIZE_MAX / 2) {
+                new_cap = needed;
+                break;
             }
+            new_cap *= 2;
+        }
+        char *tmp = (char *)realloc(*buffer, new_cap);
+        if (!tmp) {
+            perror("realloc");
+            free(*buffer);
+            exit(EXIT_FAILURE);
+        }
+        *buffer = tmp;
+        *capacity = new_cap;
+    }
+    memcpy(*buffer + *length, chunk, chunk_len);
+    *length += chunk_len;
+    (*buffer)[*length] = '\0';
+}
 
-            if (!cond_ok) {
-                skipping_block = true;
-                skip_indent = script[pc].indent;
-                skip_context_index = -1;
-                skip_for_true_branch = false;
-                skip_progress_pending = false;
-                skip_consumed_first = false;
-                note_branch_progress(if_stack, &if_sp);
-                continue;
+static void expand_argv_variables(char **argv, int argc, int line, int debug) {
+    if (!argv) {
+        return;
+    }
+    for (int i = 0; i < argc; ++i) {
+        char *token = argv[i];
+        if (!token) {
+            continue;
+        }
+        if (!strchr(token, '$')) {
+            continue;
+        }
+
+        char *result = NULL;
+        size_t res_len = 0;
+        size_t res_cap = 0;
+        const char *cursor = token;
+        bool substituted = false;
+
+        while (*cursor) {
+            const char *dollar = strchr(cursor, '$');
+            if (!dollar) {
+                append_chunk(&result, &res_len, &res_cap, cursor, strlen(cursor));
+                break;
             }
 
-            if (step_buf[0] == '\0') {
-                if (debug) fprintf(stderr, "FOR: missing step at line %d\n", script[pc].source_line);
+            append_chunk(&result, &res_len, &res_cap, cursor, (size_t)(dollar - cursor));
+
+            const char *scan = dollar + 1;
+            if (*scan == '\0') {
+                append_chunk(&result, &res_len, &res_cap, "$", 1);
+                cursor = scan;
                 continue;
             }
 
-            ForContext fctx;
-            fctx.for_line_pc = pc;
-            fctx.body_start_pc = pc + 1;
-            fctx.indent = script[pc].indent;
-            snprintf(fctx.condition, sizeof(fctx.condition), "%s", cond_buf);
-            snprintf(fctx.step, sizeof(fctx.step), "%s", step_buf);
-            for_stack[for_sp++] = fctx;
-            note_branch_progress(if_stack, &if_sp);
-        }
-        else if (strncmp(command, "ELSE", 4) == 0 && (command[4] == '\0' || isspace((unsigned char)command[4]))) {
-            if (if_sp <= 0) {
-                if (debug) fprintf(stderr, "ELSE without matching IF at line %d\n", script[pc].source_line);
+            if (!isalnum((unsigned char)*scan) && *scan != '_') {
+                append_chunk(&result, &res_len, &res_cap, "$", 1);
+                cursor = scan;
                 continue;
             }
-            const char *cursor = command + 4;
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
+
+            while (isalnum((unsigned char)*scan) || *scan == '_') {
+                scan++;
             }
-            if (*cursor == ':') {
-                cursor++;
-                while (isspace((unsigned char)*cursor)) {
-                    cursor++;
+
+            bool unterminated = false;
+            while (*scan == '[') {
+                const char *closing = strchr(scan + 1, ']');
+                if (!closing) {
+                    unterminated = true;
+                    break;
                 }
+                scan = closing + 1;
             }
-            if (*cursor != '\0' && debug) {
-                fprintf(stderr, "ELSE: unexpected characters at %d\n", script[pc].source_line);
-            }
-            IfContext *ctx = &if_stack[if_sp - 1];
-            if (ctx->else_encountered) {
-                if (debug) fprintf(stderr, "ELSE already processed for IF at line %d\n", ctx->line_number);
+            if (unterminated) {
+                if (debug) {
+                    fprintf(stderr, "RUN: missing closing ']' in '%s' at line %d\n", token, line);
+                }
+                append_chunk(&result, &res_len, &res_cap, "$", 1);
+                cursor = dollar + 1;
                 continue;
             }
-            ctx->else_encountered = true;
-            ctx->true_branch_done = true;
-            if (ctx->result) {
-                skipping_block = true;
-                skip_indent = script[pc].indent;
-                skip_context_index = if_sp - 1;
-                skip_for_true_branch = false;
-                skip_progress_pending = true;
-                skip_consumed_first = false;
-            }
-        }
-        else if (strncmp(command, "END", 3) == 0 && (command[3] == '\0' || isspace((unsigned char)command[3]))) {
-            const char *cursor = command + 3;
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
-            }
-            if (*cursor != '\0' && debug) {
-                fprintf(stderr, "END: unexpected characters at %d\n", script[pc].source_line);
-            }
 
-            bool matched = false;
-            if (while_sp > 0) {
-                WhileContext *ctx = &while_stack[while_sp - 1];
-                if (script[pc].indent == ctx->indent) {
-                    matched = true;
-                    bool cond_result = false;
-                    /* Re-evaluate the stored condition on every END to decide whether
-                     * to loop again. */
-                    if (!evaluate_condition_string(ctx->condition, script[ctx->while_line_pc].source_line, debug, &cond_result)) {
-                        cond_result = false;
-                    }
+            size_t ref_len = (size_t)(scan - dollar);
+            char *ref_token = (char *)malloc(ref_len + 1);
+            if (!ref_token) {
+                perror("malloc");
+                free(result);
+                exit(EXIT_FAILURE);
+            }
+            memcpy(ref_token, dollar, ref_len);
+            ref_token[ref_len] = '\0';
 
-                    if (cond_result) {
-                        pc = ctx->body_start_pc - 1;
-                        pc_changed = true;
-                    } else {
-                        while_sp--;
-                    }
-                    note_branch_progress(if_stack, &if_sp);
+            VariableRef ref;
+            if (!parse_variable_reference_token(ref_token, &ref, line, debug)) {
+                if (debug) {
+                    fprintf(stderr, "RUN: invalid variable reference '%s' at line %d\n", ref_token, line);
                 }
+                free(ref_token);
+                append_chunk(&result, &res_len, &res_cap, "$", 1);
+                cursor = dollar + 1;
+                continue;
             }
+            free(ref_token);
 
-            if (!matched && for_sp > 0) {
-                ForContext *ctx = &for_stack[for_sp - 1];
-                if (script[pc].indent == ctx->indent) {
-                    matched = true;
-                    if (!apply_increment_step(ctx->step, script[ctx->for_line_pc].source_line, debug)) {
-                        for_sp--;
-                        continue;
-                    }
-
-                    bool cond_result = true;
-                    if (ctx->condition[0] != '\0') {
-                        cond_result = false;
-                        if (!evaluate_condition_string(ctx->condition, script[ctx->for_line_pc].source_line, debug, &cond_result)) {
-                            for_sp--;
-                            continue;
-                        }
-                    }
-
-                    if (cond_result) {
-                        pc = ctx->body_start_pc - 1;
-                        pc_changed = true;
-                    } else {
-                        for_sp--;
-                    }
-                    note_branch_progress(if_stack, &if_sp);
+            Value value;
+            memset(&value, 0, sizeof(value));
+            if (!resolve_variable_reference(&ref, &value, line, debug)) {
+                if (debug) {
+                    fprintf(stderr, "RUN: undefined variable '%s' at line %d\n", ref.name, line);
                 }
+                value.type = VALUE_UNSET;
             }
 
-            if (!matched && if_sp > 0) {
-                IfContext *ctx = &if_stack[if_sp - 1];
-                if (script[pc].indent == ctx->indent) {
-                    matched = true;
-                    if (ctx->else_encountered) {
-                        ctx->else_branch_done = true;
-                    } else {
-                        ctx->true_branch_done = true;
-                    }
-                    if_sp--;
-                }
+            char *replacement = value_to_string(&value);
+            free_value(&value);
+            if (!replacement) {
+                replacement = xstrdup("");
             }
+            append_chunk(&result, &res_len, &res_cap, replacement, strlen(replacement));
+            free(replacement);
+            substituted = true;
+            cursor = scan;
+        }
 
-            if (!matched && debug) {
-                fprintf(stderr, "END without matching FOR/WHILE/IF at line %d\n", script[pc].source_line);
+        if (substituted) {
+            if (!result) {
+                result = xstrdup("");
             }
-        }
-        else if (strncmp(command, "INPUT", 5) == 0 && (command[5] == '\0' || isspace((unsigned char)command[5]))) {
-            const char *cursor = command + 5;
-            char *var_token = NULL;
-            bool quoted = false;
-            if (!parse_token(&cursor, &var_token, &quoted, NULL) || quoted) {
-                if (debug) fprintf(stderr, "INPUT: expected variable at line %d\n", script[pc].source_line);
-                free(var_token);
-                continue;
+            free(argv[i]);
+            argv[i] = result;
+            char *evaluated = try_evaluate_math_token(argv[i]);
+            if (evaluated) {
+                free(argv[i]);
+                argv[i] = evaluated;
             }
-            char name[64];
-            if (!parse_variable_name_token(var_token, name, sizeof(name))) {
-                if (debug) fprintf(stderr, "INPUT: invalid variable name at line %d\n", script[pc].source_line);
-                free(var_token);
-                continue;
+        } else {
+            free(result);
+        }
+    }
+}
+
+/* Resolve executable path:
+   - If argv0 contains '/', use as-is.
+   - Else try "apps/argv0", then "commands/argv0", then "utilities/argv0".
+   - If found and executable, write into resolved (size bytes) and return 0; else -1.
+*/
+static int resolve_exec_path(const char *argv0, char *resolved, size_t size) {
+    if (!argv0 || !*argv0) return -1;
+
+    if (strchr(argv0, '/')) {
+        // explicit relative/absolute path
+        if (build_from_base(argv0, resolved, size) != 0) return -1;
+        if (access(resolved, X_OK) != 0) return -1;
+        return 0;
+    }
+
+    const char *dirs[] = { "apps", "commands", "utilities" };
+    for (size_t i = 0; i < sizeof(dirs)/sizeof(dirs[0]); ++i) {
+        char candidate[PATH_MAX];
+        if (snprintf(candidate, sizeof(candidate), "%s/%s", dirs[i], argv0) >= (int)sizeof(candidate))
+            continue;
+        if (build_from_base(candidate, resolved, size) != 0)
+            continue;
+        if (access(resolved, X_OK) == 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Commands linked in from commands/ (see RUNTASK_COMMANDS in the makefile).
+   Each entry is the command's main() under another name, so RUN can call it
+   without starting a process. */
+#ifndef RUNTASK_COMMANDS
+#define RUNTASK_COMMANDS(X)
+#endif
+
+typedef int (*TaskCommandEntry)(int argc, char **argv);
+
+typedef struct {
+    const char *name;
+    TaskCommandEntry entry;
+} TaskCommand;
+
+#define RUNTASK_DECLARE_COMMAND(name) int runtask_command##name(int argc, char **argv);
+RUNTASK_COMMANDS(RUNTASK_DECLARE_COMMAND)
+#undef RUNTASK_DECLARE_COMMAND
+
+#define RUNTASK_COMMAND_ENTRY(name) { #name, runtask_command##name },
+static const TaskCommand task_commands[] = {
+    RUNTASK_COMMANDS(RUNTASK_COMMAND_ENTRY)
+    { NULL, NULL }
+};
+#undef RUNTASK_COMMAND_ENTRY
+
+static const TaskCommand *find_task_command(const char *name) {
+    for (const TaskCommand *command = task_commands; command->name; ++command) {
+        if (strcmp(command->name, name) == 0) {
+            return command;
+        }
+    }
+    return NULL;
+}
+
+/* Runs a linked-in command in this process. With `capture` set, everything
+   it writes to file descriptors 1 and 2 -- through stdio or directly --
+   lands in *captured_out (NUL-terminated) instead of the terminal. The
+   descriptors point at a temporary file while the command runs, so output
+   of any size can be collected without a reader thread. Returns false only
+   if capturing could not start. */
+static bool run_linked_command(const TaskCommand *command, int argc, char **argv, bool capture, char **captured_out,
+                               size_t *captured_len, int line, int debug) {
+    FILE *capture_file = NULL;
+    int saved_stdout = -1;
+    int saved_stderr = -1;
+
+    fflush(stdout);
+    fflush(stderr);
+    if (capture) {
+        capture_file = tmpfile();
+        if (!capture_file) {
+            perror("tmpfile");
+            return false;
+        }
+        saved_stdout = dup(STDOUT_FILENO);
+        saved_stderr = dup(STDERR_FILENO);
+        if (saved_stdout < 0 || saved_stderr < 0 || dup2(fileno(capture_file), STDOUT_FILENO) < 0 ||
+            dup2(fileno(capture_file), STDERR_FILENO) < 0) {
+            perror("dup2");
+            if (saved_stdout >= 0) {
+                dup2(saved_stdout, STDOUT_FILENO);
+                close(saved_stdout);
             }
-            free(var_token);
-            bool wait_for_enter = true;
-            char *option_token = NULL;
-            bool option_quoted = false;
-            if (parse_token(&cursor, &option_token, &option_quoted, NULL)) {
-                if (option_quoted) {
-                    if (debug) fprintf(stderr, "INPUT: unexpected quoted argument at line %d\n", script[pc].source_line);
-                    free(option_token);
-                    continue;
-                }
-                if (equals_ignore_case(option_token, "-wait")) {
-                    free(option_token);
-                    option_token = NULL;
-                    char *value_token = NULL;
-                    bool value_quoted = false;
-                    if (!parse_token(&cursor, &value_token, &value_quoted, NULL) || value_quoted) {
-                        if (debug) fprintf(stderr, "INPUT: -wait expects ON or OFF at line %d\n", script[pc].source_line);
-                        free(value_token);
-                        continue;
-                    }
-                    if (equals_ignore_case(value_token, "on")) {
-                        wait_for_enter = true;
-                    } else if (equals_ignore_case(value_token, "off")) {
-                        wait_for_enter = false;
-                    } else {
-                        if (debug) fprintf(stderr, "INPUT: -wait expects ON or OFF at line %d\n", script[pc].source_line);
-                        free(value_token);
-                        continue;
-                    }
-                    free(value_token);
-                } else {
-                    if (debug) fprintf(stderr, "INPUT: unexpected argument '%s' at line %d\n", option_token, script[pc].source_line);
-                    free(option_token);
-                    continue;
-                }
+            if (saved_stderr >= 0) {
+                dup2(saved_stderr, STDERR_FILENO);
+                close(saved_stderr);
             }
-            free(option_token);
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
+            fclose(capture_file);
+            return false;
+        }
+    }
+
+    int status = command->entry(argc, argv);
+
+    fflush(stdout);
+    fflush(stderr);
+    if (capture) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        dup2(saved_stderr, STDERR_FILENO);
+        close(saved_stdout);
+        close(saved_stderr);
+
+        // The command wrote through the shared descriptors, so the FILE's own
+        // position is stale; ask the descriptor how much there is.
+        int fd = fileno(capture_file);
+        off_t end = lseek(fd, 0, SEEK_END);
+        size_t length = end > 0 ? (size_t)end : 0;
+        char *buffer = (char *)malloc(length + 1);
+        if (!buffer) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        size_t filled = 0;
+        while (filled < length) {
+            ssize_t got = pread(fd, buffer + filled, length - filled, (off_t)filled);
+            if (got < 0 && errno == EINTR) {
+                continue;
             }
-            if (*cursor != '\0' && debug) {
-                fprintf(stderr, "INPUT: unexpected characters at %d\n", script[pc].source_line);
+            if (got <= 0) {
+                break;
             }
-            Variable *var = find_variable(name, true);
-            if (!var) {
-                continue;
+            filled += (size_t)got;
+        }
+        buffer[filled] = '\0';
+        fclose(capture_file);
+        *captured_out = buffer;
+        *captured_len = filled;
+    }
+
+    // Commands drop their background-cell state on exit; do the same here so
+    // the next call reloads whatever other processes have written since.
+    termbg_shutdown();
+
+    if (debug) {
+        fprintf(stderr, "RUN: %s returned %d (in-process) at line %d\n", command->name, status, line);
+    }
+    return true;
+}
+
+// Stores captured RUN output in the TO variable, as a number when it parses as one.
+static void store_captured_output(Variable *capture_var, const VariableRef *capture_ref, char *captured_output,
+                                  size_t captured_len, int line, int debug) {
+    while (captured_len > 0 && (captured_output[captured_len - 1] == '\n' || captured_output[captured_len - 1] == '\r')) {
+        captured_output[--captured_len] = '\0';
+    }
+    Value value;
+    memset(&value, 0, sizeof(value));
+    bool parsed = parse_value_from_string(captured_output, &value, line, debug);
+    bool keep_captured_buffer = false;
+    if (!parsed) {
+        long long iv = 0;
+        double fv = 0.0;
+        ValueType vt = detect_numeric_type(captured_output, &iv, &fv);
+        if (vt == VALUE_INT) {
+            value.type = VALUE_INT;
+            value.int_val = iv;
+            value.float_val = (double)iv;
+        } else if (vt == VALUE_FLOAT) {
+            value.type = VALUE_FLOAT;
+            value.float_val = fv;
+            value.int_val = float_to_int(fv);
+        } else {
+            value.type = VALUE_STRING;
+            value.str_val = captured_output;
+            value.owns_string = true;
+            keep_captured_buffer = true;
+        }
+    }
+    set_variable_from_ref(capture_var, capture_ref, &value);
+    if (!keep_captured_buffer) {
+        free(captured_output);
+    }
+    free_value(&value);
+}
+
+static void run_task_command(const char *cmdline, int line, int debug) {
+    if (!*cmdline) {
+        if (debug) fprintf(stderr, "RUN: missing command at line %d\n", line);
+        return;
+    }
+
+    ensure_task_workdir();
+
+    // Tokenize to argv[] (heap-based)
+    int argcnt = 0;
+    char **argv_heap = split_args_heap(cmdline, &argcnt);
+    if (argcnt <= 0) {
+        if (debug) fprintf(stderr, "RUN: failed to parse command at line %d\n", line);
+        free_argv(argv_heap);
+        return;
+    }
+
+    bool blocking_mode = true;
+    bool capture_output = false;
+    Variable *capture_var = NULL;
+    VariableRef capture_ref;
+    char *captured_output = NULL;
+    size_t captured_len = 0;
+    size_t captured_cap = 0;
+    bool use_execvp = false;
+    bool explicit_path_requested = false;
+    bool run_in_exec_dir = false;
+    char resolved[PATH_MAX];
+
+    if (argcnt > 0) {
+        if (equals_ignore_case(argv_heap[0], "BLOCKING")) {
+            blocking_mode = true;
+            free(argv_heap[0]);
+            for (int i = 1; i < argcnt; ++i) {
+                argv_heap[i - 1] = argv_heap[i];
+            }
+            argv_heap[argcnt - 1] = NULL;
+            argcnt--;
+        } else if (equals_ignore_case(argv_heap[0], "NONBLOCKING") ||
+                   equals_ignore_case(argv_heap[0], "NON-BLOCKING")) {
+            blocking_mode = false;
+            free(argv_heap[0]);
+            for (int i = 1; i < argcnt; ++i) {
+                argv_heap[i - 1] = argv_heap[i];
+            }
+            argv_heap[argcnt - 1] = NULL;
+            argcnt--;
+        }
+    }
+
+    if (argcnt <= 0) {
+        if (debug) fprintf(stderr, "RUN: missing executable at line %d\n", line);
+        free_argv(argv_heap);
+        return;
+    }
+
+    if (argcnt >= 3 && equals_ignore_case(argv_heap[argcnt - 2], "TO")) {
+        if (!parse_variable_reference_token(argv_heap[argcnt - 1], &capture_ref, line, debug)) {
+            fprintf(stderr, "RUN: invalid variable name after TO at line %d\n", line);
+            free_argv(argv_heap);
+            return;
+        }
+        capture_var = find_variable(capture_ref.name, true);
+        if (!capture_var) {
+            free_argv(argv_heap);
+            return;
+        }
+        capture_output = true;
+        free(argv_heap[argcnt - 1]);
+        free(argv_heap[argcnt - 2]);
+        argv_heap[argcnt - 2] = NULL;
+        argv_heap[argcnt - 1] = NULL;
+        argcnt -= 2;
+        argv_heap[argcnt] = NULL;
+        if (argcnt <= 0) {
+            fprintf(stderr, "RUN: missing executable before TO at line %d\n", line);
+            free_argv(argv_heap);
+            return;
+        }
+    }
+
+    expand_argv_variables(argv_heap, argcnt, line, debug);
+
+    if (argcnt > 0 && strcmp(argv_heap[0], "_TOFILE") == 0) {
+        int start_flag = 0;
+        int stop_flag = 0;
+        const char *path = NULL;
+
+        for (int i = 1; i < argcnt; ++i) {
+            if (strcmp(argv_heap[i], "-file") == 0 && i + 1 < argcnt) {
+                path = argv_heap[i + 1];
+                i++;
+            } else if (strcmp(argv_heap[i], "--start") == 0) {
+                start_flag = 1;
+            } else if (strcmp(argv_heap[i], "--stop") == 0) {
+                stop_flag = 1;
+            }
+        }
+
+        if (start_flag && stop_flag) {
+            fprintf(stderr, "_TOFILE: cannot use --start and --stop together\n");
+        } else if (start_flag) {
+            (void)start_logging(path);
+        } else if (stop_flag) {
+            if (log_file != NULL) {
+                printf("_TOFILE: logging stopped (%s)\n", log_file_path[0] != '\0' ? log_file_path : "<unknown>");
+            } else {
+                printf("_TOFILE: logging was not active\n");
             }
-            fflush(stdout);
-            char buffer[512];
-            if (wait_for_enter) {
-                if (!fgets(buffer, sizeof(buffer), stdin)) {
-                    if (debug) fprintf(stderr, "INPUT: failed to read input at line %d\n", script[pc].source_line);
-                    buffer[0] = '\0';
+            stop_logging();
+        } else {
+            fprintf(stderr, "Usage: _TOFILE -file <path> --start | _TOFILE --stop\n");
+        }
+
+        free_argv(argv_heap);
+        return;
+    }
+
+    TaskTermBuiltinResult term_builtin_result = try_run_builtin_term_command(argv_heap,
+                                                                             argcnt,
+                                                                             line,
+                                                                             debug,
+                                                                             capture_output,
+                                                                             capture_var,
+                                                                             &capture_ref);
+    if (term_builtin_result != TASK_TERM_BUILTIN_NOT_HANDLED) {
+        free_argv(argv_heap);
+        return;
+    }
+
+    if (argcnt > 0) {
+        explicit_path_requested = strchr(argv_heap[0], '/') != NULL;
+    }
+
+    if (capture_output && blocking_mode && argcnt > 0) {
+        bool handled = false;
+        if (equals_ignore_case(argv_heap[0], "_GETROW") ||
+            equals_ignore_case(argv_heap[0], "_GETCOL")) {
+            long row = 0;
+            long col = 0;
+            if (query_cursor_position(&row, &col) == 0) {
+                Value value;
+                memset(&value, 0, sizeof(value));
+                value.type = VALUE_INT;
+                if (equals_ignore_case(argv_heap[0], "_GETCOL")) {
+                    value.int_val = col;
+                    value.float_val = (double)col;
                 } else {
-                    size_t len = strcspn(buffer, "\r\n");
-                    buffer[len] = '\0';
+                    value.int_val = row;
+                    value.float_val = (double)row;
                 }
-            } else {
-                if (!read_keypress_sequence(buffer, sizeof(buffer))) {
-                    if (debug) fprintf(stderr, "INPUT: failed to read key press at line %d\n", script[pc].source_line);
-                    buffer[0] = '\0';
+                assign_variable(capture_var, &value);
+                free_value(&value);
+            } else if (debug) {
+                fprintf(stderr, "RUN: failed to query cursor position at line %d\n",
+                        line);
+            }
+            handled = true;
+        }
+
+        if (handled) {
+            free_argv(argv_heap);
+            return;
+        }
+    }
+
+    bool log_child_output = (log_file != NULL && blocking_mode && !capture_output);
+
+    const TaskCommand *linked = (blocking_mode && !explicit_path_requested) ? find_task_command(argv_heap[0]) : NULL;
+    if (linked) {
+        bool capture = capture_output || log_child_output;
+        if (run_linked_command(linked, argcnt, argv_heap, capture, &captured_output, &captured_len, line, debug)) {
+            if (log_child_output && captured_output) {
+                if (fwrite(captured_output, 1, captured_len, stdout) < captured_len) {
+                    perror("write");
                 }
+                fflush(stdout);
+                log_output(captured_output, captured_len);
             }
-            long long iv = 0;
-            double fv = 0.0;
-            Value val;
-            memset(&val, 0, sizeof(val));
-            ValueType vt = detect_numeric_type(buffer, &iv, &fv);
-            if (vt == VALUE_INT) {
-                val.type = VALUE_INT;
-                val.int_val = iv;
-                val.float_val = (double)iv;
-            } else if (vt == VALUE_FLOAT) {
-                val.type = VALUE_FLOAT;
-                val.float_val = fv;
-                val.int_val = (long long)fv;
+            if (capture_output && capture_var && captured_output) {
+                store_captured_output(capture_var, &capture_ref, captured_output, captured_len, line, debug);
             } else {
-                val.type = VALUE_STRING;
-                val.str_val = xstrdup(buffer);
-                val.owns_string = true;
+                free(captured_output);
             }
-            assign_variable(var, &val);
-            free_value(&val);
-            note_branch_progress(if_stack, &if_sp);
+            free_argv(argv_heap);
+            return;
         }
-        else if (strncmp(command, "SET", 3) == 0 && (command[3] == '\0' || isspace((unsigned char)command[3]))) {
-            const char *cursor = command + 3;
-            char *var_token = NULL;
-            bool quoted = false;
-            bool static_target = false;
-            if (!parse_token(&cursor, &var_token, &quoted, NULL) || quoted) {
-                if (debug) fprintf(stderr, "SET: expected variable at line %d\n", script[pc].source_line);
-                free(var_token);
-                continue;
+    }
+
+    // Resolve executable path for internal commands; fall back to system PATH.
+    if (resolve_exec_path(argv_heap[0], resolved, sizeof(resolved)) == 0) {
+        free(argv_heap[0]);
+        argv_heap[0] = xstrdup(resolved);
+        run_in_exec_dir = explicit_path_requested;
+    } else if (!explicit_path_requested) {
+        use_execvp = true;
+    } else {
+        fprintf(stderr, "RUN: executable not found or not executable: %s\n", argv_heap[0]);
+        free_argv(argv_heap);
+        return;
+    }
+
+    if (debug) {
+        fprintf(stderr, "RUN: %s %s", use_execvp ? "execvp" : "execv", argv_heap[0]);
+        for (int i = 1; i < argcnt; ++i) fprintf(stderr, " [%s]", argv_heap[i]);
+        if (capture_output) fprintf(stderr, " -> TO $%s", capture_var ? capture_var->name : "?");
+        fprintf(stderr, " (%s)\n", blocking_mode ? "blocking" : "non-blocking");
+    }
+
+    if (!blocking_mode && capture_output) {
+        fprintf(stderr, "RUN: cannot capture output in non-blocking mode at line %d\n", line);
+        free_argv(argv_heap);
+        if (captured_output) {
+            free(captured_output);
+        }
+        return;
+    }
+
+    if (!blocking_mode) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            free_argv(argv_heap);
+            return;
+        } else if (pid == 0) {
+            pid_t gpid = fork();
+            if (gpid < 0) {
+                perror("fork");
+                _exit(EXIT_FAILURE);
             }
-            if (equals_ignore_case(var_token, "STATIC")) {
-                static_target = true;
-                free(var_token);
-                var_token = NULL;
-                while (isspace((unsigned char)*cursor)) {
-                    cursor++;
+            if (gpid == 0) {
+                if (run_in_exec_dir) {
+                    apply_exec_workdir(argv_heap[0], line);
                 }
-                if (!parse_token(&cursor, &var_token, &quoted, NULL) || quoted) {
-                    if (debug) fprintf(stderr, "SET: expected variable after STATIC at line %d\n", script[pc].source_line);
-                    free(var_token);
-                    continue;
+                if (use_execvp) {
+                    execvp(argv_heap[0], argv_heap);
+                    perror("execvp");
+                } else {
+                    execv(argv_heap[0], argv_heap);
+                    perror("execv");
                 }
+                _exit(EXIT_FAILURE);
             }
-            VariableRef ref;
-            if (!parse_variable_reference_token(var_token, &ref, script[pc].source_line, debug)) {
-                if (debug) fprintf(stderr, "SET: invalid variable name at line %d\n", script[pc].source_line);
-                free(var_token);
-                continue;
-            }
-            free(var_token);
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
-            }
-            if (*cursor != '=') {
-                if (debug) fprintf(stderr, "SET: expected '=' at line %d\n", script[pc].source_line);
-                continue;
-            }
-            cursor++;
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
-            }
-            Value value;
-            if (!parse_expression(&cursor, &value, NULL, script[pc].source_line, debug)) {
-                continue;
-            }
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
-            }
-            if (*cursor != '\0' && debug) {
-                fprintf(stderr, "SET: unexpected characters at %d\n", script[pc].source_line);
-            }
-            Variable *var = NULL;
-            if (static_target) {
-                var = find_static_variable(ref.name, true);
-                if (!var && debug) {
-                    fprintf(stderr, "SET: STATIC not allowed outside of a function at line %d\n", script[pc].source_line);
+            _exit(EXIT_SUCCESS);
+        } else {
+            int status;
+            while (waitpid(pid, &status, 0) < 0) {
+                if (errno != EINTR) {
+                    perror("waitpid");
+                    break;
                 }
             }
-            if (!var) {
-                var = find_variable(ref.name, true);
-            }
-            if (var && !set_variable_from_ref(var, &ref, &value) && debug) {
-                fprintf(stderr, "SET: failed to set variable at line %d\n", script[pc].source_line);
+        }
+        free_argv(argv_heap);
+        return;
+    }
+
+    bool need_pipe = capture_output || log_child_output;
+
+    int pipefd[2] = { -1, -1 };
+    if (need_pipe) {
+        if (pipe(pipefd) < 0) {
+            perror("pipe");
+            free_argv(argv_heap);
+            return;
+        }
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        if (need_pipe) {
+            close(pipefd[0]);
+            close(pipefd[1]);
+        }
+        free_argv(argv_heap);
+        return;
+    } else if (pid == 0) {
+        if (need_pipe) {
+            close(pipefd[0]);
+            if (dup2(pipefd[1], STDOUT_FILENO) < 0) {
+                perror("dup2");
+                _exit(EXIT_FAILURE);
             }
-            free_value(&value);
-            note_branch_progress(if_stack, &if_sp);
-        }
-        else if (command[0] == '$') {
-            process_assignment_statement(command, script[pc].source_line, debug);
-            note_branch_progress(if_stack, &if_sp);
-        }
-        else if (strncmp(command, "PRINT", 5) == 0 && (command[5] == '\0' || isspace((unsigned char)command[5]))) {
-            const char *cursor = command + 5;
-            size_t out_cap = 128;
-            size_t out_len = 0;
-            char *out_buf = (char *)malloc(out_cap);
-            if (!out_buf) {
-                perror("malloc");
-                exit(EXIT_FAILURE);
+            if (dup2(pipefd[1], STDERR_FILENO) < 0) {
+                perror("dup2");
+                _exit(EXIT_FAILURE);
             }
-            bool ok = true;
+            close(pipefd[1]);
+        }
+        if (run_in_exec_dir) {
+            apply_exec_workdir(argv_heap[0], line);
+        }
+        if (use_execvp) {
+            execvp(argv_heap[0], argv_heap);
+            perror("execvp");
+        } else {
+            execv(argv_heap[0], argv_heap);
+            perror("execv");
+        }
+        _exit(EXIT_FAILURE);
+    } else {
+        if (need_pipe) {
+            close(pipefd[1]);
+            char buffer[4096];
+            ssize_t rd;
             while (1) {
-                Value term;
-                if (!parse_value_token(&cursor, &term, "+", script[pc].source_line, debug)) {
-                    ok = false;
-                    break;
-                }
-                char *as_str = value_to_string(&term);
-                size_t need = strlen(as_str);
-                if (out_len + need + 1 > out_cap) {
-                    while (out_len + need + 1 > out_cap) {
-                        out_cap *= 2;
+                rd = read(pipefd[0], buffer, sizeof(buffer));
+                if (rd > 0) {
+                    if (capture_output) {
+                        if (captured_len + (size_t)rd + 1 > captured_cap) {
+                            size_t new_cap = captured_cap ? captured_cap : 128;
+                            while (captured_len + (size_t)rd + 1 > new_cap) {
+                                new_cap *= 2;
+                            }
+                            char *tmp = (char *)realloc(captured_output, new_cap);
+                            if (!tmp) {
+                                perror("realloc");
+                                free(captured_output);
+                                captured_output = NULL;
+                                captured_cap = captured_len = 0;
+                                break;
+                            }
+                            captured_output = tmp;
+                            captured_cap = new_cap;
+                        }
+                        memcpy(captured_output + captured_len, buffer, (size_t)rd);
+                        captured_len += (size_t)rd;
                     }
-                    char *tmp = (char *)realloc(out_buf, out_cap);
-                    if (!tmp) {
-                        perror("realloc");
-                        free(out_buf);
-                        free(as_str);
-                        free_value(&term);
-                        exit(EXIT_FAILURE);
+                    if (log_child_output) {
+                        if (fwrite(buffer, 1, (size_t)rd, stdout) < (size_t)rd) {
+                            perror("write");
+                        }
+                        fflush(stdout);
+                        log_output(buffer, (size_t)rd);
                     }
-                    out_buf = tmp;
-                }
-                memcpy(out_buf + out_len, as_str, need);
-                out_len += need;
-                free(as_str);
-                free_value(&term);
-                while (isspace((unsigned char)*cursor)) {
-                    cursor++;
-                }
-                if (*cursor == '+') {
-                    cursor++;
-                    continue;
+                } else if (rd == 0) {
+                    break;
+                } else {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    perror("read");
+                    break;
                 }
-                break;
-            }
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
             }
-            if (*cursor != '\0') {
-                ok = false;
-                if (debug) {
-                    fprintf(stderr, "PRINT: unexpected characters at %d\n", script[pc].source_line);
+            if (capture_output) {
+                if (captured_output) {
+                    captured_output[captured_len] = '\0';
+                } else {
+                    captured_output = xstrdup("");
+                    captured_len = 0;
+                    captured_cap = 1;
                 }
             }
-                    if (ok) {
-                        out_buf[out_len] = '\0';
-                        size_t len = strlen(out_buf);
-                        if (len > 0 && out_buf[len - 1] == '\n') {
-                            fputs(out_buf, stdout);
-                        } else {
-                            fputs(out_buf, stdout);
-                            fflush(stdout); // keep INPUT on the same line if needed
-                        }
-                        log_output(out_buf, len);
-                    }
-		    free(out_buf);
-                    note_branch_progress(if_stack, &if_sp);
+            close(pipefd[0]);
         }
-        else if (strncmp(command, "EVAL", 4) == 0 && (command[4] == '\0' || isspace((unsigned char)command[4]))) {
-            const char *cursor = command + 4;
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
-            }
-            const char *name_start = cursor;
-            while (*cursor && (isalnum((unsigned char)*cursor) || *cursor == '_')) {
-                cursor++;
-            }
-            size_t name_len = (size_t)(cursor - name_start);
-            char func_name[sizeof(((FunctionDef *)0)->name)];
-            if (name_len == 0 || name_len >= sizeof(func_name)) {
-                if (debug) fprintf(stderr, "EVAL: invalid function name at line %d\n", script[pc].source_line);
+
+        int status;
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR) { perror("waitpid"); break; }
+        }
+        if (debug) {
+            if (WIFEXITED(status))
+                fprintf(stderr, "RUN: exited with %d\n", WEXITSTATUS(status));
+            else if (WIFSIGNALED(status))
+                fprintf(stderr, "RUN: killed by signal %d\n", WTERMSIG(status));
+        }
+
+        if (capture_output && capture_var && captured_output) {
+            store_captured_output(capture_var, &capture_ref, captured_output, captured_len, line, debug);
+            captured_output = NULL;
+        } else if (captured_output) {
+            free(captured_output);
+        }
+
+        free_argv(argv_heap);
+    }
+}
+
+typedef struct {
+    int line;            // script index of the header
+    int indent;
+    int entry;           // header's JUMP_IF_FALSE, -1 if none
+    int skip_line;       // where a false entry condition resumes
+    int body;            // first instruction of the body
+    int cond;            // condition re-tested at the end of a loop, -1 if none
+    Instruction step;    // FOR step, emitted in the loop tail
+    bool else_seen;
+} BlockContext;
+
+enum { FIX_LINE_START, FIX_LINE_BODY, FIX_LINE_END };
+
+typedef struct {
+    int instruction;
+    int line;
+    int kind;
+} JumpFixup;
+
+typedef struct {
+    TaskProgram *prog;
+    ScriptLine *script;
+    int count;
+    const Label *labels;
+    int label_count;
+    const FunctionDef *functions;
+    int function_count;
+    BlockContext if_stack[64];
+    int if_sp;
+    BlockContext while_stack[64];
+    int while_sp;
+    BlockContext for_stack[64];
+    int for_sp;
+    JumpFixup *fixups;
+    int fixup_count;
+    size_t fixup_cap;
+    int debug;
+} TaskCompiler;
+
+static bool command_is(const char *command, const char *keyword, bool allow_paren) {
+    size_t len = strlen(keyword);
+    if (strncmp(command, keyword, len) != 0) {
+        return false;
+    }
+    char next = command[len];
+    return next == '\0' || isspace((unsigned char)next) || (allow_paren && next == '(');
+}
+
+static int compiler_emit(TaskCompiler *tc, OpCode op, int line) {
+    TaskProgram *prog = tc->prog;
+    prog->code = (Instruction *)grow_buffer(prog->code, &prog->code_cap, (size_t)prog->code_count + 1, sizeof(Instruction));
+    Instruction *ins = &prog->code[prog->code_count];
+    memset(ins, 0, sizeof(*ins));
+    ins->op = op;
+    ins->line = line;
+    ins->a = -1;
+    ins->b = -1;
+    ins->c = 0;
+    ins->d = -1;
+    ins->target = -1;
+    return prog->code_count++;
+}
+
+static int compiler_emit_instruction(TaskCompiler *tc, const Instruction *template_ins) {
+    int index = compiler_emit(tc, template_ins->op, template_ins->line);
+    tc->prog->code[index] = *template_ins;
+    return index;
+}
+
+static void compiler_fixup(TaskCompiler *tc, int instruction, int line, int kind) {
+    tc->fixups = (JumpFixup *)grow_buffer(tc->fixups, &tc->fixup_cap, (size_t)tc->fixup_count + 1, sizeof(JumpFixup));
+    tc->fixups[tc->fixup_count].instruction = instruction;
+    tc->fixups[tc->fixup_count].line = line;
+    tc->fixups[tc->fixup_count].kind = kind;
+    tc->fixup_count++;
+}
+
+/* Line where execution resumes when the block opened at `header` is
+   skipped: its first line always belongs to the block, after that the block
+   runs until a label, an ELSE or any line at or left of `indent`. */
+static int block_skip_target(const ScriptLine *script, int count, int header, int indent) {
+    bool consumed_first = false;
+    for (int pc = header + 1; pc < count; ++pc) {
+        if (script[pc].type == LINE_LABEL) {
+            if (script[pc].indent > indent) {
                 continue;
             }
-            memcpy(func_name, name_start, name_len);
-            func_name[name_len] = '\0';
+            return pc;
+        }
+        if (script[pc].indent <= indent && command_is(script[pc].text, "ELSE", false)) {
+            return pc;
+        }
+        if (!consumed_first) {
+            consumed_first = true;
+            continue;
+        }
+        if (script[pc].indent > indent) {
+            continue;
+        }
+        return pc;
+    }
+    return count;
+}
 
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
-            }
-            if (*cursor != '(') {
-                if (debug) fprintf(stderr, "EVAL: expected '(' after function name at line %d\n", script[pc].source_line);
-                continue;
+// Extracts the condition of an `IF (...):` or `WHILE (...):` header.
+static bool parse_block_condition(const char *command, size_t keyword_len, const char *what, char *cond_buf, size_t cond_size,
+                                  int line, int debug) {
+    const char *after_keyword = command + keyword_len;
+    while (isspace((unsigned char)*after_keyword)) {
+        after_keyword++;
+    }
+
+    const char *colon = strrchr(after_keyword, ':');
+    if (!colon) {
+        if (debug) fprintf(stderr, "%s: expected ':' before END-delimited block at %d\n", what, line);
+        return false;
+    }
+
+    const char *cond_end = colon;
+    while (cond_end > after_keyword && isspace((unsigned char)*(cond_end - 1))) {
+        cond_end--;
+    }
+
+    if (cond_end <= after_keyword) {
+        if (debug) fprintf(stderr, "%s: missing condition before ':' at %d\n", what, line);
+        return false;
+    }
+
+    size_t cond_len = (size_t)(cond_end - after_keyword);
+    if (cond_len >= cond_size) {
+        if (debug) fprintf(stderr, "%s: condition too long at %d\n", what, line);
+        return false;
+    }
+    memcpy(cond_buf, after_keyword, cond_len);
+    cond_buf[cond_len] = '\0';
+
+    size_t start_off = 0;
+    size_t end_off = cond_len;
+    while (start_off < end_off && isspace((unsigned char)cond_buf[start_off])) {
+        start_off++;
+    }
+    while (end_off > start_off && isspace((unsigned char)cond_buf[end_off - 1])) {
+        end_off--;
+    }
+    while (end_off > start_off && cond_buf[start_off] == '(' && cond_buf[end_off - 1] == ')') {
+        start_off++;
+        end_off--;
+        while (start_off < end_off && isspace((unsigned char)cond_buf[start_off])) {
+            start_off++;
+        }
+        while (end_off > start_off && isspace((unsigned char)cond_buf[end_off - 1])) {
+            end_off--;
+        }
+    }
+
+    if (start_off >= end_off) {
+        if (debug) fprintf(stderr, "%s: empty condition after trimming at %d\n", what, line);
+        return false;
+    }
+
+    memmove(cond_buf, cond_buf + start_off, end_off - start_off);
+    cond_buf[end_off - start_off] = '\0';
+
+    const char *after_colon = colon + 1;
+    while (isspace((unsigned char)*after_colon)) {
+        after_colon++;
+    }
+    if (*after_colon != '\0' && debug) {
+        fprintf(stderr, "%s: unexpected characters after ':' at %d\n", what, line);
+    }
+    return true;
+}
+
+static int compile_block_condition(TaskCompiler *tc, const char *cond_buf, const char *what, int line) {
+    bool trailing = false;
+    int cond = compile_condition(tc->prog, cond_buf, &trailing, line, tc->debug);
+    if (trailing && tc->debug) {
+        fprintf(stderr, "%s: unexpected characters in condition at %d\n", what, line);
+    }
+    return cond;
+}
+
+/* Conditions re-tested by FOR and at a WHILE's END reject trailing text
+   outright instead of just reporting it. */
+static int compile_loop_condition(TaskCompiler *tc, const char *cond_buf, int line) {
+    bool trailing = false;
+    int cond = compile_condition(tc->prog, cond_buf, &trailing, line, tc->debug);
+    if (trailing) {
+        if (tc->debug) fprintf(stderr, "Condition: unexpected trailing characters at line %d\n", line);
+        return program_fail_expression(tc->prog);
+    }
+    return cond;
+}
+
+/* Fills `ins` with an assignment `$VAR[idx] = expr`; returns false with
+   nothing to run when the statement does not parse. */
+static bool compile_assignment(TaskCompiler *tc, Instruction *ins, const char *statement, const char *what, int line) {
+    int debug = tc->debug;
+    const char *cursor = statement;
+    char *var_token = NULL;
+    bool quoted = false;
+    if (!parse_token(&cursor, &var_token, &quoted, "=") || quoted) {
+        if (debug) fprintf(stderr, "%s: expected variable at line %d\n", what, line);
+        free(var_token);
+        return false;
+    }
+
+    int indices[MAX_REF_INDICES];
+    int index_count = 0;
+    int slot = -1;
+    if (!compile_variable_reference(tc->prog, var_token, &slot, indices, &index_count, line, debug)) {
+        if (debug) fprintf(stderr, "%s: invalid variable name at line %d\n", what, line);
+        free(var_token);
+        return false;
+    }
+    free(var_token);
+
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor != '=') {
+        if (debug) fprintf(stderr, "%s: expected '=' at line %d\n", what, line);
+        return false;
+    }
+    cursor++;
+
+    int value = compile_expression_text(tc->prog, &cursor, NULL, line, debug);
+    if (value < 0) {
+        return false;
+    }
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor != '\0' && debug) {
+        fprintf(stderr, "%s: unexpected characters at %d\n", what, line);
+    }
+
+    ins->op = OP_ASSIGN;
+    ins->a = slot;
+    ins->b = program_add_list(tc->prog, indices, index_count);
+    ins->c = index_count;
+    ins->d = value;
+    ins->text = what;
+    return true;
+}
+
+// Fills `ins` with an expression evaluated only for its diagnostics.
+static bool compile_expression_statement(TaskCompiler *tc, Instruction *ins, const char *expr, int line) {
+    const char *cursor = expr;
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor == '\0') {
+        ins->op = OP_NOP;
+        return true;
+    }
+
+    int value = compile_expression_text(tc->prog, &cursor, NULL, line, tc->debug);
+    if (value < 0) {
+        return false;
+    }
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor != '\0' && tc->debug) {
+        fprintf(stderr, "Expression: unexpected characters at %d\n", line);
+    }
+    ins->op = OP_EXPR;
+    ins->d = value;
+    return true;
+}
+
+/* Fills `ins` with a FOR step: `$VAR++`, `$VAR--`, an assignment or an
+   expression. A step that cannot run compiles to a jump out of the loop. */
+static void compile_for_step(TaskCompiler *tc, Instruction *ins, const char *step, int line) {
+    int debug = tc->debug;
+    char trimmed[128];
+    copy_trimmed_segment(step, step + strlen(step), trimmed, sizeof(trimmed));
+
+    if (strchr(trimmed, '=')) {
+        if (!compile_assignment(tc, ins, trimmed, "Assignment", line)) {
+            if (debug) fprintf(stderr, "FOR: failed to evaluate step assignment at line %d\n", line);
+            ins->op = OP_JUMP;
+        }
+        return;
+    }
+
+    const char *cursor = trimmed;
+    if (*cursor == '$') {
+        cursor++;
+    }
+
+    char name[64];
+    size_t len = 0;
+    bool too_long = false;
+    while (isalnum((unsigned char)*cursor) || *cursor == '_') {
+        if (len + 1 >= sizeof(name)) {
+            too_long = true;
+        } else {
+            name[len++] = *cursor;
+        }
+        cursor++;
+    }
+    name[len] = '\0';
+
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+
+    int delta = 0;
+    if (strncmp(cursor, "++", 2) == 0) {
+        delta = 1;
+        cursor += 2;
+    } else if (strncmp(cursor, "--", 2) == 0) {
+        delta = -1;
+        cursor += 2;
+    } else {
+        if (!compile_expression_statement(tc, ins, trimmed, line)) {
+            if (debug) fprintf(stderr, "FOR: unsupported step at line %d\n", line);
+            ins->op = OP_JUMP;
+        }
+        return;
+    }
+
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor != '\0') {
+        if (debug) fprintf(stderr, "FOR: unexpected characters after step at line %d\n", line);
+        ins->op = OP_JUMP;
+        return;
+    }
+
+    if (len == 0 || too_long) {
+        if (debug) fprintf(stderr, "FOR: invalid step variable at line %d\n", line);
+        ins->op = OP_JUMP;
+        return;
+    }
+
+    ins->op = OP_STEP;
+    ins->a = program_intern_slot(tc->prog, name);
+    ins->b = delta;
+}
+
+/* Emits the tail of the innermost FOR loop: step, condition and the jump
+   back to the body. A failed step or a false condition leaves the loop. */
+static void compiler_close_for(TaskCompiler *tc, int closing_line) {
+    BlockContext *ctx = &tc->for_stack[--tc->for_sp];
+    TaskProgram *prog = tc->prog;
+
+    int step = compiler_emit_instruction(tc, &ctx->step);
+    int back;
+    if (ctx->cond >= 0) {
+        back = compiler_emit(tc, OP_JUMP_IF_TRUE, ctx->line);
+        prog->code[back].d = ctx->cond;
+    } else {
+        back = compiler_emit(tc, OP_JUMP, ctx->line);
+    }
+    prog->code[back].target = ctx->body;
+
+    int exit = prog->code_count;
+    if (prog->code[step].op != OP_NOP) {
+        prog->code[step].target = exit;
+    }
+    if (ctx->entry >= 0) {
+        if (ctx->skip_line == closing_line) {
+            prog->code[ctx->entry].target = exit;
+        } else {
+            compiler_fixup(tc, ctx->entry, ctx->skip_line, FIX_LINE_START);
+        }
+    }
+}
+
+static void compile_if(TaskCompiler *tc, int pc, const char *command, int line) {
+    char cond_buf[256];
+    if (!parse_block_condition(command, 2, "IF", cond_buf, sizeof(cond_buf), line, tc->debug)) {
+        return;
+    }
+    int cond = compile_block_condition(tc, cond_buf, "IF", line);
+    if (tc->if_sp >= (int)(sizeof(tc->if_stack) / sizeof(tc->if_stack[0]))) {
+        if (tc->debug) fprintf(stderr, "IF: nesting limit reached at line %d\n", line);
+        return;
+    }
+
+    BlockContext *ctx = &tc->if_stack[tc->if_sp++];
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->line = pc;
+    ctx->indent = tc->script[pc].indent;
+
+    int jump = compiler_emit(tc, OP_JUMP_IF_FALSE, pc);
+    tc->prog->code[jump].d = cond;
+    int target = block_skip_target(tc->script, tc->count, pc, ctx->indent);
+    if (target < tc->count && command_is(tc->script[target].text, "ELSE", false)) {
+        // A false IF runs the ELSE branch, so land after the ELSE line itself.
+        compiler_fixup(tc, jump, target, FIX_LINE_END);
+    } else {
+        compiler_fixup(tc, jump, target, FIX_LINE_START);
+    }
+}
+
+static void compile_while(TaskCompiler *tc, int pc, const char *command, int line) {
+    if (tc->while_sp >= (int)(sizeof(tc->while_stack) / sizeof(tc->while_stack[0]))) {
+        if (tc->debug) fprintf(stderr, "WHILE: nesting limit reached at line %d\n", line);
+        return;
+    }
+    char cond_buf[256];
+    if (!parse_block_condition(command, 5, "WHILE", cond_buf, sizeof(cond_buf), line, tc->debug)) {
+        return;
+    }
+    int cond = compile_block_condition(tc, cond_buf, "WHILE", line);
+
+    BlockContext *ctx = &tc->while_stack[tc->while_sp++];
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->line = pc;
+    ctx->indent = tc->script[pc].indent;
+    ctx->skip_line = block_skip_target(tc->script, tc->count, pc, ctx->indent);
+    ctx->cond = compile_loop_condition(tc, cond_buf, line);
+    ctx->entry = compiler_emit(tc, OP_JUMP_IF_FALSE, pc);
+    tc->prog->code[ctx->entry].d = cond;
+    ctx->body = tc->prog->code_count;
+}
+
+static void compile_for(TaskCompiler *tc, int pc, const char *command, int line) {
+    int debug = tc->debug;
+    if (tc->for_sp >= (int)(sizeof(tc->for_stack) / sizeof(tc->for_stack[0]))) {
+        if (debug) fprintf(stderr, "FOR: nesting limit reached at line %d\n", line);
+        return;
+    }
+
+    const char *cursor = command + 3;
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+
+    const char *line_end = cursor + strlen(cursor);
+    while (line_end > cursor && isspace((unsigned char)*(line_end - 1))) {
+        line_end--;
+    }
+
+    bool has_colon = false;
+    if (line_end > cursor && *(line_end - 1) == ':') {
+        has_colon = true;
+        line_end--;
+        while (line_end > cursor && isspace((unsigned char)*(line_end - 1))) {
+            line_end--;
+        }
+    }
+
+    if (line_end == cursor) {
+        if (debug) fprintf(stderr, "FOR: expected loop body after header at line %d\n", line);
+        return;
+    }
+
+    bool has_paren = false;
+    if (*cursor == '(') {
+        has_paren = true;
+        cursor++;
+    }
+
+    const char *first_semi = strchr(cursor, ';');
+    if (!first_semi) {
+        if (debug) fprintf(stderr, "FOR: missing first ';' at line %d\n", line);
+        return;
+    }
+    const char *second_semi = strchr(first_semi + 1, ';');
+    if (!second_semi) {
+        if (debug) fprintf(stderr, "FOR: missing second ';' at line %d\n", line);
+        return;
+    }
+
+    const char *step_end = line_end;
+    if (has_paren) {
+        const char *closing = strchr(second_semi + 1, ')');
+        if (!closing) {
+            if (debug) fprintf(stderr, "FOR: missing closing ')' at line %d\n", line);
+            return;
+        }
+        step_end = closing;
+        if (has_colon && closing >= line_end) {
+            if (debug) fprintf(stderr, "FOR: ':' must appear after ')' at line %d\n", line);
+            return;
+        }
+    } else {
+        while (step_end > second_semi + 1 && isspace((unsigned char)*(step_end - 1))) {
+            step_end--;
+        }
+    }
+
+    char init_buf[256];
+    char cond_buf[256];
+    char step_buf[128];
+    memset(init_buf, 0, sizeof(init_buf));
+    memset(cond_buf, 0, sizeof(cond_buf));
+    memset(step_buf, 0, sizeof(step_buf));
+
+    copy_trimmed_segment(cursor, first_semi, init_buf, sizeof(init_buf));
+    copy_trimmed_segment(first_semi + 1, second_semi, cond_buf, sizeof(cond_buf));
+    copy_trimmed_segment(second_semi + 1, step_end, step_buf, sizeof(step_buf));
+
+    if (init_buf[0] != '\0') {
+        int init = compiler_emit(tc, OP_NOP, pc);
+        Instruction *ins = &tc->prog->code[init];
+        if (!compile_assignment(tc, ins, init_buf, "Assignment", line) &&
+            !compile_expression_statement(tc, ins, init_buf, line)) {
+            return;
+        }
+    }
+
+    int cond = -1;
+    int entry = -1;
+    if (cond_buf[0] != '\0') {
+        cond = compile_loop_condition(tc, cond_buf, line);
+        entry = compiler_emit(tc, OP_JUMP_IF_FALSE, pc);
+        tc->prog->code[entry].d = cond;
+    }
+    int skip_line = block_skip_target(tc->script, tc->count, pc, tc->script[pc].indent);
+
+    if (step_buf[0] == '\0') {
+        // Without a step the body runs once, as plain statements.
+        if (debug) fprintf(stderr, "FOR: missing step at line %d\n", line);
+        if (entry >= 0) {
+            compiler_fixup(tc, entry, skip_line, FIX_LINE_START);
+        }
+        return;
+    }
+
+    BlockContext *ctx = &tc->for_stack[tc->for_sp++];
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->line = pc;
+    ctx->indent = tc->script[pc].indent;
+    ctx->entry = entry;
+    ctx->skip_line = skip_line;
+    ctx->cond = cond;
+    memset(&ctx->step, 0, sizeof(ctx->step));
+    ctx->step.line = pc;
+    ctx->step.a = -1;
+    ctx->step.b = -1;
+    ctx->step.d = -1;
+    ctx->step.target = -1;
+    compile_for_step(tc, &ctx->step, step_buf, line);
+    ctx->body = tc->prog->code_count;
+}
+
+static void compile_else(TaskCompiler *tc, int pc, const char *command, int line) {
+    if (tc->if_sp <= 0) {
+        if (tc->debug) fprintf(stderr, "ELSE without matching IF at line %d\n", line);
+        return;
+    }
+    const char *cursor = command + 4;
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor == ':') {
+        cursor++;
+        while (isspace((unsigned char)*cursor)) {
+            cursor++;
+        }
+    }
+    if (*cursor != '\0' && tc->debug) {
+        fprintf(stderr, "ELSE: unexpected characters at %d\n", line);
+    }
+    BlockContext *ctx = &tc->if_stack[tc->if_sp - 1];
+    if (ctx->else_seen) {
+        if (tc->debug) fprintf(stderr, "ELSE already processed for IF at line %d\n", tc->script[ctx->line].source_line);
+        return;
+    }
+    ctx->else_seen = true;
+
+    // Reached from the true branch: skip the ELSE branch.
+    int jump = compiler_emit(tc, OP_JUMP, pc);
+    compiler_fixup(tc, jump, block_skip_target(tc->script, tc->count, pc, tc->script[pc].indent), FIX_LINE_START);
+}
+
+static void compile_end(TaskCompiler *tc, int pc, const char *command, int line) {
+    const char *cursor = command + 3;
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor != '\0' && tc->debug) {
+        fprintf(stderr, "END: unexpected characters at %d\n", line);
+    }
+
+    int indent = tc->script[pc].indent;
+    if (tc->while_sp > 0 && tc->while_stack[tc->while_sp - 1].indent == indent) {
+        BlockContext *ctx = &tc->while_stack[--tc->while_sp];
+        int back = compiler_emit(tc, OP_JUMP_IF_TRUE, pc);
+        tc->prog->code[back].d = ctx->cond;
+        tc->prog->code[back].target = ctx->body;
+        if (ctx->skip_line == pc) {
+            tc->prog->code[ctx->entry].target = tc->prog->code_count;
+        } else {
+            compiler_fixup(tc, ctx->entry, ctx->skip_line, FIX_LINE_START);
+        }
+        return;
+    }
+
+    /* FOR loops close as soon as indentation returns to their column, before
+       their END is reached, so only IF is left to match here. */
+    if (tc->if_sp > 0 && tc->if_stack[tc->if_sp - 1].indent == indent) {
+        tc->if_sp--;
+        return;
+    }
+
+    if (tc->debug) {
+        fprintf(stderr, "END without matching FOR/WHILE/IF at line %d\n", line);
+    }
+}
+
+static void compile_input(TaskCompiler *tc, int pc, const char *command, int line) {
+    int debug = tc->debug;
+    const char *cursor = command + 5;
+    char *var_token = NULL;
+    bool quoted = false;
+    if (!parse_token(&cursor, &var_token, &quoted, NULL) || quoted) {
+        if (debug) fprintf(stderr, "INPUT: expected variable at line %d\n", line);
+        free(var_token);
+        return;
+    }
+    char name[64];
+    if (!parse_variable_name_token(var_token, name, sizeof(name))) {
+        if (debug) fprintf(stderr, "INPUT: invalid variable name at line %d\n", line);
+        free(var_token);
+        return;
+    }
+    free(var_token);
+    bool wait_for_enter = true;
+    char *option_token = NULL;
+    bool option_quoted = false;
+    if (parse_token(&cursor, &option_token, &option_quoted, NULL)) {
+        if (option_quoted) {
+            if (debug) fprintf(stderr, "INPUT: unexpected quoted argument at line %d\n", line);
+            free(option_token);
+            return;
+        }
+        if (equals_ignore_case(option_token, "-wait")) {
+            free(option_token);
+            option_token = NULL;
+            char *value_token = NULL;
+            bool value_quoted = false;
+            if (!parse_token(&cursor, &value_token, &value_quoted, NULL) || value_quoted) {
+                if (debug) fprintf(stderr, "INPUT: -wait expects ON or OFF at line %d\n", line);
+                free(value_token);
+                return;
+            }
+            if (equals_ignore_case(value_token, "on")) {
+                wait_for_enter = true;
+            } else if (equals_ignore_case(value_token, "off")) {
+                wait_for_enter = false;
+            } else {
+                if (debug) fprintf(stderr, "INPUT: -wait expects ON or OFF at line %d\n", line);
+                free(value_token);
+                return;
             }
+            free(value_token);
+        } else {
+            if (debug) fprintf(stderr, "INPUT: unexpected argument '%s' at line %d\n", option_token, line);
+            free(option_token);
+            return;
+        }
+    }
+    free(option_token);
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor != '\0' && debug) {
+        fprintf(stderr, "INPUT: unexpected characters at %d\n", line);
+    }
+
+    int ins = compiler_emit(tc, OP_INPUT, pc);
+    tc->prog->code[ins].a = program_intern_slot(tc->prog, name);
+    tc->prog->code[ins].b = wait_for_enter ? 1 : 0;
+}
+
+static void compile_set(TaskCompiler *tc, int pc, const char *command, int line) {
+    int debug = tc->debug;
+    const char *cursor = command + 3;
+    char *var_token = NULL;
+    bool quoted = false;
+    bool static_target = false;
+    if (!parse_token(&cursor, &var_token, &quoted, NULL) || quoted) {
+        if (debug) fprintf(stderr, "SET: expected variable at line %d\n", line);
+        free(var_token);
+        return;
+    }
+    if (equals_ignore_case(var_token, "STATIC")) {
+        static_target = true;
+        free(var_token);
+        var_token = NULL;
+        while (isspace((unsigned char)*cursor)) {
             cursor++;
+        }
+        if (!parse_token(&cursor, &var_token, &quoted, NULL) || quoted) {
+            if (debug) fprintf(stderr, "SET: expected variable after STATIC at line %d\n", line);
+            free(var_token);
+            return;
+        }
+    }
+    int indices[MAX_REF_INDICES];
+    int index_count = 0;
+    int slot = -1;
+    if (!compile_variable_reference(tc->prog, var_token, &slot, indices, &index_count, line, debug)) {
+        if (debug) fprintf(stderr, "SET: invalid variable name at line %d\n", line);
+        free(var_token);
+        return;
+    }
+    free(var_token);
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor != '=') {
+        if (debug) fprintf(stderr, "SET: expected '=' at line %d\n", line);
+        return;
+    }
+    cursor++;
+    int value = compile_expression_text(tc->prog, &cursor, NULL, line, debug);
+    if (value < 0) {
+        return;
+    }
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor != '\0' && debug) {
+        fprintf(stderr, "SET: unexpected characters at %d\n", line);
+    }
 
-            Value args[MAX_FUNCTION_PARAMS];
-            int arg_count = 0;
-            bool ok = true;
-            memset(args, 0, sizeof(args));
-            while (1) {
-                while (isspace((unsigned char)*cursor)) {
-                    cursor++;
-                }
-                if (*cursor == ')') {
-                    cursor++;
-                    break;
-                }
-                if (arg_count >= MAX_FUNCTION_PARAMS) {
-                    if (debug) fprintf(stderr, "EVAL: too many arguments at line %d\n", script[pc].source_line);
-                    ok = false;
-                    break;
-                }
-                if (!parse_expression(&cursor, &args[arg_count], ",)", script[pc].source_line, debug)) {
-                    ok = false;
-                    break;
-                }
-                arg_count++;
-                while (isspace((unsigned char)*cursor)) {
-                    cursor++;
-                }
-                if (*cursor == ',') {
-                    cursor++;
-                    continue;
-                }
-                if (*cursor == ')') {
-                    cursor++;
-                    break;
-                }
-                ok = false;
-                break;
+    int ins = compiler_emit(tc, static_target ? OP_ASSIGN_STATIC : OP_ASSIGN, pc);
+    tc->prog->code[ins].a = slot;
+    tc->prog->code[ins].b = program_add_list(tc->prog, indices, index_count);
+    tc->prog->code[ins].c = index_count;
+    tc->prog->code[ins].d = value;
+    tc->prog->code[ins].text = "SET";
+}
+
+static void compile_print(TaskCompiler *tc, int pc, const char *command, int line) {
+    const char *cursor = command + 5;
+    int terms[64];
+    int *list = terms;
+    int list_cap = (int)(sizeof(terms) / sizeof(terms[0]));
+    int count = 0;
+    bool ok = true;
+    while (1) {
+        int start = tc->prog->expr_count;
+        if (!compile_value_token(tc->prog, &cursor, "+", line, tc->debug)) {
+            ok = false;
+            break;
+        }
+        program_emit_expr(tc->prog, EXPR_END, 0, 0);
+        if (count == list_cap) {
+            int *grown = (int *)malloc((size_t)list_cap * 2 * sizeof(int));
+            if (!grown) {
+                perror("malloc");
+                exit(EXIT_FAILURE);
+            }
+            memcpy(grown, list, (size_t)count * sizeof(int));
+            if (list != terms) {
+                free(list);
             }
+            list = grown;
+            list_cap *= 2;
+        }
+        list[count++] = start;
+        while (isspace((unsigned char)*cursor)) {
+            cursor++;
+        }
+        if (*cursor == '+') {
+            cursor++;
+            continue;
+        }
+        break;
+    }
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (ok && *cursor != '\0') {
+        ok = false;
+        if (tc->debug) {
+            fprintf(stderr, "PRINT: unexpected characters at %d\n", line);
+        }
+    }
+    if (ok) {
+        int ins = compiler_emit(tc, OP_PRINT, pc);
+        tc->prog->code[ins].b = program_add_list(tc->prog, list, count);
+        tc->prog->code[ins].c = count;
+    }
+    if (list != terms) {
+        free(list);
+    }
+}
+
+static void compile_eval(TaskCompiler *tc, int pc, const char *command, int line) {
+    int debug = tc->debug;
+    const char *cursor = command + 4;
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    const char *name_start = cursor;
+    while (*cursor && (isalnum((unsigned char)*cursor) || *cursor == '_')) {
+        cursor++;
+    }
+    size_t name_len = (size_t)(cursor - name_start);
+    char func_name[sizeof(((FunctionDef *)0)->name)];
+    if (name_len == 0 || name_len >= sizeof(func_name)) {
+        if (debug) fprintf(stderr, "EVAL: invalid function name at line %d\n", line);
+        return;
+    }
+    memcpy(func_name, name_start, name_len);
+    func_name[name_len] = '\0';
+
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor != '(') {
+        if (debug) fprintf(stderr, "EVAL: expected '(' after function name at line %d\n", line);
+        return;
+    }
+    cursor++;
+
+    int args[MAX_FUNCTION_PARAMS];
+    int arg_count = 0;
+    bool ok = true;
+    while (1) {
+        while (isspace((unsigned char)*cursor)) {
+            cursor++;
+        }
+        if (*cursor == ')') {
+            cursor++;
+            break;
+        }
+        if (arg_count >= MAX_FUNCTION_PARAMS) {
+            if (debug) fprintf(stderr, "EVAL: too many arguments at line %d\n", line);
+            ok = false;
+            break;
+        }
+        args[arg_count] = compile_expression_text(tc->prog, &cursor, ",)", line, debug);
+        if (args[arg_count] < 0) {
+            ok = false;
+            break;
+        }
+        arg_count++;
+        while (isspace((unsigned char)*cursor)) {
+            cursor++;
+        }
+        if (*cursor == ',') {
+            cursor++;
+            continue;
+        }
+        if (*cursor == ')') {
+            cursor++;
+            break;
+        }
+        ok = false;
+        break;
+    }
 
-            char target_var[sizeof(((Variable *)0)->name)];
-            bool has_target = false;
+    char target_var[sizeof(((Variable *)0)->name)];
+    bool has_target = false;
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor != '\0') {
+        const char *after_to = NULL;
+        if (!match_keyword(cursor, "TO", &after_to)) {
+            if (debug) fprintf(stderr, "EVAL: expected TO after arguments at line %d\n", line);
+            ok = false;
+        } else {
+            cursor = after_to;
             while (isspace((unsigned char)*cursor)) {
                 cursor++;
             }
-            if (*cursor != '\0') {
-                const char *after_to = NULL;
-                if (!match_keyword(cursor, "TO", &after_to)) {
-                    if (debug) fprintf(stderr, "EVAL: expected TO after arguments at line %d\n", script[pc].source_line);
+            char *var_token = NULL;
+            bool quoted = false;
+            if (!parse_token(&cursor, &var_token, &quoted, NULL) || quoted) {
+                if (debug) fprintf(stderr, "EVAL: expected variable after TO at line %d\n", line);
+                free(var_token);
+                ok = false;
+            } else {
+                if (!parse_variable_name_token(var_token, target_var, sizeof(target_var))) {
+                    if (debug) fprintf(stderr, "EVAL: invalid variable name after TO at line %d\n", line);
                     ok = false;
                 } else {
-                    cursor = after_to;
-                    while (isspace((unsigned char)*cursor)) {
-                        cursor++;
-                    }
-                    char *var_token = NULL;
-                    bool quoted = false;
-                    if (!parse_token(&cursor, &var_token, &quoted, NULL) || quoted) {
-                        if (debug) fprintf(stderr, "EVAL: expected variable after TO at line %d\n", script[pc].source_line);
-                        free(var_token);
-                        ok = false;
-                    } else {
-                        if (!parse_variable_name_token(var_token, target_var, sizeof(target_var))) {
-                            if (debug) fprintf(stderr, "EVAL: invalid variable name after TO at line %d\n", script[pc].source_line);
-                            ok = false;
-                        } else {
-                            has_target = true;
-                        }
-                        free(var_token);
-                        while (isspace((unsigned char)*cursor)) {
-                            cursor++;
-                        }
-                        if (*cursor != '\0') {
-                            if (debug) fprintf(stderr, "EVAL: unexpected characters at line %d\n", script[pc].source_line);
-                            ok = false;
-                        }
-                    }
+                    has_target = true;
                 }
-            }
-
-            if (!ok) {
-                for (int i = 0; i < arg_count; ++i) {
-                    free_value(&args[i]);
+                free(var_token);
+                while (isspace((unsigned char)*cursor)) {
+                    cursor++;
                 }
-                continue;
-            }
-
-            int fn_index = find_function_index(functions, function_count, func_name);
-            if (fn_index < 0) {
-                if (debug) fprintf(stderr, "EVAL: unknown function '%s' at line %d\n", func_name, script[pc].source_line);
-                for (int i = 0; i < arg_count; ++i) {
-                    free_value(&args[i]);
+                if (*cursor != '\0') {
+                    if (debug) fprintf(stderr, "EVAL: unexpected characters at line %d\n", line);
+                    ok = false;
                 }
-                continue;
             }
+        }
+    }
 
-            FunctionDef *fn = &functions[fn_index];
-            if (arg_count != fn->param_count) {
-                if (debug) fprintf(stderr, "EVAL: argument count mismatch for %s at line %d\n", func_name, script[pc].source_line);
-                for (int i = 0; i < arg_count; ++i) {
-                    free_value(&args[i]);
-                }
-                continue;
-            }
+    if (!ok) {
+        return;
+    }
 
-            if (call_sp >= (int)(sizeof(call_stack) / sizeof(call_stack[0]))) {
-                if (debug) fprintf(stderr, "EVAL: call stack limit reached at line %d\n", script[pc].source_line);
-                for (int i = 0; i < arg_count; ++i) {
-                    free_value(&args[i]);
-                }
-                continue;
-            }
+    int fn_index = find_function_index(tc->functions, tc->function_count, func_name);
+    if (fn_index < 0) {
+        if (debug) fprintf(stderr, "EVAL: unknown function '%s' at line %d\n", func_name, line);
+        return;
+    }
+    if (arg_count != tc->functions[fn_index].param_count) {
+        if (debug) fprintf(stderr, "EVAL: argument count mismatch for %s at line %d\n", func_name, line);
+        return;
+    }
 
-            int previous_function_index = current_function_index;
-            current_function_index = fn_index;
+    int ins = compiler_emit(tc, OP_CALL, pc);
+    tc->prog->code[ins].a = fn_index;
+    tc->prog->code[ins].b = program_add_list(tc->prog, args, arg_count);
+    tc->prog->code[ins].c = arg_count;
+    tc->prog->code[ins].d = has_target ? program_intern_slot(tc->prog, target_var) : -1;
+    compiler_fixup(tc, ins, tc->functions[fn_index].start_pc, FIX_LINE_START);
+}
 
-            if (!push_scope()) {
-                current_function_index = previous_function_index;
-                for (int i = 0; i < arg_count; ++i) {
-                    free_value(&args[i]);
-                }
-                continue;
-            }
+static void compile_echo(TaskCompiler *tc, int pc, const char *command, int line) {
+    const char *cursor = command + 4;
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+
+    char *mode_token = NULL;
+    bool quoted = false;
+    if (!parse_token(&cursor, &mode_token, &quoted, NULL) || quoted) {
+        if (tc->debug) fprintf(stderr, "ECHO: expected ON or OFF at line %d\n", line);
+        free(mode_token);
+        return;
+    }
+
+    bool enable = true;
+    if (equals_ignore_case(mode_token, "ON")) {
+        enable = true;
+    } else if (equals_ignore_case(mode_token, "OFF")) {
+        enable = false;
+    } else {
+        if (tc->debug) fprintf(stderr, "ECHO: expected ON or OFF at line %d\n", line);
+        free(mode_token);
+        return;
+    }
+    free(mode_token);
+
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor != '\0' && tc->debug) {
+        fprintf(stderr, "ECHO: unexpected characters at %d\n", line);
+    }
+
+    int ins = compiler_emit(tc, OP_ECHO, pc);
+    tc->prog->code[ins].a = enable ? 1 : 0;
+}
+
+static void compile_goto(TaskCompiler *tc, int pc, const char *command, int line) {
+    int debug = tc->debug;
+    const char *cursor = command + 4;
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
 
-            for (int i = 0; i < arg_count; ++i) {
-                Variable *param = find_variable(fn->params[i], true);
-                if (param) {
-                    assign_variable(param, &args[i]);
+    if (*cursor == '$') {
+        cursor++;
+        char var_name[sizeof(((Variable *)0)->name)];
+        size_t name_len = 0;
+        bool name_too_long = false;
+        while (isalnum((unsigned char)*cursor) || *cursor == '_') {
+            if (!name_too_long) {
+                if (name_len + 1 >= sizeof(var_name)) {
+                    name_too_long = true;
+                } else {
+                    var_name[name_len++] = *cursor;
                 }
-                free_value(&args[i]);
-            }
-
-            CallFrame *frame = &call_stack[call_sp++];
-            memset(frame, 0, sizeof(*frame));
-            frame->return_pc = pc;
-            frame->function_end_pc = fn->end_pc;
-            frame->has_return_target = has_target;
-            if (has_target) {
-                snprintf(frame->return_target, sizeof(frame->return_target), "%s", target_var);
-            }
-            frame->has_return_value = false;
-            frame->saved_if_sp = if_sp;
-            frame->saved_for_sp = for_sp;
-            frame->saved_while_sp = while_sp;
-            frame->saved_skipping_block = skipping_block;
-            frame->saved_skip_indent = skip_indent;
-            frame->saved_skip_context_index = skip_context_index;
-            frame->saved_skip_for_true_branch = skip_for_true_branch;
-            frame->saved_skip_progress_pending = skip_progress_pending;
-            frame->saved_skip_consumed_first = skip_consumed_first;
-            frame->previous_function_index = previous_function_index;
-            frame->function_index = fn_index;
-
-            current_function_index = fn_index;
-
-            if_sp = 0;
-            for_sp = 0;
-            while_sp = 0;
-            skipping_block = false;
-            skip_indent = 0;
-            skip_context_index = -1;
-            skip_for_true_branch = false;
-            skip_progress_pending = false;
-            skip_consumed_first = false;
-
-            pc = fn->start_pc - 1;
-            pc_changed = true;
-            note_branch_progress(if_stack, &if_sp);
-            continue;
+            }
+            cursor++;
         }
-        else if (strncmp(command, "ECHO", 4) == 0 && (command[4] == '\0' || isspace((unsigned char)command[4]))) {
-            const char *cursor = command + 4;
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
+        if (name_len == 0 || name_too_long ||
+            (*cursor != '\0' && !isspace((unsigned char)*cursor) && *cursor != ':')) {
+            if (debug) {
+                fprintf(stderr, "GOTO: invalid variable reference at %d: %s\n", line, command);
             }
+            return;
+        }
+        var_name[name_len] = '\0';
+        if (*cursor == ':') {
+            cursor++;
+        }
+        while (isspace((unsigned char)*cursor)) {
+            cursor++;
+        }
+        if (*cursor != '\0' && debug) {
+            fprintf(stderr, "GOTO: unexpected characters at %d\n", line);
+        }
+        int ins = compiler_emit(tc, OP_GOTO_VAR, pc);
+        tc->prog->code[ins].a = program_intern_slot(tc->prog, var_name);
+        return;
+    }
 
-            char *mode_token = NULL;
-            bool quoted = false;
-            if (!parse_token(&cursor, &mode_token, &quoted, NULL) || quoted) {
-                if (debug) fprintf(stderr, "ECHO: expected ON or OFF at line %d\n", script[pc].source_line);
-                free(mode_token);
-                continue;
-            }
+    if (*cursor == '@') {
+        cursor++;
+    }
+    if (*cursor == '\0') {
+        if (debug) {
+            fprintf(stderr, "GOTO: missing label at %d: %s\n", line, command);
+        }
+        return;
+    }
 
-            bool enable = true;
-            if (equals_ignore_case(mode_token, "ON")) {
-                enable = true;
-            } else if (equals_ignore_case(mode_token, "OFF")) {
-                enable = false;
-            } else {
-                if (debug) fprintf(stderr, "ECHO: expected ON or OFF at line %d\n", script[pc].source_line);
-                free(mode_token);
-                continue;
-            }
-            free(mode_token);
+    char label_token[64];
+    size_t len = 0;
+    bool too_long = false;
+    while (*cursor && !isspace((unsigned char)*cursor) && *cursor != ':') {
+        if (len + 1 >= sizeof(label_token)) {
+            too_long = true;
+        } else {
+            label_token[len++] = *cursor;
+        }
+        cursor++;
+    }
+    label_token[len] = '\0';
+    if (len == 0) {
+        if (debug) {
+            fprintf(stderr, "GOTO: empty label at %d\n", line);
+        }
+        return;
+    }
+    if (too_long) {
+        if (debug) {
+            fprintf(stderr, "GOTO: label too long at %d\n", line);
+        }
+        return;
+    }
 
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
-            }
-            if (*cursor != '\0' && debug) {
-                fprintf(stderr, "ECHO: unexpected characters at %d\n", script[pc].source_line);
-            }
+    if (*cursor == ':') {
+        cursor++;
+    }
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    if (*cursor != '\0' && debug) {
+        fprintf(stderr, "GOTO: unexpected characters at %d\n", line);
+    }
+    char normalized[64];
+    normalize_label_name(label_token, normalized, sizeof(normalized));
+    int label_index = find_label_index(tc->labels, tc->label_count, normalized);
+    if (label_index < 0) {
+        if (debug) {
+            fprintf(stderr, "GOTO: label '%s' not found at %d\n", label_token, line);
+        }
+        return;
+    }
+    int ins = compiler_emit(tc, OP_JUMP, pc);
+    compiler_fixup(tc, ins, tc->labels[label_index].index, FIX_LINE_BODY);
+}
 
-            if (!set_echo_enabled(enable) && debug) {
-                fprintf(stderr, "ECHO: failed to update terminal state at line %d\n", script[pc].source_line);
-            }
-            note_branch_progress(if_stack, &if_sp);
+static void compile_return(TaskCompiler *tc, int pc, const char *command, int line) {
+    const char *cursor = command + 6;
+    while (isspace((unsigned char)*cursor)) {
+        cursor++;
+    }
+    int value = -1;
+    if (*cursor != '\0') {
+        value = compile_expression_text(tc->prog, &cursor, NULL, line, tc->debug);
+        if (value < 0) {
+            return;
         }
-        else if (strncmp(command, "WAIT", 4) == 0) {
-            int ms;
-            if (sscanf(command, "WAIT %d", &ms) == 1) {
-                delay_ms(ms);
-            } else if (debug) {
-                fprintf(stderr, "WAIT: invalid format at %d: %s\n", script[pc].source_line, command);
-            }
-            note_branch_progress(if_stack, &if_sp);
+        while (isspace((unsigned char)*cursor)) {
+            cursor++;
         }
-        else if (strncmp(command, "GOTO", 4) == 0 && (command[4] == '\0' || isspace((unsigned char)command[4]))) {
-            const char *cursor = command + 4;
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
+        if (*cursor != '\0') {
+            if (tc->debug) fprintf(stderr, "RETURN: unexpected characters at line %d\n", line);
+            return;
+        }
+    }
+    int ins = compiler_emit(tc, OP_RETURN, pc);
+    tc->prog->code[ins].d = value;
+}
+
+static void compile_statement(TaskCompiler *tc, int pc) {
+    ScriptLine *script_line = &tc->script[pc];
+    char *command = script_line->text;
+    int line = script_line->source_line;
+
+    if (script_line->type == LINE_FUNCTION) {
+        for (int i = 0; i < tc->function_count; ++i) {
+            const FunctionDef *fn = &tc->functions[i];
+            if (fn->definition_pc == pc && fn->end_pc > pc) {
+                int ins = compiler_emit(tc, OP_JUMP, pc);
+                compiler_fixup(tc, ins, fn->end_pc, FIX_LINE_BODY);
+                break;
             }
+        }
+        return;
+    }
+    if (script_line->type == LINE_LABEL) {
+        return;
+    }
 
-            char label_token[64];
-            bool label_ok = true;
-            label_token[0] = '\0';
+    if (command_is(command, "IF", true)) {
+        compile_if(tc, pc, command, line);
+    } else if (command_is(command, "WHILE", true)) {
+        compile_while(tc, pc, command, line);
+    } else if (command_is(command, "FOR", false)) {
+        compile_for(tc, pc, command, line);
+    } else if (command_is(command, "ELSE", false)) {
+        compile_else(tc, pc, command, line);
+    } else if (command_is(command, "END", false)) {
+        compile_end(tc, pc, command, line);
+    } else if (command_is(command, "INPUT", false)) {
+        compile_input(tc, pc, command, line);
+    } else if (command_is(command, "SET", false)) {
+        compile_set(tc, pc, command, line);
+    } else if (command[0] == '$') {
+        int ins = compiler_emit(tc, OP_NOP, pc);
+        compile_assignment(tc, &tc->prog->code[ins], command, "Assignment", line);
+    } else if (command_is(command, "PRINT", false)) {
+        compile_print(tc, pc, command, line);
+    } else if (command_is(command, "EVAL", false)) {
+        compile_eval(tc, pc, command, line);
+    } else if (command_is(command, "ECHO", false)) {
+        compile_echo(tc, pc, command, line);
+    } else if (strncmp(command, "WAIT", 4) == 0) {
+        int ms;
+        if (sscanf(command, "WAIT %d", &ms) == 1) {
+            int ins = compiler_emit(tc, OP_WAIT, pc);
+            tc->prog->code[ins].a = ms;
+        } else if (tc->debug) {
+            fprintf(stderr, "WAIT: invalid format at %d: %s\n", line, command);
+        }
+    } else if (command_is(command, "GOTO", false)) {
+        compile_goto(tc, pc, command, line);
+    } else if (command_is(command, "SYS", false)) {
+        int ins = compiler_emit(tc, OP_SYS, pc);
+        tc->prog->code[ins].text = trim(command + 3);
+    } else if (strncmp(command, "RUN", 3) == 0) {
+        int ins = compiler_emit(tc, OP_RUN, pc);
+        tc->prog->code[ins].text = trim(command + 3);
+    } else if (command_is(command, "RETURN", false)) {
+        compile_return(tc, pc, command, line);
+    } else if (strncmp(command, "CLEAR", 5) == 0) {
+        compiler_emit(tc, OP_CLEAR, pc);
+    } else if (tc->debug) {
+        fprintf(stderr, "Unrecognized command at %d: %s\n", line, command);
+    }
+}
 
-            if (*cursor == '$') {
-                cursor++;
-                char var_name[sizeof(((Variable *)0)->name)];
-                size_t name_len = 0;
-                bool name_too_long = false;
-                while (isalnum((unsigned char)*cursor) || *cursor == '_') {
-                    if (!name_too_long) {
-                        if (name_len + 1 >= sizeof(var_name)) {
-                            name_too_long = true;
-                        } else {
-                            var_name[name_len++] = *cursor;
-                        }
-                    }
-                    cursor++;
-                }
-                if (name_len == 0 || name_too_long) {
-                    if (debug) {
-                        fprintf(stderr, "GOTO: invalid variable reference at %d: %s\n", script[pc].source_line, command);
-                    }
-                    label_ok = false;
-                } else if (*cursor != '\0' && !isspace((unsigned char)*cursor) && *cursor != ':') {
-                    if (debug) {
-                        fprintf(stderr, "GOTO: invalid variable reference at %d: %s\n", script[pc].source_line, command);
-                    }
-                    label_ok = false;
-                } else {
-                    var_name[name_len] = '\0';
-                    Variable *var = find_variable(var_name, false);
-                    Value value = variable_to_value(var);
-                    char *resolved = value_to_string(&value);
-                    free_value(&value);
-                    if (!resolved) {
-                        resolved = xstrdup("");
-                    }
-                    char *resolved_raw = resolved;
-                    char *start = resolved_raw;
-                    while (isspace((unsigned char)*start)) {
-                        start++;
-                    }
-                    char *end = start + strlen(start);
-                    while (end > start && isspace((unsigned char)*(end - 1))) {
-                        end--;
-                    }
-                    *end = '\0';
-                    if (start != resolved_raw) {
-                        memmove(resolved_raw, start, (size_t)(end - start + 1));
-                    }
-                    char *label_source = resolved_raw;
-                    if (label_source[0] == '@') {
-                        label_source++;
-                    }
-                    size_t len = strlen(label_source);
-                    if (len == 0) {
-                        if (debug) {
-                            fprintf(stderr, "GOTO: variable '%s' is empty at %d\n", var_name, script[pc].source_line);
-                        }
-                        label_ok = false;
-                    } else if (len >= sizeof(label_token)) {
-                        if (debug) {
-                            fprintf(stderr, "GOTO: label from variable '%s' too long at %d\n", var_name, script[pc].source_line);
-                        }
-                        label_ok = false;
-                    } else {
-                        memcpy(label_token, label_source, len + 1);
-                    }
-                    free(resolved_raw);
-                }
-            } else {
-                if (*cursor == '@') {
-                    cursor++;
-                }
-                if (*cursor == '\0') {
-                    if (debug) {
-                        fprintf(stderr, "GOTO: missing label at %d: %s\n", script[pc].source_line, command);
-                    }
-                    label_ok = false;
-                } else {
-                    size_t len = 0;
-                    bool too_long = false;
-                    while (*cursor && !isspace((unsigned char)*cursor) && *cursor != ':') {
-                        if (len + 1 >= sizeof(label_token)) {
-                            too_long = true;
-                        } else {
-                            label_token[len++] = *cursor;
-                        }
-                        cursor++;
-                    }
-                    label_token[len] = '\0';
-                    if (len == 0) {
-                        if (debug) {
-                            fprintf(stderr, "GOTO: empty label at %d\n", script[pc].source_line);
-                        }
-                        label_ok = false;
-                    } else if (too_long) {
-                        if (debug) {
-                            fprintf(stderr, "GOTO: label too long at %d\n", script[pc].source_line);
-                        }
-                        label_ok = false;
-                    }
-                }
-            }
+/* Lowers the loaded script into `prog`. Block structure is resolved the way
+   the line interpreter used to track it at run time: IF/ELSE/END and
+   WHILE/END pair up by indentation, and a FOR body runs until indentation
+   returns to the FOR's column. */
+static void compile_task_program(TaskProgram *prog, ScriptLine *script, int count, const Label *labels, int label_count,
+                                 const FunctionDef *functions, int function_count, int debug) {
+    TaskCompiler *tc = (TaskCompiler *)calloc(1, sizeof(TaskCompiler));
+    if (!tc) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(prog, 0, sizeof(*prog));
+    tc->prog = prog;
+    tc->script = script;
+    tc->count = count;
+    tc->labels = labels;
+    tc->label_count = label_count;
+    tc->functions = functions;
+    tc->function_count = function_count;
+    tc->debug = debug;
+
+    size_t line_slots = (size_t)count + 1;
+    prog->line_start = (int *)calloc(line_slots, sizeof(int));
+    prog->line_body = (int *)calloc(line_slots, sizeof(int));
+    prog->line_end = (int *)calloc(line_slots, sizeof(int));
+    if (!prog->line_start || !prog->line_body || !prog->line_end) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
 
-            if (!label_ok) {
-                note_branch_progress(if_stack, &if_sp);
-                continue;
+    for (int pc = 0; pc <= count; ++pc) {
+        prog->line_start[pc] = prog->code_count;
+        while (tc->for_sp > 0 && (pc == count || script[pc].indent <= tc->for_stack[tc->for_sp - 1].indent)) {
+            compiler_close_for(tc, pc);
+        }
+        for (int i = 0; i < function_count; ++i) {
+            if (functions[i].end_pc == pc && functions[i].definition_pc < pc) {
+                int ins = compiler_emit(tc, OP_FUNCTION_END, pc < count ? pc : functions[i].definition_pc);
+                prog->code[ins].a = i;
             }
+        }
+        prog->line_body[pc] = prog->code_count;
+        if (pc == count) {
+            prog->line_end[pc] = prog->code_count;
+            break;
+        }
 
-            if (*cursor == ':') {
-                cursor++;
-            }
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
-            }
-            if (*cursor != '\0' && debug) {
-                fprintf(stderr, "GOTO: unexpected characters at %d\n", script[pc].source_line);
-            }
-            char normalized[64];
-            normalize_label_name(label_token, normalized, sizeof(normalized));
-            int label_index = find_label_index(labels, label_count, normalized);
-            if (label_index < 0) {
-                if (debug) {
-                    fprintf(stderr, "GOTO: label '%s' not found at %d\n", label_token, script[pc].source_line);
-                }
-            } else {
-                int target_index = labels[label_index].index;
-                pc = target_index - 1; // -1 because loop will ++pc
-                pc_changed = true;
-            }
-            note_branch_progress(if_stack, &if_sp);
-        }
-        else if (strncmp(command, "SYS", 3) == 0 && (command[3] == '\0' || isspace((unsigned char)command[3]))) {
-            const char *after = command + 3;
-            char *cmdline = trim((char *)after);
-            run_sys_command(cmdline, script[pc].source_line, debug);
-            note_branch_progress(if_stack, &if_sp);
-        }
-        else if (strncmp(command, "RUN", 3) == 0) {
-            const char *after = command + 3;
-            char *cmdline = trim((char*)after);
-            if (!*cmdline) {
-                if (debug) fprintf(stderr, "RUN: missing command at line %d\n", script[pc].source_line);
-                continue;
-            }
+        compile_statement(tc, pc);
+        if (prog->code_count == prog->line_body[pc]) {
+            compiler_emit(tc, OP_NOP, pc);
+        }
+        prog->code[prog->line_body[pc]].trace = true;
+        prog->line_end[pc] = prog->code_count;
+    }
 
-            ensure_task_workdir();
+    for (int i = 0; i < tc->while_sp; ++i) {
+        compiler_fixup(tc, tc->while_stack[i].entry, tc->while_stack[i].skip_line, FIX_LINE_START);
+    }
 
-            // Tokenize to argv[] (heap-based)
-            int argcnt = 0;
-            char **argv_heap = split_args_heap(cmdline, &argcnt);
-            if (argcnt <= 0) {
-                if (debug) fprintf(stderr, "RUN: failed to parse command at line %d\n", script[pc].source_line);
-                free_argv(argv_heap);
-                continue;
-            }
+    for (int i = 0; i < tc->fixup_count; ++i) {
+        const JumpFixup *fix = &tc->fixups[i];
+        const int *table = prog->line_start;
+        if (fix->kind == FIX_LINE_BODY) {
+            table = prog->line_body;
+        } else if (fix->kind == FIX_LINE_END) {
+            table = prog->line_end;
+        }
+        prog->code[fix->instruction].target = table[fix->line];
+    }
 
-            bool blocking_mode = true;
-            bool capture_output = false;
-            Variable *capture_var = NULL;
-            VariableRef capture_ref;
-            char *captured_output = NULL;
-            size_t captured_len = 0;
-            size_t captured_cap = 0;
-            bool use_execvp = false;
-            bool explicit_path_requested = false;
-            bool run_in_exec_dir = false;
-            char resolved[PATH_MAX];
+    free(tc->fixups);
+    free(tc);
+}
 
-            if (argcnt > 0) {
-                if (equals_ignore_case(argv_heap[0], "BLOCKING")) {
-                    blocking_mode = true;
-                    free(argv_heap[0]);
-                    for (int i = 1; i < argcnt; ++i) {
-                        argv_heap[i - 1] = argv_heap[i];
-                    }
-                    argv_heap[argcnt - 1] = NULL;
-                    argcnt--;
-                } else if (equals_ignore_case(argv_heap[0], "NONBLOCKING") ||
-                           equals_ignore_case(argv_heap[0], "NON-BLOCKING")) {
-                    blocking_mode = false;
-                    free(argv_heap[0]);
-                    for (int i = 1; i < argcnt; ++i) {
-                        argv_heap[i - 1] = argv_heap[i];
-                    }
-                    argv_heap[argcnt - 1] = NULL;
-                    argcnt--;
-                }
-            }
+static void execute_input(Variable *var, bool wait_for_enter, int line, int debug) {
+    fflush(stdout);
+    char buffer[512];
+    if (wait_for_enter) {
+        if (!fgets(buffer, sizeof(buffer), stdin)) {
+            if (debug) fprintf(stderr, "INPUT: failed to read input at line %d\n", line);
+            buffer[0] = '\0';
+        } else {
+            size_t len = strcspn(buffer, "\r\n");
+            buffer[len] = '\0';
+        }
+    } else {
+        if (!read_keypress_sequence(buffer, sizeof(buffer))) {
+            if (debug) fprintf(stderr, "INPUT: failed to read key press at line %d\n", line);
+            buffer[0] = '\0';
+        }
+    }
+    long long iv = 0;
+    double fv = 0.0;
+    Value val;
+    memset(&val, 0, sizeof(val));
+    ValueType vt = detect_numeric_type(buffer, &iv, &fv);
+    if (vt == VALUE_INT) {
+        val.type = VALUE_INT;
+        val.int_val = iv;
+        val.float_val = (double)iv;
+    } else if (vt == VALUE_FLOAT) {
+        val.type = VALUE_FLOAT;
+        val.float_val = fv;
+        val.int_val = float_to_int(fv);
+    } else {
+        val.type = VALUE_STRING;
+        val.str_val = xstrdup(buffer);
+        val.owns_string = true;
+    }
+    assign_variable(var, &val);
+    free_value(&val);
+}
 
-            if (argcnt <= 0) {
-                if (debug) fprintf(stderr, "RUN: missing executable at line %d\n", script[pc].source_line);
-                free_argv(argv_heap);
-                continue;
+static void execute_print(TaskProgram *prog, const Instruction *ins, int line, int debug) {
+    size_t out_cap = 128;
+    size_t out_len = 0;
+    char *out_buf = (char *)malloc(out_cap);
+    if (!out_buf) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < ins->c; ++i) {
+        Value term;
+        if (!program_eval(prog, prog->lists[ins->b + i], &term, line, debug)) {
+            free(out_buf);
+            return;
+        }
+        char *as_str = value_to_string(&term);
+        size_t need = strlen(as_str);
+        if (out_len + need + 1 > out_cap) {
+            while (out_len + need + 1 > out_cap) {
+                out_cap *= 2;
+            }
+            char *tmp = (char *)realloc(out_buf, out_cap);
+            if (!tmp) {
+                perror("realloc");
+                free(out_buf);
+                free(as_str);
+                free_value(&term);
+                exit(EXIT_FAILURE);
             }
+            out_buf = tmp;
+        }
+        memcpy(out_buf + out_len, as_str, need);
+        out_len += need;
+        free(as_str);
+        free_value(&term);
+    }
+    out_buf[out_len] = '\0';
+    if (out_len > 0 && out_buf[out_len - 1] == '\n') {
+        fputs(out_buf, stdout);
+    } else {
+        fputs(out_buf, stdout);
+        fflush(stdout); // keep INPUT on the same line if needed
+    }
+    log_output(out_buf, out_len);
+    free(out_buf);
+}
 
-            if (argcnt >= 3 && equals_ignore_case(argv_heap[argcnt - 2], "TO")) {
-                if (!parse_variable_reference_token(argv_heap[argcnt - 1], &capture_ref, script[pc].source_line, debug)) {
-                    fprintf(stderr, "RUN: invalid variable name after TO at line %d\n", script[pc].source_line);
-                    free_argv(argv_heap);
-                    continue;
-                }
-                capture_var = find_variable(capture_ref.name, true);
-                if (!capture_var) {
-                    free_argv(argv_heap);
-                    continue;
-                }
-                capture_output = true;
-                free(argv_heap[argcnt - 1]);
-                free(argv_heap[argcnt - 2]);
-                argv_heap[argcnt - 2] = NULL;
-                argv_heap[argcnt - 1] = NULL;
-                argcnt -= 2;
-                argv_heap[argcnt] = NULL;
-                if (argcnt <= 0) {
-                    fprintf(stderr, "RUN: missing executable before TO at line %d\n", script[pc].source_line);
-                    free_argv(argv_heap);
-                    continue;
-                }
-            }
+static void execute_assignment(TaskProgram *prog, const Instruction *ins, int line, int debug, bool *failed) {
+    *failed = true;
+    VariableRef ref;
+    if (!program_resolve_indices(prog, ins->b, ins->c, &ref, line, debug)) {
+        if (debug) fprintf(stderr, "%s: invalid variable name at line %d\n", ins->text, line);
+        return;
+    }
+    Value value;
+    if (!program_eval(prog, ins->d, &value, line, debug)) {
+        return;
+    }
+    value_take_ownership(&value);
+    *failed = false;
 
-            expand_argv_variables(argv_heap, argcnt, script[pc].source_line, debug);
+    Variable *var = NULL;
+    if (ins->op == OP_ASSIGN_STATIC) {
+        var = find_static_variable_id(prog->slots[ins->a].name_id, true);
+        if (!var && debug) {
+            fprintf(stderr, "SET: STATIC not allowed outside of a function at line %d\n", line);
+        }
+    }
+    if (!var) {
+        var = program_slot_variable(prog, ins->a, true);
+    }
+    if (var && !set_variable_from_ref(var, &ref, &value) && debug) {
+        fprintf(stderr, "%s: failed to set variable at line %d\n", ins->text, line);
+    }
+    free_value(&value);
+}
 
-            if (argcnt > 0 && strcmp(argv_heap[0], "_TOFILE") == 0) {
-                int start_flag = 0;
-                int stop_flag = 0;
-                const char *path = NULL;
+static bool execute_step(TaskProgram *prog, const Instruction *ins) {
+    Variable *var = program_slot_variable(prog, ins->a, true);
+    if (!var) {
+        return false;
+    }
 
-                for (int i = 1; i < argcnt; ++i) {
-                    if (strcmp(argv_heap[i], "-file") == 0 && i + 1 < argcnt) {
-                        path = argv_heap[i + 1];
-                        i++;
-                    } else if (strcmp(argv_heap[i], "--start") == 0) {
-                        start_flag = 1;
-                    } else if (strcmp(argv_heap[i], "--stop") == 0) {
-                        stop_flag = 1;
-                    }
-                }
+    if (var->type == VALUE_STRING && var->str_val) {
+        free(var->str_val);
+        var->str_val = NULL;
+    }
 
-                if (start_flag && stop_flag) {
-                    fprintf(stderr, "_TOFILE: cannot use --start and --stop together\n");
-                } else if (start_flag) {
-                    (void)start_logging(path);
-                } else if (stop_flag) {
-                    if (log_file != NULL) {
-                        printf("_TOFILE: logging stopped (%s)\n", log_file_path[0] != '\0' ? log_file_path : "<unknown>");
-                    } else {
-                        printf("_TOFILE: logging was not active\n");
-                    }
-                    stop_logging();
-                } else {
-                    fprintf(stderr, "Usage: _TOFILE -file <path> --start | _TOFILE --stop\n");
-                }
+    long long current = 0;
+    if (var->type == VALUE_INT) {
+        current = var->int_val;
+    } else if (var->type == VALUE_FLOAT) {
+        current = float_to_int(var->float_val);
+    }
+    current += ins->b;
 
-                free_argv(argv_heap);
-                note_branch_progress(if_stack, &if_sp);
-                continue;
-            }
+    var->type = VALUE_INT;
+    var->int_val = current;
+    var->float_val = (double)current;
+    return true;
+}
 
-            TaskTermBuiltinResult term_builtin_result = try_run_builtin_term_command(argv_heap,
-                                                                                     argcnt,
-                                                                                     script[pc].source_line,
-                                                                                     debug,
-                                                                                     capture_output,
-                                                                                     capture_var,
-                                                                                     &capture_ref);
-            if (term_builtin_result != TASK_TERM_BUILTIN_NOT_HANDLED) {
-                free_argv(argv_heap);
-                note_branch_progress(if_stack, &if_sp);
-                continue;
-            }
+// Resolves the label named by a GOTO $VAR; returns the script index or -1.
+static int resolve_goto_variable(TaskProgram *prog, const Instruction *ins, const Label *labels, int label_count,
+                                 int line, int debug) {
+    const char *var_name = variable_name(prog->slots[ins->a].name_id);
+    Variable *var = program_slot_variable(prog, ins->a, false);
+    Value value = variable_to_value(var);
+    char *resolved = value_to_string(&value);
+    free_value(&value);
+    if (!resolved) {
+        resolved = xstrdup("");
+    }
+    char *label_source = trim(resolved);
+    if (label_source[0] == '@') {
+        label_source++;
+    }
+    size_t len = strlen(label_source);
+    char label_token[64];
+    if (len == 0) {
+        if (debug) {
+            fprintf(stderr, "GOTO: variable '%s' is empty at %d\n", var_name, line);
+        }
+        free(resolved);
+        return -1;
+    }
+    if (len >= sizeof(label_token)) {
+        if (debug) {
+            fprintf(stderr, "GOTO: label from variable '%s' too long at %d\n", var_name, line);
+        }
+        free(resolved);
+        return -1;
+    }
+    memcpy(label_token, label_source, len + 1);
+    free(resolved);
 
-            if (argcnt > 0) {
-                explicit_path_requested = strchr(argv_heap[0], '/') != NULL;
-            }
-
-            if (capture_output && blocking_mode && argcnt > 0) {
-                bool handled = false;
-                if (equals_ignore_case(argv_heap[0], "_GETROW") ||
-                    equals_ignore_case(argv_heap[0], "_GETCOL")) {
-                    long row = 0;
-                    long col = 0;
-                    if (query_cursor_position(&row, &col) == 0) {
-                        Value value;
-                        memset(&value, 0, sizeof(value));
-                        value.type = VALUE_INT;
-                        if (equals_ignore_case(argv_heap[0], "_GETCOL")) {
-                            value.int_val = col;
-                            value.float_val = (double)col;
-                        } else {
-                            value.int_val = row;
-                            value.float_val = (double)row;
-                        }
-                        assign_variable(capture_var, &value);
-                        free_value(&value);
-                    } else if (debug) {
-                        fprintf(stderr, "RUN: failed to query cursor position at line %d\n",
-                                script[pc].source_line);
-                    }
-                    handled = true;
-                }
+    char normalized[64];
+    normalize_label_name(label_token, normalized, sizeof(normalized));
+    int label_index = find_label_index(labels, label_count, normalized);
+    if (label_index < 0) {
+        if (debug) {
+            fprintf(stderr, "GOTO: label '%s' not found at %d\n", label_token, line);
+        }
+        return -1;
+    }
+    return labels[label_index].index;
+}
 
-                if (handled) {
-                    free_argv(argv_heap);
-                    note_branch_progress(if_stack, &if_sp);
-                    continue;
-                }
-            }
+static int finish_call(CallFrame *frame) {
+    current_function_index = frame->previous_function_index;
+    pop_scope();
+    apply_return_value(frame);
+    if (frame->has_return_value) {
+        free_value(&frame->return_value);
+        frame->has_return_value = false;
+    }
+    return frame->return_ip;
+}
 
-            // Resolve executable path for internal commands; fall back to system PATH.
-            if (resolve_exec_path(argv_heap[0], resolved, sizeof(resolved)) == 0) {
-                free(argv_heap[0]);
-                argv_heap[0] = xstrdup(resolved);
-                run_in_exec_dir = explicit_path_requested;
-            } else if (!explicit_path_requested) {
-                use_execvp = true;
+static void run_task_program(TaskProgram *prog, const ScriptLine *script, const Label *labels, int label_count,
+                             const FunctionDef *functions, int debug) {
+    CallFrame *call_stack = NULL;
+    size_t call_stack_cap = 0;
+    int call_sp = 0;
+    int ip = 0;
+
+    while (ip < prog->code_count && !stop) {
+        const Instruction *ins = &prog->code[ip++];
+        int line = script[ins->line].source_line;
+        if (debug && ins->trace) {
+            if (script[ins->line].type == LINE_LABEL) {
+                fprintf(stderr, "Encountered label at line %d: %s\n", line, script[ins->line].text);
             } else {
-                fprintf(stderr, "RUN: executable not found or not executable: %s\n", argv_heap[0]);
-                free_argv(argv_heap);
-                continue;
-            }
-
-            if (debug) {
-                fprintf(stderr, "RUN: %s %s", use_execvp ? "execvp" : "execv", argv_heap[0]);
-                for (int i = 1; i < argcnt; ++i) fprintf(stderr, " [%s]", argv_heap[i]);
-                if (capture_output) fprintf(stderr, " -> TO $%s", capture_var ? capture_var->name : "?");
-                fprintf(stderr, " (%s)\n", blocking_mode ? "blocking" : "non-blocking");
+                fprintf(stderr, "Executing line %d: %s\n", line, script[ins->line].text);
             }
+        }
 
-            if (!blocking_mode && capture_output) {
-                fprintf(stderr, "RUN: cannot capture output in non-blocking mode at line %d\n", script[pc].source_line);
-                free_argv(argv_heap);
-                if (captured_output) {
-                    free(captured_output);
+        switch (ins->op) {
+            case OP_NOP:
+                break;
+            case OP_JUMP:
+                ip = ins->target;
+                break;
+            case OP_JUMP_IF_FALSE:
+                if (!program_test(prog, ins->d, line, debug)) {
+                    ip = ins->target;
                 }
-                continue;
-            }
-
-            if (!blocking_mode) {
-                pid_t pid = fork();
-                if (pid < 0) {
-                    perror("fork");
-                    free_argv(argv_heap);
-                    continue;
-                } else if (pid == 0) {
-                    pid_t gpid = fork();
-                    if (gpid < 0) {
-                        perror("fork");
-                        _exit(EXIT_FAILURE);
-                    }
-                    if (gpid == 0) {
-                        if (run_in_exec_dir) {
-                            apply_exec_workdir(argv_heap[0], script[pc].source_line);
-                        }
-                        if (use_execvp) {
-                            execvp(argv_heap[0], argv_heap);
-                            perror("execvp");
-                        } else {
-                            execv(argv_heap[0], argv_heap);
-                            perror("execv");
-                        }
-                        _exit(EXIT_FAILURE);
-                    }
-                    _exit(EXIT_SUCCESS);
-                } else {
-                    int status;
-                    while (waitpid(pid, &status, 0) < 0) {
-                        if (errno != EINTR) {
-                            perror("waitpid");
-                            break;
-                        }
-                    }
+                break;
+            case OP_JUMP_IF_TRUE:
+                if (program_test(prog, ins->d, line, debug)) {
+                    ip = ins->target;
                 }
-                free_argv(argv_heap);
-                note_branch_progress(if_stack, &if_sp);
-                continue;
-            }
-
-            bool log_child_output = (log_file != NULL && blocking_mode && !capture_output);
-            bool need_pipe = capture_output || log_child_output;
-
-            int pipefd[2] = { -1, -1 };
-            if (need_pipe) {
-                if (pipe(pipefd) < 0) {
-                    perror("pipe");
-                    free_argv(argv_heap);
-                    continue;
+                break;
+            case OP_ASSIGN:
+            case OP_ASSIGN_STATIC: {
+                bool failed = false;
+                execute_assignment(prog, ins, line, debug, &failed);
+                if (failed && ins->target >= 0) {
+                    if (debug) fprintf(stderr, "FOR: failed to evaluate step assignment at line %d\n", line);
+                    ip = ins->target;
                 }
+                break;
             }
-
-            pid_t pid = fork();
-            if (pid < 0) {
-                perror("fork");
-                if (need_pipe) {
-                    close(pipefd[0]);
-                    close(pipefd[1]);
+            case OP_EXPR: {
+                Value value;
+                if (program_eval(prog, ins->d, &value, line, debug)) {
+                    free_value(&value);
+                } else if (ins->target >= 0) {
+                    if (debug) fprintf(stderr, "FOR: unsupported step at line %d\n", line);
+                    ip = ins->target;
                 }
-                free_argv(argv_heap);
-                continue;
-            } else if (pid == 0) {
-                if (need_pipe) {
-                    close(pipefd[0]);
-                    if (dup2(pipefd[1], STDOUT_FILENO) < 0) {
-                        perror("dup2");
-                        _exit(EXIT_FAILURE);
-                    }
-                    if (dup2(pipefd[1], STDERR_FILENO) < 0) {
-                        perror("dup2");
-                        _exit(EXIT_FAILURE);
-                    }
-                    close(pipefd[1]);
+                break;
+            }
+            case OP_STEP:
+                if (!execute_step(prog, ins) && ins->target >= 0) {
+                    ip = ins->target;
                 }
-                if (run_in_exec_dir) {
-                    apply_exec_workdir(argv_heap[0], script[pc].source_line);
+                break;
+            case OP_INPUT: {
+                Variable *var = program_slot_variable(prog, ins->a, true);
+                if (var) {
+                    execute_input(var, ins->b != 0, line, debug);
                 }
-                if (use_execvp) {
-                    execvp(argv_heap[0], argv_heap);
-                    perror("execvp");
-                } else {
-                    execv(argv_heap[0], argv_heap);
-                    perror("execv");
+                break;
+            }
+            case OP_PRINT:
+                execute_print(prog, ins, line, debug);
+                break;
+            case OP_CALL: {
+                const FunctionDef *fn = &functions[ins->a];
+                Value args[MAX_FUNCTION_PARAMS];
+                int arg_count = 0;
+                bool ok = true;
+                for (; arg_count < ins->c; ++arg_count) {
+                    if (!program_eval(prog, prog->lists[ins->b + arg_count], &args[arg_count], line, debug)) {
+                        ok = false;
+                        break;
+                    }
+                    value_take_ownership(&args[arg_count]);
                 }
-                _exit(EXIT_FAILURE);
-            } else {
-                if (need_pipe) {
-                    close(pipefd[1]);
-                    char buffer[4096];
-                    ssize_t rd;
-                    while (1) {
-                        rd = read(pipefd[0], buffer, sizeof(buffer));
-                        if (rd > 0) {
-                            if (capture_output) {
-                                if (captured_len + (size_t)rd + 1 > captured_cap) {
-                                    size_t new_cap = captured_cap ? captured_cap : 128;
-                                    while (captured_len + (size_t)rd + 1 > new_cap) {
-                                        new_cap *= 2;
-                                    }
-                                    char *tmp = (char *)realloc(captured_output, new_cap);
-                                    if (!tmp) {
-                                        perror("realloc");
-                                        free(captured_output);
-                                        captured_output = NULL;
-                                        captured_cap = captured_len = 0;
-                                        break;
-                                    }
-                                    captured_output = tmp;
-                                    captured_cap = new_cap;
-                                }
-                                memcpy(captured_output + captured_len, buffer, (size_t)rd);
-                                captured_len += (size_t)rd;
-                            }
-                            if (log_child_output) {
-                                if (fwrite(buffer, 1, (size_t)rd, stdout) < (size_t)rd) {
-                                    perror("write");
-                                }
-                                fflush(stdout);
-                                log_output(buffer, (size_t)rd);
-                            }
-                        } else if (rd == 0) {
-                            break;
-                        } else {
-                            if (errno == EINTR) {
-                                continue;
-                            }
-                            perror("read");
-                            break;
-                        }
+                if (!ok) {
+                    for (int i = 0; i < arg_count; ++i) {
+                        free_value(&args[i]);
                     }
-                    if (capture_output) {
-                        if (captured_output) {
-                            captured_output[captured_len] = '\0';
-                        } else {
-                            captured_output = xstrdup("");
-                            captured_len = 0;
-                            captured_cap = 1;
-                        }
+                    break;
+                }
+                int previous_function_index = current_function_index;
+                current_function_index = ins->a;
+                push_scope();
+
+                for (int i = 0; i < arg_count; ++i) {
+                    Variable *param = find_variable_id(fn->param_ids[i], true);
+                    if (param) {
+                        assign_variable(param, &args[i]);
                     }
-                    close(pipefd[0]);
+                    free_value(&args[i]);
                 }
 
-                int status;
-                while (waitpid(pid, &status, 0) < 0) {
-                    if (errno != EINTR) { perror("waitpid"); break; }
+                call_stack = (CallFrame *)grow_buffer(call_stack, &call_stack_cap, (size_t)call_sp + 1, sizeof(CallFrame));
+                CallFrame *frame = &call_stack[call_sp++];
+                memset(frame, 0, sizeof(*frame));
+                frame->return_ip = ip;
+                frame->has_return_target = ins->d >= 0;
+                if (frame->has_return_target) {
+                    frame->return_target = prog->slots[ins->d].name_id;
                 }
-                if (debug) {
-                    if (WIFEXITED(status))
-                        fprintf(stderr, "RUN: exited with %d\n", WEXITSTATUS(status));
-                    else if (WIFSIGNALED(status))
-                        fprintf(stderr, "RUN: killed by signal %d\n", WTERMSIG(status));
+                frame->function_index = ins->a;
+                frame->previous_function_index = previous_function_index;
+                ip = ins->target;
+                break;
+            }
+            case OP_RETURN: {
+                if (call_sp <= 0) {
+                    if (debug) fprintf(stderr, "RETURN outside of function at line %d\n", line);
+                    break;
                 }
-
-                if (capture_output && capture_var && captured_output) {
-                    while (captured_len > 0 && (captured_output[captured_len - 1] == '\n' || captured_output[captured_len - 1] == '\r')) {
-                        captured_output[--captured_len] = '\0';
-                    }
-                    Value value;
-                    memset(&value, 0, sizeof(value));
-                    bool parsed = parse_value_from_string(captured_output, &value, script[pc].source_line, debug);
-                    bool keep_captured_buffer = false;
-                    if (!parsed) {
-                        long long iv = 0;
-                        double fv = 0.0;
-                        ValueType vt = detect_numeric_type(captured_output, &iv, &fv);
-                        if (vt == VALUE_INT) {
-                            value.type = VALUE_INT;
-                            value.int_val = iv;
-                            value.float_val = (double)iv;
-                        } else if (vt == VALUE_FLOAT) {
-                            value.type = VALUE_FLOAT;
-                            value.float_val = fv;
-                            value.int_val = (long long)fv;
-                        } else {
-                            value.type = VALUE_STRING;
-                            value.str_val = captured_output;
-                            value.owns_string = true;
-                            keep_captured_buffer = true;
-                        }
-                    }
-                    set_variable_from_ref(capture_var, &capture_ref, &value);
-                    if (!keep_captured_buffer) {
-                        free(captured_output);
+                Value ret;
+                memset(&ret, 0, sizeof(ret));
+                bool has_value = false;
+                if (ins->d >= 0) {
+                    if (!program_eval(prog, ins->d, &ret, line, debug)) {
+                        break;
                     }
-                    captured_output = NULL;
-                    free_value(&value);
-                } else if (captured_output) {
-                    free(captured_output);
+                    has_value = true;
                 }
-
-                free_argv(argv_heap);
-            }
-            note_branch_progress(if_stack, &if_sp);
-        }
-        else if (strncmp(command, "RETURN", 6) == 0 && (command[6] == '\0' || isspace((unsigned char)command[6]))) {
-            if (call_sp <= 0) {
-                if (debug) fprintf(stderr, "RETURN outside of function at line %d\n", script[pc].source_line);
-                continue;
-            }
-            const char *cursor = command + 6;
-            while (isspace((unsigned char)*cursor)) {
-                cursor++;
+                CallFrame *frame = &call_stack[call_sp - 1];
+                frame->has_return_value = has_value;
+                if (has_value) {
+                    copy_value(&frame->return_value, &ret);
+                }
+                free_value(&ret);
+                ip = finish_call(frame);
+                call_sp--;
+                break;
             }
-            Value ret;
-            memset(&ret, 0, sizeof(ret));
-            bool has_value = false;
-            if (*cursor != '\0') {
-                if (!parse_expression(&cursor, &ret, NULL, script[pc].source_line, debug)) {
-                    continue;
+            case OP_FUNCTION_END:
+                if (call_sp > 0 && call_stack[call_sp - 1].function_index == ins->a) {
+                    ip = finish_call(&call_stack[call_sp - 1]);
+                    call_sp--;
                 }
-                has_value = true;
-                while (isspace((unsigned char)*cursor)) {
-                    cursor++;
+                break;
+            case OP_ECHO:
+                if (!set_echo_enabled(ins->a != 0) && debug) {
+                    fprintf(stderr, "ECHO: failed to update terminal state at line %d\n", line);
                 }
-                if (*cursor != '\0') {
-                    if (debug) fprintf(stderr, "RETURN: unexpected characters at line %d\n", script[pc].source_line);
-                    free_value(&ret);
-                    continue;
+                break;
+            case OP_WAIT:
+                delay_ms(ins->a);
+                break;
+            case OP_GOTO_VAR: {
+                int target = resolve_goto_variable(prog, ins, labels, label_count, line, debug);
+                if (target >= 0) {
+                    ip = prog->line_body[target];
                 }
+                break;
             }
-
-            CallFrame *frame = &call_stack[call_sp - 1];
-            frame->has_return_value = has_value;
-            if (has_value) {
-                free_value(&frame->return_value);
-                copy_value(&frame->return_value, &ret);
-            }
-            free_value(&ret);
-
-            current_function_index = frame->previous_function_index;
-            pop_scope();
-            apply_return_value(frame);
-            if (frame->has_return_value) {
-                free_value(&frame->return_value);
-                frame->has_return_value = false;
-            }
-            if_sp = frame->saved_if_sp;
-            for_sp = frame->saved_for_sp;
-            while_sp = frame->saved_while_sp;
-            skipping_block = frame->saved_skipping_block;
-            skip_indent = frame->saved_skip_indent;
-            skip_context_index = frame->saved_skip_context_index;
-            skip_for_true_branch = frame->saved_skip_for_true_branch;
-            skip_progress_pending = frame->saved_skip_progress_pending;
-            skip_consumed_first = frame->saved_skip_consumed_first;
-            call_sp--;
-            pc = frame->return_pc;
-            pc_changed = true;
-            continue;
-        }
-        else if (strncmp(command, "CLEAR", 5) == 0) {
-            printf("\033[H\033[J");
-            fflush(stdout);
-            note_branch_progress(if_stack, &if_sp);
+            case OP_SYS:
+                run_sys_command(ins->text, line, debug);
+                break;
+            case OP_RUN:
+                run_task_command((char *)ins->text, line, debug);
+                break;
+            case OP_CLEAR:
+                printf("\033[H\033[J");
+                fflush(stdout);
+                break;
         }
-        else {
-            if (debug) fprintf(stderr, "Unrecognized command at %d: %s\n", script[pc].source_line, command);
+    }
+
+    while (call_sp > 0) {
+        CallFrame *frame = &call_stack[--call_sp];
+        if (frame->has_return_value) {
+            free_value(&frame->return_value);
         }
+    }
+    free(call_stack);
+}
 
-        if (!pc_changed && for_sp > 0) {
-            ForContext *ctx = &for_stack[for_sp - 1];
-            int next_pc = pc + 1;
-            if (next_pc >= count || script[next_pc].indent <= ctx->indent) {
-                if (!apply_increment_step(ctx->step, script[ctx->for_line_pc].source_line, debug)) {
-                    for_sp--;
-                    continue;
-                }
+int main(int argc, char *argv[]) {
+    signal(SIGINT, sigint_handler);
 
-                bool cond_result = true;
-                if (ctx->condition[0] != '\0') {
-                    cond_result = false;
-                    if (!evaluate_condition_string(ctx->condition, script[ctx->for_line_pc].source_line, debug, &cond_result)) {
-                        for_sp--;
-                        continue;
-                    }
-                }
+    atexit(restore_terminal_settings);
 
-                if (cond_result) {
-                    pc = ctx->body_start_pc - 1;
-                } else {
-                    for_sp--;
-                }
+    set_initial_argv0((argc > 0) ? argv[0] : NULL);
+    init_scopes();
+    init_static_scopes();
+    current_function_index = -1;
+
+    // Initialize base directory cache for resolving bundled executables.
+    (void)get_base_dir();
+
+    if (argc >= 2 && strcmp(argv[1], "-help") == 0) {
+        print_help();
+        return 0;
+    }
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s taskfile [-d]\n", argv[0]);
+        return 1;
+    }
+    int debug = 0;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0) { debug = 1; break; }
+    }
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        perror("getcwd");
+        return 1;
+    }
+
+    char task_path[PATH_MAX];
+    if (resolve_task_path(argv[1], cwd, task_path, sizeof(task_path)) != 0) {
+        fprintf(stderr, "Error: could not resolve task path for '%s'\n", argv[1]);
+        return 1;
+    }
+
+    char task_directory[PATH_MAX];
+    task_directory[0] = '\0';
+    if (task_dirname(task_path, task_directory, sizeof(task_directory)) == 0) {
+        if (chdir(task_directory) != 0) {
+            fprintf(stderr, "Warning: failed to change directory to '%s': %s\n", task_directory, strerror(errno));
+        } else {
+            char resolved_task_dir[PATH_MAX];
+            if (getcwd(resolved_task_dir, sizeof(resolved_task_dir))) {
+                cache_task_workdir(resolved_task_dir);
+            } else {
+                cache_task_workdir(task_directory);
             }
         }
     }
 
-    if (skipping_block && skip_progress_pending) {
-        finalize_skipped_branch(if_stack, &if_sp, skip_context_index, skip_for_true_branch);
-        skip_context_index = -1;
-        skip_progress_pending = false;
-        skip_consumed_first = false;
+    TaskScript task_script;
+    memset(&task_script, 0, sizeof(task_script));
+    Label labels[MAX_LABELS];
+    FunctionDef *functions = NULL;
+    size_t function_cap = 0;
+    memset(labels, 0, sizeof(labels));
+    int label_count = 0;
+    int function_count = 0;
+    if (!load_task_file(task_path, task_directory, &task_script, labels, &label_count, &functions, &function_count, &function_cap, 0, debug)) {
+        free(functions);
+        free_task_script(&task_script);
+        return 1;
+    }
+    finish_task_script(&task_script);
+    ScriptLine *script = task_script.lines;
+    int count = task_script.count;
+
+    for (int i = 0; i < function_count; ++i) {
+        int end_pc = count;
+        int indent = functions[i].indent;
+        int start_pc = functions[i].start_pc;
+        if (start_pc < 0) {
+            start_pc = functions[i].definition_pc + 1;
+        }
+        for (int pc = start_pc; pc < count; ++pc) {
+            if (script[pc].indent <= indent && script[pc].type != LINE_LABEL) {
+                end_pc = pc;
+                break;
+            }
+        }
+        functions[i].start_pc = start_pc;
+        functions[i].end_pc = end_pc;
     }
 
+    // Compile, then run
+    TaskProgram program;
+    compile_task_program(&program, script, count, labels, label_count, functions, function_count, debug);
+    run_task_program(&program, script, labels, label_count, functions, debug);
+    free_task_program(&program);
+    free_task_program(&runtime_program);
+
     if (echo_disabled) {
         restore_terminal_settings();
     }
 
     stop_logging();
     cleanup_variables();
-    free(script);
+    free(functions);
+    free_task_script(&task_script);
     return 0;
 }
 
@@ -4,6 +4,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
+#include <regex.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -13,6 +15,7 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -38,6 +41,14 @@
 #if BUDOSTACK_HAVE_SDL2
 #define GL_GLEXT_PROTOTYPES 1
 #include <SDL2/SDL_opengl.h>
+#include "../budo/lib/budo_gl_pass.h"
+#if defined(__SSE__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#define TERMINAL_AUDIO_SIMD_SSE 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define TERMINAL_AUDIO_SIMD_NEON 1
+#endif
 #define DR_MP3_IMPLEMENTATION
 #include "../lib/dr_mp3.h"
 #define STB_VORBIS_IMPLEMENTATION
@@ -60,6 +71,9 @@
 #define TERMINAL_COLUMNS 118u
 #define TERMINAL_ROWS 66u
 #define TERMINAL_HISTORY_LIMIT 10000u
+#define TERMINAL_HISTORY_MAX_LINES 10000000u
+#define TERMINAL_HISTORY_MAX_MB 65536u
+#define TERMINAL_HISTORY_INITIAL_CAPACITY 256u
 #ifndef TERMINAL_FONT_SCALE
 #define TERMINAL_FONT_SCALE 1
 #endif
@@ -71,7 +85,25 @@
 #define TERMINAL_SHADER_TARGET_FPS 60u
 #endif
 #define TERMINAL_MAX_TARGET_FPS 1000u
+#define TERMINAL_VSYNC_OFF 0
+#define TERMINAL_VSYNC_ON 1
+#define TERMINAL_VSYNC_ADAPTIVE 2
+#define TERMINAL_FRAME_STATS_CAPACITY 4096u
+#define TERMINAL_FRAME_STATS_REPORT_SECONDS 5u
+#define TERMINAL_FRAME_STATS_MAX_GAP_US 250000u
+#define TERMINAL_PERF_HISTORY 240u
+#define TERMINAL_PERF_AVERAGE_FRAMES 60u
+#define TERMINAL_PERF_REFRESH_MS 250u
+#define TERMINAL_PERF_GRAPH_HEIGHT 64
+#define TERMINAL_PERF_PADDING 6
 #define TERMINAL_TAB_COUNT 5u
+#define TERMINAL_BACKGROUND_READ_BUDGET (256u * 1024u)
+#define TERMINAL_BACKGROUND_PARSE_BUDGET_MS 4u
+#define TERMINAL_PTY_RING_SIZE (1u << 20)
+#define TERMINAL_PTY_RING_WRAP (TERMINAL_PTY_RING_SIZE * 2u)
+#define TERMINAL_PTY_FEED_CHUNK 4096u
+#define TERMINAL_PTY_PARSE_BUDGET_MS 8u
+#define TERMINAL_PTY_POLL_TIMEOUT_MS 50
 
 #define TERMINAL_CURSOR_SPRITE_PATH "./tasks/examples/assets/cursor.png"
 #define TERMINAL_OVERLAY_PATH "./graphics/overlay.png"
@@ -84,6 +116,41 @@ _Static_assert(TERMINAL_TARGET_FPS > 0u, "TERMINAL_TARGET_FPS must be positive")
 static SDL_Window *terminal_window_handle = NULL;
 static SDL_GLContext terminal_gl_context_handle = NULL;
 static int terminal_master_fd_handle = -1;
+
+struct terminal_tab_stats {
+    uint64_t bytes_total;
+    uint64_t window_bytes;
+    uint64_t bytes_per_second;
+    Uint32 window_start;
+};
+
+static struct terminal_tab_stats terminal_tab_stats[TERMINAL_TAB_COUNT];
+static size_t terminal_active_tab = 0u;
+static int terminal_feeding_hidden_tab = 0;
+static size_t terminal_history_line_limit = TERMINAL_HISTORY_LIMIT;
+static size_t terminal_history_byte_limit = 0u;
+
+/* Single-producer/single-consumer byte ring per tab. The reader thread
+ * only advances head, the render thread only advances tail; both run
+ * modulo twice the capacity so a full ring is distinguishable from an
+ * empty one. */
+struct terminal_pty_ring {
+    unsigned char *data;
+    int fd;
+    SDL_atomic_t head;
+    SDL_atomic_t tail;
+    SDL_atomic_t closed;
+};
+
+static unsigned char terminal_pty_ring_storage[TERMINAL_TAB_COUNT][TERMINAL_PTY_RING_SIZE];
+static struct terminal_pty_ring terminal_pty_rings[TERMINAL_TAB_COUNT];
+static SDL_Thread *terminal_pty_reader_thread = NULL;
+/* Pushed by the reader thread so an idle render loop wakes on output. */
+static Uint32 terminal_pty_wake_event = (Uint32)-1;
+static SDL_atomic_t terminal_pty_wake_pending;
+static SDL_atomic_t terminal_pty_reader_stop;
+/* Written once to break the reader out of an untimed poll on shutdown. */
+static int terminal_pty_reader_wake_fds[2] = {-1, -1};
 static int terminal_cell_pixel_width = 0;
 static int terminal_cell_pixel_height = 0;
 static int terminal_logical_width = 0;
@@ -103,12 +170,86 @@ static size_t terminal_selection_caret_row = 0u;
 static size_t terminal_selection_caret_col = 0u;
 static int terminal_selection_active = 0;
 static int terminal_selection_dragging = 0;
+
+#define TERMINAL_SEARCH_QUERY_MAX 128u
+
+/* Scrollback search. The query is a case-insensitive POSIX extended
+ * regex. Hits are kept sorted by absolute line number (history_dropped +
+ * global row) so they survive history growth. */
+struct terminal_search_match {
+    size_t line;
+    size_t column;
+    size_t width;
+};
+
+static int terminal_search_active = 0;
+static struct terminal_buffer *terminal_search_buffer = NULL;
+static char terminal_search_query[TERMINAL_SEARCH_QUERY_MAX];
+static size_t terminal_search_query_length = 0u;
+static regex_t terminal_search_regex;
+static int terminal_search_regex_valid = 0;
+static int terminal_search_regex_error = 0;
+static int terminal_search_literal = 0;
+static uint64_t terminal_search_required = 0u;
+static struct terminal_search_match *terminal_search_matches = NULL;
+static size_t terminal_search_match_count = 0u;
+static size_t terminal_search_match_capacity = 0u;
+static size_t terminal_search_current = 0u;
+static size_t terminal_search_history_end = 0u;
+static unsigned char *terminal_search_row_text = NULL;
+static size_t terminal_search_row_text_capacity = 0u;
+static char *terminal_search_line_text = NULL;
+static size_t terminal_search_line_text_capacity = 0u;
 static Uint32 terminal_shader_last_frame_tick = 0u;
 static Uint32 terminal_shader_frame_interval_ms = 0u;
-static Uint32 terminal_render_last_frame_tick = 0u;
-static Uint32 terminal_render_frame_interval_ms = 0u;
+static Uint64 terminal_render_frame_period = 0u;
+static Uint64 terminal_render_frame_deadline = 0u;
 static int terminal_shaders_enabled = 1;
 static int terminal_vsync_enabled = 0;
+static int terminal_vsync_mode = TERMINAL_VSYNC_ON;
+static int terminal_swap_interval = 0;
+static int terminal_display_refresh_hz = 0;
+static int terminal_frame_stats_enabled = 0;
+static Uint32 terminal_frame_stats_samples[TERMINAL_FRAME_STATS_CAPACITY];
+static size_t terminal_frame_stats_count = 0u;
+static Uint64 terminal_frame_stats_last_present = 0u;
+static Uint64 terminal_frame_stats_last_report = 0u;
+
+/* Per-frame instrumentation, see terminal_perf_frame_commit(). Stage
+ * times are CPU wall time; GL work the driver defers shows up in swap. */
+enum terminal_perf_stage {
+    TERMINAL_PERF_PARSE = 0,
+    TERMINAL_PERF_RASTER,
+    TERMINAL_PERF_UPLOAD,
+    TERMINAL_PERF_SHADER,
+    TERMINAL_PERF_SWAP,
+    TERMINAL_PERF_STAGE_COUNT
+};
+
+struct terminal_perf_frame {
+    Uint64 sequence;
+    Uint32 frame_us;
+    Uint32 stage_us[TERMINAL_PERF_STAGE_COUNT];
+    Uint64 bytes_parsed;
+    Uint64 cells_redrawn;
+    Uint64 custom_pixels;
+};
+
+static int terminal_perf_enabled = 0;
+static struct terminal_perf_frame terminal_perf_history[TERMINAL_PERF_HISTORY];
+static size_t terminal_perf_history_count = 0u;
+static size_t terminal_perf_history_next = 0u;
+static struct terminal_perf_frame terminal_perf_current;
+static Uint64 terminal_perf_sequence = 0u;
+static Uint64 terminal_perf_last_present = 0u;
+/* OSC 777 'perf=dump' only ever creates new files in this directory
+ * (<root>/perf), so output printed to the terminal cannot overwrite
+ * anything else. */
+static char terminal_perf_dump_dir[PATH_MAX];
+static Uint32 terminal_perf_panel_tick = 0u;
+static GLuint terminal_perf_texture = 0;
+static int terminal_perf_texture_width = 0;
+static int terminal_perf_texture_height = 0;
 static int terminal_input_draw_requested = 0;
 static unsigned int terminal_runtime_target_fps = TERMINAL_TARGET_FPS;
 static unsigned int terminal_runtime_shader_target_fps = TERMINAL_SHADER_TARGET_FPS;
@@ -143,28 +284,13 @@ static int terminal_using_alternate = 0;
 static int terminal_alternate_initialized = 0;
 static struct terminal_buffer *terminal_alternate_buffer_handle = NULL;
 
-struct terminal_quad_vertex {
-    GLfloat position[4];
-    GLfloat texcoord_cpu[2];
-    GLfloat texcoord_fbo[2];
-};
-
-static const struct terminal_quad_vertex terminal_quad_vertices[4] = {
-    { { -1.0f, -1.0f, 0.0f, 1.0f }, { 0.0f, 1.0f }, { 0.0f, 0.0f } },
-    { {  1.0f, -1.0f, 0.0f, 1.0f }, { 1.0f, 1.0f }, { 1.0f, 0.0f } },
-    { { -1.0f,  1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f }, { 0.0f, 1.0f } },
-    { {  1.0f,  1.0f, 0.0f, 1.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f } }
-};
-
+/* Full-screen quad, MVPs, Prev0 history and the blit program come from
+ * budo_gl_pass, which the budo shader stack uses for the same passes. */
 static GLuint terminal_quad_vbo = 0;
-static const GLsizei terminal_quad_vertex_count = 4;
 
-static const GLfloat terminal_identity_mvp[16] = {
-    1.0f, 0.0f, 0.0f, 0.0f,
-    0.0f, 1.0f, 0.0f, 0.0f,
-    0.0f, 0.0f, 1.0f, 0.0f,
-    0.0f, 0.0f, 0.0f, 1.0f
-};
+/* Textured-quad program used for every non-shader draw (frame, overlay,
+ * cursor, final pass output). */
+static struct budo_gl_blit terminal_blit = {0u, -1, {0u, 0u}};
 
 static uint8_t *terminal_framebuffer_pixels = NULL;
 static size_t terminal_framebuffer_capacity = 0u;
@@ -175,6 +301,32 @@ static GLuint terminal_gl_intermediate_textures[2] = {0u, 0u};
 static int terminal_intermediate_width = 0;
 static int terminal_intermediate_height = 0;
 
+/* Optional GPU text path: the font lives in an atlas texture, the visible
+ * cells are uploaded as three small grid textures (glyph/flags, fg, bg),
+ * and a fragment shader composes them with the custom pixel overlay. */
+#define TERMINAL_GPU_ATLAS_COLUMNS 32u
+#define TERMINAL_GPU_GRID_GLYPH 0u
+#define TERMINAL_GPU_GRID_FG 1u
+#define TERMINAL_GPU_GRID_BG 2u
+#define TERMINAL_GPU_GRID_PLANES 3u
+#define TERMINAL_GPU_CELL_GLYPH 1u
+#define TERMINAL_GPU_CELL_UNDERLINE 2u
+
+static int terminal_gpu_text_requested = 0;
+static int terminal_gpu_text_active = 0;
+static GLuint terminal_gpu_text_program = 0;
+static GLuint terminal_gpu_atlas_texture = 0;
+static GLuint terminal_gpu_grid_textures[TERMINAL_GPU_GRID_PLANES] = {0u, 0u, 0u};
+static GLuint terminal_gpu_text_target = 0;
+static int terminal_gpu_text_target_width = 0;
+static int terminal_gpu_text_target_height = 0;
+static uint32_t *terminal_gpu_grid_cells = NULL;
+static size_t terminal_gpu_grid_columns = 0u;
+static size_t terminal_gpu_grid_rows = 0u;
+static int terminal_gpu_grid_dirty = 0;
+static int terminal_gpu_atlas_width = 0;
+static int terminal_gpu_atlas_height = 0;
+
 struct terminal_render_cache_entry {
     uint32_t ch;
     uint32_t fg;
@@ -192,36 +344,156 @@ static size_t terminal_render_cache_count = 0u;
 static int terminal_force_full_redraw = 1;
 static int terminal_background_dirty = 1;
 
-struct terminal_custom_pixel {
-    int x;
-    int y;
-    uint8_t r;
-    uint8_t g;
-    uint8_t b;
-    uint8_t layer;
-    uint64_t version;
+/* Rendered cells keyed by (codepoint, fg, bg, style) at the current cell
+ * size and font scale; a hit turns a redraw into one memcpy per row. */
+#define TERMINAL_GLYPH_CACHE_SLOTS 4096u
+
+struct terminal_glyph_cache_entry {
+    uint32_t ch;
+    uint32_t fg;
+    uint32_t bg;
+    uint8_t style;
+    uint8_t valid;
+};
+
+static struct terminal_glyph_cache_entry *terminal_glyph_cache = NULL;
+static uint32_t *terminal_glyph_cache_pixels = NULL;
+static int terminal_glyph_cache_width = 0;
+static int terminal_glyph_cache_height = 0;
+static int terminal_glyph_cache_scale = 0;
+
+/* Row-band rasterisation of full redraws, see terminal_raster_frame(). */
+#define TERMINAL_RASTER_MAX_WORKERS 7u
+#define TERMINAL_RASTER_MIN_BAND_ROWS 4u
+
+struct terminal_raster_job {
+    size_t rows;
+    size_t columns;
+    size_t top_index;
+    uint32_t default_fg;
+    uint32_t default_bg;
+    uint32_t cursor_color;
+    const uint32_t *search_prompt;
+    size_t search_prompt_length;
+    int selection_has_range;
+    size_t selection_start;
+    size_t selection_end;
+    int cursor_visible;
+    size_t cursor_global_index;
+    size_t cursor_column;
+    uint8_t *framebuffer;
+    int frame_width;
+    int frame_height;
+    int margin;
+    int glyph_width;
+    int glyph_height;
+    int full_redraw;
+    uint8_t *damage;
+};
+
+struct terminal_raster_worker {
+    SDL_Thread *thread;
+    SDL_sem *start;
+    size_t row_begin;
+    size_t row_end;
+    size_t redrawn;
+};
+
+static struct terminal_raster_worker terminal_raster_workers[TERMINAL_RASTER_MAX_WORKERS];
+static size_t terminal_raster_worker_count = 0u;
+static SDL_sem *terminal_raster_done = NULL;
+static SDL_atomic_t terminal_raster_stopping;
+static const struct terminal_raster_job *terminal_raster_current_job = NULL;
+static const struct terminal_cell **terminal_raster_row_cells = NULL;
+static size_t terminal_raster_row_capacity = 0u;
+static struct terminal_cell *terminal_raster_history_cells = NULL;
+static size_t terminal_raster_history_capacity = 0u;
+static uint8_t *terminal_raster_damage = NULL;
+static size_t terminal_raster_damage_capacity = 0u;
+
+#define TERMINAL_CUSTOM_LAYER_COUNT 16u
+#define TERMINAL_CUSTOM_TILE_SHIFT 6u
+#define TERMINAL_CUSTOM_TILE_SIZE (1 << TERMINAL_CUSTOM_TILE_SHIFT)
+#define TERMINAL_CUSTOM_TILE_PIXELS ((size_t)TERMINAL_CUSTOM_TILE_SIZE * (size_t)TERMINAL_CUSTOM_TILE_SIZE)
+#define TERMINAL_CUSTOM_MAX_EXTENT 16384
+
+/* Each layer is a sparse plane of 64x64 tiles allocated on first write.
+ * A stored value of zero marks an empty pixel; drawn pixels always carry
+ * opaque alpha from terminal_rgba_from_components. */
+struct terminal_custom_tile {
+    size_t used;
+    int skipped; /* left out of a recomposited frame tile while its layer was pending */
+    uint32_t pixels[TERMINAL_CUSTOM_TILE_PIXELS];
 };
 
-static struct terminal_custom_pixel *terminal_custom_pixels = NULL;
-static size_t terminal_custom_pixel_count = 0u;
-static size_t terminal_custom_pixel_capacity = 0u;
+struct terminal_custom_layer {
+    struct terminal_custom_tile **tiles;
+    size_t tiles_x;
+    size_t tiles_y;
+    size_t tile_count;
+    int damage_x0;
+    int damage_y0;
+    int damage_x1;
+    int damage_y1;
+};
+
+static struct terminal_custom_layer terminal_custom_layers[TERMINAL_CUSTOM_LAYER_COUNT];
+static size_t terminal_custom_tile_count = 0u;
 static int terminal_custom_pixels_dirty = 0;
 static uint16_t terminal_custom_pixels_pending_layers = 0u;
 static int terminal_custom_pixels_active = 0;
-static uint64_t terminal_custom_layer_versions[17] = {0};
-
-struct terminal_custom_clear_request {
-    int x;
-    int y;
-    int w;
-    int h;
-    uint8_t layer;
-    uint64_t version;
+
+/* Decoded sprites keyed by the content ID clients compute with
+ * termgfx_sprite_id(), so a tile is uploaded once and later drawn by ID.
+ * The ID is a 64-bit FNV-1a hash and not collision-resistant, so each
+ * entry also keeps its base64 text; a request that carries data only
+ * reuses an entry whose size and text match exactly.
+ * Open addressing with linear probing; a NULL rgba marks an empty slot.
+ * When either limit is reached, the least recently stored or drawn
+ * entries are evicted to make room. */
+#define TERMINAL_SPRITE_CACHE_SLOTS 4096u
+#define TERMINAL_SPRITE_CACHE_MAX_ENTRIES 3072u
+#define TERMINAL_SPRITE_CACHE_MAX_BYTES ((size_t)64u * 1024u * 1024u)
+
+struct terminal_sprite_cache_entry {
+    uint64_t id;
+    int width;
+    int height;
+    uint8_t *rgba;
+    char *encoded;
+    size_t encoded_length;
+    uint64_t last_used;
+};
+
+static struct terminal_sprite_cache_entry terminal_sprite_cache[TERMINAL_SPRITE_CACHE_SLOTS];
+static size_t terminal_sprite_cache_count = 0u;
+static size_t terminal_sprite_cache_bytes = 0u;
+static uint64_t terminal_sprite_cache_clock = 0u;
+
+/* Opt-in shared RGBA surfaces. A client asks for one with OSC 777
+ * 'layer_map=<n>', maps the POSIX shm object named in the reply, draws
+ * into it and rings 'pixel=render;pixel_layer=<n>' with a dirty rect; the
+ * rect is then copied into the layer's tiles in one pass. */
+struct terminal_shared_layer {
+    char name[64];
+    uint8_t *pixels;
+    int width;
+    int height;
+    size_t size;
 };
 
-static struct terminal_custom_clear_request *terminal_custom_pending_clears = NULL;
-static size_t terminal_custom_pending_clear_count = 0u;
-static size_t terminal_custom_pending_clear_capacity = 0u;
+static struct terminal_shared_layer terminal_shared_layers[TERMINAL_CUSTOM_LAYER_COUNT];
+
+/* Framebuffer damage on the same tile grid. DIRTY tiles are recomposited
+ * and uploaded; RESTORE tiles also need the text underneath repainted
+ * because committed layer pixels may have been removed from them. */
+#define TERMINAL_FRAME_TILE_DIRTY 1u
+#define TERMINAL_FRAME_TILE_RESTORE 2u
+
+static uint8_t *terminal_frame_tiles = NULL;
+static size_t terminal_frame_tiles_x = 0u;
+static size_t terminal_frame_tiles_y = 0u;
+static size_t terminal_frame_dirty_tile_count = 0u;
 
 struct terminal_gl_shader {
     GLuint program;
@@ -254,8 +526,7 @@ struct terminal_gl_shader {
     GLint uniform_interlace_detect;
     GLint uniform_saturation;
     GLint uniform_inv_gamma;
-    GLuint history_texture;
-    GLuint history_texture_flipped;
+    struct budo_gl_history history;
     GLuint quad_vaos[2];
     int has_cached_mvp;
     GLfloat cached_mvp[16];
@@ -286,8 +557,12 @@ struct psf_font {
     uint8_t *glyphs;
     struct psf_unicode_map *unicode_map;
     size_t unicode_map_count;
+    uint32_t *bmp_map;
 };
 
+#define PSF_FONT_BMP_SIZE 0x10000u
+#define PSF_FONT_BMP_MISSING UINT32_MAX
+
 struct psf_unicode_map {
     uint32_t codepoint;
     uint32_t glyph_index;
@@ -309,6 +584,71 @@ static struct psf_font terminal_font = {0};
 #define TERMINAL_BACKGROUND_SOUND_DEFAULT_VOLUME 0.25f
 #define TERMINAL_BACKGROUND_SOUND_CROSSFADE_MS 10u
 #define TERMINAL_KEYBOARD_SOUND_VOLUME_VARIATION_PERCENT 25
+#define TERMINAL_SOUND_CACHE_MAX_ENTRIES 64u
+#define TERMINAL_SOUND_CACHE_MAX_BYTES (64u * 1024u * 1024u)
+#define TERMINAL_SOUND_STREAM_THRESHOLD_BYTES (1024u * 1024u)
+#define TERMINAL_SOUND_STREAM_RING_MS 1000u
+#define TERMINAL_SOUND_STREAM_DECODE_FRAMES 4096u
+
+/* Decoded, device-format sound shared between channels. Entries live in an
+ * LRU list owned by the main thread, which also owns refs: the audio thread
+ * hands released references back through the retire ring. An evicted entry
+ * that is still playing is detached and freed when its last reference goes. */
+struct terminal_sound_sample {
+    char *path;
+    time_t mtime_sec;
+    long mtime_nsec;
+    off_t file_size;
+    float *samples;
+    size_t frame_count;
+    size_t bytes;
+    unsigned int refs;
+    int cached;
+    struct terminal_sound_sample *prev;
+    struct terminal_sound_sample *next;
+};
+
+enum terminal_sound_stream_format {
+    TERMINAL_SOUND_STREAM_NONE,
+    TERMINAL_SOUND_STREAM_WAV,
+    TERMINAL_SOUND_STREAM_MP3,
+    TERMINAL_SOUND_STREAM_OGG
+};
+
+/* A file decoded on the fly by its own worker thread. The worker is the
+ * only writer of write_index and the audio callback the only writer of
+ * read_index; everything else belongs to the worker until it is joined. */
+struct terminal_sound_stream {
+    int format;
+    FILE *wav_file;
+    long wav_data_offset;
+    size_t wav_data_bytes;
+    size_t wav_data_read;
+    size_t wav_frame_bytes;
+    drmp3 mp3;
+    stb_vorbis *vorbis;
+    SDL_AudioSpec source_spec;
+    SDL_AudioStream *converter;
+    void *decoded;
+    float *converted;
+    float *ring;
+    size_t ring_frames;
+    size_t channels;
+    SDL_atomic_t write_index;
+    SDL_atomic_t read_index;
+    SDL_atomic_t finished;
+    SDL_atomic_t stop;
+    SDL_sem *wake;
+    SDL_Thread *thread;
+    int loop;
+    size_t loop_crossfade_frames;
+    float *head;
+    size_t head_frames;
+    float *pending;
+    size_t pending_frames;
+    size_t skip_frames;
+    size_t pass_frames;
+};
 
 struct terminal_sound_channel {
     float *samples;
@@ -316,6 +656,8 @@ struct terminal_sound_channel {
     size_t position;
     int active;
     int owns_samples;
+    struct terminal_sound_sample *shared;
+    struct terminal_sound_stream *stream;
     int loop;
     size_t loop_crossfade_frames;
     float volume;
@@ -323,8 +665,60 @@ struct terminal_sound_channel {
 
 static SDL_AudioDeviceID terminal_audio_device = 0;
 static SDL_AudioSpec terminal_audio_spec = {0};
-static SDL_mutex *terminal_audio_mutex = NULL;
+
+/* The main thread never touches terminal_sound_channels while the device
+ * runs. It queues commands for the audio callback instead, and the callback
+ * hands every buffer a channel lets go of back through the retire ring, so
+ * neither side locks and the callback never frees memory. Both rings are
+ * single-producer/single-consumer, like the PTY rings. The retire ring has
+ * room for every buffer the channels and a full command queue can hold. */
+#define TERMINAL_AUDIO_COMMAND_RING_SIZE 256u
+#define TERMINAL_AUDIO_RETIRE_RING_SIZE 512u
+#define TERMINAL_AUDIO_LIMITER_KNEE 0.8f
+
+enum terminal_audio_command_type {
+    TERMINAL_AUDIO_COMMAND_PLAY,
+    TERMINAL_AUDIO_COMMAND_STOP
+};
+
+struct terminal_audio_command {
+    enum terminal_audio_command_type type;
+    size_t channel;
+    float *samples;
+    size_t frame_count;
+    int owns_samples;
+    struct terminal_sound_sample *shared;
+    struct terminal_sound_stream *stream;
+    int loop;
+    size_t loop_crossfade_frames;
+    float volume;
+};
+
+struct terminal_audio_retired {
+    float *samples;
+    struct terminal_sound_sample *shared;
+    struct terminal_sound_stream *stream;
+};
+
+static struct terminal_audio_command terminal_audio_commands[TERMINAL_AUDIO_COMMAND_RING_SIZE];
+static SDL_atomic_t terminal_audio_command_head;
+static SDL_atomic_t terminal_audio_command_tail;
+static struct terminal_audio_retired terminal_audio_retired[TERMINAL_AUDIO_RETIRE_RING_SIZE];
+static SDL_atomic_t terminal_audio_retire_head;
+static SDL_atomic_t terminal_audio_retire_tail;
+static Uint64 terminal_audio_last_callback = 0u;
+
+/* Diagnostics, reported by sound=stats. */
+static SDL_atomic_t terminal_audio_active_channels;
+static SDL_atomic_t terminal_audio_peak_channels;
+static SDL_atomic_t terminal_audio_underruns;
+static SDL_atomic_t terminal_audio_limited_buffers;
+static SDL_atomic_t terminal_audio_dropped_commands;
 static struct terminal_sound_channel terminal_sound_channels[TERMINAL_AUDIO_CHANNEL_COUNT];
+static struct terminal_sound_sample *terminal_sound_cache_head = NULL;
+static struct terminal_sound_sample *terminal_sound_cache_tail = NULL;
+static size_t terminal_sound_cache_count = 0u;
+static size_t terminal_sound_cache_bytes = 0u;
 
 struct terminal_keyboard_sound_library {
     float *key_press_samples;
@@ -340,17 +734,35 @@ static size_t terminal_keyboard_sound_next_channel = 0u;
 static float terminal_keyboard_sound_volume = TERMINAL_KEYBOARD_SOUND_DEFAULT_VOLUME;
 static float *terminal_background_sound_samples = NULL;
 static size_t terminal_background_sound_frame_count = 0u;
+static char *terminal_background_sound_stream_path = NULL;
 static int terminal_background_sound_enabled = 0;
 static float terminal_background_sound_volume = TERMINAL_BACKGROUND_SOUND_DEFAULT_VOLUME;
 
 static void SDLCALL terminal_audio_callback(void *userdata, Uint8 *stream, int len);
 static void terminal_audio_channel_clear(struct terminal_sound_channel *channel);
+static void terminal_audio_apply_commands(void);
+static void terminal_audio_collect(void);
+static void terminal_audio_sync(void);
 static int terminal_initialize_audio(void);
 static void terminal_shutdown_audio(void);
 static int terminal_audio_convert(const SDL_AudioSpec *source_spec, const void *data, size_t length, float **out_samples, size_t *out_frames);
 static int terminal_audio_load_file(const char *path, float **out_samples, size_t *out_frames);
+static void terminal_sound_sample_release(struct terminal_sound_sample *sample);
+static struct terminal_sound_sample *terminal_sound_cache_load(const char *path);
+static void terminal_sound_cache_clear(void);
+static int terminal_sound_stream_wanted(const char *path);
+static struct terminal_sound_stream *terminal_sound_stream_open(const char *path, int loop, size_t loop_crossfade_frames);
+static void terminal_sound_stream_close(struct terminal_sound_stream *stream);
+static int terminal_sound_play_stream(int channel_index, struct terminal_sound_stream *stream, float volume);
 static int terminal_sound_play(int channel_index, const char *path, float volume);
-static int terminal_sound_play_samples(int channel_index, float *samples, size_t frames, int owns_samples, int loop, size_t loop_crossfade_frames, float volume);
+static int terminal_sound_play_samples(int channel_index,
+                                       float *samples,
+                                       size_t frames,
+                                       int owns_samples,
+                                       struct terminal_sound_sample *shared,
+                                       int loop,
+                                       size_t loop_crossfade_frames,
+                                       float volume);
 static void terminal_sound_stop(int channel_index);
 static void terminal_keyboard_sound_library_free(void);
 static void terminal_background_sound_free(void);
@@ -383,6 +795,8 @@ static int terminal_send_mouse_report(const struct terminal_buffer *buffer,
                                       SDL_Keymod mod);
 static size_t terminal_total_rows(const struct terminal_buffer *buffer);
 static const struct terminal_cell *terminal_buffer_row_at(const struct terminal_buffer *buffer, size_t index);
+static void terminal_buffer_history_free(struct terminal_buffer *buffer);
+static void terminal_search_end(struct terminal_buffer *buffer);
 static size_t terminal_clamped_scroll_offset(const struct terminal_buffer *buffer);
 static void terminal_visible_row_range(const struct terminal_buffer *buffer, size_t *out_top_index, size_t *out_bottom_index);
 static void terminal_buffer_fill_line_current(struct terminal_buffer *buffer, size_t row);
@@ -429,19 +843,10 @@ static void terminal_destroy_quad_geometry(void);
 static int terminal_shader_configure_vaos(struct terminal_gl_shader *shader);
 static void terminal_shader_clear_vaos(struct terminal_gl_shader *shader);
 static void terminal_shader_reset_uniform_cache(struct terminal_gl_shader *shader);
-static void terminal_shader_set_matrix(GLint location, GLfloat *cache, int *has_cache, const GLfloat *matrix);
-static void terminal_shader_set_vec2(GLint location, GLfloat *cache, int *has_cache, GLfloat x, GLfloat y);
 static void terminal_bind_texture(GLuint texture);
 static int terminal_resize_render_targets(int width, int height);
 static int terminal_upload_framebuffer(const uint8_t *pixels, int width, int height);
 static int terminal_prepare_intermediate_targets(int width, int height);
-static int terminal_prepare_shader_history(struct terminal_gl_shader *shader, int width, int height, int resized);
-static void terminal_update_shader_history(struct terminal_gl_shader *shader, int width, int height);
-static void terminal_update_flipped_history_texture(GLuint history_texture,
-                                                    GLuint history_texture_flipped,
-                                                    int width,
-                                                    int height);
-static void terminal_clear_shader_history(struct terminal_gl_shader *shader);
 static int terminal_load_cursor_sprite(const char *path);
 static void terminal_destroy_cursor_sprite(void);
 static void terminal_set_mouse_cursor_visible(int visible);
@@ -457,17 +862,34 @@ static uint32_t terminal_rgba_from_color(uint32_t color);
 static int terminal_custom_pixels_set(int x, int y, uint8_t r, uint8_t g, uint8_t b, uint8_t layer);
 static void terminal_custom_pixels_clear(void);
 static int terminal_custom_pixels_clear_rect(int origin_x, int origin_y, int width, int height, uint8_t layer);
-static void terminal_custom_pixels_apply(uint8_t *framebuffer, int width, int height);
-static int terminal_custom_pixels_reserve(size_t additional);
+static size_t terminal_custom_pixels_apply(uint8_t *framebuffer, int width, int height);
 static int terminal_custom_pixels_draw_sprite(int origin_x, int origin_y, const uint8_t *rgba, int width, int height, uint8_t layer);
 static int terminal_custom_pixels_draw_rect(int origin_x, int origin_y, int width, int height, uint8_t r, uint8_t g, uint8_t b, uint8_t layer);
 static uint16_t terminal_custom_layer_mask(uint8_t layer);
 static void terminal_custom_pixels_mark_pending(uint8_t layer);
-static int terminal_custom_pixels_apply_pending_clears(uint8_t layer);
-static void terminal_custom_pixels_clear_pending_requests(void);
 static void terminal_custom_pixels_shutdown(void);
+static void terminal_custom_pixels_commit(uint16_t mask);
+static int terminal_frame_damage_resize(int width, int height);
+static void terminal_frame_damage_rect(int x, int y, int width, int height, uint8_t level);
+static void terminal_frame_damage_all(void);
+static void terminal_frame_damage_reset(void);
 static int terminal_ensure_render_cache(size_t columns, size_t rows);
 static void terminal_reset_render_cache(void);
+static void terminal_glyph_cache_reset(void);
+static void terminal_render_glyph_cell(uint32_t *dst,
+                                       size_t dst_stride,
+                                       int cell_width,
+                                       int cell_height,
+                                       uint32_t ch,
+                                       uint32_t glyph_color,
+                                       uint32_t fill_color,
+                                       uint8_t style);
+static const uint32_t *terminal_glyph_cache_lookup(uint32_t ch,
+                                                   uint32_t glyph_color,
+                                                   uint32_t fill_color,
+                                                   uint8_t style,
+                                                   int cell_width,
+                                                   int cell_height);
 static char *terminal_read_text_file(const char *path, size_t *out_size);
 static const char *terminal_skip_utf8_bom(const char *src, size_t *size);
 static const char *terminal_skip_leading_space_and_comments(const char *src, const char *end);
@@ -489,7 +911,9 @@ static int terminal_parse_shader_parameters(const char *source, size_t length, s
 static float terminal_get_parameter_default(const struct terminal_shader_parameter *params, size_t count, const char *name, float fallback);
 static GLuint terminal_compile_shader(GLenum type, const char *source, const char *label);
 static void terminal_print_usage(const char *progname);
+static void terminal_tab_stats_report(void);
 static int terminal_resolve_shader_path(const char *root_dir, const char *shader_arg, char *out_path, size_t out_size);
+static int build_path(char *dest, size_t dest_size, const char *base, const char *suffix);
 static void terminal_handle_osc_777(struct terminal_buffer *buffer, const char *args);
 
 static int terminal_send_response(const char *response) {
@@ -504,14 +928,30 @@ static int terminal_send_response(const char *response) {
 
 
 #if BUDOSTACK_HAVE_SDL2
+/* Audio thread (or main thread with the device locked or closed). */
 static void terminal_audio_channel_clear(struct terminal_sound_channel *channel) {
     if (!channel) {
         return;
     }
-    if (channel->owns_samples && channel->samples) {
-        free(channel->samples);
+    float *owned = (channel->owns_samples && channel->samples) ? channel->samples : NULL;
+    if (owned || channel->shared || channel->stream) {
+        unsigned int head = (unsigned int)SDL_AtomicGet(&terminal_audio_retire_head);
+        unsigned int tail = (unsigned int)SDL_AtomicGet(&terminal_audio_retire_tail);
+        if (head - tail < TERMINAL_AUDIO_RETIRE_RING_SIZE) {
+            struct terminal_audio_retired *retired = &terminal_audio_retired[head & (TERMINAL_AUDIO_RETIRE_RING_SIZE - 1u)];
+            retired->samples = owned;
+            retired->shared = channel->shared;
+            retired->stream = channel->stream;
+            SDL_AtomicSet(&terminal_audio_retire_head, (int)(head + 1u));
+        } else {
+            /* Unreachable with the ring sized as above; keep the buffer
+             * alive rather than free it from the callback. */
+            SDL_AtomicAdd(&terminal_audio_dropped_commands, 1);
+        }
     }
     channel->samples = NULL;
+    channel->shared = NULL;
+    channel->stream = NULL;
     channel->frame_count = 0u;
     channel->position = 0u;
     channel->active = 0;
@@ -521,6 +961,183 @@ static void terminal_audio_channel_clear(struct terminal_sound_channel *channel)
     channel->volume = 1.0f;
 }
 
+/* Consumer side of the command ring. */
+static void terminal_audio_apply_commands(void) {
+    unsigned int tail = (unsigned int)SDL_AtomicGet(&terminal_audio_command_tail);
+    unsigned int head = (unsigned int)SDL_AtomicGet(&terminal_audio_command_head);
+    while (tail != head) {
+        const struct terminal_audio_command *command =
+            &terminal_audio_commands[tail & (TERMINAL_AUDIO_COMMAND_RING_SIZE - 1u)];
+        struct terminal_sound_channel *channel = &terminal_sound_channels[command->channel];
+        terminal_audio_channel_clear(channel);
+        if (command->type == TERMINAL_AUDIO_COMMAND_PLAY) {
+            channel->samples = command->samples;
+            channel->frame_count = command->frame_count;
+            channel->owns_samples = command->owns_samples;
+            channel->shared = command->shared;
+            channel->stream = command->stream;
+            channel->loop = command->loop;
+            channel->loop_crossfade_frames = command->loop_crossfade_frames;
+            channel->volume = command->volume;
+            channel->position = 0u;
+            channel->active = 1;
+        }
+        tail++;
+    }
+    SDL_AtomicSet(&terminal_audio_command_tail, (int)tail);
+}
+
+/* Main thread: frees what the channels released. */
+static void terminal_audio_collect(void) {
+    unsigned int tail = (unsigned int)SDL_AtomicGet(&terminal_audio_retire_tail);
+    unsigned int head = (unsigned int)SDL_AtomicGet(&terminal_audio_retire_head);
+    while (tail != head) {
+        struct terminal_audio_retired *retired = &terminal_audio_retired[tail & (TERMINAL_AUDIO_RETIRE_RING_SIZE - 1u)];
+        free(retired->samples);
+        terminal_sound_sample_release(retired->shared);
+        terminal_sound_stream_close(retired->stream);
+        retired->samples = NULL;
+        retired->shared = NULL;
+        retired->stream = NULL;
+        tail++;
+    }
+    SDL_AtomicSet(&terminal_audio_retire_tail, (int)tail);
+}
+
+/* Applies every queued command before returning. Needed before freeing a
+ * buffer that channels borrow without owning (keyboard, background). */
+static void terminal_audio_sync(void) {
+    if (terminal_audio_device != 0) {
+        SDL_LockAudioDevice(terminal_audio_device);
+        terminal_audio_apply_commands();
+        SDL_UnlockAudioDevice(terminal_audio_device);
+    }
+    terminal_audio_collect();
+}
+
+static int terminal_audio_push(const struct terminal_audio_command *command) {
+    unsigned int head = (unsigned int)SDL_AtomicGet(&terminal_audio_command_head);
+    unsigned int tail = (unsigned int)SDL_AtomicGet(&terminal_audio_command_tail);
+    if (head - tail >= TERMINAL_AUDIO_COMMAND_RING_SIZE) {
+        SDL_AtomicAdd(&terminal_audio_dropped_commands, 1);
+        return -1;
+    }
+    terminal_audio_commands[head & (TERMINAL_AUDIO_COMMAND_RING_SIZE - 1u)] = *command;
+    SDL_AtomicSet(&terminal_audio_command_head, (int)(head + 1u));
+    return 0;
+}
+
+/* output[i] += input[i] * gain, four samples at a time where available. */
+static void terminal_audio_mix_gain(float *output, const float *input, size_t count, float gain) {
+    size_t i = 0u;
+#if defined(TERMINAL_AUDIO_SIMD_SSE)
+    __m128 gain4 = _mm_set1_ps(gain);
+    for (; i + 4u <= count; i += 4u) {
+        __m128 mixed = _mm_add_ps(_mm_loadu_ps(output + i), _mm_mul_ps(_mm_loadu_ps(input + i), gain4));
+        _mm_storeu_ps(output + i, mixed);
+    }
+#elif defined(TERMINAL_AUDIO_SIMD_NEON)
+    float32x4_t gain4 = vdupq_n_f32(gain);
+    for (; i + 4u <= count; i += 4u) {
+        vst1q_f32(output + i, vmlaq_f32(vld1q_f32(output + i), vld1q_f32(input + i), gain4));
+    }
+#endif
+    for (; i < count; i++) {
+        output[i] += input[i] * gain;
+    }
+}
+
+/* Mixes the looping tail blended with the head. The weight changes every
+ * frame and the region is at most a few milliseconds, so it stays scalar. */
+static void terminal_audio_mix_crossfade(float *output,
+                                         const struct terminal_sound_channel *channel,
+                                         size_t first_frame,
+                                         size_t frames,
+                                         size_t channel_count) {
+    size_t fade_start = channel->frame_count - channel->loop_crossfade_frames;
+    for (size_t frame_index = 0u; frame_index < frames; frame_index++) {
+        size_t source_frame = first_frame + frame_index;
+        size_t crossfade_frame = source_frame - fade_start;
+        float weight = (float)(crossfade_frame + 1u) / (float)(channel->loop_crossfade_frames + 1u);
+        const float *tail = channel->samples + source_frame * channel_count;
+        const float *head = channel->samples + crossfade_frame * channel_count;
+        float *out = output + frame_index * channel_count;
+        for (size_t sample_channel = 0u; sample_channel < channel_count; sample_channel++) {
+            float sample = tail[sample_channel] * (1.0f - weight) + head[sample_channel] * weight;
+            out[sample_channel] += sample * channel->volume;
+        }
+    }
+}
+
+/* Soft knee above TERMINAL_AUDIO_LIMITER_KNEE that approaches but never
+ * reaches full scale, instead of hard clipping the summed bus. */
+static int terminal_audio_soft_limit(float *samples, size_t count) {
+    const float knee = TERMINAL_AUDIO_LIMITER_KNEE;
+    const float range = 1.0f - knee;
+    int limited = 0;
+    for (size_t i = 0u; i < count; i++) {
+        float sample = samples[i];
+        float magnitude = sample < 0.0f ? -sample : sample;
+        if (magnitude <= knee) {
+            continue;
+        }
+        float over = (magnitude - knee) / range;
+        magnitude = knee + range * (over / (1.0f + over));
+        samples[i] = sample < 0.0f ? -magnitude : magnitude;
+        limited = 1;
+    }
+    return limited;
+}
+
+static void terminal_audio_channel_rewind(struct terminal_sound_channel *channel) {
+    if (channel->loop) {
+        if (channel->loop_crossfade_frames > 0u && channel->loop_crossfade_frames < channel->frame_count) {
+            channel->position = channel->loop_crossfade_frames;
+        } else {
+            channel->position = 0u;
+        }
+    } else {
+        terminal_audio_channel_clear(channel);
+    }
+}
+
+/* Copies what the worker has decoded so far, in at most two pieces. A
+ * ring that runs dry before the worker is done counts as an underrun. */
+static void terminal_audio_mix_stream(float *output,
+                                      struct terminal_sound_channel *channel,
+                                      size_t frames,
+                                      size_t channel_count) {
+    struct terminal_sound_stream *stream = channel->stream;
+    unsigned int read = (unsigned int)SDL_AtomicGet(&stream->read_index);
+    int finished = SDL_AtomicGet(&stream->finished);
+    unsigned int write = (unsigned int)SDL_AtomicGet(&stream->write_index);
+    size_t available = (size_t)(write - read);
+    size_t mix_frames = available < frames ? available : frames;
+    size_t offset = (size_t)read & (stream->ring_frames - 1u);
+    size_t first = stream->ring_frames - offset;
+    if (first > mix_frames) {
+        first = mix_frames;
+    }
+    terminal_audio_mix_gain(output, stream->ring + offset * channel_count, first * channel_count, channel->volume);
+    if (first < mix_frames) {
+        terminal_audio_mix_gain(output + first * channel_count,
+                                stream->ring,
+                                (mix_frames - first) * channel_count,
+                                channel->volume);
+    }
+    SDL_AtomicSet(&stream->read_index, (int)(read + (unsigned int)mix_frames));
+    if (mix_frames > 0u && SDL_SemValue(stream->wake) == 0u) {
+        SDL_SemPost(stream->wake);
+    }
+    if (mix_frames < frames) {
+        if (finished) {
+            terminal_audio_channel_clear(channel);
+        } else {
+            SDL_AtomicAdd(&terminal_audio_underruns, 1);
+        }
+    }
+}
+
 static void SDLCALL terminal_audio_callback(void *userdata, Uint8 *stream, int len) {
     (void)userdata;
     if (!stream || len <= 0) {
@@ -529,113 +1146,105 @@ static void SDLCALL terminal_audio_callback(void *userdata, Uint8 *stream, int l
 
     SDL_memset(stream, 0, (size_t)len);
 
-    if (!terminal_audio_mutex) {
-        return;
-    }
-
     int channel_count = (int)terminal_audio_spec.channels;
     if (channel_count <= 0) {
         return;
     }
 
-    if (SDL_LockMutex(terminal_audio_mutex) != 0) {
-        return;
-    }
-
     size_t byte_length = (size_t)len;
     size_t frames = byte_length / (sizeof(float) * (size_t)channel_count);
     if (frames == 0u) {
-        SDL_UnlockMutex(terminal_audio_mutex);
         return;
     }
 
+    /* A callback arriving well after the previous buffer ran dry means the
+     * device played silence in between. */
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (terminal_audio_last_callback != 0u && terminal_audio_spec.freq > 0) {
+        double elapsed = (double)(now - terminal_audio_last_callback) / (double)SDL_GetPerformanceFrequency();
+        double period = (double)frames / (double)terminal_audio_spec.freq;
+        if (elapsed > period * 1.5) {
+            SDL_AtomicAdd(&terminal_audio_underruns, 1);
+        }
+    }
+    terminal_audio_last_callback = now;
+
+    terminal_audio_apply_commands();
+
     float *output = (float *)stream;
+    int active_channels = 0;
 
     for (size_t channel_index = 0u; channel_index < TERMINAL_AUDIO_CHANNEL_COUNT; channel_index++) {
         struct terminal_sound_channel *channel = &terminal_sound_channels[channel_index];
+        if (channel->active && channel->stream) {
+            terminal_audio_mix_stream(output, channel, frames, (size_t)channel_count);
+            if (channel->active) {
+                active_channels++;
+            }
+            continue;
+        }
         if (!channel->active || !channel->samples || channel->frame_count == 0u) {
             continue;
         }
 
-        size_t available_frames = 0u;
-        if (channel->position < channel->frame_count) {
-            available_frames = channel->frame_count - channel->position;
-        }
-        if (available_frames == 0u) {
-            if (channel->loop) {
-                if (channel->loop_crossfade_frames > 0u && channel->loop_crossfade_frames < channel->frame_count) {
-                    channel->position = channel->loop_crossfade_frames;
-                } else {
-                    channel->position = 0u;
-                }
-            } else {
-                terminal_audio_channel_clear(channel);
+        if (channel->position >= channel->frame_count) {
+            terminal_audio_channel_rewind(channel);
+            if (!channel->active) {
                 continue;
             }
         }
 
+        int crossfade = channel->loop &&
+                        channel->loop_crossfade_frames > 0u &&
+                        channel->loop_crossfade_frames < channel->frame_count;
+        size_t fade_start = crossfade ? channel->frame_count - channel->loop_crossfade_frames : channel->frame_count;
+
         size_t mixed_frames = 0u;
         while (mixed_frames < frames && channel->active) {
-            available_frames = channel->frame_count - channel->position;
             size_t mix_frames = frames - mixed_frames;
+            size_t available_frames = channel->frame_count - channel->position;
             if (available_frames < mix_frames) {
                 mix_frames = available_frames;
             }
 
-            for (size_t frame_index = 0u; frame_index < mix_frames; frame_index++) {
-                size_t output_offset = (mixed_frames + frame_index) * (size_t)channel_count;
-                size_t source_frame = channel->position + frame_index;
-                size_t input_offset = source_frame * (size_t)channel_count;
-                int crossfade = channel->loop &&
-                                channel->loop_crossfade_frames > 0u &&
-                                channel->loop_crossfade_frames < channel->frame_count &&
-                                source_frame >= channel->frame_count - channel->loop_crossfade_frames;
-                size_t crossfade_frame = 0u;
-                float crossfade_weight = 0.0f;
-                if (crossfade) {
-                    crossfade_frame = source_frame - (channel->frame_count - channel->loop_crossfade_frames);
-                    crossfade_weight = (float)(crossfade_frame + 1u) / (float)(channel->loop_crossfade_frames + 1u);
-                }
-                for (int sample_channel = 0; sample_channel < channel_count; sample_channel++) {
-                    size_t sample_index = output_offset + (size_t)sample_channel;
-                    size_t input_index = input_offset + (size_t)sample_channel;
-                    float sample = channel->samples[input_index];
-                    if (crossfade) {
-                        size_t head_index = (crossfade_frame * (size_t)channel_count) + (size_t)sample_channel;
-                        float head_sample = channel->samples[head_index];
-                        sample = sample * (1.0f - crossfade_weight) + head_sample * crossfade_weight;
-                    }
-                    output[sample_index] += sample * channel->volume;
+            float *out = output + mixed_frames * (size_t)channel_count;
+            size_t plain_frames = 0u;
+            if (channel->position < fade_start) {
+                plain_frames = fade_start - channel->position;
+                if (plain_frames > mix_frames) {
+                    plain_frames = mix_frames;
                 }
+                terminal_audio_mix_gain(out,
+                                        channel->samples + channel->position * (size_t)channel_count,
+                                        plain_frames * (size_t)channel_count,
+                                        channel->volume);
+            }
+            if (plain_frames < mix_frames) {
+                terminal_audio_mix_crossfade(out + plain_frames * (size_t)channel_count,
+                                             channel,
+                                             channel->position + plain_frames,
+                                             mix_frames - plain_frames,
+                                             (size_t)channel_count);
             }
 
             mixed_frames += mix_frames;
             channel->position += mix_frames;
             if (channel->position >= channel->frame_count) {
-                if (channel->loop) {
-                    if (channel->loop_crossfade_frames > 0u && channel->loop_crossfade_frames < channel->frame_count) {
-                        channel->position = channel->loop_crossfade_frames;
-                    } else {
-                        channel->position = 0u;
-                    }
-                } else {
-                    terminal_audio_channel_clear(channel);
-                }
+                terminal_audio_channel_rewind(channel);
             }
         }
+        if (channel->active) {
+            active_channels++;
+        }
     }
 
-    SDL_UnlockMutex(terminal_audio_mutex);
+    SDL_AtomicSet(&terminal_audio_active_channels, active_channels);
+    if (active_channels > SDL_AtomicGet(&terminal_audio_peak_channels)) {
+        SDL_AtomicSet(&terminal_audio_peak_channels, active_channels);
+    }
 
-    size_t total_samples = frames * (size_t)channel_count;
-    for (size_t i = 0u; i < total_samples; i++) {
-        float sample = output[i];
-        if (sample > 1.0f) {
-            sample = 1.0f;
-        } else if (sample < -1.0f) {
-            sample = -1.0f;
-        }
-        output[i] = sample;
+    if (terminal_audio_soft_limit(output, frames * (size_t)channel_count)) {
+        SDL_AtomicAdd(&terminal_audio_limited_buffers, 1);
     }
 }
 
@@ -675,48 +1284,37 @@ static int terminal_initialize_audio(void) {
         return -1;
     }
 
-    if (!terminal_audio_mutex) {
-        terminal_audio_mutex = SDL_CreateMutex();
-        if (!terminal_audio_mutex) {
-            fprintf(stderr, "terminal: Failed to create audio mutex: %s\n", SDL_GetError());
-            SDL_CloseAudioDevice(terminal_audio_device);
-            terminal_audio_device = 0;
-            SDL_zero(terminal_audio_spec);
-            return -1;
-        }
-    }
-
     SDL_memset(terminal_sound_channels, 0, sizeof(terminal_sound_channels));
+    SDL_AtomicSet(&terminal_audio_command_head, 0);
+    SDL_AtomicSet(&terminal_audio_command_tail, 0);
+    SDL_AtomicSet(&terminal_audio_retire_head, 0);
+    SDL_AtomicSet(&terminal_audio_retire_tail, 0);
+    SDL_AtomicSet(&terminal_audio_active_channels, 0);
+    SDL_AtomicSet(&terminal_audio_peak_channels, 0);
+    SDL_AtomicSet(&terminal_audio_underruns, 0);
+    SDL_AtomicSet(&terminal_audio_limited_buffers, 0);
+    SDL_AtomicSet(&terminal_audio_dropped_commands, 0);
+    terminal_audio_last_callback = 0u;
 
     SDL_PauseAudioDevice(terminal_audio_device, 0);
     return 0;
 }
 
 static void terminal_shutdown_audio(void) {
-    if (terminal_audio_mutex) {
-        if (SDL_LockMutex(terminal_audio_mutex) == 0) {
-            for (size_t i = 0u; i < TERMINAL_AUDIO_CHANNEL_COUNT; i++) {
-                terminal_audio_channel_clear(&terminal_sound_channels[i]);
-            }
-            SDL_UnlockMutex(terminal_audio_mutex);
-        } else {
-            for (size_t i = 0u; i < TERMINAL_AUDIO_CHANNEL_COUNT; i++) {
-                terminal_audio_channel_clear(&terminal_sound_channels[i]);
-            }
-        }
-    }
-
     if (terminal_audio_device != 0) {
         SDL_CloseAudioDevice(terminal_audio_device);
         terminal_audio_device = 0;
+        /* The callback is gone; drain what it left behind from here. */
+        terminal_audio_apply_commands();
+        for (size_t i = 0u; i < TERMINAL_AUDIO_CHANNEL_COUNT; i++) {
+            terminal_audio_channel_clear(&terminal_sound_channels[i]);
+        }
+        terminal_audio_collect();
     }
 
+    /* Cached buffers are in the device format, so they go with the device. */
+    terminal_sound_cache_clear();
     SDL_zero(terminal_audio_spec);
-
-    if (terminal_audio_mutex) {
-        SDL_DestroyMutex(terminal_audio_mutex);
-        terminal_audio_mutex = NULL;
-    }
 }
 
 static int terminal_audio_convert(const SDL_AudioSpec *source_spec, const void *data, size_t length, float **out_samples, size_t *out_frames) {
@@ -989,122 +1587,765 @@ static int terminal_audio_load_file(const char *path, float **out_samples, size_
     return -1;
 }
 
-static int terminal_sound_play(int channel_index, const char *path, float volume) {
-    if (channel_index < 0 || channel_index >= (int)TERMINAL_AUDIO_CHANNEL_COUNT) {
-        fprintf(stderr, "terminal: Sound channel %d out of range.\n", channel_index + 1);
-        return -1;
+/* Streaming playback. A worker thread decodes a long file in chunks,
+ * converts it to the device format and keeps a ring of about
+ * TERMINAL_SOUND_STREAM_RING_MS ahead of the audio callback, which only
+ * copies out of the ring. Looping streams hold back the last
+ * loop_crossfade_frames of every pass and blend them with the saved head
+ * of the track, the same crossfade in-memory loops get from the mixer. */
+static int terminal_sound_stream_format_of(const char *path) {
+    const char *extension = path ? strrchr(path, '.') : NULL;
+    if (!extension) {
+        return TERMINAL_SOUND_STREAM_NONE;
     }
-    if (!path || path[0] == '\0') {
-        fprintf(stderr, "terminal: Sound path is empty.\n");
-        return -1;
+    char lower_ext[8];
+    size_t ext_length = strlen(extension);
+    if (ext_length >= sizeof(lower_ext)) {
+        return TERMINAL_SOUND_STREAM_NONE;
     }
-    if (terminal_audio_device == 0 || !terminal_audio_mutex) {
-        fprintf(stderr, "terminal: Audio subsystem not initialized.\n");
-        return -1;
+    for (size_t i = 0u; i <= ext_length; i++) {
+        lower_ext[i] = (char)tolower((unsigned char)extension[i]);
     }
-
-    float *samples = NULL;
-    size_t frames = 0u;
-    if (terminal_audio_load_file(path, &samples, &frames) != 0) {
-        return -1;
+    if (strcmp(lower_ext, ".wav") == 0) {
+        return TERMINAL_SOUND_STREAM_WAV;
     }
-
-    if (terminal_sound_play_samples(channel_index, samples, frames, 1, 0, 0u, volume) != 0) {
-        free(samples);
-        return -1;
+    if (strcmp(lower_ext, ".mp3") == 0) {
+        return TERMINAL_SOUND_STREAM_MP3;
     }
-
-    return 0;
+    if (strcmp(lower_ext, ".ogg") == 0) {
+        return TERMINAL_SOUND_STREAM_OGG;
+    }
+    return TERMINAL_SOUND_STREAM_NONE;
 }
 
-static int terminal_sound_play_samples(int channel_index, float *samples, size_t frames, int owns_samples, int loop, size_t loop_crossfade_frames, float volume) {
-    if (channel_index < 0 || channel_index >= (int)TERMINAL_AUDIO_CHANNEL_COUNT) {
-        fprintf(stderr, "terminal: Sound channel %d out of range.\n", channel_index + 1);
-        return -1;
-    }
-    if (!samples || frames == 0u) {
-        fprintf(stderr, "terminal: Sound sample buffer is empty.\n");
-        return -1;
+/* Regular files above the threshold in a format the stream can decode. */
+static int terminal_sound_stream_wanted(const char *path) {
+    struct stat path_stat;
+    if (terminal_sound_stream_format_of(path) == TERMINAL_SOUND_STREAM_NONE) {
+        return 0;
     }
-    if (terminal_audio_device == 0 || !terminal_audio_mutex) {
-        fprintf(stderr, "terminal: Audio subsystem not initialized.\n");
-        return -1;
+    if (stat(path, &path_stat) != 0 || !S_ISREG(path_stat.st_mode)) {
+        return 0;
     }
+    return path_stat.st_size > (off_t)TERMINAL_SOUND_STREAM_THRESHOLD_BYTES;
+}
+
+static Uint32 terminal_sound_stream_le32(const unsigned char *bytes) {
+    return (Uint32)bytes[0] | ((Uint32)bytes[1] << 8) | ((Uint32)bytes[2] << 16) | ((Uint32)bytes[3] << 24);
+}
+
+static Uint16 terminal_sound_stream_le16(const unsigned char *bytes) {
+    return (Uint16)(bytes[0] | (bytes[1] << 8));
+}
 
-    if (SDL_LockMutex(terminal_audio_mutex) != 0) {
-        fprintf(stderr, "terminal: Failed to lock audio mutex: %s\n", SDL_GetError());
+/* Finds the fmt and data chunks of a RIFF WAVE file. Only formats
+ * SDL_AudioStream takes directly are streamed; anything else (24-bit or
+ * compressed WAV) returns -1 and is decoded whole by SDL_LoadWAV. */
+static int terminal_sound_stream_open_wav(struct terminal_sound_stream *stream) {
+    unsigned char header[12];
+    if (fread(header, 1u, sizeof(header), stream->wav_file) != sizeof(header) ||
+        memcmp(header, "RIFF", 4u) != 0 ||
+        memcmp(header + 8, "WAVE", 4u) != 0) {
         return -1;
     }
 
-    struct terminal_sound_channel *channel = &terminal_sound_channels[(size_t)channel_index];
-    terminal_audio_channel_clear(channel);
-    channel->samples = samples;
-    channel->frame_count = frames;
-    channel->position = 0u;
-    channel->active = 1;
-    channel->owns_samples = owns_samples ? 1 : 0;
-    channel->loop = loop ? 1 : 0;
-    if (!channel->loop || loop_crossfade_frames >= frames) {
-        loop_crossfade_frames = 0u;
-    }
-    channel->loop_crossfade_frames = loop_crossfade_frames;
-    if (volume < 0.0f) {
-        volume = 0.0f;
-    } else if (volume > 1.0f) {
-        volume = 1.0f;
+    int have_format = 0;
+    for (;;) {
+        unsigned char chunk[8];
+        if (fread(chunk, 1u, sizeof(chunk), stream->wav_file) != sizeof(chunk)) {
+            return -1;
+        }
+        Uint32 chunk_size = terminal_sound_stream_le32(chunk + 4);
+        if (memcmp(chunk, "fmt ", 4u) == 0) {
+            unsigned char format[40];
+            size_t wanted = chunk_size < sizeof(format) ? (size_t)chunk_size : sizeof(format);
+            if (wanted < 16u || fread(format, 1u, wanted, stream->wav_file) != wanted) {
+                return -1;
+            }
+            Uint16 tag = terminal_sound_stream_le16(format);
+            Uint16 channels = terminal_sound_stream_le16(format + 2);
+            Uint32 rate = terminal_sound_stream_le32(format + 4);
+            Uint16 block_align = terminal_sound_stream_le16(format + 12);
+            Uint16 bits = terminal_sound_stream_le16(format + 14);
+            if (tag == 0xFFFEu) {
+                if (wanted < 26u) {
+                    return -1;
+                }
+                tag = terminal_sound_stream_le16(format + 24);
+            }
+            SDL_AudioFormat sdl_format = 0;
+            if (tag == 1u && bits == 8u) {
+                sdl_format = AUDIO_U8;
+            } else if (tag == 1u && bits == 16u) {
+                sdl_format = AUDIO_S16LSB;
+            } else if (tag == 1u && bits == 32u) {
+                sdl_format = AUDIO_S32LSB;
+            } else if (tag == 3u && bits == 32u) {
+                sdl_format = AUDIO_F32LSB;
+            }
+            if (sdl_format == 0 || channels == 0u || channels > 8u || rate == 0u ||
+                block_align != channels * (bits / 8u)) {
+                return -1;
+            }
+            SDL_zero(stream->source_spec);
+            stream->source_spec.format = sdl_format;
+            stream->source_spec.channels = (Uint8)channels;
+            stream->source_spec.freq = (int)rate;
+            stream->wav_frame_bytes = block_align;
+            have_format = 1;
+            if (fseek(stream->wav_file, (long)(chunk_size - wanted + (chunk_size & 1u)), SEEK_CUR) != 0) {
+                return -1;
+            }
+        } else if (memcmp(chunk, "data", 4u) == 0) {
+            if (!have_format) {
+                return -1;
+            }
+            long offset = ftell(stream->wav_file);
+            if (offset < 0) {
+                return -1;
+            }
+            stream->wav_data_offset = offset;
+            stream->wav_data_bytes = (size_t)chunk_size - (size_t)chunk_size % stream->wav_frame_bytes;
+            stream->wav_data_read = 0u;
+            return stream->wav_data_bytes > 0u ? 0 : -1;
+        } else if (fseek(stream->wav_file, (long)chunk_size + (long)(chunk_size & 1u), SEEK_CUR) != 0) {
+            return -1;
+        }
     }
-    channel->volume = volume;
-
-    SDL_UnlockMutex(terminal_audio_mutex);
-    return 0;
 }
 
-static void terminal_sound_stop(int channel_index) {
-    if (channel_index < 0 || channel_index >= (int)TERMINAL_AUDIO_CHANNEL_COUNT) {
-        return;
+/* Decodes up to TERMINAL_SOUND_STREAM_DECODE_FRAMES source frames into the
+ * converter. Returns 0 at the end of the track. */
+static size_t terminal_sound_stream_decode(struct terminal_sound_stream *stream) {
+    size_t frames = 0u;
+    size_t source_channels = (size_t)stream->source_spec.channels;
+    if (stream->format == TERMINAL_SOUND_STREAM_WAV) {
+        size_t remaining = stream->wav_data_bytes - stream->wav_data_read;
+        size_t wanted = TERMINAL_SOUND_STREAM_DECODE_FRAMES * stream->wav_frame_bytes;
+        if (wanted > remaining) {
+            wanted = remaining;
+        }
+        size_t bytes = wanted > 0u ? fread(stream->decoded, 1u, wanted, stream->wav_file) : 0u;
+        bytes -= bytes % stream->wav_frame_bytes;
+        stream->wav_data_read += bytes;
+        frames = bytes / stream->wav_frame_bytes;
+    } else if (stream->format == TERMINAL_SOUND_STREAM_MP3) {
+        frames = (size_t)drmp3_read_pcm_frames_f32(&stream->mp3, TERMINAL_SOUND_STREAM_DECODE_FRAMES, stream->decoded);
+    } else if (stream->format == TERMINAL_SOUND_STREAM_OGG) {
+        int decoded = stb_vorbis_get_samples_float_interleaved(stream->vorbis,
+                                                               (int)source_channels,
+                                                               stream->decoded,
+                                                               (int)(TERMINAL_SOUND_STREAM_DECODE_FRAMES * source_channels));
+        frames = decoded > 0 ? (size_t)decoded : 0u;
     }
-    if (!terminal_audio_mutex) {
-        return;
+    if (frames == 0u) {
+        return 0u;
     }
 
-    if (SDL_LockMutex(terminal_audio_mutex) != 0) {
-        fprintf(stderr, "terminal: Failed to lock audio mutex for stop: %s\n", SDL_GetError());
-        return;
+    size_t frame_bytes = stream->format == TERMINAL_SOUND_STREAM_WAV ? stream->wav_frame_bytes
+                                                                      : source_channels * sizeof(float);
+    if (SDL_AudioStreamPut(stream->converter, stream->decoded, (int)(frames * frame_bytes)) != 0) {
+        fprintf(stderr, "terminal: SDL_AudioStreamPut failed: %s\n", SDL_GetError());
+        return 0u;
     }
-
-    terminal_audio_channel_clear(&terminal_sound_channels[(size_t)channel_index]);
-    SDL_UnlockMutex(terminal_audio_mutex);
+    return frames;
 }
 
-static void terminal_keyboard_sound_library_free(void) {
-    free(terminal_keyboard_sound_library.key_press_samples);
-    free(terminal_keyboard_sound_library.enter_press_samples);
-    terminal_keyboard_sound_library.key_press_samples = NULL;
-    terminal_keyboard_sound_library.key_press_frame_count = 0u;
-    terminal_keyboard_sound_library.enter_press_samples = NULL;
-    terminal_keyboard_sound_library.enter_press_frame_count = 0u;
+static int terminal_sound_stream_rewind(struct terminal_sound_stream *stream) {
+    SDL_AudioStreamClear(stream->converter);
+    if (stream->format == TERMINAL_SOUND_STREAM_WAV) {
+        stream->wav_data_read = 0u;
+        return fseek(stream->wav_file, stream->wav_data_offset, SEEK_SET) == 0 ? 0 : -1;
+    }
+    if (stream->format == TERMINAL_SOUND_STREAM_MP3) {
+        return drmp3_seek_to_pcm_frame(&stream->mp3, 0) ? 0 : -1;
+    }
+    return stb_vorbis_seek_start(stream->vorbis) ? 0 : -1;
 }
 
-static int terminal_keyboard_sound_file_is_usable(const char *path) {
-    if (!path || path[0] == '\0') {
-        return 0;
+/* Copies device frames into the ring, waiting for the callback to make
+ * room. Returns -1 once the stream is being closed. */
+static int terminal_sound_stream_emit(struct terminal_sound_stream *stream, const float *frames, size_t count) {
+    size_t channels = stream->channels;
+    while (count > 0u) {
+        unsigned int write = (unsigned int)SDL_AtomicGet(&stream->write_index);
+        unsigned int read = (unsigned int)SDL_AtomicGet(&stream->read_index);
+        size_t space = stream->ring_frames - (size_t)(write - read);
+        if (space == 0u) {
+            if (SDL_AtomicGet(&stream->stop)) {
+                return -1;
+            }
+            SDL_SemWaitTimeout(stream->wake, 100u);
+            continue;
+        }
+        size_t offset = (size_t)write & (stream->ring_frames - 1u);
+        size_t chunk = count < space ? count : space;
+        if (chunk > stream->ring_frames - offset) {
+            chunk = stream->ring_frames - offset;
+        }
+        memcpy(stream->ring + offset * channels, frames, chunk * channels * sizeof(float));
+        SDL_AtomicSet(&stream->write_index, (int)(write + (unsigned int)chunk));
+        frames += chunk * channels;
+        count -= chunk;
     }
+    return 0;
+}
 
-    struct stat path_stat;
-    if (stat(path, &path_stat) != 0) {
-        fprintf(stderr, "terminal: Unable to stat keyboard sound '%s': %s\n", path, strerror(errno));
+/* Takes converted frames in order: drops the head again on repeat passes,
+ * remembers it on the first, and keeps the newest crossfade frames back so
+ * the end of the pass can be blended. */
+static int terminal_sound_stream_feed(struct terminal_sound_stream *stream, const float *frames, size_t count) {
+    size_t channels = stream->channels;
+    size_t fade = stream->loop_crossfade_frames;
+    if (stream->skip_frames > 0u) {
+        size_t skipped = count < stream->skip_frames ? count : stream->skip_frames;
+        stream->skip_frames -= skipped;
+        frames += skipped * channels;
+        count -= skipped;
+    }
+    if (count == 0u) {
         return 0;
     }
-    if (!S_ISREG(path_stat.st_mode)) {
-        fprintf(stderr, "terminal: Keyboard sound '%s' is not a regular file.\n", path);
+    stream->pass_frames += count;
+    if (fade == 0u) {
+        return terminal_sound_stream_emit(stream, frames, count);
+    }
+    if (stream->head_frames < fade) {
+        size_t copied = fade - stream->head_frames;
+        if (copied > count) {
+            copied = count;
+        }
+        memcpy(stream->head + stream->head_frames * channels, frames, copied * channels * sizeof(float));
+        stream->head_frames += copied;
+    }
+    memcpy(stream->pending + stream->pending_frames * channels, frames, count * channels * sizeof(float));
+    stream->pending_frames += count;
+    if (stream->pending_frames <= fade) {
         return 0;
     }
-
-    return 1;
+    size_t ready = stream->pending_frames - fade;
+    if (terminal_sound_stream_emit(stream, stream->pending, ready) != 0) {
+        return -1;
+    }
+    memmove(stream->pending, stream->pending + ready * channels, fade * channels * sizeof(float));
+    stream->pending_frames = fade;
+    return 0;
 }
 
-static int terminal_keyboard_sound_library_load(const char *directory_path) {
-    (void)directory_path;
+static int terminal_sound_stream_drain(struct terminal_sound_stream *stream) {
+    size_t frame_bytes = stream->channels * sizeof(float);
+    for (;;) {
+        int available = SDL_AudioStreamAvailable(stream->converter);
+        if (available < (int)frame_bytes) {
+            return 0;
+        }
+        size_t wanted = (size_t)available;
+        if (wanted > TERMINAL_SOUND_STREAM_DECODE_FRAMES * frame_bytes) {
+            wanted = TERMINAL_SOUND_STREAM_DECODE_FRAMES * frame_bytes;
+        }
+        wanted -= wanted % frame_bytes;
+        int obtained = SDL_AudioStreamGet(stream->converter, stream->converted, (int)wanted);
+        if (obtained <= 0) {
+            return obtained < 0 ? -1 : 0;
+        }
+        if (terminal_sound_stream_feed(stream, stream->converted, (size_t)obtained / frame_bytes) != 0) {
+            return -1;
+        }
+    }
+}
+
+/* End of a pass: a one-shot stream lets the held-back tail out as is, a
+ * looping one blends it into the head and starts over past the head. */
+static int terminal_sound_stream_finish_pass(struct terminal_sound_stream *stream) {
+    size_t channels = stream->channels;
+    if (SDL_AudioStreamFlush(stream->converter) != 0 || terminal_sound_stream_drain(stream) != 0) {
+        return -1;
+    }
+    size_t tail = stream->pending_frames;
+    if (stream->loop && tail > stream->head_frames) {
+        tail = stream->head_frames;
+    }
+    if (stream->loop) {
+        for (size_t frame = 0u; frame < tail; frame++) {
+            float weight = (float)(frame + 1u) / (float)(tail + 1u);
+            float *out = stream->pending + frame * channels;
+            const float *head = stream->head + frame * channels;
+            for (size_t channel = 0u; channel < channels; channel++) {
+                out[channel] = out[channel] * (1.0f - weight) + head[channel] * weight;
+            }
+        }
+    }
+    if (tail > 0u && terminal_sound_stream_emit(stream, stream->pending, tail) != 0) {
+        return -1;
+    }
+    stream->pending_frames = 0u;
+    if (!stream->loop || stream->pass_frames == 0u || terminal_sound_stream_rewind(stream) != 0) {
+        return -1;
+    }
+    stream->skip_frames = tail;
+    stream->pass_frames = 0u;
+    return 0;
+}
+
+/* Decodes one chunk. Returns -1 once nothing more will be written. */
+static int terminal_sound_stream_step(struct terminal_sound_stream *stream) {
+    if (terminal_sound_stream_decode(stream) == 0u) {
+        return terminal_sound_stream_finish_pass(stream);
+    }
+    return terminal_sound_stream_drain(stream);
+}
+
+static int SDLCALL terminal_sound_stream_main(void *userdata) {
+    struct terminal_sound_stream *stream = userdata;
+    while (!SDL_AtomicGet(&stream->stop)) {
+        if (terminal_sound_stream_step(stream) != 0) {
+            break;
+        }
+    }
+    SDL_AtomicSet(&stream->finished, 1);
+    return 0;
+}
+
+static void terminal_sound_stream_free(struct terminal_sound_stream *stream) {
+    if (!stream) {
+        return;
+    }
+    if (stream->format == TERMINAL_SOUND_STREAM_MP3) {
+        drmp3_uninit(&stream->mp3);
+    }
+    if (stream->vorbis) {
+        stb_vorbis_close(stream->vorbis);
+    }
+    if (stream->wav_file) {
+        fclose(stream->wav_file);
+    }
+    if (stream->converter) {
+        SDL_FreeAudioStream(stream->converter);
+    }
+    if (stream->wake) {
+        SDL_DestroySemaphore(stream->wake);
+    }
+    free(stream->ring);
+    free(stream->head);
+    free(stream->pending);
+    free(stream->decoded);
+    free(stream->converted);
+    free(stream);
+}
+
+/* Main thread; the stream must no longer be reachable from a channel. */
+static void terminal_sound_stream_close(struct terminal_sound_stream *stream) {
+    if (!stream) {
+        return;
+    }
+    if (stream->thread) {
+        SDL_AtomicSet(&stream->stop, 1);
+        SDL_SemPost(stream->wake);
+        SDL_WaitThread(stream->thread, NULL);
+    }
+    terminal_sound_stream_free(stream);
+}
+
+/* Opens the decoder, fills the first chunk of the ring and starts the
+ * worker. Returns NULL when the file cannot be streamed; callers fall back
+ * to decoding it whole. */
+static struct terminal_sound_stream *terminal_sound_stream_open(const char *path, int loop, size_t loop_crossfade_frames) {
+    if (terminal_audio_device == 0 || terminal_audio_spec.channels == 0 || terminal_audio_spec.freq <= 0) {
+        return NULL;
+    }
+    struct terminal_sound_stream *stream = calloc(1u, sizeof(*stream));
+    if (!stream) {
+        return NULL;
+    }
+    stream->format = terminal_sound_stream_format_of(path);
+    stream->channels = (size_t)terminal_audio_spec.channels;
+    stream->loop = loop ? 1 : 0;
+    stream->loop_crossfade_frames = loop ? loop_crossfade_frames : 0u;
+
+    int opened = 0;
+    if (stream->format == TERMINAL_SOUND_STREAM_WAV) {
+        stream->wav_file = fopen(path, "rb");
+        opened = stream->wav_file && terminal_sound_stream_open_wav(stream) == 0;
+    } else if (stream->format == TERMINAL_SOUND_STREAM_MP3) {
+        if (drmp3_init_file(&stream->mp3, path, NULL)) {
+            SDL_zero(stream->source_spec);
+            stream->source_spec.format = AUDIO_F32SYS;
+            stream->source_spec.channels = (Uint8)stream->mp3.channels;
+            stream->source_spec.freq = (int)stream->mp3.sampleRate;
+            opened = stream->mp3.channels > 0u;
+        } else {
+            stream->format = TERMINAL_SOUND_STREAM_NONE;
+        }
+    } else if (stream->format == TERMINAL_SOUND_STREAM_OGG) {
+        int vorbis_error = 0;
+        stream->vorbis = stb_vorbis_open_filename(path, &vorbis_error, NULL);
+        if (stream->vorbis) {
+            stb_vorbis_info info = stb_vorbis_get_info(stream->vorbis);
+            SDL_zero(stream->source_spec);
+            stream->source_spec.format = AUDIO_F32SYS;
+            stream->source_spec.channels = (Uint8)info.channels;
+            stream->source_spec.freq = (int)info.sample_rate;
+            opened = info.channels > 0;
+        }
+    }
+    if (!opened) {
+        terminal_sound_stream_free(stream);
+        return NULL;
+    }
+
+    size_t ring_frames = 1u;
+    size_t ring_wanted = ((size_t)terminal_audio_spec.freq * TERMINAL_SOUND_STREAM_RING_MS) / 1000u;
+    while (ring_frames < ring_wanted) {
+        ring_frames <<= 1u;
+    }
+    stream->ring_frames = ring_frames;
+
+    size_t source_frame_bytes = (size_t)stream->source_spec.channels * sizeof(float);
+    size_t device_frame_bytes = stream->channels * sizeof(float);
+    stream->ring = malloc(ring_frames * device_frame_bytes);
+    stream->decoded = malloc(TERMINAL_SOUND_STREAM_DECODE_FRAMES * source_frame_bytes);
+    stream->converted = malloc(TERMINAL_SOUND_STREAM_DECODE_FRAMES * device_frame_bytes);
+    if (stream->loop_crossfade_frames > 0u) {
+        stream->head = malloc(stream->loop_crossfade_frames * device_frame_bytes);
+        stream->pending = malloc((stream->loop_crossfade_frames + TERMINAL_SOUND_STREAM_DECODE_FRAMES) * device_frame_bytes);
+    }
+    stream->converter = SDL_NewAudioStream(stream->source_spec.format,
+                                           stream->source_spec.channels,
+                                           stream->source_spec.freq,
+                                           terminal_audio_spec.format,
+                                           terminal_audio_spec.channels,
+                                           terminal_audio_spec.freq);
+    stream->wake = SDL_CreateSemaphore(0u);
+    if (!stream->ring || !stream->decoded || !stream->converted || !stream->converter || !stream->wake ||
+        (stream->loop_crossfade_frames > 0u && (!stream->head || !stream->pending))) {
+        fprintf(stderr, "terminal: Failed to set up audio stream for '%s'.\n", path);
+        terminal_sound_stream_free(stream);
+        return NULL;
+    }
+
+    /* Prime the ring so the first callbacks have something to play. */
+    (void)terminal_sound_stream_step(stream);
+    if (SDL_AtomicGet(&stream->write_index) == 0) {
+        terminal_sound_stream_free(stream);
+        return NULL;
+    }
+
+    stream->thread = SDL_CreateThread(terminal_sound_stream_main, "terminal-sound", stream);
+    if (!stream->thread) {
+        fprintf(stderr, "terminal: SDL_CreateThread failed: %s\n", SDL_GetError());
+        terminal_sound_stream_free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+static int terminal_sound_play_stream(int channel_index, struct terminal_sound_stream *stream, float volume) {
+    terminal_audio_collect();
+
+    if (volume < 0.0f) {
+        volume = 0.0f;
+    } else if (volume > 1.0f) {
+        volume = 1.0f;
+    }
+
+    struct terminal_audio_command command = {
+        .type = TERMINAL_AUDIO_COMMAND_PLAY,
+        .channel = (size_t)channel_index,
+        .stream = stream,
+        .volume = volume
+    };
+    if (terminal_audio_push(&command) != 0) {
+        terminal_sound_stream_close(stream);
+        fprintf(stderr, "terminal: Audio command queue is full.\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int terminal_sound_play(int channel_index, const char *path, float volume) {
+    if (channel_index < 0 || channel_index >= (int)TERMINAL_AUDIO_CHANNEL_COUNT) {
+        fprintf(stderr, "terminal: Sound channel %d out of range.\n", channel_index + 1);
+        return -1;
+    }
+    if (!path || path[0] == '\0') {
+        fprintf(stderr, "terminal: Sound path is empty.\n");
+        return -1;
+    }
+    if (terminal_audio_device == 0) {
+        fprintf(stderr, "terminal: Audio subsystem not initialized.\n");
+        return -1;
+    }
+
+    /* Long tracks are streamed instead of decoded whole into the cache. */
+    if (terminal_sound_stream_wanted(path)) {
+        struct terminal_sound_stream *stream = terminal_sound_stream_open(path, 0, 0u);
+        if (stream) {
+            return terminal_sound_play_stream(channel_index, stream, volume);
+        }
+    }
+
+    struct terminal_sound_sample *sample = terminal_sound_cache_load(path);
+    if (!sample) {
+        return -1;
+    }
+
+    return terminal_sound_play_samples(channel_index, sample->samples, sample->frame_count, 0, sample, 0, 0u, volume);
+}
+
+static void terminal_sound_sample_free(struct terminal_sound_sample *sample) {
+    if (!sample) {
+        return;
+    }
+    free(sample->path);
+    free(sample->samples);
+    free(sample);
+}
+
+static void terminal_sound_sample_release(struct terminal_sound_sample *sample) {
+    if (!sample || sample->refs == 0u) {
+        return;
+    }
+    sample->refs--;
+    if (sample->refs == 0u && !sample->cached) {
+        terminal_sound_sample_free(sample);
+    }
+}
+
+static void terminal_sound_cache_unlink(struct terminal_sound_sample *sample) {
+    if (sample->prev) {
+        sample->prev->next = sample->next;
+    } else {
+        terminal_sound_cache_head = sample->next;
+    }
+    if (sample->next) {
+        sample->next->prev = sample->prev;
+    } else {
+        terminal_sound_cache_tail = sample->prev;
+    }
+    sample->prev = NULL;
+    sample->next = NULL;
+    terminal_sound_cache_count--;
+    terminal_sound_cache_bytes -= sample->bytes;
+}
+
+static void terminal_sound_cache_push_front(struct terminal_sound_sample *sample) {
+    sample->prev = NULL;
+    sample->next = terminal_sound_cache_head;
+    if (terminal_sound_cache_head) {
+        terminal_sound_cache_head->prev = sample;
+    } else {
+        terminal_sound_cache_tail = sample;
+    }
+    terminal_sound_cache_head = sample;
+    terminal_sound_cache_count++;
+    terminal_sound_cache_bytes += sample->bytes;
+}
+
+static void terminal_sound_cache_drop(struct terminal_sound_sample *sample) {
+    terminal_sound_cache_unlink(sample);
+    sample->cached = 0;
+    if (sample->refs == 0u) {
+        terminal_sound_sample_free(sample);
+    }
+}
+
+static void terminal_sound_cache_trim(void) {
+    /* The most recent entry always stays, even if it alone exceeds the budget. */
+    while (terminal_sound_cache_tail && terminal_sound_cache_tail != terminal_sound_cache_head &&
+           (terminal_sound_cache_count > TERMINAL_SOUND_CACHE_MAX_ENTRIES ||
+            terminal_sound_cache_bytes > TERMINAL_SOUND_CACHE_MAX_BYTES)) {
+        terminal_sound_cache_drop(terminal_sound_cache_tail);
+    }
+}
+
+/* Returns the decoded samples for path, decoding only when the file is new
+ * or has changed on disk since it was cached. */
+static struct terminal_sound_sample *terminal_sound_cache_load(const char *path) {
+    if (!path || path[0] == '\0') {
+        return NULL;
+    }
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "terminal: Unable to stat sound '%s': %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    for (struct terminal_sound_sample *sample = terminal_sound_cache_head; sample; sample = sample->next) {
+        if (strcmp(sample->path, path) != 0) {
+            continue;
+        }
+        if (sample->mtime_sec == st.st_mtim.tv_sec &&
+            sample->mtime_nsec == st.st_mtim.tv_nsec &&
+            sample->file_size == st.st_size) {
+            if (sample != terminal_sound_cache_head) {
+                terminal_sound_cache_unlink(sample);
+                terminal_sound_cache_push_front(sample);
+            }
+            return sample;
+        }
+        terminal_sound_cache_drop(sample);
+        break;
+    }
+
+    struct terminal_sound_sample *sample = calloc(1u, sizeof(*sample));
+    if (!sample) {
+        fprintf(stderr, "terminal: Failed to allocate sound cache entry.\n");
+        return NULL;
+    }
+    sample->path = strdup(path);
+    if (!sample->path || terminal_audio_load_file(path, &sample->samples, &sample->frame_count) != 0) {
+        terminal_sound_sample_free(sample);
+        return NULL;
+    }
+    sample->mtime_sec = st.st_mtim.tv_sec;
+    sample->mtime_nsec = st.st_mtim.tv_nsec;
+    sample->file_size = st.st_size;
+    sample->bytes = sample->frame_count * (size_t)terminal_audio_spec.channels * sizeof(float);
+    sample->cached = 1;
+    terminal_sound_cache_push_front(sample);
+    terminal_sound_cache_trim();
+    return sample;
+}
+
+static int terminal_sound_preload(const char *path) {
+    if (terminal_audio_device == 0) {
+        fprintf(stderr, "terminal: Audio subsystem not initialized.\n");
+        return -1;
+    }
+    return terminal_sound_cache_load(path) ? 0 : -1;
+}
+
+static void terminal_sound_cache_clear(void) {
+    while (terminal_sound_cache_head) {
+        terminal_sound_cache_drop(terminal_sound_cache_head);
+    }
+}
+
+static int terminal_sound_play_samples(int channel_index,
+                                       float *samples,
+                                       size_t frames,
+                                       int owns_samples,
+                                       struct terminal_sound_sample *shared,
+                                       int loop,
+                                       size_t loop_crossfade_frames,
+                                       float volume) {
+    if (channel_index < 0 || channel_index >= (int)TERMINAL_AUDIO_CHANNEL_COUNT) {
+        fprintf(stderr, "terminal: Sound channel %d out of range.\n", channel_index + 1);
+        return -1;
+    }
+    if (!samples || frames == 0u) {
+        fprintf(stderr, "terminal: Sound sample buffer is empty.\n");
+        return -1;
+    }
+    if (terminal_audio_device == 0) {
+        fprintf(stderr, "terminal: Audio subsystem not initialized.\n");
+        return -1;
+    }
+
+    terminal_audio_collect();
+
+    if (volume < 0.0f) {
+        volume = 0.0f;
+    } else if (volume > 1.0f) {
+        volume = 1.0f;
+    }
+    if (!loop || loop_crossfade_frames >= frames) {
+        loop_crossfade_frames = 0u;
+    }
+
+    struct terminal_audio_command command = {
+        .type = TERMINAL_AUDIO_COMMAND_PLAY,
+        .channel = (size_t)channel_index,
+        .samples = samples,
+        .frame_count = frames,
+        .owns_samples = owns_samples ? 1 : 0,
+        .shared = shared,
+        .loop = loop ? 1 : 0,
+        .loop_crossfade_frames = loop_crossfade_frames,
+        .volume = volume
+    };
+    if (shared) {
+        shared->refs++;
+    }
+    if (terminal_audio_push(&command) != 0) {
+        if (shared) {
+            shared->refs--;
+        }
+        fprintf(stderr, "terminal: Audio command queue is full.\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void terminal_sound_stop(int channel_index) {
+    if (channel_index < 0 || channel_index >= (int)TERMINAL_AUDIO_CHANNEL_COUNT) {
+        return;
+    }
+    if (terminal_audio_device == 0) {
+        return;
+    }
+
+    terminal_audio_collect();
+
+    struct terminal_audio_command command = {
+        .type = TERMINAL_AUDIO_COMMAND_STOP,
+        .channel = (size_t)channel_index
+    };
+    if (terminal_audio_push(&command) != 0) {
+        fprintf(stderr, "terminal: Audio command queue is full; stop dropped.\n");
+    }
+}
+
+static void terminal_sound_report_stats(void) {
+    char response[160];
+    int written = snprintf(response,
+                           sizeof(response),
+                           "_TERM_SOUND active=%d peak=%d channels=%d underruns=%d limited=%d dropped=%d\n",
+                           SDL_AtomicGet(&terminal_audio_active_channels),
+                           SDL_AtomicGet(&terminal_audio_peak_channels),
+                           (int)TERMINAL_AUDIO_CHANNEL_COUNT,
+                           SDL_AtomicGet(&terminal_audio_underruns),
+                           SDL_AtomicGet(&terminal_audio_limited_buffers),
+                           SDL_AtomicGet(&terminal_audio_dropped_commands));
+    if (written > 0 && (size_t)written < sizeof(response)) {
+        terminal_send_response(response);
+    }
+}
+
+static void terminal_keyboard_sound_library_free(void) {
+    for (int i = 0; i < TERMINAL_KEYBOARD_SOUND_CHANNEL_COUNT; i++) {
+        terminal_sound_stop(TERMINAL_KEYBOARD_SOUND_FIRST_CHANNEL + i);
+    }
+    terminal_audio_sync();
+    free(terminal_keyboard_sound_library.key_press_samples);
+    free(terminal_keyboard_sound_library.enter_press_samples);
+    terminal_keyboard_sound_library.key_press_samples = NULL;
+    terminal_keyboard_sound_library.key_press_frame_count = 0u;
+    terminal_keyboard_sound_library.enter_press_samples = NULL;
+    terminal_keyboard_sound_library.enter_press_frame_count = 0u;
+}
+
+static int terminal_keyboard_sound_file_is_usable(const char *path) {
+    if (!path || path[0] == '\0') {
+        return 0;
+    }
+
+    struct stat path_stat;
+    if (stat(path, &path_stat) != 0) {
+        fprintf(stderr, "terminal: Unable to stat keyboard sound '%s': %s\n", path, strerror(errno));
+        return 0;
+    }
+    if (!S_ISREG(path_stat.st_mode)) {
+        fprintf(stderr, "terminal: Keyboard sound '%s' is not a regular file.\n", path);
+        return 0;
+    }
+
+    return 1;
+}
+
+static int terminal_keyboard_sound_library_load(const char *directory_path) {
+    (void)directory_path;
 
     terminal_keyboard_sound_library_free();
 
@@ -1138,9 +2379,12 @@ static int terminal_keyboard_sound_library_load(const char *directory_path) {
 
 static void terminal_background_sound_free(void) {
     terminal_sound_stop(TERMINAL_BACKGROUND_SOUND_CHANNEL);
+    terminal_audio_sync();
     free(terminal_background_sound_samples);
     terminal_background_sound_samples = NULL;
     terminal_background_sound_frame_count = 0u;
+    free(terminal_background_sound_stream_path);
+    terminal_background_sound_stream_path = NULL;
 }
 
 static int terminal_background_sound_load(const char *path) {
@@ -1151,6 +2395,15 @@ static int terminal_background_sound_load(const char *path) {
         return -1;
     }
 
+    /* Long tracks are streamed from disk each time the loop is started. */
+    if (terminal_sound_stream_wanted(path)) {
+        terminal_background_sound_stream_path = strdup(path);
+        if (!terminal_background_sound_stream_path) {
+            return -1;
+        }
+        return 0;
+    }
+
     if (terminal_audio_load_file(path, &terminal_background_sound_samples, &terminal_background_sound_frame_count) != 0) {
         fprintf(stderr, "terminal: Failed to preload background sound '%s'.\n", path);
         terminal_background_sound_free();
@@ -1164,6 +2417,25 @@ static void terminal_background_sound_restart_if_enabled(void) {
     if (!terminal_background_sound_enabled) {
         return;
     }
+    if (terminal_background_sound_stream_path) {
+        struct terminal_sound_stream *stream = terminal_sound_stream_open(terminal_background_sound_stream_path,
+                                                                          1,
+                                                                          terminal_background_sound_crossfade_frames());
+        if (stream) {
+            if (terminal_sound_play_stream(TERMINAL_BACKGROUND_SOUND_CHANNEL, stream, terminal_background_sound_volume) != 0) {
+                fprintf(stderr, "terminal: Failed to play background sound.\n");
+                terminal_background_sound_enabled = 0;
+            }
+            return;
+        }
+        /* Not streamable after all; decode it whole once. */
+        char *path = terminal_background_sound_stream_path;
+        terminal_background_sound_stream_path = NULL;
+        if (terminal_audio_load_file(path, &terminal_background_sound_samples, &terminal_background_sound_frame_count) != 0) {
+            fprintf(stderr, "terminal: Failed to preload background sound '%s'.\n", path);
+        }
+        free(path);
+    }
     if (!terminal_background_sound_samples || terminal_background_sound_frame_count == 0u) {
         fprintf(stderr, "terminal: Background sound sample is not loaded.\n");
         terminal_background_sound_enabled = 0;
@@ -1173,6 +2445,7 @@ static void terminal_background_sound_restart_if_enabled(void) {
                                     terminal_background_sound_samples,
                                     terminal_background_sound_frame_count,
                                     0,
+                                    NULL,
                                     1,
                                     terminal_background_sound_crossfade_frames(),
                                     terminal_background_sound_volume) != 0) {
@@ -1268,7 +2541,7 @@ static void terminal_play_keyboard_sound(int is_enter_key) {
     int channel_index = TERMINAL_KEYBOARD_SOUND_FIRST_CHANNEL + (int)terminal_keyboard_sound_next_channel;
     terminal_keyboard_sound_next_channel = (terminal_keyboard_sound_next_channel + 1u) % TERMINAL_KEYBOARD_SOUND_CHANNEL_COUNT;
 
-    if (terminal_sound_play_samples(channel_index, samples, frames, 0, 0, 0u, terminal_keyboard_sound_random_volume()) != 0) {
+    if (terminal_sound_play_samples(channel_index, samples, frames, 0, NULL, 0, 0u, terminal_keyboard_sound_random_volume()) != 0) {
         fprintf(stderr, "terminal: Failed to play keyboard sound '%s'.\n", sound_path);
     }
 }
@@ -1306,7 +2579,25 @@ struct terminal_buffer {
     int cursor_saved;
     int attr_saved;
     struct terminal_cell *cells;
-    struct terminal_cell *history;
+    /* Screen rows live in cells in any order: logical row r is stored at
+     * physical row row_map[(row_head + r) % rows]. Scrolling rotates the
+     * map instead of moving cells. */
+    size_t *row_map;
+    size_t row_head;
+    size_t scrolled_lines;
+    /* Scrollback is a ring of individually compressed rows that grows on
+     * demand up to history_limit rows and history_byte_limit bytes. Rows
+     * are expanded into history_scratch only when they are looked at. */
+    unsigned char **history;
+    /* Search index: a bigram signature per history row, kept alongside
+     * the ring, and the number of rows ever dropped from its front so
+     * that search hits can be tracked by absolute line number. */
+    uint64_t *history_signatures;
+    size_t history_dropped;
+    size_t history_capacity;
+    size_t history_bytes;
+    size_t history_byte_limit;
+    struct terminal_cell *history_scratch;
     struct terminal_attributes current_attr;
     struct terminal_attributes saved_attr;
     uint32_t default_fg;
@@ -2020,219 +3311,419 @@ static uint32_t terminal_rgba_from_color(uint32_t color) {
                                          terminal_color_b(color));
 }
 
-static uint16_t terminal_custom_layer_mask(uint8_t layer) {
-    if (layer < 1u || layer > 16u) {
-        return 0u;
+static int terminal_frame_damage_resize(int width, int height) {
+    size_t tiles_x = 0u;
+    size_t tiles_y = 0u;
+    if (width > 0 && height > 0) {
+        tiles_x = ((size_t)width + TERMINAL_CUSTOM_TILE_SIZE - 1u) >> TERMINAL_CUSTOM_TILE_SHIFT;
+        tiles_y = ((size_t)height + TERMINAL_CUSTOM_TILE_SIZE - 1u) >> TERMINAL_CUSTOM_TILE_SHIFT;
     }
-    return (uint16_t)(1u << (layer - 1u));
-}
-
-static void terminal_custom_pixels_mark_pending(uint8_t layer) {
-    uint16_t mask = terminal_custom_layer_mask(layer);
-    if (mask != 0u) {
-        terminal_custom_pixels_pending_layers |= mask;
+    if (tiles_x != terminal_frame_tiles_x || tiles_y != terminal_frame_tiles_y) {
+        uint8_t *new_tiles = NULL;
+        if (tiles_x > 0u && tiles_y > 0u) {
+            new_tiles = malloc(tiles_x * tiles_y);
+            if (!new_tiles) {
+                return -1;
+            }
+        }
+        free(terminal_frame_tiles);
+        terminal_frame_tiles = new_tiles;
+        terminal_frame_tiles_x = tiles_x;
+        terminal_frame_tiles_y = tiles_y;
     }
+    terminal_frame_damage_all();
+    return 0;
 }
 
-static void terminal_custom_pixels_clear_pending_requests(void) {
-    terminal_custom_pending_clear_count = 0u;
+static void terminal_frame_damage_all(void) {
+    size_t total = terminal_frame_tiles_x * terminal_frame_tiles_y;
+    if (!terminal_frame_tiles || total == 0u) {
+        terminal_frame_dirty_tile_count = 0u;
+        return;
+    }
+    for (size_t i = 0u; i < total; i++) {
+        if (terminal_frame_tiles[i] < TERMINAL_FRAME_TILE_DIRTY) {
+            terminal_frame_tiles[i] = TERMINAL_FRAME_TILE_DIRTY;
+        }
+    }
+    terminal_frame_dirty_tile_count = total;
 }
 
-static void terminal_custom_pixels_shutdown(void) {
-    free(terminal_custom_pixels);
-    terminal_custom_pixels = NULL;
-    terminal_custom_pixel_count = 0u;
-    terminal_custom_pixel_capacity = 0u;
-    terminal_custom_pixels_dirty = 0;
-    terminal_custom_pixels_pending_layers = 0u;
-    terminal_custom_pixels_active = 0;
-    free(terminal_custom_pending_clears);
-    terminal_custom_pending_clears = NULL;
-    terminal_custom_pending_clear_count = 0u;
-    terminal_custom_pending_clear_capacity = 0u;
-    for (size_t i = 0u; i < sizeof(terminal_custom_layer_versions) / sizeof(terminal_custom_layer_versions[0]); i++) {
-        terminal_custom_layer_versions[i] = 0u;
+static void terminal_frame_damage_reset(void) {
+    if (terminal_frame_tiles) {
+        memset(terminal_frame_tiles, 0, terminal_frame_tiles_x * terminal_frame_tiles_y);
     }
+    terminal_frame_dirty_tile_count = 0u;
 }
 
-static void terminal_custom_pixels_clear(void) {
-    terminal_custom_pixel_count = 0u;
-    terminal_custom_pixels_pending_layers = 0u;
-    terminal_custom_pixels_active = 0;
-    terminal_custom_pixels_clear_pending_requests();
-    for (size_t i = 0u; i < sizeof(terminal_custom_layer_versions) / sizeof(terminal_custom_layer_versions[0]); i++) {
-        terminal_custom_layer_versions[i] = 0u;
+static void terminal_frame_damage_rect(int x, int y, int width, int height, uint8_t level) {
+    if (!terminal_frame_tiles || width <= 0 || height <= 0) {
+        return;
+    }
+    int max_x = (x > INT_MAX - width) ? INT_MAX : x + width;
+    int max_y = (y > INT_MAX - height) ? INT_MAX : y + height;
+    if (x < 0) {
+        x = 0;
+    }
+    if (y < 0) {
+        y = 0;
+    }
+    if (max_x > terminal_framebuffer_width) {
+        max_x = terminal_framebuffer_width;
+    }
+    if (max_y > terminal_framebuffer_height) {
+        max_y = terminal_framebuffer_height;
+    }
+    if (x >= max_x || y >= max_y) {
+        return;
+    }
+
+    size_t first_tx = (size_t)x >> TERMINAL_CUSTOM_TILE_SHIFT;
+    size_t first_ty = (size_t)y >> TERMINAL_CUSTOM_TILE_SHIFT;
+    size_t last_tx = (size_t)(max_x - 1) >> TERMINAL_CUSTOM_TILE_SHIFT;
+    size_t last_ty = (size_t)(max_y - 1) >> TERMINAL_CUSTOM_TILE_SHIFT;
+    if (last_tx >= terminal_frame_tiles_x) {
+        last_tx = terminal_frame_tiles_x - 1u;
+    }
+    if (last_ty >= terminal_frame_tiles_y) {
+        last_ty = terminal_frame_tiles_y - 1u;
+    }
+    for (size_t ty = first_ty; ty <= last_ty; ty++) {
+        uint8_t *row = terminal_frame_tiles + ty * terminal_frame_tiles_x;
+        for (size_t tx = first_tx; tx <= last_tx; tx++) {
+            if (row[tx] == 0u) {
+                terminal_frame_dirty_tile_count++;
+            }
+            if (row[tx] < level) {
+                row[tx] = level;
+            }
+        }
     }
-    terminal_mark_full_redraw();
 }
 
-static int terminal_custom_pixels_reserve_clear_requests(size_t additional) {
-    if (additional == 0u) {
-        return 0;
+/* Repaints the margin colour over tiles whose layer pixels were removed and
+ * invalidates the render cache for the cells they overlap so the cell pass
+ * redraws the text underneath. */
+static void terminal_frame_restore_damage(uint8_t *framebuffer,
+                                          int width,
+                                          int height,
+                                          uint32_t fill_pixel,
+                                          int margin,
+                                          int cell_width,
+                                          int cell_height) {
+    if (!framebuffer || !terminal_frame_tiles || width <= 0 || height <= 0) {
+        return;
     }
+    size_t frame_pitch = (size_t)width * 4u;
+    for (size_t ty = 0u; ty < terminal_frame_tiles_y; ty++) {
+        for (size_t tx = 0u; tx < terminal_frame_tiles_x; tx++) {
+            uint8_t *state = &terminal_frame_tiles[ty * terminal_frame_tiles_x + tx];
+            if (*state != TERMINAL_FRAME_TILE_RESTORE) {
+                continue;
+            }
+            *state = TERMINAL_FRAME_TILE_DIRTY;
 
-    if (terminal_custom_pending_clear_count > SIZE_MAX - additional) {
-        return -1;
+            int x0 = (int)(tx << TERMINAL_CUSTOM_TILE_SHIFT);
+            int y0 = (int)(ty << TERMINAL_CUSTOM_TILE_SHIFT);
+            int x1 = width - x0 < TERMINAL_CUSTOM_TILE_SIZE ? width : x0 + TERMINAL_CUSTOM_TILE_SIZE;
+            int y1 = height - y0 < TERMINAL_CUSTOM_TILE_SIZE ? height : y0 + TERMINAL_CUSTOM_TILE_SIZE;
+            for (int y = y0; y < y1; y++) {
+                uint32_t *dst32 = (uint32_t *)(framebuffer + (size_t)y * frame_pitch) + x0;
+                for (int x = 0; x < x1 - x0; x++) {
+                    dst32[x] = fill_pixel;
+                }
+            }
+
+            if (!terminal_render_cache || cell_width <= 0 || cell_height <= 0 ||
+                x1 <= margin || y1 <= margin) {
+                continue;
+            }
+            size_t first_col = x0 > margin ? (size_t)((x0 - margin) / cell_width) : 0u;
+            size_t first_row = y0 > margin ? (size_t)((y0 - margin) / cell_height) : 0u;
+            size_t last_col = (size_t)((x1 - 1 - margin) / cell_width);
+            size_t last_row = (size_t)((y1 - 1 - margin) / cell_height);
+            if (last_col >= terminal_render_cache_columns) {
+                last_col = terminal_render_cache_columns - 1u;
+            }
+            if (last_row >= terminal_render_cache_rows) {
+                last_row = terminal_render_cache_rows - 1u;
+            }
+            for (size_t row = first_row; row <= last_row && row < terminal_render_cache_rows; row++) {
+                for (size_t col = first_col; col <= last_col && col < terminal_render_cache_columns; col++) {
+                    terminal_render_cache[row * terminal_render_cache_columns + col].ch = UINT32_MAX;
+                }
+            }
+        }
     }
+}
 
-    size_t required = terminal_custom_pending_clear_count + additional;
-    if (required <= terminal_custom_pending_clear_capacity) {
-        return 0;
+static uint16_t terminal_custom_layer_mask(uint8_t layer) {
+    if (layer < 1u || layer > 16u) {
+        return 0u;
     }
+    return (uint16_t)(1u << (layer - 1u));
+}
 
-    size_t new_capacity = (terminal_custom_pending_clear_capacity == 0u) ? 4u : terminal_custom_pending_clear_capacity;
-    while (new_capacity < required) {
-        if (new_capacity > SIZE_MAX / 2u) {
-            new_capacity = required;
-            break;
+static void terminal_custom_pixels_mark_pending(uint8_t layer) {
+    uint16_t mask = terminal_custom_layer_mask(layer);
+    if (mask != 0u) {
+        terminal_custom_pixels_pending_layers |= mask;
+    }
+}
+
+static void terminal_custom_layer_touch(uint8_t layer, int x, int y, int width, int height) {
+    if (layer < 1u || layer > TERMINAL_CUSTOM_LAYER_COUNT || width <= 0 || height <= 0) {
+        return;
+    }
+    struct terminal_custom_layer *plane = &terminal_custom_layers[layer - 1u];
+    if (plane->damage_x1 <= plane->damage_x0 || plane->damage_y1 <= plane->damage_y0) {
+        plane->damage_x0 = x;
+        plane->damage_y0 = y;
+        plane->damage_x1 = x + width;
+        plane->damage_y1 = y + height;
+        return;
+    }
+    if (x < plane->damage_x0) {
+        plane->damage_x0 = x;
+    }
+    if (y < plane->damage_y0) {
+        plane->damage_y0 = y;
+    }
+    if (x + width > plane->damage_x1) {
+        plane->damage_x1 = x + width;
+    }
+    if (y + height > plane->damage_y1) {
+        plane->damage_y1 = y + height;
+    }
+}
+
+static void terminal_custom_pixels_commit(uint16_t mask) {
+    mask &= terminal_custom_pixels_pending_layers;
+    if (mask == 0u) {
+        return;
+    }
+    for (uint8_t layer = 1u; layer <= TERMINAL_CUSTOM_LAYER_COUNT; layer++) {
+        if ((mask & terminal_custom_layer_mask(layer)) == 0u) {
+            continue;
+        }
+        struct terminal_custom_layer *plane = &terminal_custom_layers[layer - 1u];
+        terminal_frame_damage_rect(plane->damage_x0,
+                                   plane->damage_y0,
+                                   plane->damage_x1 - plane->damage_x0,
+                                   plane->damage_y1 - plane->damage_y0,
+                                   TERMINAL_FRAME_TILE_RESTORE);
+        plane->damage_x0 = 0;
+        plane->damage_y0 = 0;
+        plane->damage_x1 = 0;
+        plane->damage_y1 = 0;
+
+        /* Frame tiles recomposited while the layer was pending lost its
+           committed pixels as well; restore them along with the new damage. */
+        for (size_t ty = 0u; ty < plane->tiles_y; ty++) {
+            for (size_t tx = 0u; tx < plane->tiles_x; tx++) {
+                struct terminal_custom_tile *tile = plane->tiles[ty * plane->tiles_x + tx];
+                if (!tile || !tile->skipped) {
+                    continue;
+                }
+                tile->skipped = 0;
+                terminal_frame_damage_rect((int)(tx << TERMINAL_CUSTOM_TILE_SHIFT),
+                                           (int)(ty << TERMINAL_CUSTOM_TILE_SHIFT),
+                                           TERMINAL_CUSTOM_TILE_SIZE,
+                                           TERMINAL_CUSTOM_TILE_SIZE,
+                                           TERMINAL_FRAME_TILE_RESTORE);
+            }
         }
-        new_capacity *= 2u;
     }
+    terminal_custom_pixels_pending_layers &= (uint16_t)(~mask);
+    terminal_custom_pixels_active = (terminal_custom_tile_count > 0u);
+    terminal_custom_pixels_dirty = 1;
+}
 
-    struct terminal_custom_clear_request *new_reqs = realloc(terminal_custom_pending_clears,
-                                                             new_capacity * sizeof(*terminal_custom_pending_clears));
-    if (!new_reqs) {
-        return -1;
+static void terminal_custom_layer_release(struct terminal_custom_layer *plane) {
+    if (!plane) {
+        return;
     }
+    if (plane->tiles) {
+        size_t total = plane->tiles_x * plane->tiles_y;
+        for (size_t i = 0u; i < total; i++) {
+            free(plane->tiles[i]);
+        }
+    }
+    free(plane->tiles);
+    if (terminal_custom_tile_count >= plane->tile_count) {
+        terminal_custom_tile_count -= plane->tile_count;
+    } else {
+        terminal_custom_tile_count = 0u;
+    }
+    plane->tiles = NULL;
+    plane->tiles_x = 0u;
+    plane->tiles_y = 0u;
+    plane->tile_count = 0u;
+    plane->damage_x0 = 0;
+    plane->damage_y0 = 0;
+    plane->damage_x1 = 0;
+    plane->damage_y1 = 0;
+}
 
-    terminal_custom_pending_clears = new_reqs;
-    terminal_custom_pending_clear_capacity = new_capacity;
-    return 0;
+static void terminal_custom_pixels_shutdown(void) {
+    for (size_t i = 0u; i < TERMINAL_CUSTOM_LAYER_COUNT; i++) {
+        terminal_custom_layer_release(&terminal_custom_layers[i]);
+    }
+    terminal_custom_tile_count = 0u;
+    terminal_custom_pixels_dirty = 0;
+    terminal_custom_pixels_pending_layers = 0u;
+    terminal_custom_pixels_active = 0;
 }
 
-static int terminal_custom_pixels_clear_rect(int origin_x, int origin_y, int width, int height, uint8_t layer) {
-    if (width <= 0 || height <= 0) {
-        return -1;
+static void terminal_custom_pixels_clear(void) {
+    for (size_t i = 0u; i < TERMINAL_CUSTOM_LAYER_COUNT; i++) {
+        terminal_custom_layer_release(&terminal_custom_layers[i]);
     }
+    terminal_custom_tile_count = 0u;
+    terminal_custom_pixels_pending_layers = 0u;
+    terminal_custom_pixels_active = 0;
+    terminal_mark_background_dirty();
+}
 
-    if (origin_x < 0 || origin_y < 0) {
+static int terminal_custom_layer_reserve(struct terminal_custom_layer *plane, size_t tiles_x, size_t tiles_y) {
+    if (!plane) {
         return -1;
     }
+    if (tiles_x <= plane->tiles_x && tiles_y <= plane->tiles_y) {
+        return 0;
+    }
 
-    if (layer < 1u || layer > 16u) {
+    size_t new_x = plane->tiles_x > tiles_x ? plane->tiles_x : tiles_x;
+    size_t new_y = plane->tiles_y > tiles_y ? plane->tiles_y : tiles_y;
+    if (new_x != 0u && new_y > SIZE_MAX / new_x) {
         return -1;
     }
-
-    if (origin_x > INT_MAX - width || origin_y > INT_MAX - height) {
+    size_t total = new_x * new_y;
+    if (total > SIZE_MAX / sizeof(*plane->tiles)) {
         return -1;
     }
 
-    if (terminal_custom_pixels_reserve_clear_requests(1u) != 0) {
+    struct terminal_custom_tile **new_tiles = calloc(total, sizeof(*new_tiles));
+    if (!new_tiles) {
         return -1;
     }
-
-    uint64_t previous_version = terminal_custom_layer_versions[layer];
-    if (terminal_custom_layer_versions[layer] < UINT64_MAX) {
-        terminal_custom_layer_versions[layer]++;
+    for (size_t ty = 0u; ty < plane->tiles_y; ty++) {
+        for (size_t tx = 0u; tx < plane->tiles_x; tx++) {
+            new_tiles[ty * new_x + tx] = plane->tiles[ty * plane->tiles_x + tx];
+        }
     }
-
-    struct terminal_custom_clear_request *req = &terminal_custom_pending_clears[terminal_custom_pending_clear_count++];
-    req->x = origin_x;
-    req->y = origin_y;
-    req->w = width;
-    req->h = height;
-    req->layer = layer;
-    req->version = previous_version;
-
-    terminal_custom_pixels_mark_pending(layer);
-    terminal_custom_pixels_active = 1;
+    free(plane->tiles);
+    plane->tiles = new_tiles;
+    plane->tiles_x = new_x;
+    plane->tiles_y = new_y;
     return 0;
 }
 
-static int terminal_custom_pixels_apply_clear_request(const struct terminal_custom_clear_request *req) {
-    if (!req) {
-        return 0;
-    }
-
-    int origin_x = req->x;
-    int origin_y = req->y;
-    int width = req->w;
-    int height = req->h;
-    uint8_t layer = req->layer;
-    uint64_t version = req->version;
-
-    if (width <= 0 || height <= 0) {
-        return 0;
+static struct terminal_custom_tile *terminal_custom_pixels_tile(uint8_t layer, size_t tile_x, size_t tile_y, int create) {
+    if (layer < 1u || layer > TERMINAL_CUSTOM_LAYER_COUNT) {
+        return NULL;
     }
-
-    int max_x = origin_x + width;
-    int max_y = origin_y + height;
-    size_t write_idx = 0u;
-    for (size_t read_idx = 0u; read_idx < terminal_custom_pixel_count; read_idx++) {
-        struct terminal_custom_pixel *entry = &terminal_custom_pixels[read_idx];
-        if (entry->layer == layer && entry->version <= version && entry->x >= origin_x && entry->x < max_x &&
-            entry->y >= origin_y && entry->y < max_y) {
-            continue;
+    struct terminal_custom_layer *plane = &terminal_custom_layers[layer - 1u];
+    if (tile_x >= plane->tiles_x || tile_y >= plane->tiles_y) {
+        if (!create) {
+            return NULL;
         }
-        if (write_idx != read_idx) {
-            terminal_custom_pixels[write_idx] = *entry;
+        if (terminal_custom_layer_reserve(plane, tile_x + 1u, tile_y + 1u) != 0) {
+            return NULL;
         }
-        write_idx++;
     }
 
-    if (write_idx == terminal_custom_pixel_count) {
-        return 0;
+    struct terminal_custom_tile **slot = &plane->tiles[tile_y * plane->tiles_x + tile_x];
+    if (!*slot && create) {
+        *slot = calloc(1u, sizeof(**slot));
+        if (*slot) {
+            plane->tile_count++;
+            terminal_custom_tile_count++;
+        }
     }
+    return *slot;
+}
 
-    terminal_custom_pixel_count = write_idx;
-    terminal_custom_pixels_active = (terminal_custom_pixel_count > 0u);
-    return 1;
+static void terminal_custom_pixels_drop_tile(uint8_t layer, size_t tile_x, size_t tile_y) {
+    struct terminal_custom_layer *plane = &terminal_custom_layers[layer - 1u];
+    struct terminal_custom_tile **slot = &plane->tiles[tile_y * plane->tiles_x + tile_x];
+    free(*slot);
+    *slot = NULL;
+    plane->tile_count--;
+    terminal_custom_tile_count--;
 }
 
-static int terminal_custom_pixels_apply_pending_clears(uint8_t layer) {
-    if (terminal_custom_pending_clear_count == 0u) {
+/* Clips a rectangle to the addressable plane; returns 0 when nothing is left. */
+static int terminal_custom_pixels_clip(int *origin_x, int *origin_y, int *width, int *height) {
+    if (*origin_x >= TERMINAL_CUSTOM_MAX_EXTENT || *origin_y >= TERMINAL_CUSTOM_MAX_EXTENT) {
         return 0;
     }
+    if (*width > TERMINAL_CUSTOM_MAX_EXTENT - *origin_x) {
+        *width = TERMINAL_CUSTOM_MAX_EXTENT - *origin_x;
+    }
+    if (*height > TERMINAL_CUSTOM_MAX_EXTENT - *origin_y) {
+        *height = TERMINAL_CUSTOM_MAX_EXTENT - *origin_y;
+    }
+    return (*width > 0 && *height > 0);
+}
 
-    size_t write_idx = 0u;
-    int modified = 0;
-    for (size_t i = 0u; i < terminal_custom_pending_clear_count; i++) {
-        struct terminal_custom_clear_request *req = &terminal_custom_pending_clears[i];
-        if (layer != 0u && req->layer != layer) {
-            if (write_idx != i) {
-                terminal_custom_pending_clears[write_idx] = *req;
-            }
-            write_idx++;
-            continue;
-        }
-
-        if (terminal_custom_pixels_apply_clear_request(req) != 0) {
-            modified = 1;
-        }
+static int terminal_custom_pixels_clear_rect(int origin_x, int origin_y, int width, int height, uint8_t layer) {
+    if (width <= 0 || height <= 0) {
+        return -1;
     }
 
-    terminal_custom_pending_clear_count = write_idx;
-    return modified;
-}
+    if (origin_x < 0 || origin_y < 0) {
+        return -1;
+    }
 
-static int terminal_custom_pixels_reserve(size_t additional) {
-    if (additional == 0u) {
-        return 0;
+    if (layer < 1u || layer > 16u) {
+        return -1;
     }
-    if (terminal_custom_pixel_count > SIZE_MAX - additional) {
+
+    if (origin_x > INT_MAX - width || origin_y > INT_MAX - height) {
         return -1;
     }
-    size_t required = terminal_custom_pixel_count + additional;
-    if (required <= terminal_custom_pixel_capacity) {
+
+    terminal_custom_pixels_mark_pending(layer);
+    terminal_custom_pixels_active = 1;
+
+    if (!terminal_custom_pixels_clip(&origin_x, &origin_y, &width, &height)) {
         return 0;
     }
+    terminal_custom_layer_touch(layer, origin_x, origin_y, width, height);
 
-    size_t new_capacity = (terminal_custom_pixel_capacity == 0u) ? 64u : terminal_custom_pixel_capacity;
-    while (new_capacity < required) {
-        if (new_capacity > SIZE_MAX / 2u) {
-            new_capacity = required;
-            break;
+    int max_x = origin_x + width;
+    int max_y = origin_y + height;
+    size_t first_tx = (size_t)origin_x >> TERMINAL_CUSTOM_TILE_SHIFT;
+    size_t first_ty = (size_t)origin_y >> TERMINAL_CUSTOM_TILE_SHIFT;
+    size_t last_tx = (size_t)(max_x - 1) >> TERMINAL_CUSTOM_TILE_SHIFT;
+    size_t last_ty = (size_t)(max_y - 1) >> TERMINAL_CUSTOM_TILE_SHIFT;
+    for (size_t ty = first_ty; ty <= last_ty; ty++) {
+        for (size_t tx = first_tx; tx <= last_tx; tx++) {
+            struct terminal_custom_tile *tile = terminal_custom_pixels_tile(layer, tx, ty, 0);
+            if (!tile) {
+                continue;
+            }
+            int tile_x0 = (int)(tx << TERMINAL_CUSTOM_TILE_SHIFT);
+            int tile_y0 = (int)(ty << TERMINAL_CUSTOM_TILE_SHIFT);
+            int x0 = origin_x > tile_x0 ? origin_x - tile_x0 : 0;
+            int y0 = origin_y > tile_y0 ? origin_y - tile_y0 : 0;
+            int x1 = max_x - tile_x0 < TERMINAL_CUSTOM_TILE_SIZE ? max_x - tile_x0 : TERMINAL_CUSTOM_TILE_SIZE;
+            int y1 = max_y - tile_y0 < TERMINAL_CUSTOM_TILE_SIZE ? max_y - tile_y0 : TERMINAL_CUSTOM_TILE_SIZE;
+            for (int y = y0; y < y1; y++) {
+                uint32_t *row = tile->pixels + (size_t)y * TERMINAL_CUSTOM_TILE_SIZE;
+                for (int x = x0; x < x1; x++) {
+                    if (row[x] != 0u) {
+                        row[x] = 0u;
+                        tile->used--;
+                    }
+                }
+            }
+            if (tile->used == 0u) {
+                terminal_custom_pixels_drop_tile(layer, tx, ty);
+            }
         }
-        new_capacity *= 2u;
     }
-
-    struct terminal_custom_pixel *new_pixels =
-        realloc(terminal_custom_pixels, new_capacity * sizeof(*terminal_custom_pixels));
-    if (!new_pixels) {
-        return -1;
-    }
-    terminal_custom_pixels = new_pixels;
-    terminal_custom_pixel_capacity = new_capacity;
     return 0;
 }
 
@@ -2245,33 +3736,30 @@ static int terminal_custom_pixels_set(int x, int y, uint8_t r, uint8_t g, uint8_
         return -1;
     }
 
-    for (size_t i = 0u; i < terminal_custom_pixel_count; i++) {
-        struct terminal_custom_pixel *entry = &terminal_custom_pixels[i];
-        if (entry->x == x && entry->y == y && entry->layer == layer) {
-            if (entry->r == r && entry->g == g && entry->b == b) {
-                return 0;
-            }
-            entry->r = r;
-            entry->g = g;
-            entry->b = b;
-            entry->version = terminal_custom_layer_versions[layer];
-            terminal_custom_pixels_mark_pending(layer);
-            return 0;
-        }
+    if (x >= TERMINAL_CUSTOM_MAX_EXTENT || y >= TERMINAL_CUSTOM_MAX_EXTENT) {
+        return 0;
     }
 
-    if (terminal_custom_pixels_reserve(1u) != 0) {
+    struct terminal_custom_tile *tile = terminal_custom_pixels_tile(layer,
+                                                                    (size_t)x >> TERMINAL_CUSTOM_TILE_SHIFT,
+                                                                    (size_t)y >> TERMINAL_CUSTOM_TILE_SHIFT,
+                                                                    1);
+    if (!tile) {
         return -1;
     }
 
-    struct terminal_custom_pixel *entry = &terminal_custom_pixels[terminal_custom_pixel_count++];
-    entry->x = x;
-    entry->y = y;
-    entry->r = r;
-    entry->g = g;
-    entry->b = b;
-    entry->layer = layer;
-    entry->version = terminal_custom_layer_versions[layer];
+    uint32_t *slot = tile->pixels +
+                     (size_t)(y & (TERMINAL_CUSTOM_TILE_SIZE - 1)) * TERMINAL_CUSTOM_TILE_SIZE +
+                     (size_t)(x & (TERMINAL_CUSTOM_TILE_SIZE - 1));
+    uint32_t value = terminal_rgba_from_components(r, g, b);
+    if (*slot == value) {
+        return 0;
+    }
+    if (*slot == 0u) {
+        tile->used++;
+    }
+    *slot = value;
+    terminal_custom_layer_touch(layer, x, y, 1, 1);
     terminal_custom_pixels_mark_pending(layer);
     return 0;
 }
@@ -2290,36 +3778,54 @@ static int terminal_custom_pixels_draw_rect(int origin_x, int origin_y, int widt
         return -1;
     }
 
-    size_t width_sz = (size_t)width;
-    size_t height_sz = (size_t)height;
-    if (width_sz != 0u && height_sz > SIZE_MAX / width_sz) {
-        return -1;
-    }
+    terminal_custom_pixels_mark_pending(layer);
+    terminal_custom_pixels_active = 1;
 
-    size_t pixel_count = width_sz * height_sz;
-    if (terminal_custom_pixels_reserve(pixel_count) != 0) {
-        return -1;
+    if (!terminal_custom_pixels_clip(&origin_x, &origin_y, &width, &height)) {
+        return 0;
     }
+    terminal_custom_layer_touch(layer, origin_x, origin_y, width, height);
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            struct terminal_custom_pixel *entry = &terminal_custom_pixels[terminal_custom_pixel_count++];
-            entry->x = origin_x + x;
-            entry->y = origin_y + y;
-            entry->r = r;
-            entry->g = g;
-            entry->b = b;
-            entry->layer = layer;
-            entry->version = terminal_custom_layer_versions[layer];
+    uint32_t value = terminal_rgba_from_components(r, g, b);
+    int max_x = origin_x + width;
+    int max_y = origin_y + height;
+    size_t first_tx = (size_t)origin_x >> TERMINAL_CUSTOM_TILE_SHIFT;
+    size_t first_ty = (size_t)origin_y >> TERMINAL_CUSTOM_TILE_SHIFT;
+    size_t last_tx = (size_t)(max_x - 1) >> TERMINAL_CUSTOM_TILE_SHIFT;
+    size_t last_ty = (size_t)(max_y - 1) >> TERMINAL_CUSTOM_TILE_SHIFT;
+    for (size_t ty = first_ty; ty <= last_ty; ty++) {
+        for (size_t tx = first_tx; tx <= last_tx; tx++) {
+            struct terminal_custom_tile *tile = terminal_custom_pixels_tile(layer, tx, ty, 1);
+            if (!tile) {
+                return -1;
+            }
+            int tile_x0 = (int)(tx << TERMINAL_CUSTOM_TILE_SHIFT);
+            int tile_y0 = (int)(ty << TERMINAL_CUSTOM_TILE_SHIFT);
+            int x0 = origin_x > tile_x0 ? origin_x - tile_x0 : 0;
+            int y0 = origin_y > tile_y0 ? origin_y - tile_y0 : 0;
+            int x1 = max_x - tile_x0 < TERMINAL_CUSTOM_TILE_SIZE ? max_x - tile_x0 : TERMINAL_CUSTOM_TILE_SIZE;
+            int y1 = max_y - tile_y0 < TERMINAL_CUSTOM_TILE_SIZE ? max_y - tile_y0 : TERMINAL_CUSTOM_TILE_SIZE;
+            for (int y = y0; y < y1; y++) {
+                uint32_t *row = tile->pixels + (size_t)y * TERMINAL_CUSTOM_TILE_SIZE;
+                for (int x = x0; x < x1; x++) {
+                    if (row[x] == 0u) {
+                        tile->used++;
+                    }
+                    row[x] = value;
+                }
+            }
         }
     }
-
-    terminal_custom_pixels_mark_pending(layer);
-    terminal_custom_pixels_active = 1;
     return 0;
 }
 
-static int terminal_custom_pixels_draw_sprite(int origin_x, int origin_y, const uint8_t *rgba, int width, int height, uint8_t layer) {
+static int terminal_custom_pixels_blit(int origin_x,
+                                       int origin_y,
+                                       const uint8_t *rgba,
+                                       int width,
+                                       int height,
+                                       size_t stride,
+                                       uint8_t layer) {
     if (!rgba || width <= 0 || height <= 0) {
         return -1;
     }
@@ -2339,82 +3845,237 @@ static int terminal_custom_pixels_draw_sprite(int origin_x, int origin_y, const
         return -1;
     }
 
-    size_t pixel_count = width_sz * height_sz;
-    size_t opaque_pixels = 0u;
-    for (size_t i = 0u; i < pixel_count; i++) {
-        size_t idx = i * 4u + 3u;
-        if (rgba[idx] != 0u) {
-            opaque_pixels++;
-        }
-    }
-
-    if (opaque_pixels == 0u) {
-        return 0;
-    }
-
-    if (terminal_custom_pixels_reserve(opaque_pixels) != 0) {
-        return -1;
-    }
-
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            size_t idx = ((size_t)y * width_sz + (size_t)x) * 4u;
-            uint8_t a = rgba[idx + 3u];
+    int clip_w = width;
+    int clip_h = height;
+    int clip_x = origin_x;
+    int clip_y = origin_y;
+    int visible = terminal_custom_pixels_clip(&clip_x, &clip_y, &clip_w, &clip_h);
+    int drawn = 0;
+
+    for (int y = 0; visible && y < clip_h; y++) {
+        int dest_y = origin_y + y;
+        size_t ty = (size_t)dest_y >> TERMINAL_CUSTOM_TILE_SHIFT;
+        size_t tile_row = (size_t)(dest_y & (TERMINAL_CUSTOM_TILE_SIZE - 1)) * TERMINAL_CUSTOM_TILE_SIZE;
+        const uint8_t *src = rgba + (size_t)y * stride;
+        struct terminal_custom_tile *tile = NULL;
+        size_t tile_tx = SIZE_MAX;
+        for (int x = 0; x < clip_w; x++) {
+            const uint8_t *px = src + (size_t)x * 4u;
+            uint8_t a = px[3];
             if (a == 0u) {
                 continue;
             }
-            uint8_t r = rgba[idx];
-            uint8_t g = rgba[idx + 1u];
-            uint8_t b = rgba[idx + 2u];
+            uint8_t r = px[0];
+            uint8_t g = px[1];
+            uint8_t b = px[2];
             if (a < 255u) {
                 r = (uint8_t)((((uint32_t)r) * (uint32_t)a + 127u) / 255u);
                 g = (uint8_t)((((uint32_t)g) * (uint32_t)a + 127u) / 255u);
                 b = (uint8_t)((((uint32_t)b) * (uint32_t)a + 127u) / 255u);
             }
 
-            struct terminal_custom_pixel *entry = &terminal_custom_pixels[terminal_custom_pixel_count++];
-            entry->x = origin_x + x;
-            entry->y = origin_y + y;
-            entry->r = r;
-            entry->g = g;
-            entry->b = b;
-            entry->layer = layer;
-            entry->version = terminal_custom_layer_versions[layer];
+            int dest_x = origin_x + x;
+            size_t tx = (size_t)dest_x >> TERMINAL_CUSTOM_TILE_SHIFT;
+            if (!tile || tx != tile_tx) {
+                tile = terminal_custom_pixels_tile(layer, tx, ty, 1);
+                tile_tx = tx;
+                if (!tile) {
+                    return -1;
+                }
+            }
+            uint32_t *slot = tile->pixels + tile_row + (size_t)(dest_x & (TERMINAL_CUSTOM_TILE_SIZE - 1));
+            if (*slot == 0u) {
+                tile->used++;
+            }
+            *slot = terminal_rgba_from_components(r, g, b);
+            drawn = 1;
         }
     }
 
+    if (!drawn) {
+        return 0;
+    }
+
+    terminal_custom_layer_touch(layer, clip_x, clip_y, clip_w, clip_h);
     terminal_custom_pixels_mark_pending(layer);
     terminal_custom_pixels_active = 1;
     return 0;
 }
 
-static void terminal_custom_pixels_apply(uint8_t *framebuffer, int width, int height) {
-    if (!framebuffer || width <= 0 || height <= 0) {
+static int terminal_custom_pixels_draw_sprite(int origin_x, int origin_y, const uint8_t *rgba, int width, int height, uint8_t layer) {
+    if (width <= 0) {
+        return -1;
+    }
+    return terminal_custom_pixels_blit(origin_x, origin_y, rgba, width, height, (size_t)width * 4u, layer);
+}
+
+static void terminal_shared_layer_release(uint8_t layer) {
+    if (layer < 1u || layer > TERMINAL_CUSTOM_LAYER_COUNT) {
+        return;
+    }
+    struct terminal_shared_layer *shared = &terminal_shared_layers[layer - 1u];
+    if (!shared->pixels) {
         return;
     }
+    munmap(shared->pixels, shared->size);
+    shm_unlink(shared->name);
+    shared->pixels = NULL;
+    shared->size = 0u;
+    shared->width = 0;
+    shared->height = 0;
+    shared->name[0] = '\0';
+}
+
+static void terminal_shared_layers_shutdown(void) {
+    for (uint8_t layer = 1u; layer <= TERMINAL_CUSTOM_LAYER_COUNT; layer++) {
+        terminal_shared_layer_release(layer);
+    }
+}
+
+/* Publishes a zeroed (fully transparent) surface the size of the pixel
+ * plane. An existing mapping of the same size is handed out again. */
+static int terminal_shared_layer_map(uint8_t layer, int width, int height) {
+    if (layer < 1u || layer > TERMINAL_CUSTOM_LAYER_COUNT || width <= 0 || height <= 0 ||
+        width > TERMINAL_CUSTOM_MAX_EXTENT || height > TERMINAL_CUSTOM_MAX_EXTENT) {
+        return -1;
+    }
+    struct terminal_shared_layer *shared = &terminal_shared_layers[layer - 1u];
+    if (shared->pixels && shared->width == width && shared->height == height) {
+        return 0;
+    }
+    terminal_shared_layer_release(layer);
+
+    int written = snprintf(shared->name, sizeof(shared->name), "/budostack-%ld-layer%u", (long)getpid(), (unsigned int)layer);
+    if (written <= 0 || (size_t)written >= sizeof(shared->name)) {
+        shared->name[0] = '\0';
+        return -1;
+    }
+    size_t size = (size_t)width * (size_t)height * 4u;
+    shm_unlink(shared->name);
+    int fd = shm_open(shared->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "terminal: shm_open %s failed: %s\n", shared->name, strerror(errno));
+        shared->name[0] = '\0';
+        return -1;
+    }
+    if (ftruncate(fd, (off_t)size) != 0) {
+        fprintf(stderr, "terminal: Failed to size shared layer: %s\n", strerror(errno));
+        close(fd);
+        shm_unlink(shared->name);
+        shared->name[0] = '\0';
+        return -1;
+    }
+    void *pixels = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pixels == MAP_FAILED) {
+        fprintf(stderr, "terminal: Failed to map shared layer: %s\n", strerror(errno));
+        shm_unlink(shared->name);
+        shared->name[0] = '\0';
+        return -1;
+    }
+    shared->pixels = pixels;
+    shared->size = size;
+    shared->width = width;
+    shared->height = height;
+    return 0;
+}
+
+/* Replaces a rectangle of the layer with the shared surface contents;
+ * transparent surface pixels clear the layer underneath. A non-positive
+ * width or height syncs the whole surface. */
+static int terminal_shared_layer_sync(uint8_t layer, long x, long y, long width, long height) {
+    if (layer < 1u || layer > TERMINAL_CUSTOM_LAYER_COUNT) {
+        return -1;
+    }
+    const struct terminal_shared_layer *shared = &terminal_shared_layers[layer - 1u];
+    if (!shared->pixels) {
+        return 0;
+    }
+    if (width <= 0 || height <= 0) {
+        x = 0;
+        y = 0;
+        width = shared->width;
+        height = shared->height;
+    }
+    if (x < 0) {
+        width += x;
+        x = 0;
+    }
+    if (y < 0) {
+        height += y;
+        y = 0;
+    }
+    if (x >= shared->width || y >= shared->height || width <= 0 || height <= 0) {
+        return 0;
+    }
+    if (width > shared->width - x) {
+        width = shared->width - x;
+    }
+    if (height > shared->height - y) {
+        height = shared->height - y;
+    }
+
+    size_t stride = (size_t)shared->width * 4u;
+    const uint8_t *origin = shared->pixels + (size_t)y * stride + (size_t)x * 4u;
+    if (terminal_custom_pixels_clear_rect((int)x, (int)y, (int)width, (int)height, layer) != 0) {
+        return -1;
+    }
+    return terminal_custom_pixels_blit((int)x, (int)y, origin, (int)width, (int)height, stride, layer);
+}
+
+/* Returns how many pixels were composited, counted once per layer. */
+static size_t terminal_custom_pixels_apply(uint8_t *framebuffer, int width, int height) {
+    size_t composited = 0u;
+    if (!framebuffer || width <= 0 || height <= 0 || !terminal_frame_tiles) {
+        return composited;
+    }
 
     size_t frame_pitch = (size_t)width * 4u;
     uint16_t pending_mask = terminal_custom_pixels_pending_layers;
-    for (int layer = 16; layer >= 1; layer--) {
-        for (size_t i = 0u; i < terminal_custom_pixel_count; i++) {
-            const struct terminal_custom_pixel *entry = &terminal_custom_pixels[i];
-            if (entry->layer != (uint8_t)layer) {
-                continue;
-            }
-            if ((pending_mask & terminal_custom_layer_mask(entry->layer)) != 0u) {
+    for (size_t ty = 0u; ty < terminal_frame_tiles_y; ty++) {
+        for (size_t tx = 0u; tx < terminal_frame_tiles_x; tx++) {
+            if (terminal_frame_tiles[ty * terminal_frame_tiles_x + tx] == 0u) {
                 continue;
             }
-            if (entry->x < 0 || entry->y < 0) {
+            int x0 = (int)(tx << TERMINAL_CUSTOM_TILE_SHIFT);
+            int y0 = (int)(ty << TERMINAL_CUSTOM_TILE_SHIFT);
+            int span_w = width - x0 < TERMINAL_CUSTOM_TILE_SIZE ? width - x0 : TERMINAL_CUSTOM_TILE_SIZE;
+            int span_h = height - y0 < TERMINAL_CUSTOM_TILE_SIZE ? height - y0 : TERMINAL_CUSTOM_TILE_SIZE;
+            if (span_w <= 0 || span_h <= 0) {
                 continue;
             }
-            if (entry->x >= width || entry->y >= height) {
-                continue;
+            for (int layer = 16; layer >= 1; layer--) {
+                const struct terminal_custom_layer *plane = &terminal_custom_layers[layer - 1];
+                if (plane->tile_count == 0u || tx >= plane->tiles_x || ty >= plane->tiles_y) {
+                    continue;
+                }
+                struct terminal_custom_tile *tile = plane->tiles[ty * plane->tiles_x + tx];
+                if (!tile) {
+                    continue;
+                }
+                if ((pending_mask & terminal_custom_layer_mask((uint8_t)layer)) != 0u) {
+                    tile->skipped = 1;
+                    continue;
+                }
+                int opaque = (tile->used == TERMINAL_CUSTOM_TILE_PIXELS);
+                composited += (size_t)span_w * (size_t)span_h;
+                for (int y = 0; y < span_h; y++) {
+                    const uint32_t *src = tile->pixels + (size_t)y * TERMINAL_CUSTOM_TILE_SIZE;
+                    uint32_t *dst32 = (uint32_t *)(framebuffer + (size_t)(y0 + y) * frame_pitch + (size_t)x0 * 4u);
+                    if (opaque) {
+                        memcpy(dst32, src, (size_t)span_w * sizeof(uint32_t));
+                        continue;
+                    }
+                    for (int x = 0; x < span_w; x++) {
+                        if (src[x] != 0u) {
+                            dst32[x] = src[x];
+                        }
+                    }
+                }
             }
-            uint8_t *dst = framebuffer + (size_t)entry->y * frame_pitch + (size_t)entry->x * 4u;
-            uint32_t *dst32 = (uint32_t *)dst;
-            *dst32 = terminal_rgba_from_components(entry->r, entry->g, entry->b);
         }
     }
+    return composited;
 }
 
 static int terminal_ensure_render_cache(size_t columns, size_t rows) {
@@ -2455,6 +4116,216 @@ static void terminal_reset_render_cache(void) {
     terminal_render_cache_rows = 0u;
 }
 
+/* The screen scrolled by 'lines' rows since the last frame: move the
+ * rendered text and the matching cache entries up so only the rows that
+ * scrolled in are redrawn. Rows that were clipped by the frame edge are
+ * invalidated rather than moved. */
+static void terminal_render_cache_scroll(uint8_t *framebuffer,
+                                         int frame_width,
+                                         int frame_height,
+                                         int margin,
+                                         int cell_width,
+                                         int cell_height,
+                                         size_t lines) {
+    size_t columns = terminal_render_cache_columns;
+    size_t rows = terminal_render_cache_rows;
+    if (!framebuffer || !terminal_render_cache || cell_width <= 0 || cell_height <= 0 ||
+        margin >= frame_width || margin >= frame_height) {
+        return;
+    }
+    size_t full_rows = (size_t)((frame_height - margin) / cell_height);
+    if (full_rows > rows) {
+        full_rows = rows;
+    }
+    if (lines == 0u || lines >= full_rows) {
+        return;
+    }
+    int area_width = frame_width - margin;
+    if ((size_t)area_width / (size_t)cell_width >= columns) {
+        area_width = (int)(columns * (size_t)cell_width);
+    }
+
+    size_t pitch = (size_t)frame_width * 4u;
+    size_t row_bytes = (size_t)area_width * 4u;
+    int shift = (int)lines * cell_height;
+    int kept_height = (int)(full_rows - lines) * cell_height;
+    uint8_t *origin = framebuffer + (size_t)margin * pitch + (size_t)margin * 4u;
+    for (int y = 0; y < kept_height; y++) {
+        memcpy(origin + (size_t)y * pitch, origin + (size_t)(y + shift) * pitch, row_bytes);
+    }
+
+    memmove(terminal_render_cache,
+            terminal_render_cache + lines * columns,
+            (rows - lines) * columns * sizeof(*terminal_render_cache));
+    for (size_t i = (full_rows - lines) * columns; i < rows * columns; i++) {
+        terminal_render_cache[i].ch = UINT32_MAX;
+    }
+    terminal_frame_damage_rect(margin, margin, area_width, kept_height, TERMINAL_FRAME_TILE_DIRTY);
+}
+
+static void terminal_glyph_cache_reset(void) {
+    free(terminal_glyph_cache);
+    terminal_glyph_cache = NULL;
+    free(terminal_glyph_cache_pixels);
+    terminal_glyph_cache_pixels = NULL;
+    terminal_glyph_cache_width = 0;
+    terminal_glyph_cache_height = 0;
+    terminal_glyph_cache_scale = 0;
+}
+
+static void terminal_render_glyph_cell(uint32_t *dst,
+                                       size_t dst_stride,
+                                       int cell_width,
+                                       int cell_height,
+                                       uint32_t ch,
+                                       uint32_t glyph_color,
+                                       uint32_t fill_color,
+                                       uint8_t style) {
+    uint32_t fill_pixel = terminal_rgba_from_color(fill_color);
+    for (int py = 0; py < cell_height; py++) {
+        uint32_t *dst32 = dst + (size_t)py * dst_stride;
+        for (int px = 0; px < cell_width; px++) {
+            dst32[px] = fill_pixel;
+        }
+    }
+
+    if (ch == 0u || !terminal_font.glyphs) {
+        return;
+    }
+
+    uint32_t glyph_index = psf_font_resolve_glyph(&terminal_font, ch);
+    if (glyph_index >= terminal_font.glyph_count) {
+        glyph_index = 0u;
+    }
+    const uint8_t *glyph_bitmap = terminal_font.glyphs + glyph_index * terminal_font.glyph_size;
+    uint32_t glyph_pixel_value = terminal_rgba_from_color(glyph_color);
+    int glyph_scale = TERMINAL_FONT_SCALE;
+    if (glyph_scale <= 0) {
+        glyph_scale = 1;
+    }
+    for (int py = 0; py < cell_height; py++) {
+        uint32_t src_y = (uint32_t)(py / glyph_scale);
+        if (src_y >= terminal_font.height) {
+            break;
+        }
+        const uint8_t *glyph_row = glyph_bitmap + (size_t)src_y * terminal_font.stride;
+        uint32_t *dst32 = dst + (size_t)py * dst_stride;
+        for (uint32_t src_x = 0; src_x < terminal_font.width; src_x++) {
+            uint8_t mask = (uint8_t)(0x80u >> (src_x & 7u));
+            if ((glyph_row[src_x / 8u] & mask) == 0u) {
+                continue;
+            }
+            int start_px = (int)(src_x * (uint32_t)glyph_scale);
+            int end_px = start_px + glyph_scale;
+            if (start_px >= cell_width) {
+                break;
+            }
+            if (end_px > cell_width) {
+                end_px = cell_width;
+            }
+            for (int px = start_px; px < end_px; px++) {
+                dst32[px] = glyph_pixel_value;
+            }
+        }
+    }
+
+    if ((style & TERMINAL_STYLE_UNDERLINE) != 0u && cell_height > 0) {
+        uint32_t *dst32 = dst + (size_t)(cell_height - 1) * dst_stride;
+        for (int px = 0; px < cell_width; px++) {
+            dst32[px] = glyph_pixel_value;
+        }
+    }
+}
+
+static size_t terminal_glyph_cache_slot(uint32_t ch, uint32_t glyph_color, uint32_t fill_color, uint8_t style) {
+    uint32_t hash = ch * 0x9E3779B1u;
+    hash ^= glyph_color * 0x85EBCA77u;
+    hash ^= fill_color * 0xC2B2AE3Du;
+    hash ^= (uint32_t)style * 0x27D4EB2Fu;
+    hash ^= hash >> 15u;
+    return (size_t)(hash & (TERMINAL_GLYPH_CACHE_SLOTS - 1u));
+}
+
+/* Read-only lookup for the raster bands, which must not fill slots. */
+static const uint32_t *terminal_glyph_cache_peek(uint32_t ch,
+                                                 uint32_t glyph_color,
+                                                 uint32_t fill_color,
+                                                 uint8_t style,
+                                                 int cell_width,
+                                                 int cell_height) {
+    if (!terminal_glyph_cache ||
+        terminal_glyph_cache_width != cell_width ||
+        terminal_glyph_cache_height != cell_height ||
+        terminal_glyph_cache_scale != TERMINAL_FONT_SCALE) {
+        return NULL;
+    }
+    size_t slot = terminal_glyph_cache_slot(ch, glyph_color, fill_color, style);
+    const struct terminal_glyph_cache_entry *entry = &terminal_glyph_cache[slot];
+    if (!entry->valid ||
+        entry->ch != ch ||
+        entry->fg != glyph_color ||
+        entry->bg != fill_color ||
+        entry->style != style) {
+        return NULL;
+    }
+    return terminal_glyph_cache_pixels + slot * (size_t)cell_width * (size_t)cell_height;
+}
+
+static const uint32_t *terminal_glyph_cache_lookup(uint32_t ch,
+                                                   uint32_t glyph_color,
+                                                   uint32_t fill_color,
+                                                   uint8_t style,
+                                                   int cell_width,
+                                                   int cell_height) {
+    if (cell_width <= 0 || cell_height <= 0) {
+        return NULL;
+    }
+    size_t cell_pixels = (size_t)cell_width * (size_t)cell_height;
+    if (cell_pixels > SIZE_MAX / sizeof(uint32_t) / TERMINAL_GLYPH_CACHE_SLOTS) {
+        return NULL;
+    }
+
+    if (!terminal_glyph_cache ||
+        terminal_glyph_cache_width != cell_width ||
+        terminal_glyph_cache_height != cell_height ||
+        terminal_glyph_cache_scale != TERMINAL_FONT_SCALE) {
+        terminal_glyph_cache_reset();
+        terminal_glyph_cache = calloc(TERMINAL_GLYPH_CACHE_SLOTS, sizeof(*terminal_glyph_cache));
+        terminal_glyph_cache_pixels = malloc(cell_pixels * TERMINAL_GLYPH_CACHE_SLOTS * sizeof(uint32_t));
+        if (!terminal_glyph_cache || !terminal_glyph_cache_pixels) {
+            terminal_glyph_cache_reset();
+            return NULL;
+        }
+        terminal_glyph_cache_width = cell_width;
+        terminal_glyph_cache_height = cell_height;
+        terminal_glyph_cache_scale = TERMINAL_FONT_SCALE;
+    }
+
+    size_t slot = terminal_glyph_cache_slot(ch, glyph_color, fill_color, style);
+    struct terminal_glyph_cache_entry *entry = &terminal_glyph_cache[slot];
+    uint32_t *pixels = terminal_glyph_cache_pixels + slot * cell_pixels;
+    if (!entry->valid ||
+        entry->ch != ch ||
+        entry->fg != glyph_color ||
+        entry->bg != fill_color ||
+        entry->style != style) {
+        terminal_render_glyph_cell(pixels,
+                                   (size_t)cell_width,
+                                   cell_width,
+                                   cell_height,
+                                   ch,
+                                   glyph_color,
+                                   fill_color,
+                                   style);
+        entry->ch = ch;
+        entry->fg = glyph_color;
+        entry->bg = fill_color;
+        entry->style = style;
+        entry->valid = 1u;
+    }
+    return pixels;
+}
+
 static void terminal_buffer_reset_attributes(struct terminal_buffer *buffer) {
     if (!buffer) {
         return;
@@ -2780,6 +4651,8 @@ static void free_font(struct psf_font *font) {
     free(font->unicode_map);
     font->unicode_map = NULL;
     font->unicode_map_count = 0u;
+    free(font->bmp_map);
+    font->bmp_map = NULL;
 }
 
 static char *terminal_read_text_file(const char *path, size_t *out_size) {
@@ -3032,41 +4905,11 @@ static void terminal_shader_reset_uniform_cache(struct terminal_gl_shader *shade
     shader->has_cached_input_size = 0;
 }
 
-static void terminal_shader_set_matrix(GLint location, GLfloat *cache, int *has_cache, const GLfloat *matrix) {
-    if (location < 0 || !cache || !has_cache || !matrix) {
-        return;
-    }
-    if (*has_cache && memcmp(cache, matrix, sizeof(GLfloat) * 16u) == 0) {
-        return;
-    }
-    memcpy(cache, matrix, sizeof(GLfloat) * 16u);
-    *has_cache = 1;
-    glUniformMatrix4fv(location, 1, GL_FALSE, matrix);
-}
-
-static void terminal_shader_set_vec2(GLint location, GLfloat *cache, int *has_cache, GLfloat x, GLfloat y) {
-    if (location < 0 || !cache || !has_cache) {
-        return;
-    }
-    if (*has_cache && cache[0] == x && cache[1] == y) {
-        return;
-    }
-    cache[0] = x;
-    cache[1] = y;
-    *has_cache = 1;
-    glUniform2f(location, x, y);
-}
-
 static void terminal_shader_clear_vaos(struct terminal_gl_shader *shader) {
     if (!shader) {
         return;
     }
-    for (size_t i = 0; i < 2; i++) {
-        if (shader->quad_vaos[i] != 0) {
-            glDeleteVertexArrays(1, &shader->quad_vaos[i]);
-            shader->quad_vaos[i] = 0;
-        }
-    }
+    budo_gl_quad_vaos_destroy(shader->quad_vaos);
     terminal_shader_reset_uniform_cache(shader);
 }
 
@@ -3074,72 +4917,59 @@ static int terminal_initialize_quad_geometry(void) {
     if (terminal_quad_vbo != 0) {
         return 0;
     }
-    glGenBuffers(1, &terminal_quad_vbo);
+    terminal_quad_vbo = budo_gl_quad_vbo_create();
     if (terminal_quad_vbo == 0) {
         return -1;
     }
-    glBindBuffer(GL_ARRAY_BUFFER, terminal_quad_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(terminal_quad_vertices), terminal_quad_vertices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    return 0;
+    return budo_gl_blit_init(&terminal_blit, terminal_quad_vbo);
 }
 
 static void terminal_destroy_quad_geometry(void) {
+    budo_gl_blit_destroy(&terminal_blit);
     if (terminal_quad_vbo != 0) {
         glDeleteBuffers(1, &terminal_quad_vbo);
         terminal_quad_vbo = 0;
     }
 }
 
-static int terminal_shader_configure_vaos(struct terminal_gl_shader *shader) {
-    if (!shader) {
-        return -1;
-    }
-    if (terminal_quad_vbo == 0) {
-        return -1;
-    }
+/* Draws texture over the NDC rectangle whose (-1,-1) corner lands on
+ * (x0,y0) and (1,1) corner on (x1,y1). cpu_order selects texcoords for
+ * textures stored top row first (uploads, images); FBO-rendered textures
+ * are stored bottom row first. */
+static void terminal_blit_texture(GLuint texture, int cpu_order, GLfloat x0, GLfloat y0, GLfloat x1, GLfloat y1) {
+    budo_gl_blit_draw(&terminal_blit, &terminal_bound_texture, texture, cpu_order, x0, y0, x1, y1);
+}
 
-    GLuint vaos[2] = {0u, 0u};
-    glGenVertexArrays(2, vaos);
-    if (vaos[0] == 0u || vaos[1] == 0u) {
-        if (vaos[0] != 0u) {
-            glDeleteVertexArrays(1, &vaos[0]);
-        }
-        if (vaos[1] != 0u) {
-            glDeleteVertexArrays(1, &vaos[1]);
-        }
-        return -1;
+/* Places a top-row-first texture at a pixel rectangle with a top-left origin. */
+static void terminal_blit_texture_rect(GLuint texture,
+                                       GLfloat x,
+                                       GLfloat y,
+                                       GLfloat width,
+                                       GLfloat height,
+                                       int target_width,
+                                       int target_height) {
+    if (target_width <= 0 || target_height <= 0) {
+        return;
     }
+    GLfloat sx = 2.0f / (GLfloat)target_width;
+    GLfloat sy = 2.0f / (GLfloat)target_height;
+    terminal_blit_texture(texture,
+                          1,
+                          x * sx - 1.0f,
+                          1.0f - (y + height) * sy,
+                          (x + width) * sx - 1.0f,
+                          1.0f - y * sy);
+}
 
-    const GLsizei stride = (GLsizei)sizeof(struct terminal_quad_vertex);
-    const void *position_offset = (const void *)offsetof(struct terminal_quad_vertex, position);
-    const void *cpu_offset = (const void *)offsetof(struct terminal_quad_vertex, texcoord_cpu);
-    const void *fbo_offset = (const void *)offsetof(struct terminal_quad_vertex, texcoord_fbo);
-
-    GLuint *targets[2] = {&vaos[0], &vaos[1]};
-    const void *texcoord_offsets[2] = {cpu_offset, fbo_offset};
-
-    for (size_t i = 0; i < 2; i++) {
-        glBindVertexArray(*targets[i]);
-        glBindBuffer(GL_ARRAY_BUFFER, terminal_quad_vbo);
-        if (shader->attrib_vertex >= 0) {
-            glEnableVertexAttribArray((GLuint)shader->attrib_vertex);
-            glVertexAttribPointer((GLuint)shader->attrib_vertex, 4, GL_FLOAT, GL_FALSE, stride, position_offset);
-        }
-        if (shader->attrib_texcoord >= 0) {
-            glEnableVertexAttribArray((GLuint)shader->attrib_texcoord);
-            glVertexAttribPointer((GLuint)shader->attrib_texcoord, 2, GL_FLOAT, GL_FALSE, stride, texcoord_offsets[i]);
-        }
-        if (shader->attrib_color >= 0) {
-            glDisableVertexAttribArray((GLuint)shader->attrib_color);
-        }
+static int terminal_shader_configure_vaos(struct terminal_gl_shader *shader) {
+    if (!shader) {
+        return -1;
     }
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    shader->quad_vaos[0] = vaos[0];
-    shader->quad_vaos[1] = vaos[1];
-    return 0;
+    return budo_gl_quad_vaos_create(terminal_quad_vbo,
+                                    shader->attrib_vertex,
+                                    shader->attrib_texcoord,
+                                    shader->attrib_color,
+                                    shader->quad_vaos);
 }
 
 static void terminal_bind_texture(GLuint texture) {
@@ -3205,6 +5035,10 @@ static int terminal_initialize_gl_program(const char *shader_path) {
     GLuint vertex_shader = 0;
     GLuint fragment_shader = 0;
     GLuint program = 0;
+    /* Declared before the first goto so cleanup never reads them uninitialized. */
+    struct terminal_gl_shader shader_info;
+    memset(&shader_info, 0, sizeof(shader_info));
+    int shader_registered = 0;
 
     shader_source = terminal_read_text_file(shader_path, &shader_size);
     if (!shader_source) {
@@ -3343,10 +5177,7 @@ static int terminal_initialize_gl_program(const char *shader_path) {
         goto cleanup;
     }
 
-    struct terminal_gl_shader shader_info;
-    memset(&shader_info, 0, sizeof(shader_info));
     terminal_shader_reset_uniform_cache(&shader_info);
-    int shader_registered = 0;
     shader_info.program = program;
     shader_info.attrib_vertex = glGetAttribLocation(program, "VertexCoord");
     shader_info.attrib_color = glGetAttribLocation(program, "COLOR");
@@ -3390,10 +5221,10 @@ static int terminal_initialize_gl_program(const char *shader_path) {
         glUniform1i(shader_info.uniform_frame_direction, 1);
     }
     if (shader_info.uniform_mvp >= 0) {
-        terminal_shader_set_matrix(shader_info.uniform_mvp,
+        budo_gl_set_matrix(shader_info.uniform_mvp,
                                    shader_info.cached_mvp,
                                    &shader_info.has_cached_mvp,
-                                   terminal_identity_mvp);
+                                   budo_gl_identity_mvp);
     }
 
     for (size_t i = 0; i < parameter_count; i++) {
@@ -3539,6 +5370,9 @@ static int terminal_resize_render_targets(int width, int height) {
     if (terminal_framebuffer_pixels) {
         memset(terminal_framebuffer_pixels, 0, required_size);
     }
+    if (terminal_frame_damage_resize(width, height) != 0) {
+        return -1;
+    }
 
     terminal_mark_background_dirty();
     terminal_mark_full_redraw();
@@ -3571,9 +5405,58 @@ static int terminal_upload_framebuffer(const uint8_t *pixels, int width, int hei
         return -1;
     }
 
+    size_t total_tiles = terminal_frame_tiles_x * terminal_frame_tiles_y;
+    if (terminal_frame_tiles && total_tiles > 0u && terminal_frame_dirty_tile_count == 0u) {
+        return 0;
+    }
+
     terminal_bind_texture(terminal_gl_texture);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    if (!terminal_frame_tiles || total_tiles == 0u || terminal_frame_dirty_tile_count * 2u >= total_tiles) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    } else {
+        /* Upload horizontal runs of dirty tiles straight out of the framebuffer. */
+        size_t frame_pitch = (size_t)width * 4u;
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+        for (size_t ty = 0u; ty < terminal_frame_tiles_y; ty++) {
+            const uint8_t *row = terminal_frame_tiles + ty * terminal_frame_tiles_x;
+            int y0 = (int)(ty << TERMINAL_CUSTOM_TILE_SHIFT);
+            if (y0 >= height) {
+                break;
+            }
+            int span_h = height - y0 < TERMINAL_CUSTOM_TILE_SIZE ? height - y0 : TERMINAL_CUSTOM_TILE_SIZE;
+            size_t tx = 0u;
+            while (tx < terminal_frame_tiles_x) {
+                if (row[tx] == 0u) {
+                    tx++;
+                    continue;
+                }
+                size_t run_start = tx;
+                while (tx < terminal_frame_tiles_x && row[tx] != 0u) {
+                    tx++;
+                }
+                int x0 = (int)(run_start << TERMINAL_CUSTOM_TILE_SHIFT);
+                int x1 = (int)(tx << TERMINAL_CUSTOM_TILE_SHIFT);
+                if (x0 >= width) {
+                    break;
+                }
+                if (x1 > width) {
+                    x1 = width;
+                }
+                glTexSubImage2D(GL_TEXTURE_2D,
+                                0,
+                                x0,
+                                y0,
+                                x1 - x0,
+                                span_h,
+                                GL_RGBA,
+                                GL_UNSIGNED_BYTE,
+                                pixels + (size_t)y0 * frame_pitch + (size_t)x0 * 4u);
+            }
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+    terminal_frame_damage_reset();
     GLenum error = glGetError();
     if (error != GL_NO_ERROR) {
         fprintf(stderr, "glTexSubImage2D failed with error 0x%x\n", error);
@@ -3629,205 +5512,399 @@ static int terminal_prepare_intermediate_targets(int width, int height) {
     return 0;
 }
 
-static void terminal_clear_history_texture(GLuint texture, int width, int height) {
-    if (texture == 0 || width <= 0 || height <= 0) {
-        return;
+static const char terminal_gpu_text_vertex_source[] =
+    "#version 110\n"
+    "attribute vec4 Position;\n"
+    "void main() {\n"
+    "    gl_Position = Position;\n"
+    "}\n";
+
+static const char terminal_gpu_text_fragment_source[] =
+    "#version 110\n"
+    "uniform sampler2D Atlas;\n"
+    "uniform sampler2D GridGlyph;\n"
+    "uniform sampler2D GridFg;\n"
+    "uniform sampler2D GridBg;\n"
+    "uniform sampler2D Overlay;\n"
+    "uniform vec2 FrameSize;\n"
+    "uniform vec2 GridSize;\n"
+    "uniform vec2 CellSize;\n"
+    "uniform vec2 GlyphSize;\n"
+    "uniform vec2 AtlasSize;\n"
+    "uniform float AtlasColumns;\n"
+    "uniform float Margin;\n"
+    "uniform float Scale;\n"
+    "uniform vec4 MarginColor;\n"
+    "void main() {\n"
+    "    vec2 pixel = floor(gl_FragCoord.xy);\n"
+    "    vec4 color = MarginColor;\n"
+    "    vec2 local = pixel - vec2(Margin);\n"
+    "    vec2 cell = floor(local / CellSize);\n"
+    "    if (local.x >= 0.0 && local.y >= 0.0 && cell.x < GridSize.x && cell.y < GridSize.y) {\n"
+    "        vec2 grid_uv = (cell + 0.5) / GridSize;\n"
+    "        vec4 info = texture2D(GridGlyph, grid_uv);\n"
+    "        vec4 fg = texture2D(GridFg, grid_uv);\n"
+    "        color = texture2D(GridBg, grid_uv);\n"
+    "        float flags = floor(info.b * 255.0 + 0.5);\n"
+    "        if (flags >= 1.0) {\n"
+    "            vec2 in_cell = local - cell * CellSize;\n"
+    "            float index = floor(info.r * 255.0 + 0.5) + floor(info.g * 255.0 + 0.5) * 256.0;\n"
+    "            vec2 origin = vec2(mod(index, AtlasColumns), floor(index / AtlasColumns)) * GlyphSize;\n"
+    "            vec2 texel = origin + floor(in_cell / Scale) + 0.5;\n"
+    "            if (texture2D(Atlas, texel / AtlasSize).r > 0.5) {\n"
+    "                color = fg;\n"
+    "            }\n"
+    "            if (flags >= 3.0 && in_cell.y >= CellSize.y - 1.0) {\n"
+    "                color = fg;\n"
+    "            }\n"
+    "        }\n"
+    "    }\n"
+    "    vec4 overlay = texture2D(Overlay, (pixel + 0.5) / FrameSize);\n"
+    "    if (overlay.a > 0.0) {\n"
+    "        color = overlay;\n"
+    "    }\n"
+    "    gl_FragColor = vec4(color.rgb, 1.0);\n"
+    "}\n";
+
+static void terminal_gpu_text_configure_texture(GLuint texture, GLint filter) {
+    terminal_bind_texture(texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+static int terminal_gpu_text_build_atlas(const struct psf_font *font) {
+    if (!font || !font->glyphs || font->glyph_count == 0u || font->width == 0u || font->height == 0u) {
+        return -1;
     }
-    if (terminal_gl_framebuffer == 0) {
-        glGenFramebuffers(1, &terminal_gl_framebuffer);
-        if (terminal_gl_framebuffer == 0) {
-            return;
-        }
+    if (font->glyph_count > 65536u) {
+        return -1;
     }
 
-    GLint viewport[4];
-    glGetIntegerv(GL_VIEWPORT, viewport);
-    glBindFramebuffer(GL_FRAMEBUFFER, terminal_gl_framebuffer);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                           GL_TEXTURE_2D, texture, 0);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
-        glViewport(0, 0, width, height);
-        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+    uint32_t atlas_columns = TERMINAL_GPU_ATLAS_COLUMNS;
+    uint32_t atlas_rows = (font->glyph_count + atlas_columns - 1u) / atlas_columns;
+    size_t width = (size_t)atlas_columns * font->width;
+    size_t height = (size_t)atlas_rows * font->height;
+    if (width > (size_t)INT_MAX || height > (size_t)INT_MAX || height > SIZE_MAX / width) {
+        return -1;
+    }
+
+    uint8_t *texels = calloc(width * height, 1u);
+    if (!texels) {
+        return -1;
+    }
+    for (uint32_t glyph = 0u; glyph < font->glyph_count; glyph++) {
+        const uint8_t *bitmap = font->glyphs + (size_t)glyph * font->glyph_size;
+        size_t origin_x = (size_t)(glyph % atlas_columns) * font->width;
+        size_t origin_y = (size_t)(glyph / atlas_columns) * font->height;
+        for (uint32_t y = 0u; y < font->height; y++) {
+            const uint8_t *glyph_row = bitmap + (size_t)y * font->stride;
+            uint8_t *dst = texels + (origin_y + y) * width + origin_x;
+            for (uint32_t x = 0u; x < font->width; x++) {
+                if ((glyph_row[x / 8u] & (uint8_t)(0x80u >> (x & 7u))) != 0u) {
+                    dst[x] = 0xFFu;
+                }
+            }
+        }
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
-}
 
-static int terminal_prepare_shader_history(struct terminal_gl_shader *shader, int width, int height, int resized) {
-    if (!shader || width <= 0 || height <= 0) {
+    if (terminal_gpu_atlas_texture == 0) {
+        glGenTextures(1, &terminal_gpu_atlas_texture);
+    }
+    if (terminal_gpu_atlas_texture == 0) {
+        free(texels);
         return -1;
     }
+    terminal_gpu_text_configure_texture(terminal_gpu_atlas_texture, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, (GLsizei)width, (GLsizei)height, 0,
+                 GL_LUMINANCE, GL_UNSIGNED_BYTE, texels);
+    terminal_bind_texture(0);
+    free(texels);
 
-    int created_history = 0;
-    int created_flipped = 0;
+    terminal_gpu_atlas_width = (int)width;
+    terminal_gpu_atlas_height = (int)height;
+    return 0;
+}
 
-    if (shader->history_texture == 0) {
-        glGenTextures(1, &shader->history_texture);
-        if (shader->history_texture != 0) {
-            created_history = 1;
+static void terminal_gpu_text_shutdown(void) {
+    if (terminal_gpu_text_program != 0) {
+        glDeleteProgram(terminal_gpu_text_program);
+        terminal_gpu_text_program = 0;
+    }
+    if (terminal_gpu_atlas_texture != 0) {
+        glDeleteTextures(1, &terminal_gpu_atlas_texture);
+        terminal_gpu_atlas_texture = 0;
+    }
+    for (size_t i = 0u; i < TERMINAL_GPU_GRID_PLANES; i++) {
+        if (terminal_gpu_grid_textures[i] != 0) {
+            glDeleteTextures(1, &terminal_gpu_grid_textures[i]);
+            terminal_gpu_grid_textures[i] = 0;
         }
     }
-    if (shader->history_texture == 0) {
+    if (terminal_gpu_text_target != 0) {
+        glDeleteTextures(1, &terminal_gpu_text_target);
+        terminal_gpu_text_target = 0;
+    }
+    free(terminal_gpu_grid_cells);
+    terminal_gpu_grid_cells = NULL;
+    terminal_gpu_grid_columns = 0u;
+    terminal_gpu_grid_rows = 0u;
+    terminal_gpu_grid_dirty = 0;
+    terminal_gpu_text_target_width = 0;
+    terminal_gpu_text_target_height = 0;
+    terminal_gpu_atlas_width = 0;
+    terminal_gpu_atlas_height = 0;
+    terminal_gpu_text_active = 0;
+}
+
+static int terminal_gpu_text_init(void) {
+    GLint texture_units = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &texture_units);
+    if (texture_units < 5) {
         return -1;
     }
 
-    if (shader->history_texture_flipped == 0) {
-        glGenTextures(1, &shader->history_texture_flipped);
-        if (shader->history_texture_flipped == 0) {
-            fprintf(stderr, "Failed to create flipped history texture.\n");
-        } else {
-            created_flipped = 1;
+    GLuint vertex_shader = terminal_compile_shader(GL_VERTEX_SHADER, terminal_gpu_text_vertex_source, "GPU text vertex");
+    GLuint fragment_shader = terminal_compile_shader(GL_FRAGMENT_SHADER, terminal_gpu_text_fragment_source, "GPU text fragment");
+    if (vertex_shader == 0 || fragment_shader == 0) {
+        if (vertex_shader != 0) {
+            glDeleteShader(vertex_shader);
         }
+        if (fragment_shader != 0) {
+            glDeleteShader(fragment_shader);
+        }
+        return -1;
     }
 
-    if (created_history || resized || terminal_history_width == 0 || terminal_history_height == 0) {
-        terminal_bind_texture(shader->history_texture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
-                     GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-        terminal_bind_texture(0);
-        terminal_clear_history_texture(shader->history_texture, width, height);
+    GLuint program = glCreateProgram();
+    if (program == 0) {
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+        return -1;
+    }
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glBindAttribLocation(program, BUDO_GL_BLIT_ATTRIB_POSITION, "Position");
+    glLinkProgram(program);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+
+    GLint link_status = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+    if (link_status != GL_TRUE) {
+        fprintf(stderr, "terminal: Failed to link GPU text program.\n");
+        glDeleteProgram(program);
+        return -1;
+    }
+    terminal_gpu_text_program = program;
+
+    if (terminal_gpu_text_build_atlas(&terminal_font) != 0) {
+        terminal_gpu_text_shutdown();
+        return -1;
+    }
+
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "Atlas"), 0);
+    glUniform1i(glGetUniformLocation(program, "GridGlyph"), 1);
+    glUniform1i(glGetUniformLocation(program, "GridFg"), 2);
+    glUniform1i(glGetUniformLocation(program, "GridBg"), 3);
+    glUniform1i(glGetUniformLocation(program, "Overlay"), 4);
+    glUseProgram(0);
+
+    terminal_gpu_text_active = 1;
+    terminal_mark_background_dirty();
+    return 0;
+}
+
+static int terminal_gpu_text_prepare_grid(size_t columns, size_t rows) {
+    if (columns == 0u || rows == 0u) {
+        return -1;
+    }
+    if (columns == terminal_gpu_grid_columns && rows == terminal_gpu_grid_rows && terminal_gpu_grid_cells) {
+        return 0;
+    }
+    if (columns > (size_t)INT_MAX || rows > (size_t)INT_MAX || rows > SIZE_MAX / columns) {
+        return -1;
+    }
+    size_t count = columns * rows;
+    if (count > SIZE_MAX / (TERMINAL_GPU_GRID_PLANES * sizeof(uint32_t))) {
+        return -1;
+    }
+    uint32_t *cells = calloc(count * TERMINAL_GPU_GRID_PLANES, sizeof(*cells));
+    if (!cells) {
+        return -1;
+    }
+    free(terminal_gpu_grid_cells);
+    terminal_gpu_grid_cells = cells;
+    terminal_gpu_grid_columns = columns;
+    terminal_gpu_grid_rows = rows;
 
-        if (shader->history_texture_flipped != 0 &&
-            (created_flipped || resized || terminal_history_width == 0 || terminal_history_height == 0)) {
-            terminal_bind_texture(shader->history_texture_flipped);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
-                         GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-            terminal_bind_texture(0);
-            terminal_clear_history_texture(shader->history_texture_flipped, width, height);
+    for (size_t i = 0u; i < TERMINAL_GPU_GRID_PLANES; i++) {
+        if (terminal_gpu_grid_textures[i] == 0) {
+            glGenTextures(1, &terminal_gpu_grid_textures[i]);
+        }
+        if (terminal_gpu_grid_textures[i] == 0) {
+            return -1;
         }
+        terminal_gpu_text_configure_texture(terminal_gpu_grid_textures[i], GL_NEAREST);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, (GLsizei)columns, (GLsizei)rows, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, cells + i * count);
     }
-
+    terminal_bind_texture(0);
+    terminal_gpu_grid_dirty = 1;
+    terminal_mark_full_redraw();
     return 0;
 }
 
-static void terminal_update_shader_history(struct terminal_gl_shader *shader, int width, int height) {
-    if (!shader || shader->history_texture == 0 || width <= 0 || height <= 0) {
+static void terminal_gpu_text_set_cell(size_t index,
+                                       uint32_t ch,
+                                       uint32_t glyph_color,
+                                       uint32_t fill_color,
+                                       uint8_t style) {
+    size_t count = terminal_gpu_grid_columns * terminal_gpu_grid_rows;
+    if (!terminal_gpu_grid_cells || index >= count) {
         return;
     }
 
-    glActiveTexture(GL_TEXTURE1);
-    terminal_bind_texture(shader->history_texture);
-    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
-    terminal_bind_texture(0);
-    glActiveTexture(GL_TEXTURE0);
-
-    terminal_update_flipped_history_texture(shader->history_texture,
-                                            shader->history_texture_flipped,
-                                            width,
-                                            height);
+    uint32_t glyph_index = 0u;
+    uint8_t flags = 0u;
+    if (ch != 0u) {
+        glyph_index = psf_font_resolve_glyph(&terminal_font, ch);
+        if (glyph_index >= terminal_font.glyph_count) {
+            glyph_index = 0u;
+        }
+        flags = TERMINAL_GPU_CELL_GLYPH;
+        if ((style & TERMINAL_STYLE_UNDERLINE) != 0u) {
+            flags |= TERMINAL_GPU_CELL_UNDERLINE;
+        }
+    }
+    uint8_t *info = (uint8_t *)&terminal_gpu_grid_cells[TERMINAL_GPU_GRID_GLYPH * count + index];
+    info[0] = (uint8_t)(glyph_index & 0xFFu);
+    info[1] = (uint8_t)((glyph_index >> 8u) & 0xFFu);
+    info[2] = flags;
+    info[3] = 0xFFu;
+    terminal_gpu_grid_cells[TERMINAL_GPU_GRID_FG * count + index] = terminal_rgba_from_color(glyph_color);
+    terminal_gpu_grid_cells[TERMINAL_GPU_GRID_BG * count + index] = terminal_rgba_from_color(fill_color);
+    terminal_gpu_grid_dirty = 1;
 }
 
-static void terminal_update_flipped_history_texture(GLuint history_texture,
-                                                    GLuint history_texture_flipped,
-                                                    int width,
-                                                    int height) {
-    if (history_texture == 0 || history_texture_flipped == 0 || width <= 0 || height <= 0) {
-        return;
+static int terminal_gpu_text_upload_grid(void) {
+    if (!terminal_gpu_grid_dirty) {
+        return 0;
+    }
+    size_t count = terminal_gpu_grid_columns * terminal_gpu_grid_rows;
+    if (!terminal_gpu_grid_cells || count == 0u) {
+        return -1;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0u; i < TERMINAL_GPU_GRID_PLANES; i++) {
+        terminal_bind_texture(terminal_gpu_grid_textures[i]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+                        (GLsizei)terminal_gpu_grid_columns, (GLsizei)terminal_gpu_grid_rows,
+                        GL_RGBA, GL_UNSIGNED_BYTE, terminal_gpu_grid_cells + i * count);
     }
+    terminal_bind_texture(0);
+    terminal_gpu_grid_dirty = 0;
+    return 0;
+}
 
+/* Composes the text grid and the overlay texture into a frame-sized texture
+ * that uses the same row order as the CPU framebuffer texture. */
+static int terminal_gpu_text_render(int width, int height, int margin, int cell_width, int cell_height, uint32_t margin_pixel) {
+    if (!terminal_gpu_text_active || width <= 0 || height <= 0) {
+        return -1;
+    }
     if (terminal_gl_framebuffer == 0) {
         glGenFramebuffers(1, &terminal_gl_framebuffer);
         if (terminal_gl_framebuffer == 0) {
-            return;
+            return -1;
         }
     }
+    if (terminal_gpu_text_target == 0) {
+        glGenTextures(1, &terminal_gpu_text_target);
+        if (terminal_gpu_text_target == 0) {
+            return -1;
+        }
+        terminal_gpu_text_target_width = 0;
+        terminal_gpu_text_target_height = 0;
+    }
+    if (terminal_gpu_text_target_width != width || terminal_gpu_text_target_height != height) {
+        terminal_gpu_text_configure_texture(terminal_gpu_text_target, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        terminal_bind_texture(0);
+        terminal_gpu_text_target_width = width;
+        terminal_gpu_text_target_height = height;
+    }
 
-    GLint viewport[4];
-    glGetIntegerv(GL_VIEWPORT, viewport);
     glBindFramebuffer(GL_FRAMEBUFFER, terminal_gl_framebuffer);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                           GL_TEXTURE_2D, history_texture_flipped, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, terminal_gpu_text_target, 0);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        return;
+        return -1;
     }
-
     glViewport(0, 0, width, height);
-    glClear(GL_COLOR_BUFFER_BIT);
 
-    glUseProgram(0);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-
-    glActiveTexture(GL_TEXTURE0);
-    terminal_bind_texture(history_texture);
-    glEnable(GL_TEXTURE_2D);
-
-    glBegin(GL_TRIANGLE_STRIP);
-    glTexCoord2f(0.0f, 1.0f);
-    glVertex2f(-1.0f, -1.0f);
-    glTexCoord2f(1.0f, 1.0f);
-    glVertex2f(1.0f, -1.0f);
-    glTexCoord2f(0.0f, 0.0f);
-    glVertex2f(-1.0f, 1.0f);
-    glTexCoord2f(1.0f, 0.0f);
-    glVertex2f(1.0f, 1.0f);
-    glEnd();
-
-    glDisable(GL_TEXTURE_2D);
-    terminal_bind_texture(0);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
-}
+    const uint8_t *margin_rgba = (const uint8_t *)&margin_pixel;
+    GLuint program = terminal_gpu_text_program;
+    glUseProgram(program);
+    glUniform2f(glGetUniformLocation(program, "FrameSize"), (GLfloat)width, (GLfloat)height);
+    glUniform2f(glGetUniformLocation(program, "GridSize"),
+                (GLfloat)terminal_gpu_grid_columns, (GLfloat)terminal_gpu_grid_rows);
+    glUniform2f(glGetUniformLocation(program, "CellSize"), (GLfloat)cell_width, (GLfloat)cell_height);
+    glUniform2f(glGetUniformLocation(program, "GlyphSize"), (GLfloat)terminal_font.width, (GLfloat)terminal_font.height);
+    glUniform2f(glGetUniformLocation(program, "AtlasSize"),
+                (GLfloat)terminal_gpu_atlas_width, (GLfloat)terminal_gpu_atlas_height);
+    glUniform1f(glGetUniformLocation(program, "AtlasColumns"), (GLfloat)TERMINAL_GPU_ATLAS_COLUMNS);
+    glUniform1f(glGetUniformLocation(program, "Margin"), (GLfloat)margin);
+    glUniform1f(glGetUniformLocation(program, "Scale"), (GLfloat)TERMINAL_FONT_SCALE);
+    glUniform4f(glGetUniformLocation(program, "MarginColor"),
+                (GLfloat)margin_rgba[0] / 255.0f,
+                (GLfloat)margin_rgba[1] / 255.0f,
+                (GLfloat)margin_rgba[2] / 255.0f,
+                1.0f);
+
+    /* Bind units directly: terminal_bind_texture only tracks one unit. */
+    const GLuint units[5] = {
+        terminal_gpu_atlas_texture,
+        terminal_gpu_grid_textures[TERMINAL_GPU_GRID_GLYPH],
+        terminal_gpu_grid_textures[TERMINAL_GPU_GRID_FG],
+        terminal_gpu_grid_textures[TERMINAL_GPU_GRID_BG],
+        terminal_gl_texture
+    };
+    for (GLenum i = 0u; i < 5u; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, units[i]);
+    }
+
+    /* Reuses the blit VAO; the text program only reads Position. */
+    glBindVertexArray(terminal_blit.vaos[1]);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, BUDO_GL_QUAD_VERTEX_COUNT);
+    glBindVertexArray(0);
 
-static void terminal_clear_shader_history(struct terminal_gl_shader *shader) {
-    if (!shader) {
-        return;
-    }
-    if (shader->history_texture != 0) {
-        glDeleteTextures(1, &shader->history_texture);
-        shader->history_texture = 0;
-    }
-    if (shader->history_texture_flipped != 0) {
-        glDeleteTextures(1, &shader->history_texture_flipped);
-        shader->history_texture_flipped = 0;
+    for (GLenum i = 5u; i-- > 0u;) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, 0);
     }
+    terminal_bound_texture = 0;
+    glUseProgram(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return 0;
 }
 
 static void terminal_draw_textured_quad(GLuint texture, int x, int y, int width, int height, int drawable_width, int drawable_height) {
     if (texture == 0 || width <= 0 || height <= 0 || drawable_width <= 0 || drawable_height <= 0) {
         return;
     }
-    glUseProgram(0);
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    glOrtho(0.0, (GLdouble)drawable_width, (GLdouble)drawable_height, 0.0, -1.0, 1.0);
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
-    glEnable(GL_TEXTURE_2D);
-    terminal_bind_texture(texture);
-    glBegin(GL_TRIANGLE_STRIP);
-    glTexCoord2f(0.0f, 0.0f);
-    glVertex2f((GLfloat)x, (GLfloat)y);
-    glTexCoord2f(1.0f, 0.0f);
-    glVertex2f((GLfloat)(x + width), (GLfloat)y);
-    glTexCoord2f(0.0f, 1.0f);
-    glVertex2f((GLfloat)x, (GLfloat)(y + height));
-    glTexCoord2f(1.0f, 1.0f);
-    glVertex2f((GLfloat)(x + width), (GLfloat)(y + height));
-    glEnd();
-    glDisable(GL_TEXTURE_2D);
-    terminal_bind_texture(0);
-    glPopMatrix();
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode(GL_MODELVIEW);
+    terminal_blit_texture_rect(texture,
+                               (GLfloat)x,
+                               (GLfloat)y,
+                               (GLfloat)width,
+                               (GLfloat)height,
+                               drawable_width,
+                               drawable_height);
 }
 
 static int terminal_load_overlay(const char *path) {
@@ -4009,39 +6086,16 @@ static void terminal_cursor_render(int framebuffer_width, int framebuffer_height
     GLfloat right = left + (GLfloat)((double)terminal_cursor_width * scale_x);
     GLfloat bottom = top + (GLfloat)((double)terminal_cursor_height * scale_y);
 
-    glUseProgram(0);
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    glOrtho(0.0, (GLdouble)drawable_width, (GLdouble)drawable_height, 0.0, -1.0, 1.0);
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
-
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_TEXTURE_2D);
-    terminal_bind_texture(terminal_cursor_texture);
-
-    glBegin(GL_TRIANGLE_STRIP);
-    glTexCoord2f(0.0f, 0.0f);
-    glVertex2f(left, top);
-    glTexCoord2f(1.0f, 0.0f);
-    glVertex2f(right, top);
-    glTexCoord2f(0.0f, 1.0f);
-    glVertex2f(left, bottom);
-    glTexCoord2f(1.0f, 1.0f);
-    glVertex2f(right, bottom);
-    glEnd();
-
-    glDisable(GL_TEXTURE_2D);
-    terminal_bind_texture(0);
+    terminal_blit_texture_rect(terminal_cursor_texture,
+                               left,
+                               top,
+                               right - left,
+                               bottom - top,
+                               drawable_width,
+                               drawable_height);
     glDisable(GL_BLEND);
-
-    glPopMatrix();
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode(GL_MODELVIEW);
 }
 
 static void terminal_clear_gl_shaders(void) {
@@ -4050,7 +6104,7 @@ static void terminal_clear_gl_shaders(void) {
             if (terminal_gl_shaders[i].program != 0) {
                 glDeleteProgram(terminal_gl_shaders[i].program);
             }
-            terminal_clear_shader_history(&terminal_gl_shaders[i]);
+            budo_gl_history_release(&terminal_gl_shaders[i].history);
             terminal_shader_clear_vaos(&terminal_gl_shaders[i]);
         }
         free(terminal_gl_shaders);
@@ -4072,8 +6126,13 @@ static void terminal_release_gl_resources(void) {
         terminal_overlay_texture = 0;
     }
     terminal_overlay_available = 0;
+    if (terminal_perf_texture != 0) {
+        glDeleteTextures(1, &terminal_perf_texture);
+        terminal_perf_texture = 0;
+    }
     terminal_destroy_cursor_sprite();
     terminal_clear_gl_shaders();
+    terminal_gpu_text_shutdown();
     if (terminal_gl_intermediate_textures[0] != 0) {
         glDeleteTextures(1, &terminal_gl_intermediate_textures[0]);
         terminal_gl_intermediate_textures[0] = 0;
@@ -4093,11 +6152,13 @@ static void terminal_release_gl_resources(void) {
     terminal_framebuffer_capacity = 0u;
     terminal_framebuffer_width = 0;
     terminal_framebuffer_height = 0;
+    terminal_frame_damage_resize(0, 0);
     terminal_texture_width = 0;
     terminal_texture_height = 0;
     terminal_bind_texture(0);
     terminal_destroy_quad_geometry();
     terminal_reset_render_cache();
+    terminal_glyph_cache_reset();
     terminal_custom_pixels_shutdown();
     terminal_mark_full_redraw();
     terminal_mark_background_dirty();
@@ -4173,12 +6234,22 @@ static int terminal_shaders_require_animation(void) {
 
 static void terminal_print_usage(const char *progname) {
     const char *name = (progname && progname[0] != '\0') ? progname : "terminal";
-    fprintf(stderr, "Usage: %s [-s shader_path]... [--fps hz] [--shader-fps hz]\n", name);
+    fprintf(stderr, "Usage: %s [-s shader_path]... [--fps hz] [--vsync mode] [--fps-stats] [--perf-overlay]\n"
+                    "       [--shader-fps hz] [--gpu-text] [--scrollback lines] [--scrollback-mb mb]\n", name);
     fprintf(stderr, "  --fps hz         Set render target FPS (0 disables frame pacing).\n");
+    fprintf(stderr, "  --vsync mode     on, off or adaptive swap interval (default on).\n");
+    fprintf(stderr, "  --fps-stats      Print frame-time percentiles to stderr every few seconds.\n");
+    fprintf(stderr, "  --perf-overlay   Show per-stage frame timings and throughput in an on-screen graph.\n");
     fprintf(stderr, "  --shader-fps hz  Set shader animation FPS (0 disables animation pacing).\n");
+    fprintf(stderr, "  --gpu-text       Compose text on the GPU from a glyph atlas (falls back to CPU).\n");
+    fprintf(stderr, "  --scrollback n   Keep at most n lines of scrollback per screen (default %u, 0 disables).\n",
+            TERMINAL_HISTORY_LIMIT);
+    fprintf(stderr, "  --scrollback-mb n  Cap compressed scrollback at n MB per screen (default 0, no cap).\n");
     fprintf(stderr, "  Send OSC 777 'shader=enable|disable' via _TERM_SHADER to toggle shaders at runtime.\n");
     fprintf(stderr, "  Send OSC 777 'cursor_blink=enable|disable' via _TERM_CURSOR_BLINK to toggle cursor blinking.\n");
     fprintf(stderr, "  Send OSC 777 'overlay=enable|disable|query' via _TERM_OVERLAY to control the overlay.\n");
+    fprintf(stderr, "  Send OSC 777 'perf=enable|disable|dump' via _TERM_PERF to control the performance overlay.\n");
+    fprintf(stderr, "  Press Ctrl+Shift+F (or send OSC 777 'search=regex' via _TERM_SEARCH) to search scrollback.\n");
 }
 
 static int terminal_parse_fps_value(const char *text, unsigned int *out_value) {
@@ -4202,6 +6273,486 @@ static int terminal_parse_fps_value(const char *text, unsigned int *out_value) {
     return 0;
 }
 
+static int terminal_parse_vsync_mode(const char *text, int *out_mode) {
+    if (!text || !out_mode) {
+        return -1;
+    }
+    if (strcmp(text, "on") == 0) {
+        *out_mode = TERMINAL_VSYNC_ON;
+    } else if (strcmp(text, "off") == 0) {
+        *out_mode = TERMINAL_VSYNC_OFF;
+    } else if (strcmp(text, "adaptive") == 0) {
+        *out_mode = TERMINAL_VSYNC_ADAPTIVE;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* Picks the swap interval and the timer period from the display refresh
+ * rate and --fps. A target that divides the refresh rate is paced by the
+ * swap alone (120 Hz at --fps 60 swaps every second vblank); any other
+ * target below the refresh rate adds a performance-counter deadline. */
+static void terminal_configure_frame_pacing(SDL_Window *window) {
+    SDL_DisplayMode mode;
+    int display_index = window ? SDL_GetWindowDisplayIndex(window) : 0;
+    terminal_display_refresh_hz = 0;
+    if (display_index >= 0 && SDL_GetCurrentDisplayMode(display_index, &mode) == 0 && mode.refresh_rate > 0) {
+        terminal_display_refresh_hz = mode.refresh_rate;
+    }
+
+    unsigned int fps = terminal_runtime_target_fps;
+    int interval = 0;
+    if (terminal_vsync_mode != TERMINAL_VSYNC_OFF) {
+        interval = 1;
+        if (fps > 0u && terminal_display_refresh_hz > 0 && fps < (unsigned int)terminal_display_refresh_hz) {
+            unsigned int ratio = ((unsigned int)terminal_display_refresh_hz + fps / 2u) / fps;
+            unsigned int paced_fps = (unsigned int)terminal_display_refresh_hz / ratio;
+            if (ratio > 1u && paced_fps * 20u >= fps * 19u && paced_fps * 20u <= fps * 21u) {
+                interval = (int)ratio;
+            }
+        }
+    }
+
+    int applied = 0;
+    if (terminal_vsync_mode == TERMINAL_VSYNC_ADAPTIVE && interval == 1 && SDL_GL_SetSwapInterval(-1) == 0) {
+        applied = 1;
+    }
+    if (!applied && SDL_GL_SetSwapInterval(interval) != 0) {
+        fprintf(stderr, "Warning: Unable to set swap interval %d: %s\n", interval, SDL_GetError());
+        if (interval > 1 && SDL_GL_SetSwapInterval(1) != 0) {
+            fprintf(stderr, "Warning: Unable to enable VSync: %s\n", SDL_GetError());
+        }
+    }
+    terminal_swap_interval = SDL_GL_GetSwapInterval();
+    terminal_vsync_enabled = terminal_swap_interval != 0 ? 1 : 0;
+
+    /* Swap-paced whenever vsync alone already meets the target. */
+    unsigned int swap_fps = 0u;
+    if (terminal_vsync_enabled && terminal_display_refresh_hz > 0) {
+        int swap_divisor = terminal_swap_interval < 0 ? 1 : terminal_swap_interval;
+        swap_fps = (unsigned int)(terminal_display_refresh_hz / swap_divisor);
+    }
+    terminal_render_frame_period = 0u;
+    if (fps > 0u && !(terminal_vsync_enabled && (swap_fps == 0u || swap_fps * 20u <= fps * 21u))) {
+        terminal_render_frame_period = SDL_GetPerformanceFrequency() / (Uint64)fps;
+    }
+    terminal_render_frame_deadline = 0u;
+}
+
+/* Holds the next frame back until its deadline. The last millisecond is
+ * yielded away rather than slept, since SDL_Delay overshoots. */
+static void terminal_frame_pacing_wait(void) {
+    if (terminal_render_frame_period == 0u || terminal_render_frame_deadline == 0u) {
+        return;
+    }
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    for (;;) {
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (now >= terminal_render_frame_deadline) {
+            return;
+        }
+        Uint64 remaining_ms = ((terminal_render_frame_deadline - now) * 1000u) / frequency;
+        SDL_Delay(remaining_ms > 1u ? (Uint32)(remaining_ms - 1u) : 0u);
+    }
+}
+
+static int terminal_frame_stats_compare(const void *lhs, const void *rhs) {
+    Uint32 a = *(const Uint32 *)lhs;
+    Uint32 b = *(const Uint32 *)rhs;
+    return (a > b) - (a < b);
+}
+
+static void terminal_frame_stats_report(void) {
+    size_t count = terminal_frame_stats_count;
+    terminal_frame_stats_count = 0u;
+    if (count == 0u) {
+        return;
+    }
+    qsort(terminal_frame_stats_samples, count, sizeof(terminal_frame_stats_samples[0]), terminal_frame_stats_compare);
+    Uint32 p50 = terminal_frame_stats_samples[(count - 1u) * 50u / 100u];
+    Uint32 p90 = terminal_frame_stats_samples[(count - 1u) * 90u / 100u];
+    Uint32 p99 = terminal_frame_stats_samples[(count - 1u) * 99u / 100u];
+    Uint32 worst = terminal_frame_stats_samples[count - 1u];
+    fprintf(stderr,
+            "terminal: frame ms p50=%.2f p90=%.2f p99=%.2f max=%.2f frames=%zu target=%u refresh=%d swap=%d\n",
+            (double)p50 / 1000.0,
+            (double)p90 / 1000.0,
+            (double)p99 / 1000.0,
+            (double)worst / 1000.0,
+            count,
+            terminal_runtime_target_fps,
+            terminal_display_refresh_hz,
+            terminal_swap_interval);
+}
+
+/* After every swap: advances the deadline on the previous one's phase
+ * so timer pacing does not drift, and records the present-to-present
+ * time. Gaps after idle stretches are not frame times and are skipped. */
+static void terminal_frame_presented(void) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    if (terminal_render_frame_period > 0u) {
+        Uint64 base = terminal_render_frame_deadline;
+        if (base == 0u || now >= base + terminal_render_frame_period) {
+            base = now;
+        }
+        terminal_render_frame_deadline = base + terminal_render_frame_period;
+    }
+
+    if (!terminal_frame_stats_enabled) {
+        return;
+    }
+    if (terminal_frame_stats_last_present != 0u) {
+        Uint64 elapsed_us = ((now - terminal_frame_stats_last_present) * 1000000u) / frequency;
+        if (elapsed_us < TERMINAL_FRAME_STATS_MAX_GAP_US &&
+            terminal_frame_stats_count < TERMINAL_FRAME_STATS_CAPACITY) {
+            terminal_frame_stats_samples[terminal_frame_stats_count++] = (Uint32)elapsed_us;
+        }
+    }
+    terminal_frame_stats_last_present = now;
+    if (terminal_frame_stats_last_report == 0u) {
+        terminal_frame_stats_last_report = now;
+    } else if (now - terminal_frame_stats_last_report >= frequency * TERMINAL_FRAME_STATS_REPORT_SECONDS ||
+               terminal_frame_stats_count == TERMINAL_FRAME_STATS_CAPACITY) {
+        terminal_frame_stats_report();
+        terminal_frame_stats_last_report = now;
+    }
+}
+
+static void terminal_perf_set_enabled(int enabled) {
+    enabled = enabled ? 1 : 0;
+    if (enabled == terminal_perf_enabled) {
+        return;
+    }
+    terminal_perf_enabled = enabled;
+    memset(&terminal_perf_current, 0, sizeof(terminal_perf_current));
+    terminal_perf_history_count = 0u;
+    terminal_perf_history_next = 0u;
+    terminal_perf_last_present = 0u;
+    terminal_perf_panel_tick = 0u;
+}
+
+static Uint64 terminal_perf_stage_begin(void) {
+    return terminal_perf_enabled ? SDL_GetPerformanceCounter() : 0u;
+}
+
+static void terminal_perf_stage_end(enum terminal_perf_stage stage, Uint64 start) {
+    if (!terminal_perf_enabled || start == 0u) {
+        return;
+    }
+    Uint64 elapsed_us = ((SDL_GetPerformanceCounter() - start) * 1000000u) / SDL_GetPerformanceFrequency();
+    terminal_perf_current.stage_us[stage] += (Uint32)(elapsed_us > UINT32_MAX ? UINT32_MAX : elapsed_us);
+}
+
+/* After every swap: closes the frame that was accumulated since the
+ * previous one. Parsing done in loop iterations that drew nothing is
+ * charged to the next frame that is drawn. */
+static void terminal_perf_frame_commit(void) {
+    if (!terminal_perf_enabled) {
+        return;
+    }
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (terminal_perf_last_present != 0u) {
+        Uint64 elapsed_us = ((now - terminal_perf_last_present) * 1000000u) / SDL_GetPerformanceFrequency();
+        terminal_perf_current.frame_us = (Uint32)(elapsed_us > UINT32_MAX ? UINT32_MAX : elapsed_us);
+    }
+    terminal_perf_last_present = now;
+    terminal_perf_current.sequence = terminal_perf_sequence++;
+    terminal_perf_history[terminal_perf_history_next] = terminal_perf_current;
+    terminal_perf_history_next = (terminal_perf_history_next + 1u) % TERMINAL_PERF_HISTORY;
+    if (terminal_perf_history_count < TERMINAL_PERF_HISTORY) {
+        terminal_perf_history_count++;
+    }
+    memset(&terminal_perf_current, 0, sizeof(terminal_perf_current));
+}
+
+/* index 0 is the oldest frame kept. */
+static const struct terminal_perf_frame *terminal_perf_frame_at(size_t index) {
+    size_t first = (terminal_perf_history_next + TERMINAL_PERF_HISTORY - terminal_perf_history_count) %
+                   TERMINAL_PERF_HISTORY;
+    return &terminal_perf_history[(first + index) % TERMINAL_PERF_HISTORY];
+}
+
+#define TERMINAL_PERF_DUMP_NAME_MAX 64u
+
+/* Dump names are plain file names: letters, digits, '.', '_' and '-',
+ * not starting with '.'. */
+static int terminal_perf_dump_name_valid(const char *name) {
+    size_t length = 0u;
+    if (!name || name[0] == '\0' || name[0] == '.') {
+        return 0;
+    }
+    for (; name[length] != '\0'; length++) {
+        unsigned char ch = (unsigned char)name[length];
+        if (length >= TERMINAL_PERF_DUMP_NAME_MAX ||
+            !(isalnum(ch) || ch == '.' || ch == '_' || ch == '-')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Writes the kept history as CSV, oldest frame first, to a new file
+ * <dump dir>/<name>. An existing file is never replaced. Returns the
+ * number of frames written or -1; path_out receives the full path. */
+static long terminal_perf_dump_csv(const char *name, char *path_out, size_t path_size) {
+    if (!terminal_perf_dump_name_valid(name)) {
+        fprintf(stderr, "terminal: Rejected performance dump name.\n");
+        return -1;
+    }
+    if (terminal_perf_dump_dir[0] == '\0' ||
+        build_path(path_out, path_size, terminal_perf_dump_dir, name) != 0) {
+        return -1;
+    }
+    if (mkdir(terminal_perf_dump_dir, 0700) != 0 && errno != EEXIST) {
+        fprintf(stderr, "terminal: Failed to create '%s': %s\n", terminal_perf_dump_dir, strerror(errno));
+        return -1;
+    }
+    int fd = open(path_out, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "terminal: Failed to create '%s' for the performance dump: %s\n", path_out, strerror(errno));
+        return -1;
+    }
+    FILE *file = fdopen(fd, "w");
+    if (!file) {
+        close(fd);
+        return -1;
+    }
+    const char *path = path_out;
+    fprintf(file, "frame,frame_ms,parse_ms,raster_ms,upload_ms,shader_ms,swap_ms,bytes_parsed,cells_redrawn,custom_pixels\n");
+    for (size_t i = 0u; i < terminal_perf_history_count; i++) {
+        const struct terminal_perf_frame *frame = terminal_perf_frame_at(i);
+        fprintf(file,
+                "%llu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%llu,%llu,%llu\n",
+                (unsigned long long)frame->sequence,
+                (double)frame->frame_us / 1000.0,
+                (double)frame->stage_us[TERMINAL_PERF_PARSE] / 1000.0,
+                (double)frame->stage_us[TERMINAL_PERF_RASTER] / 1000.0,
+                (double)frame->stage_us[TERMINAL_PERF_UPLOAD] / 1000.0,
+                (double)frame->stage_us[TERMINAL_PERF_SHADER] / 1000.0,
+                (double)frame->stage_us[TERMINAL_PERF_SWAP] / 1000.0,
+                (unsigned long long)frame->bytes_parsed,
+                (unsigned long long)frame->cells_redrawn,
+                (unsigned long long)frame->custom_pixels);
+    }
+    if (fclose(file) != 0) {
+        fprintf(stderr, "terminal: Failed to write the performance dump '%s'.\n", path);
+        return -1;
+    }
+    return (long)terminal_perf_history_count;
+}
+
+static const uint32_t terminal_perf_stage_colors[TERMINAL_PERF_STAGE_COUNT] = {
+    0xFFD040u, /* parse */
+    0x50E050u, /* raster */
+    0x40C0FFu, /* upload */
+    0xE060E0u, /* shader */
+    0xA0A0A0u  /* swap */
+};
+
+static void terminal_perf_fill(uint8_t *pixels, int pitch_width, int x, int y, int w, int h, uint32_t color, uint8_t alpha) {
+    for (int py = y; py < y + h; py++) {
+        uint8_t *row = pixels + ((size_t)py * (size_t)pitch_width + (size_t)x) * 4u;
+        for (int px = 0; px < w; px++) {
+            row[px * 4 + 0] = terminal_color_r(color);
+            row[px * 4 + 1] = terminal_color_g(color);
+            row[px * 4 + 2] = terminal_color_b(color);
+            row[px * 4 + 3] = alpha;
+        }
+    }
+}
+
+/* Rebuilds the panel: one legend line per stage with its average over
+ * the last frames, then a stacked bar per kept frame. The bar height
+ * covers two target frame periods. */
+static int terminal_perf_build_panel(void) {
+    size_t window = terminal_perf_history_count < TERMINAL_PERF_AVERAGE_FRAMES
+        ? terminal_perf_history_count
+        : TERMINAL_PERF_AVERAGE_FRAMES;
+    Uint64 stage_sum[TERMINAL_PERF_STAGE_COUNT] = {0};
+    Uint64 frame_sum = 0u;
+    Uint64 bytes_sum = 0u;
+    Uint64 cells_sum = 0u;
+    Uint64 pixels_sum = 0u;
+    for (size_t i = terminal_perf_history_count - window; i < terminal_perf_history_count; i++) {
+        const struct terminal_perf_frame *frame = terminal_perf_frame_at(i);
+        for (size_t stage = 0u; stage < TERMINAL_PERF_STAGE_COUNT; stage++) {
+            stage_sum[stage] += frame->stage_us[stage];
+        }
+        frame_sum += frame->frame_us;
+        bytes_sum += frame->bytes_parsed;
+        cells_sum += frame->cells_redrawn;
+        pixels_sum += frame->custom_pixels;
+    }
+    double frames = window > 0u ? (double)window : 1.0;
+    double seconds = (double)frame_sum / 1000000.0;
+
+    char lines[TERMINAL_PERF_STAGE_COUNT + 1u][64];
+    snprintf(lines[0], sizeof(lines[0]), "frame  %6.2f ms %8.0f px custom",
+             (double)frame_sum / frames / 1000.0,
+             (double)pixels_sum / frames);
+    snprintf(lines[1], sizeof(lines[1]), "parse  %6.2f ms %8.2f MB/s",
+             (double)stage_sum[TERMINAL_PERF_PARSE] / frames / 1000.0,
+             seconds > 0.0 ? (double)bytes_sum / seconds / 1000000.0 : 0.0);
+    snprintf(lines[2], sizeof(lines[2]), "raster %6.2f ms %8.0f cells",
+             (double)stage_sum[TERMINAL_PERF_RASTER] / frames / 1000.0,
+             (double)cells_sum / frames);
+    snprintf(lines[3], sizeof(lines[3]), "upload %6.2f ms", (double)stage_sum[TERMINAL_PERF_UPLOAD] / frames / 1000.0);
+    snprintf(lines[4], sizeof(lines[4]), "shader %6.2f ms", (double)stage_sum[TERMINAL_PERF_SHADER] / frames / 1000.0);
+    snprintf(lines[5], sizeof(lines[5]), "swap   %6.2f ms", (double)stage_sum[TERMINAL_PERF_SWAP] / frames / 1000.0);
+
+    uint8_t *text_pixels[TERMINAL_PERF_STAGE_COUNT + 1u] = {0};
+    int text_w[TERMINAL_PERF_STAGE_COUNT + 1u] = {0};
+    int text_h[TERMINAL_PERF_STAGE_COUNT + 1u] = {0};
+    int width = (int)TERMINAL_PERF_HISTORY;
+    int height = TERMINAL_PERF_GRAPH_HEIGHT;
+    for (size_t line = 0u; line < TERMINAL_PERF_STAGE_COUNT + 1u; line++) {
+        uint32_t color = line == 0u ? 0xFFFFFFu : terminal_perf_stage_colors[line - 1u];
+        if (terminal_render_text_sprite(&terminal_font,
+                                        (const uint8_t *)lines[line],
+                                        strlen(lines[line]),
+                                        color,
+                                        &text_pixels[line],
+                                        &text_w[line],
+                                        &text_h[line]) != 0) {
+            text_pixels[line] = NULL;
+            continue;
+        }
+        if (text_w[line] > width) {
+            width = text_w[line];
+        }
+        height += text_h[line];
+    }
+    width += TERMINAL_PERF_PADDING * 2;
+    height += TERMINAL_PERF_PADDING * 3;
+
+    int result = -1;
+    uint8_t *pixels = malloc((size_t)width * (size_t)height * 4u);
+    if (pixels) {
+        terminal_perf_fill(pixels, width, 0, 0, width, height, 0x000000u, 0xB0u);
+        int y = TERMINAL_PERF_PADDING;
+        for (size_t line = 0u; line < TERMINAL_PERF_STAGE_COUNT + 1u; line++) {
+            if (!text_pixels[line]) {
+                continue;
+            }
+            for (int ty = 0; ty < text_h[line]; ty++) {
+                const uint8_t *src = text_pixels[line] + (size_t)ty * (size_t)text_w[line] * 4u;
+                uint8_t *dst = pixels + ((size_t)(y + ty) * (size_t)width + TERMINAL_PERF_PADDING) * 4u;
+                for (int tx = 0; tx < text_w[line]; tx++) {
+                    if (src[tx * 4 + 3] != 0u) {
+                        memcpy(dst + tx * 4, src + tx * 4, 4u);
+                    }
+                }
+            }
+            y += text_h[line];
+        }
+
+        int graph_top = y + TERMINAL_PERF_PADDING;
+        int graph_bottom = graph_top + TERMINAL_PERF_GRAPH_HEIGHT;
+        Uint32 target_us = terminal_runtime_target_fps > 0u ? 1000000u / terminal_runtime_target_fps : 16667u;
+        double px_per_us = (double)TERMINAL_PERF_GRAPH_HEIGHT / (double)(target_us * 2u);
+        size_t first = TERMINAL_PERF_HISTORY - terminal_perf_history_count;
+        for (size_t i = 0u; i < terminal_perf_history_count; i++) {
+            const struct terminal_perf_frame *frame = terminal_perf_frame_at(i);
+            int x = TERMINAL_PERF_PADDING + (int)(first + i);
+            int bar_bottom = graph_bottom;
+            for (size_t stage = 0u; stage < TERMINAL_PERF_STAGE_COUNT && bar_bottom > graph_top; stage++) {
+                int bar = (int)((double)frame->stage_us[stage] * px_per_us + 0.5);
+                if (bar > bar_bottom - graph_top) {
+                    bar = bar_bottom - graph_top;
+                }
+                terminal_perf_fill(pixels, width, x, bar_bottom - bar, 1, bar, terminal_perf_stage_colors[stage], 0xFFu);
+                bar_bottom -= bar;
+            }
+        }
+        terminal_perf_fill(pixels,
+                           width,
+                           TERMINAL_PERF_PADDING,
+                           graph_bottom - TERMINAL_PERF_GRAPH_HEIGHT / 2,
+                           (int)TERMINAL_PERF_HISTORY,
+                           1,
+                           0xFFFFFFu,
+                           0x60u);
+
+        if (terminal_perf_texture == 0) {
+            glGenTextures(1, &terminal_perf_texture);
+        }
+        if (terminal_perf_texture != 0) {
+            terminal_bind_texture(terminal_perf_texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+            GLenum error = glGetError();
+            terminal_bind_texture(0);
+            if (error == GL_NO_ERROR) {
+                terminal_perf_texture_width = width;
+                terminal_perf_texture_height = height;
+                result = 0;
+            }
+        }
+        free(pixels);
+    }
+    for (size_t line = 0u; line < TERMINAL_PERF_STAGE_COUNT + 1u; line++) {
+        free(text_pixels[line]);
+    }
+    return result;
+}
+
+/* Draws the panel in the top right corner of the terminal, scaled like
+ * the cursor sprite. */
+static void terminal_perf_render(int framebuffer_width, int framebuffer_height, int drawable_width, int drawable_height) {
+    if (!terminal_perf_enabled || !terminal_font.glyphs) {
+        return;
+    }
+    if (framebuffer_width <= 0 || framebuffer_height <= 0 || drawable_width <= 0 || drawable_height <= 0) {
+        return;
+    }
+    Uint32 now = SDL_GetTicks();
+    if (terminal_perf_texture == 0 || (Uint32)(now - terminal_perf_panel_tick) >= TERMINAL_PERF_REFRESH_MS) {
+        terminal_perf_panel_tick = now;
+        if (terminal_perf_build_panel() != 0) {
+            return;
+        }
+    }
+
+    double scale_x = (double)drawable_width / (double)framebuffer_width;
+    double scale_y = (double)drawable_height / (double)framebuffer_height;
+    GLfloat width = (GLfloat)((double)terminal_perf_texture_width * scale_x);
+    GLfloat height = (GLfloat)((double)terminal_perf_texture_height * scale_y);
+    GLfloat left = (GLfloat)drawable_width - width - (GLfloat)((double)TERMINAL_PERF_PADDING * scale_x);
+    GLfloat top = (GLfloat)((double)TERMINAL_PERF_PADDING * scale_y);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    terminal_blit_texture_rect(terminal_perf_texture, left, top, width, height, drawable_width, drawable_height);
+    glDisable(GL_BLEND);
+}
+
+static int terminal_parse_limit_value(const char *text, unsigned long max_value, size_t *out_value) {
+    char *endptr = NULL;
+    unsigned long parsed = 0ul;
+
+    if (!text || !out_value || text[0] == '\0' || text[0] == '-') {
+        return -1;
+    }
+
+    errno = 0;
+    parsed = strtoul(text, &endptr, 10);
+    if (errno != 0 || !endptr || endptr[0] != '\0') {
+        return -1;
+    }
+    if (parsed > max_value) {
+        return -1;
+    }
+
+    *out_value = (size_t)parsed;
+    return 0;
+}
+
 static int psf_unicode_map_compare(const void *a, const void *b) {
     const struct psf_unicode_map *ma = (const struct psf_unicode_map *)a;
     const struct psf_unicode_map *mb = (const struct psf_unicode_map *)b;
@@ -4224,6 +6775,16 @@ static int psf_font_lookup_unicode(const struct psf_font *font, uint32_t codepoi
     if (!font) {
         return 0;
     }
+    if (font->bmp_map && codepoint < PSF_FONT_BMP_SIZE) {
+        uint32_t glyph_index = font->bmp_map[codepoint];
+        if (glyph_index == PSF_FONT_BMP_MISSING) {
+            return 0;
+        }
+        if (out_index) {
+            *out_index = glyph_index;
+        }
+        return 1;
+    }
     size_t count = font->unicode_map_count;
     const struct psf_unicode_map *map = font->unicode_map;
     if (count > 0u && map) {
@@ -4272,6 +6833,26 @@ static uint32_t psf_font_resolve_glyph(const struct psf_font *font, uint32_t cod
     return 0u;
 }
 
+/* Flattens the BMP part of the unicode map into a direct lookup table. */
+static void psf_font_build_bmp_map(struct psf_font *font) {
+    if (!font || font->bmp_map) {
+        return;
+    }
+    uint32_t *table = malloc(PSF_FONT_BMP_SIZE * sizeof(*table));
+    if (!table) {
+        return;
+    }
+    for (uint32_t codepoint = 0u; codepoint < PSF_FONT_BMP_SIZE; codepoint++) {
+        uint32_t glyph_index = 0u;
+        if (psf_font_lookup_unicode(font, codepoint, &glyph_index)) {
+            table[codepoint] = glyph_index;
+        } else {
+            table[codepoint] = PSF_FONT_BMP_MISSING;
+        }
+    }
+    font->bmp_map = table;
+}
+
 static uint32_t read_u32_le(const unsigned char *p) {
     return (uint32_t)p[0] | ((uint32_t)p[1] << 8u) | ((uint32_t)p[2] << 16u) | ((uint32_t)p[3] << 24u);
 }
@@ -4553,10 +7134,70 @@ static int load_psf_font(const char *path, struct psf_font *out_font, char *errb
     }
 
     fclose(fp);
+    psf_font_build_bmp_map(&font);
     *out_font = font;
     return 0;
 }
 
+static size_t *terminal_buffer_alloc_row_map(size_t rows) {
+    if (rows == 0u || rows > SIZE_MAX / sizeof(size_t)) {
+        return NULL;
+    }
+    size_t *row_map = malloc(rows * sizeof(size_t));
+    if (!row_map) {
+        return NULL;
+    }
+    for (size_t row = 0u; row < rows; row++) {
+        row_map[row] = row;
+    }
+    return row_map;
+}
+
+static size_t terminal_buffer_row_slot(const struct terminal_buffer *buffer, size_t row) {
+    size_t slot = buffer->row_head + row;
+    if (slot >= buffer->rows) {
+        slot -= buffer->rows;
+    }
+    return slot;
+}
+
+/* Cells of logical screen row 'row'. Callers check row < rows. */
+static struct terminal_cell *terminal_buffer_line(const struct terminal_buffer *buffer, size_t row) {
+    return buffer->cells + buffer->row_map[terminal_buffer_row_slot(buffer, row)] * buffer->columns;
+}
+
+/* Rotates logical rows top..bottom so that row top + count becomes row
+ * top. Only row indices move; cell contents stay where they are. */
+static void terminal_buffer_rotate_rows(struct terminal_buffer *buffer, size_t top, size_t bottom, size_t count) {
+    size_t region_rows = bottom - top + 1u;
+    count %= region_rows;
+    if (count == 0u) {
+        return;
+    }
+    if (top == 0u && bottom + 1u == buffer->rows) {
+        buffer->row_head = terminal_buffer_row_slot(buffer, count);
+        return;
+    }
+    size_t spans[3][2] = {
+        { top, top + count - 1u },
+        { top + count, bottom },
+        { top, bottom },
+    };
+    for (size_t pass = 0u; pass < 3u; pass++) {
+        size_t left = spans[pass][0];
+        size_t right = spans[pass][1];
+        while (left < right) {
+            size_t *a = &buffer->row_map[terminal_buffer_row_slot(buffer, left)];
+            size_t *b = &buffer->row_map[terminal_buffer_row_slot(buffer, right)];
+            size_t tmp = *a;
+            *a = *b;
+            *b = tmp;
+            left++;
+            right--;
+        }
+    }
+}
+
 static int terminal_buffer_init(struct terminal_buffer *buffer, size_t columns, size_t rows) {
     buffer->columns = columns;
     buffer->rows = rows;
@@ -4577,54 +7218,51 @@ static int terminal_buffer_init(struct terminal_buffer *buffer, size_t columns,
     buffer->mouse_drag_tracking = 0;
     buffer->mouse_motion_tracking = 0;
     buffer->mouse_sgr = 0;
-    buffer->history_limit = TERMINAL_HISTORY_LIMIT;
+    buffer->history_limit = terminal_history_line_limit;
+    buffer->history_byte_limit = terminal_history_byte_limit;
     buffer->history_rows = 0u;
     buffer->history_start = 0u;
+    buffer->history_capacity = 0u;
+    buffer->history_bytes = 0u;
+    buffer->history = NULL;
+    buffer->history_signatures = NULL;
+    buffer->history_dropped = 0u;
+    buffer->history_scratch = NULL;
     buffer->scroll_offset = 0u;
     buffer->last_emitted = 0u;
     buffer->last_emitted_valid = 0;
+    buffer->row_map = NULL;
+    buffer->row_head = 0u;
+    buffer->scrolled_lines = 0u;
 
     if (columns == 0u || rows == 0u) {
         buffer->cells = NULL;
-        buffer->history = NULL;
         return -1;
     }
 
     if (columns > SIZE_MAX / rows) {
         buffer->cells = NULL;
-        buffer->history = NULL;
         return -1;
     }
 
     size_t total_cells = columns * rows;
     buffer->cells = calloc(total_cells, sizeof(struct terminal_cell));
     if (!buffer->cells) {
-        buffer->history = NULL;
         return -1;
     }
     for (size_t i = 0u; i < total_cells; i++) {
-        terminal_cell_apply_defaults(buffer, &buffer->cells[i]);
-    }
-
-    if (buffer->history_limit > 0u) {
-        if (columns > SIZE_MAX / buffer->history_limit) {
-            free(buffer->cells);
-            buffer->cells = NULL;
-            buffer->history = NULL;
-            return -1;
-        }
-        size_t history_cells = buffer->history_limit * columns;
-        buffer->history = calloc(history_cells, sizeof(struct terminal_cell));
-        if (!buffer->history) {
-            free(buffer->cells);
-            buffer->cells = NULL;
-            return -1;
-        }
-        for (size_t i = 0u; i < history_cells; i++) {
-            terminal_cell_apply_defaults(buffer, &buffer->history[i]);
-        }
-    } else {
-        buffer->history = NULL;
+        terminal_cell_apply_defaults(buffer, &buffer->cells[i]);
+    }
+    buffer->row_map = terminal_buffer_alloc_row_map(rows);
+    buffer->history_scratch = calloc(columns, sizeof(struct terminal_cell));
+    if (!buffer->row_map || !buffer->history_scratch) {
+        free(buffer->cells);
+        buffer->cells = NULL;
+        free(buffer->row_map);
+        buffer->row_map = NULL;
+        free(buffer->history_scratch);
+        buffer->history_scratch = NULL;
+        return -1;
     }
 
     terminal_buffer_reset_attributes(buffer);
@@ -4653,6 +7291,14 @@ static int terminal_buffer_resize_single(struct terminal_buffer *buffer, size_t
     if (!new_cells) {
         return -1;
     }
+    size_t *new_row_map = terminal_buffer_alloc_row_map(new_rows);
+    struct terminal_cell *new_scratch = calloc(new_columns, sizeof(struct terminal_cell));
+    if (!new_row_map || !new_scratch) {
+        free(new_cells);
+        free(new_row_map);
+        free(new_scratch);
+        return -1;
+    }
 
     for (size_t i = 0u; i < total_cells; i++) {
         terminal_cell_apply_defaults(buffer, &new_cells[i]);
@@ -4661,35 +7307,23 @@ static int terminal_buffer_resize_single(struct terminal_buffer *buffer, size_t
     size_t copy_rows = old_rows < new_rows ? old_rows : new_rows;
     size_t copy_cols = old_columns < new_columns ? old_columns : new_columns;
 
-    if (copy_rows > 0u && copy_cols > 0u && old_cells) {
+    if (copy_rows > 0u && copy_cols > 0u && old_cells && buffer->row_map) {
         for (size_t row = 0u; row < copy_rows; row++) {
             struct terminal_cell *dst = new_cells + row * new_columns;
-            struct terminal_cell *src = old_cells + row * old_columns;
+            const struct terminal_cell *src = terminal_buffer_line(buffer, row);
             memcpy(dst, src, copy_cols * sizeof(struct terminal_cell));
         }
     }
 
-    struct terminal_cell *new_history = NULL;
-    if (buffer->history_limit > 0u) {
-        if (new_columns > SIZE_MAX / buffer->history_limit) {
-            free(new_cells);
-            return -1;
-        }
-        size_t history_cells = buffer->history_limit * new_columns;
-        new_history = calloc(history_cells, sizeof(struct terminal_cell));
-        if (!new_history) {
-            free(new_cells);
-            return -1;
-        }
-        for (size_t i = 0u; i < history_cells; i++) {
-            terminal_cell_apply_defaults(buffer, &new_history[i]);
-        }
-    }
-
+    terminal_buffer_history_free(buffer);
     free(buffer->cells);
-    free(buffer->history);
+    free(buffer->row_map);
+    free(buffer->history_scratch);
     buffer->cells = new_cells;
-    buffer->history = new_history;
+    buffer->row_map = new_row_map;
+    buffer->row_head = 0u;
+    buffer->scrolled_lines = 0u;
+    buffer->history_scratch = new_scratch;
     buffer->columns = new_columns;
     buffer->rows = new_rows;
 
@@ -4742,8 +7376,12 @@ static void terminal_buffer_free(struct terminal_buffer *buffer) {
     }
     free(buffer->cells);
     buffer->cells = NULL;
-    free(buffer->history);
-    buffer->history = NULL;
+    free(buffer->row_map);
+    buffer->row_map = NULL;
+    buffer->row_head = 0u;
+    terminal_buffer_history_free(buffer);
+    free(buffer->history_scratch);
+    buffer->history_scratch = NULL;
     buffer->columns = 0u;
     buffer->rows = 0u;
     buffer->cursor_column = 0u;
@@ -4774,6 +7412,7 @@ static int terminal_prepare_alternate_buffer(const struct terminal_buffer *sourc
         return -1;
     }
     terminal_alternate_buffer_handle->history_limit = source->history_limit;
+    terminal_alternate_buffer_handle->history_byte_limit = source->history_byte_limit;
     terminal_alternate_initialized = 1;
     return 0;
 }
@@ -4788,6 +7427,10 @@ static void terminal_swap_alternate_buffer(struct terminal_buffer *buffer) {
         }
     }
 
+    if (terminal_search_active && terminal_search_buffer == buffer) {
+        terminal_search_end(buffer);
+    }
+
     int mouse_tracking = buffer->mouse_tracking;
     int mouse_drag_tracking = buffer->mouse_drag_tracking;
     int mouse_motion_tracking = buffer->mouse_motion_tracking;
@@ -4843,185 +7486,768 @@ static void terminal_buffer_resolve_scroll_region(const struct terminal_buffer *
     }
 }
 
+/* Compressed history row: a header of two uint32 counts, then runs of
+ * identical attributes (fg, bg, style, length) and finally the cell text
+ * as UTF-8 with empty cells stored as NUL bytes. Trailing empty cells
+ * carry no text at all. */
+#define TERMINAL_HISTORY_HEADER_SIZE 8u
+#define TERMINAL_HISTORY_SPAN_SIZE 13u
+
+static unsigned char *terminal_history_compress(const struct terminal_cell *row, size_t columns, size_t *out_size) {
+    size_t text_cells = columns;
+    while (text_cells > 0u && row[text_cells - 1u].ch == 0u) {
+        text_cells--;
+    }
+
+    size_t span_count = 0u;
+    size_t text_length = 0u;
+    for (size_t col = 0u; col < columns; col++) {
+        if (col == 0u ||
+            row[col].fg != row[col - 1u].fg ||
+            row[col].bg != row[col - 1u].bg ||
+            row[col].style != row[col - 1u].style) {
+            span_count++;
+        }
+        if (col < text_cells) {
+            char encoded[4];
+            text_length += row[col].ch == 0u ? 1u : terminal_encode_utf8(row[col].ch, encoded);
+        }
+    }
+
+    size_t size = TERMINAL_HISTORY_HEADER_SIZE + span_count * TERMINAL_HISTORY_SPAN_SIZE + text_length;
+    unsigned char *blob = malloc(size);
+    if (!blob) {
+        return NULL;
+    }
+    uint32_t header[2] = { (uint32_t)span_count, (uint32_t)text_length };
+    memcpy(blob, header, sizeof(header));
+
+    unsigned char *span = blob + TERMINAL_HISTORY_HEADER_SIZE;
+    size_t col = 0u;
+    while (col < columns) {
+        size_t run = 1u;
+        while (col + run < columns &&
+               row[col + run].fg == row[col].fg &&
+               row[col + run].bg == row[col].bg &&
+               row[col + run].style == row[col].style) {
+            run++;
+        }
+        uint32_t run_length = (uint32_t)run;
+        memcpy(span, &row[col].fg, 4u);
+        memcpy(span + 4u, &row[col].bg, 4u);
+        span[8] = row[col].style;
+        memcpy(span + 9u, &run_length, 4u);
+        span += TERMINAL_HISTORY_SPAN_SIZE;
+        col += run;
+    }
+
+    char *text = (char *)span;
+    for (col = 0u; col < text_cells; col++) {
+        if (row[col].ch == 0u) {
+            *text++ = '\0';
+        } else {
+            text += terminal_encode_utf8(row[col].ch, text);
+        }
+    }
+
+    *out_size = size;
+    return blob;
+}
+
+static const unsigned char *terminal_history_text(const unsigned char *blob, size_t *out_length) {
+    uint32_t header[2];
+    memcpy(header, blob, sizeof(header));
+    *out_length = header[1];
+    return blob + TERMINAL_HISTORY_HEADER_SIZE + (size_t)header[0] * TERMINAL_HISTORY_SPAN_SIZE;
+}
+
+static unsigned char terminal_search_fold(unsigned char byte) {
+    if (byte == 0u) {
+        return ' ';
+    }
+    if (byte >= 'A' && byte <= 'Z') {
+        return (unsigned char)(byte - 'A' + 'a');
+    }
+    return byte;
+}
+
+/* One bit per case-folded byte bigram. A row can only contain a query if
+ * its signature covers every bit of the query's signature. */
+static uint64_t terminal_search_signature(const unsigned char *text, size_t length) {
+    uint64_t signature = 0u;
+    for (size_t i = 0u; i + 1u < length; i++) {
+        unsigned int a = terminal_search_fold(text[i]);
+        unsigned int b = terminal_search_fold(text[i + 1u]);
+        signature |= UINT64_C(1) << ((a * 31u + b) & 63u);
+    }
+    return signature;
+}
+
+static size_t terminal_history_size(const unsigned char *blob) {
+    uint32_t header[2];
+    memcpy(header, blob, sizeof(header));
+    return TERMINAL_HISTORY_HEADER_SIZE + (size_t)header[0] * TERMINAL_HISTORY_SPAN_SIZE + header[1];
+}
+
+static void terminal_history_expand(const unsigned char *blob, struct terminal_cell *row, size_t columns) {
+    uint32_t header[2];
+    memcpy(header, blob, sizeof(header));
+
+    const unsigned char *span = blob + TERMINAL_HISTORY_HEADER_SIZE;
+    size_t col = 0u;
+    for (uint32_t i = 0u; i < header[0] && col < columns; i++) {
+        struct terminal_cell cell;
+        uint32_t run_length = 0u;
+        memcpy(&cell.fg, span, 4u);
+        memcpy(&cell.bg, span + 4u, 4u);
+        cell.style = span[8];
+        memcpy(&run_length, span + 9u, 4u);
+        cell.ch = 0u;
+        for (uint32_t run = 0u; run < run_length && col < columns; run++) {
+            row[col++] = cell;
+        }
+        span += TERMINAL_HISTORY_SPAN_SIZE;
+    }
+
+    const uint8_t *text = blob + TERMINAL_HISTORY_HEADER_SIZE + (size_t)header[0] * TERMINAL_HISTORY_SPAN_SIZE;
+    size_t offset = 0u;
+    for (col = 0u; col < columns && offset < header[1]; col++) {
+        uint32_t codepoint = 0u;
+        if (terminal_utf8_next(text, header[1], &offset, &codepoint) != 0) {
+            break;
+        }
+        row[col].ch = codepoint;
+    }
+}
+
+static void terminal_buffer_history_drop_oldest(struct terminal_buffer *buffer) {
+    if (buffer->history_rows == 0u) {
+        return;
+    }
+    unsigned char *oldest = buffer->history[buffer->history_start];
+    buffer->history_bytes -= terminal_history_size(oldest);
+    free(oldest);
+    buffer->history[buffer->history_start] = NULL;
+    buffer->history_start = (buffer->history_start + 1u) % buffer->history_capacity;
+    buffer->history_rows--;
+    buffer->history_dropped++;
+}
+
+static void terminal_buffer_history_free(struct terminal_buffer *buffer) {
+    if (buffer->history) {
+        for (size_t i = 0u; i < buffer->history_rows; i++) {
+            free(buffer->history[(buffer->history_start + i) % buffer->history_capacity]);
+        }
+    }
+    free(buffer->history);
+    buffer->history = NULL;
+    free(buffer->history_signatures);
+    buffer->history_signatures = NULL;
+    buffer->history_dropped += buffer->history_rows;
+    buffer->history_capacity = 0u;
+    buffer->history_rows = 0u;
+    buffer->history_start = 0u;
+    buffer->history_bytes = 0u;
+}
+
+/* Doubles the ring (up to history_limit) and unwraps it so the oldest
+ * row sits at index 0. */
+static int terminal_buffer_history_grow(struct terminal_buffer *buffer) {
+    size_t capacity = buffer->history_capacity > 0u
+        ? buffer->history_capacity * 2u
+        : TERMINAL_HISTORY_INITIAL_CAPACITY;
+    if (capacity > buffer->history_limit) {
+        capacity = buffer->history_limit;
+    }
+    if (capacity <= buffer->history_capacity || capacity > SIZE_MAX / sizeof(unsigned char *)) {
+        return -1;
+    }
+    unsigned char **history = calloc(capacity, sizeof(unsigned char *));
+    uint64_t *signatures = calloc(capacity, sizeof(uint64_t));
+    if (!history || !signatures) {
+        free(history);
+        free(signatures);
+        return -1;
+    }
+    for (size_t i = 0u; i < buffer->history_rows; i++) {
+        size_t index = (buffer->history_start + i) % buffer->history_capacity;
+        history[i] = buffer->history[index];
+        signatures[i] = buffer->history_signatures[index];
+    }
+    free(buffer->history);
+    free(buffer->history_signatures);
+    buffer->history = history;
+    buffer->history_signatures = signatures;
+    buffer->history_capacity = capacity;
+    buffer->history_start = 0u;
+    return 0;
+}
+
 static void terminal_buffer_push_history(struct terminal_buffer *buffer, const struct terminal_cell *row) {
     if (!buffer || !row || buffer->columns == 0u) {
         return;
     }
-    if (buffer->history_limit == 0u || !buffer->history) {
+    if (buffer->history_limit == 0u) {
         return;
     }
 
-    size_t row_size = buffer->columns * sizeof(struct terminal_cell);
-    size_t target_index;
-    if (buffer->history_rows < buffer->history_limit) {
-        target_index = (buffer->history_start + buffer->history_rows) % buffer->history_limit;
-        buffer->history_rows++;
-    } else {
-        target_index = buffer->history_start;
-        buffer->history_start = (buffer->history_start + 1u) % buffer->history_limit;
+    size_t size = 0u;
+    unsigned char *compressed = terminal_history_compress(row, buffer->columns, &size);
+    if (!compressed) {
+        return;
+    }
+
+    /* If the ring cannot grow, keep recycling the rows it already has. */
+    if (buffer->history_rows >= buffer->history_capacity && buffer->history_rows < buffer->history_limit) {
+        (void)terminal_buffer_history_grow(buffer);
+    }
+    if (buffer->history_capacity == 0u) {
+        free(compressed);
+        return;
+    }
+    if (buffer->history_rows >= buffer->history_capacity || buffer->history_rows >= buffer->history_limit) {
+        terminal_buffer_history_drop_oldest(buffer);
+    }
+    while (buffer->history_byte_limit > 0u &&
+           buffer->history_rows > 0u &&
+           buffer->history_bytes + size > buffer->history_byte_limit) {
+        terminal_buffer_history_drop_oldest(buffer);
+    }
+
+    size_t target_index = (buffer->history_start + buffer->history_rows) % buffer->history_capacity;
+    size_t text_length = 0u;
+    const unsigned char *text = terminal_history_text(compressed, &text_length);
+    buffer->history[target_index] = compressed;
+    buffer->history_signatures[target_index] = terminal_search_signature(text, text_length);
+    buffer->history_rows++;
+    buffer->history_bytes += size;
+    terminal_buffer_clamp_scroll(buffer);
+}
+
+static void terminal_buffer_scroll(struct terminal_buffer *buffer) {
+    if (!buffer || buffer->rows == 0u || buffer->columns == 0u) {
+        return;
+    }
+    terminal_buffer_push_history(buffer, terminal_buffer_line(buffer, 0u));
+    buffer->row_head = terminal_buffer_row_slot(buffer, 1u);
+    buffer->scrolled_lines++;
+    struct terminal_cell *last_row = terminal_buffer_line(buffer, buffer->rows - 1u);
+    for (size_t col = 0u; col < buffer->columns; col++) {
+        terminal_cell_apply_defaults(buffer, &last_row[col]);
+    }
+    if (buffer->scroll_offset > 0u) {
+        buffer->scroll_offset++;
+        terminal_buffer_clamp_scroll(buffer);
+    }
+}
+
+static void terminal_buffer_scroll_region_up(struct terminal_buffer *buffer, size_t count) {
+    if (!buffer || buffer->rows == 0u || buffer->columns == 0u) {
+        return;
+    }
+
+    size_t top = 0u;
+    size_t bottom = 0u;
+    terminal_buffer_resolve_scroll_region(buffer, &top, &bottom);
+    if (top == 0u && bottom == buffer->rows - 1u) {
+        for (size_t i = 0u; i < count; i++) {
+            terminal_buffer_scroll(buffer);
+        }
+        return;
+    }
+    if (bottom <= top) {
+        return;
+    }
+
+    size_t region_rows = bottom - top + 1u;
+    if (count >= region_rows) {
+        for (size_t row = top; row <= bottom; row++) {
+            terminal_buffer_fill_line_current(buffer, row);
+        }
+        return;
+    }
+
+    terminal_buffer_rotate_rows(buffer, top, bottom, count);
+    for (size_t row = bottom + 1u - count; row <= bottom; row++) {
+        terminal_buffer_fill_line_current(buffer, row);
+    }
+}
+
+static void terminal_buffer_scroll_region_down(struct terminal_buffer *buffer, size_t count) {
+    if (!buffer || buffer->rows == 0u || buffer->columns == 0u) {
+        return;
+    }
+
+    size_t top = 0u;
+    size_t bottom = 0u;
+    terminal_buffer_resolve_scroll_region(buffer, &top, &bottom);
+    if (bottom <= top) {
+        return;
+    }
+
+    size_t region_rows = bottom - top + 1u;
+    if (count >= region_rows) {
+        for (size_t row = top; row <= bottom; row++) {
+            terminal_buffer_fill_line_current(buffer, row);
+        }
+        return;
+    }
+
+    terminal_buffer_rotate_rows(buffer, top, bottom, region_rows - count);
+    for (size_t row = top; row < top + count; row++) {
+        terminal_buffer_fill_line_current(buffer, row);
+    }
+}
+
+static void terminal_buffer_index(struct terminal_buffer *buffer) {
+    if (!buffer || buffer->rows == 0u) {
+        return;
+    }
+
+    if (buffer->cursor_row >= buffer->rows) {
+        buffer->cursor_row = buffer->rows - 1u;
+    }
+
+    size_t top = 0u;
+    size_t bottom = 0u;
+    terminal_buffer_resolve_scroll_region(buffer, &top, &bottom);
+        if (buffer->cursor_row >= top && buffer->cursor_row <= bottom) {
+            if (buffer->cursor_row == bottom) {
+                terminal_buffer_scroll_region_up(buffer, 1u);
+            } else {
+                buffer->cursor_row++;
+            }
+    } else if (buffer->cursor_row + 1u < buffer->rows) {
+        buffer->cursor_row++;
+    }
+}
+
+static void terminal_buffer_reverse_index(struct terminal_buffer *buffer) {
+    if (!buffer || buffer->rows == 0u) {
+        return;
+    }
+
+    if (buffer->cursor_row >= buffer->rows) {
+        buffer->cursor_row = buffer->rows - 1u;
+    }
+
+    size_t top = 0u;
+    size_t bottom = 0u;
+    terminal_buffer_resolve_scroll_region(buffer, &top, &bottom);
+        if (buffer->cursor_row >= top && buffer->cursor_row <= bottom) {
+            if (buffer->cursor_row == top) {
+                terminal_buffer_scroll_region_down(buffer, 1u);
+            } else {
+                buffer->cursor_row--;
+            }
+    } else if (buffer->cursor_row > 0u) {
+        buffer->cursor_row--;
+    }
+}
+
+static const struct terminal_cell *terminal_buffer_row_at(const struct terminal_buffer *buffer, size_t index) {
+    if (!buffer) {
+        return NULL;
+    }
+    if (index < buffer->history_rows) {
+        if (!buffer->history || !buffer->history_scratch) {
+            return NULL;
+        }
+        /* The returned row stays valid until the next history lookup. */
+        size_t ring_index = (buffer->history_start + index) % buffer->history_capacity;
+        terminal_history_expand(buffer->history[ring_index], buffer->history_scratch, buffer->columns);
+        return buffer->history_scratch;
+    }
+    index -= buffer->history_rows;
+    if (index >= buffer->rows || !buffer->cells || !buffer->row_map) {
+        return NULL;
+    }
+    return terminal_buffer_line(buffer, index);
+}
+
+static int terminal_search_add_match(size_t line, size_t column, size_t width) {
+    if (terminal_search_match_count == terminal_search_match_capacity) {
+        size_t capacity = terminal_search_match_capacity > 0u ? terminal_search_match_capacity * 2u : 64u;
+        struct terminal_search_match *matches = realloc(terminal_search_matches, capacity * sizeof(*matches));
+        if (!matches) {
+            return -1;
+        }
+        terminal_search_matches = matches;
+        terminal_search_match_capacity = capacity;
+    }
+    struct terminal_search_match *match = &terminal_search_matches[terminal_search_match_count++];
+    match->line = line;
+    match->column = column;
+    match->width = width;
+    return 0;
+}
+
+static size_t terminal_search_columns(const unsigned char *text, size_t length) {
+    size_t columns = 0u;
+    for (size_t i = 0u; i < length; i++) {
+        if ((text[i] & 0xC0u) != 0x80u) {
+            columns++;
+        }
+    }
+    return columns;
+}
+
+#define TERMINAL_SEARCH_GROUP_MAX 16u
+
+/* Bigram bits that every hit of the extended regex must contain: the
+ * literal runs outside optional atoms and groups. Alternation makes any
+ * single run optional, so such patterns return 0 and skip the prefilter. */
+static uint64_t terminal_search_required_signature(const char *pattern) {
+    if (strchr(pattern, '|')) {
+        return 0u;
+    }
+    uint64_t groups[TERMINAL_SEARCH_GROUP_MAX];
+    size_t depth = 0u;
+    unsigned char run[TERMINAL_SEARCH_QUERY_MAX] = {0};
+    size_t run_length = 0u;
+    int last_literal = 0;
+    groups[0] = 0u;
+
+    size_t i = 0u;
+    while (pattern[i] != '\0') {
+        unsigned char ch = (unsigned char)pattern[i];
+        int literal = -1;
+        if (ch == '\\') {
+            unsigned char next = (unsigned char)pattern[i + 1u];
+            if (next == '\0') {
+                break;
+            }
+            /* \w, \b, \< and back-references are not literals. */
+            if (!isalnum(next) && next != '<' && next != '>' && next != '`' && next != '\'' && next < 0x80u) {
+                literal = next;
+            }
+            i += 2u;
+        } else if (ch == '*' || ch == '?' || ch == '{') {
+            if (last_literal && run_length > 0u) {
+                run_length--;
+            }
+            if (ch == '{') {
+                while (pattern[i] != '\0' && pattern[i] != '}') {
+                    i++;
+                }
+            }
+            if (pattern[i] != '\0') {
+                i++;
+            }
+        } else if (ch == '[') {
+            i++;
+            if (pattern[i] == '^') {
+                i++;
+            }
+            if (pattern[i] == ']') {
+                i++;
+            }
+            while (pattern[i] != '\0' && pattern[i] != ']') {
+                if (pattern[i] == '[' && (pattern[i + 1u] == ':' || pattern[i + 1u] == '=' || pattern[i + 1u] == '.')) {
+                    char close = pattern[i + 1u];
+                    i += 2u;
+                    while (pattern[i] != '\0' && !(pattern[i] == close && pattern[i + 1u] == ']')) {
+                        i++;
+                    }
+                    if (pattern[i] == '\0') {
+                        break;
+                    }
+                    i++;
+                }
+                i++;
+            }
+            if (pattern[i] != '\0') {
+                i++;
+            }
+        } else if (ch == '(' || ch == ')') {
+            groups[depth] |= terminal_search_signature(run, run_length);
+            run_length = 0u;
+            if (ch == '(') {
+                if (depth + 1u >= TERMINAL_SEARCH_GROUP_MAX) {
+                    return 0u;
+                }
+                groups[++depth] = 0u;
+            } else {
+                if (depth == 0u) {
+                    return 0u;
+                }
+                uint64_t inner = groups[depth--];
+                char next = pattern[i + 1u];
+                if (next != '*' && next != '?' && next != '{') {
+                    groups[depth] |= inner;
+                }
+            }
+            i++;
+        } else if (ch < 0x80u && ch != '.' && ch != '^' && ch != '$' && ch != '+') {
+            literal = ch;
+            i++;
+        } else {
+            i++;
+        }
+
+        if (literal >= 0) {
+            run[run_length++] = (unsigned char)literal;
+            last_literal = 1;
+        } else {
+            groups[depth] |= terminal_search_signature(run, run_length);
+            run_length = 0u;
+            last_literal = 0;
+        }
     }
-
-    struct terminal_cell *dest = buffer->history + target_index * buffer->columns;
-    memcpy(dest, row, row_size);
-    terminal_buffer_clamp_scroll(buffer);
+    groups[depth] |= terminal_search_signature(run, run_length);
+    return depth == 0u ? groups[0] : 0u;
 }
 
-static void terminal_buffer_scroll(struct terminal_buffer *buffer) {
-    if (!buffer || buffer->rows == 0u || buffer->columns == 0u) {
-        return;
+/* Compiles the current query. Literal queries are remembered so that a
+ * query which only grew can be refined from the previous hits. */
+static void terminal_search_compile(void) {
+    if (terminal_search_regex_valid) {
+        regfree(&terminal_search_regex);
+        terminal_search_regex_valid = 0;
     }
-    size_t row_size = buffer->columns * sizeof(struct terminal_cell);
-    struct terminal_cell *first_row = buffer->cells;
-    terminal_buffer_push_history(buffer, first_row);
-    memmove(buffer->cells, buffer->cells + buffer->columns, row_size * (buffer->rows - 1u));
-    struct terminal_cell *last_row = buffer->cells + buffer->columns * (buffer->rows - 1u);
-    for (size_t col = 0u; col < buffer->columns; col++) {
-        terminal_cell_apply_defaults(buffer, &last_row[col]);
+    terminal_search_regex_error = 0;
+    terminal_search_literal = 0;
+    terminal_search_required = 0u;
+    if (terminal_search_query_length == 0u) {
+        return;
     }
-    if (buffer->scroll_offset > 0u) {
-        buffer->scroll_offset++;
-        terminal_buffer_clamp_scroll(buffer);
+    int result = regcomp(&terminal_search_regex, terminal_search_query, REG_EXTENDED | REG_ICASE);
+    if (result != 0) {
+        terminal_search_regex_error = result;
+        return;
     }
+    terminal_search_regex_valid = 1;
+    terminal_search_literal = strpbrk(terminal_search_query, ".[]()*+?{}|^$\\") == NULL;
+    terminal_search_required = terminal_search_required_signature(terminal_search_query);
 }
 
-static void terminal_buffer_scroll_region_up(struct terminal_buffer *buffer, size_t count) {
-    if (!buffer || buffer->rows == 0u || buffer->columns == 0u) {
+/* Records every non-empty hit in one row of UTF-8 text (one code point
+ * per cell, 0 for a blank cell). */
+static void terminal_search_scan_text(const unsigned char *text, size_t length, size_t line) {
+    if (!terminal_search_regex_valid) {
         return;
     }
-
-    size_t top = 0u;
-    size_t bottom = 0u;
-    terminal_buffer_resolve_scroll_region(buffer, &top, &bottom);
-    if (top == 0u && bottom == buffer->rows - 1u) {
-        for (size_t i = 0u; i < count; i++) {
-            terminal_buffer_scroll(buffer);
+    if (length + 1u > terminal_search_line_text_capacity) {
+        char *line_text = realloc(terminal_search_line_text, length + 1u);
+        if (!line_text) {
+            return;
         }
-        return;
+        terminal_search_line_text = line_text;
+        terminal_search_line_text_capacity = length + 1u;
     }
-    if (bottom <= top) {
-        return;
+    for (size_t i = 0u; i < length; i++) {
+        terminal_search_line_text[i] = text[i] == 0u ? ' ' : (char)text[i];
     }
+    terminal_search_line_text[length] = '\0';
 
-    size_t region_rows = bottom - top + 1u;
-    if (count >= region_rows) {
-        for (size_t row = top; row <= bottom; row++) {
-            terminal_buffer_fill_line_current(buffer, row);
+    size_t offset = 0u;
+    size_t column = 0u;
+    int flags = 0;
+    while (offset <= length) {
+        regmatch_t hit;
+        if (regexec(&terminal_search_regex, terminal_search_line_text + offset, 1u, &hit, flags) != 0) {
+            return;
         }
-        return;
+        size_t start = offset + (size_t)hit.rm_so;
+        size_t end = offset + (size_t)hit.rm_eo;
+        column += terminal_search_columns(text + offset, start - offset);
+        if (end > start) {
+            size_t width = terminal_search_columns(text + start, end - start);
+            if (terminal_search_add_match(line, column, width) != 0) {
+                return;
+            }
+            column += width;
+            offset = end;
+        } else {
+            /* Step over empty hits so patterns like "x*" make progress. */
+            if (start >= length) {
+                return;
+            }
+            offset = start + 1u;
+            while (offset < length && (text[offset] & 0xC0u) == 0x80u) {
+                offset++;
+            }
+            column++;
+        }
+        flags = REG_NOTBOL;
     }
+}
 
-    size_t row_size = buffer->columns * sizeof(struct terminal_cell);
-    memmove(buffer->cells + top * buffer->columns,
-            buffer->cells + (top + count) * buffer->columns,
-            row_size * (region_rows - count));
+static void terminal_search_scan_line(const struct terminal_buffer *buffer, size_t line) {
+    size_t index = (buffer->history_start + (line - buffer->history_dropped)) % buffer->history_capacity;
+    size_t length = 0u;
+    const unsigned char *text = terminal_history_text(buffer->history[index], &length);
+    terminal_search_scan_text(text, length, line);
+}
 
-    for (size_t row = bottom + 1u - count; row <= bottom; row++) {
-        terminal_buffer_fill_line_current(buffer, row);
+static void terminal_search_scan_history(const struct terminal_buffer *buffer, size_t first_line) {
+    for (size_t line = first_line; line < buffer->history_dropped + buffer->history_rows; line++) {
+        size_t index = (buffer->history_start + (line - buffer->history_dropped)) % buffer->history_capacity;
+        if ((buffer->history_signatures[index] & terminal_search_required) != terminal_search_required) {
+            continue;
+        }
+        terminal_search_scan_line(buffer, line);
     }
 }
 
-static void terminal_buffer_scroll_region_down(struct terminal_buffer *buffer, size_t count) {
-    if (!buffer || buffer->rows == 0u || buffer->columns == 0u) {
-        return;
+/* Screen rows change in place, so they are never indexed; they are
+ * encoded and scanned on every search instead. */
+static void terminal_search_scan_screen(const struct terminal_buffer *buffer) {
+    size_t needed = buffer->columns * 4u;
+    if (needed > terminal_search_row_text_capacity) {
+        unsigned char *text = realloc(terminal_search_row_text, needed);
+        if (!text) {
+            return;
+        }
+        terminal_search_row_text = text;
+        terminal_search_row_text_capacity = needed;
     }
-
-    size_t top = 0u;
-    size_t bottom = 0u;
-    terminal_buffer_resolve_scroll_region(buffer, &top, &bottom);
-    if (top == 0u && bottom == buffer->rows - 1u) {
-        size_t row_size = buffer->columns * sizeof(struct terminal_cell);
-        for (size_t i = 0u; i < count; i++) {
-            memmove(buffer->cells + buffer->columns,
-                    buffer->cells,
-                    row_size * (buffer->rows - 1u));
-            terminal_buffer_fill_line_current(buffer, 0u);
+    for (size_t row = 0u; row < buffer->rows; row++) {
+        const struct terminal_cell *cells = terminal_buffer_line(buffer, row);
+        size_t length = 0u;
+        for (size_t col = 0u; col < buffer->columns; col++) {
+            if (cells[col].ch == 0u) {
+                terminal_search_row_text[length++] = 0u;
+            } else {
+                length += terminal_encode_utf8(cells[col].ch, (char *)terminal_search_row_text + length);
+            }
         }
+        terminal_search_scan_text(terminal_search_row_text, length, buffer->history_dropped + buffer->history_rows + row);
+    }
+}
+
+/* Selects the current hit and scrolls it into view. */
+static void terminal_search_show_current(struct terminal_buffer *buffer) {
+    if (terminal_search_current >= terminal_search_match_count) {
+        terminal_selection_clear();
         return;
     }
-    if (bottom <= top) {
+    const struct terminal_search_match *match = &terminal_search_matches[terminal_search_current];
+    if (match->line < buffer->history_dropped) {
+        terminal_selection_clear();
         return;
     }
-
-    size_t region_rows = bottom - top + 1u;
-    if (count >= region_rows) {
-        for (size_t row = top; row <= bottom; row++) {
-            terminal_buffer_fill_line_current(buffer, row);
-        }
+    size_t global_row = match->line - buffer->history_dropped;
+    size_t total_rows = terminal_total_rows(buffer);
+    if (global_row >= total_rows) {
+        terminal_selection_clear();
         return;
     }
 
-    size_t row_size = buffer->columns * sizeof(struct terminal_cell);
-    memmove(buffer->cells + (top + count) * buffer->columns,
-            buffer->cells + top * buffer->columns,
-            row_size * (region_rows - count));
+    terminal_selection_begin(global_row, match->column);
+    terminal_selection_update(global_row, match->column + match->width);
 
-    for (size_t row = top; row < top + count; row++) {
-        terminal_buffer_fill_line_current(buffer, row);
+    size_t top_index = 0u;
+    size_t bottom_index = 0u;
+    terminal_visible_row_range(buffer, &top_index, &bottom_index);
+    if (global_row < top_index || global_row > bottom_index) {
+        size_t target_bottom = global_row + buffer->rows / 2u;
+        if (target_bottom >= total_rows) {
+            target_bottom = total_rows - 1u;
+        }
+        buffer->scroll_offset = total_rows - 1u - target_bottom;
+        terminal_buffer_clamp_scroll(buffer);
     }
 }
 
-static void terminal_buffer_index(struct terminal_buffer *buffer) {
-    if (!buffer || buffer->rows == 0u) {
+/* Re-runs the search for the current query. When a literal query only
+ * grew (refine != 0), only the history rows that held the previous hits
+ * are rescanned, followed by rows pushed since the last run. */
+static void terminal_search_update(struct terminal_buffer *buffer, int refine) {
+    if (!buffer || buffer->columns == 0u) {
         return;
     }
-
-    if (buffer->cursor_row >= buffer->rows) {
-        buffer->cursor_row = buffer->rows - 1u;
+    int was_literal = terminal_search_regex_valid && terminal_search_literal;
+    terminal_search_compile();
+    if (buffer != terminal_search_buffer ||
+        terminal_search_history_end < buffer->history_dropped ||
+        !was_literal ||
+        !terminal_search_literal) {
+        refine = 0;
+    }
+    terminal_search_buffer = buffer;
+    if (!terminal_search_regex_valid) {
+        terminal_search_match_count = 0u;
+        terminal_search_history_end = buffer->history_dropped;
+        terminal_selection_clear();
+        return;
     }
 
-    size_t top = 0u;
-    size_t bottom = 0u;
-    terminal_buffer_resolve_scroll_region(buffer, &top, &bottom);
-        if (buffer->cursor_row >= top && buffer->cursor_row <= bottom) {
-            if (buffer->cursor_row == bottom) {
-                terminal_buffer_scroll_region_up(buffer, 1u);
-            } else {
-                buffer->cursor_row++;
+    size_t first_line = buffer->history_dropped;
+    if (refine) {
+        struct terminal_search_match *previous = terminal_search_matches;
+        size_t previous_count = terminal_search_match_count;
+        terminal_search_matches = NULL;
+        terminal_search_match_count = 0u;
+        terminal_search_match_capacity = 0u;
+        size_t last_line = SIZE_MAX;
+        for (size_t i = 0u; i < previous_count; i++) {
+            size_t line = previous[i].line;
+            if (line == last_line || line < buffer->history_dropped || line >= terminal_search_history_end) {
+                continue;
             }
-    } else if (buffer->cursor_row + 1u < buffer->rows) {
-        buffer->cursor_row++;
+            last_line = line;
+            terminal_search_scan_line(buffer, line);
+        }
+        free(previous);
+        first_line = terminal_search_history_end;
+    } else {
+        terminal_search_match_count = 0u;
     }
+    if (buffer->history_rows > 0u) {
+        terminal_search_scan_history(buffer, first_line);
+    }
+    terminal_search_history_end = buffer->history_dropped + buffer->history_rows;
+    terminal_search_scan_screen(buffer);
+
+    terminal_search_current = terminal_search_match_count > 0u ? terminal_search_match_count - 1u : 0u;
+    terminal_search_show_current(buffer);
 }
 
-static void terminal_buffer_reverse_index(struct terminal_buffer *buffer) {
-    if (!buffer || buffer->rows == 0u) {
+static void terminal_search_step(struct terminal_buffer *buffer, int direction) {
+    if (!buffer || terminal_search_match_count == 0u) {
         return;
     }
-
-    if (buffer->cursor_row >= buffer->rows) {
-        buffer->cursor_row = buffer->rows - 1u;
+    if (direction < 0) {
+        terminal_search_current = terminal_search_current > 0u
+            ? terminal_search_current - 1u
+            : terminal_search_match_count - 1u;
+    } else {
+        terminal_search_current = terminal_search_current + 1u < terminal_search_match_count
+            ? terminal_search_current + 1u
+            : 0u;
     }
+    terminal_search_show_current(buffer);
+}
 
-    size_t top = 0u;
-    size_t bottom = 0u;
-    terminal_buffer_resolve_scroll_region(buffer, &top, &bottom);
-        if (buffer->cursor_row >= top && buffer->cursor_row <= bottom) {
-            if (buffer->cursor_row == top) {
-                terminal_buffer_scroll_region_down(buffer, 1u);
-            } else {
-                buffer->cursor_row--;
-            }
-    } else if (buffer->cursor_row > 0u) {
-        buffer->cursor_row--;
+static int terminal_search_set_query(const char *text, size_t length) {
+    if (length >= TERMINAL_SEARCH_QUERY_MAX) {
+        return -1;
     }
+    memcpy(terminal_search_query, text, length);
+    terminal_search_query[length] = '\0';
+    terminal_search_query_length = length;
+    return 0;
 }
 
-static const struct terminal_cell *terminal_buffer_row_at(const struct terminal_buffer *buffer, size_t index) {
-    if (!buffer) {
-        return NULL;
-    }
-    if (index < buffer->history_rows) {
-        if (buffer->history_limit == 0u || !buffer->history) {
-            return NULL;
-        }
-        size_t ring_index = (buffer->history_start + index) % buffer->history_limit;
-        return buffer->history + ring_index * buffer->columns;
-    }
-    index -= buffer->history_rows;
-    if (index >= buffer->rows || !buffer->cells) {
-        return NULL;
+static void terminal_search_begin(struct terminal_buffer *buffer) {
+    terminal_search_active = 1;
+    terminal_search_buffer = buffer;
+    terminal_search_query_length = 0u;
+    terminal_search_query[0] = '\0';
+    terminal_search_match_count = 0u;
+    terminal_selection_clear();
+    terminal_mark_full_redraw();
+}
+
+static void terminal_search_end(struct terminal_buffer *buffer) {
+    terminal_search_active = 0;
+    terminal_search_match_count = 0u;
+    terminal_selection_clear();
+    if (buffer) {
+        buffer->scroll_offset = 0u;
     }
-    return buffer->cells + index * buffer->columns;
+    terminal_mark_full_redraw();
 }
 
 static void terminal_buffer_set_cursor(struct terminal_buffer *buffer, size_t column, size_t row) {
@@ -5076,7 +8302,7 @@ static void terminal_buffer_clear_line_segment(struct terminal_buffer *buffer,
     if (end_column > buffer->columns) {
         end_column = buffer->columns;
     }
-    struct terminal_cell *line = buffer->cells + row * buffer->columns;
+    struct terminal_cell *line = terminal_buffer_line(buffer, row);
     for (size_t col = start_column; col < end_column; col++) {
         terminal_cell_apply_current_blank(buffer, &line[col]);
     }
@@ -5089,7 +8315,7 @@ static void terminal_buffer_clear_entire_line(struct terminal_buffer *buffer, si
     if (row >= buffer->rows) {
         return;
     }
-    struct terminal_cell *line = buffer->cells + row * buffer->columns;
+    struct terminal_cell *line = terminal_buffer_line(buffer, row);
     for (size_t col = 0u; col < buffer->columns; col++) {
         terminal_cell_apply_current_blank(buffer, &line[col]);
     }
@@ -5178,7 +8404,7 @@ static void terminal_buffer_fill_line_current(struct terminal_buffer *buffer, si
     if (row >= buffer->rows || buffer->columns == 0u) {
         return;
     }
-    struct terminal_cell *line = buffer->cells + row * buffer->columns;
+    struct terminal_cell *line = terminal_buffer_line(buffer, row);
     for (size_t col = 0u; col < buffer->columns; col++) {
         terminal_cell_apply_current_blank(buffer, &line[col]);
     }
@@ -5200,7 +8426,7 @@ static void terminal_buffer_fill_line_segment_current(struct terminal_buffer *bu
     if (end_column > buffer->columns) {
         end_column = buffer->columns;
     }
-    struct terminal_cell *line = buffer->cells + row * buffer->columns;
+    struct terminal_cell *line = terminal_buffer_line(buffer, row);
     for (size_t col = start_column; col < end_column; col++) {
         terminal_cell_apply_current_blank(buffer, &line[col]);
     }
@@ -5224,7 +8450,7 @@ static void terminal_buffer_insert_chars(struct terminal_buffer *buffer, size_t
         count = available;
     }
     size_t tail_count = available - count;
-    struct terminal_cell *line = buffer->cells + buffer->cursor_row * buffer->columns;
+    struct terminal_cell *line = terminal_buffer_line(buffer, buffer->cursor_row);
     if (tail_count > 0u) {
         memmove(line + buffer->cursor_column + count,
                 line + buffer->cursor_column,
@@ -5254,7 +8480,7 @@ static void terminal_buffer_delete_chars(struct terminal_buffer *buffer, size_t
         count = available;
     }
     size_t tail_count = available - count;
-    struct terminal_cell *line = buffer->cells + buffer->cursor_row * buffer->columns;
+    struct terminal_cell *line = terminal_buffer_line(buffer, buffer->cursor_row);
     if (tail_count > 0u) {
         memmove(line + buffer->cursor_column,
                 line + buffer->cursor_column + count,
@@ -5290,13 +8516,7 @@ static void terminal_buffer_insert_lines(struct terminal_buffer *buffer, size_t
     if (count > available) {
         count = available;
     }
-    size_t rows_to_move = available - count;
-    size_t row_size = buffer->columns * sizeof(struct terminal_cell);
-    if (rows_to_move > 0u) {
-        memmove(buffer->cells + (buffer->cursor_row + count) * buffer->columns,
-                buffer->cells + buffer->cursor_row * buffer->columns,
-                rows_to_move * row_size);
-    }
+    terminal_buffer_rotate_rows(buffer, buffer->cursor_row, bottom, available - count);
     for (size_t row = buffer->cursor_row; row < buffer->cursor_row + count; row++) {
         terminal_buffer_fill_line_current(buffer, row);
     }
@@ -5326,13 +8546,7 @@ static void terminal_buffer_delete_lines(struct terminal_buffer *buffer, size_t
     if (count > available) {
         count = available;
     }
-    size_t rows_to_move = available - count;
-    size_t row_size = buffer->columns * sizeof(struct terminal_cell);
-    if (rows_to_move > 0u) {
-        memmove(buffer->cells + buffer->cursor_row * buffer->columns,
-                buffer->cells + (buffer->cursor_row + count) * buffer->columns,
-                rows_to_move * row_size);
-    }
+    terminal_buffer_rotate_rows(buffer, buffer->cursor_row, bottom, count);
     for (size_t row = bottom + 1u - count; row <= bottom; row++) {
         terminal_buffer_fill_line_current(buffer, row);
     }
@@ -5446,7 +8660,7 @@ static void terminal_put_char(struct terminal_buffer *buffer, uint32_t ch) {
         if (buffer->cursor_row >= buffer->rows) {
             return;
         }
-        struct terminal_cell *cell = &buffer->cells[buffer->cursor_row * buffer->columns + buffer->cursor_column];
+        struct terminal_cell *cell = &terminal_buffer_line(buffer, buffer->cursor_row)[buffer->cursor_column];
         terminal_cell_apply_current(buffer, cell, ch);
         buffer->last_emitted = ch;
         buffer->last_emitted_valid = 1;
@@ -5459,6 +8673,47 @@ static void terminal_put_char(struct terminal_buffer *buffer, uint32_t ch) {
     }
 }
 
+/* Writes a run of printable ASCII with the current attributes. Same
+ * wrapping rules as terminal_put_char, but the attributes are resolved
+ * once and each row segment is filled in one pass. */
+static void terminal_put_ascii_run(struct terminal_buffer *buffer, const unsigned char *text, size_t length) {
+    if (!buffer || !buffer->cells || !text || length == 0u) {
+        return;
+    }
+
+    uint32_t fg = terminal_resolve_fg(buffer);
+    uint32_t bg = terminal_resolve_bg(buffer);
+    uint8_t style = buffer->current_attr.style;
+    while (length > 0u) {
+        if (buffer->cursor_row >= buffer->rows) {
+            terminal_buffer_index(buffer);
+        }
+        if (buffer->cursor_column >= buffer->columns) {
+            buffer->cursor_column = 0u;
+            terminal_buffer_index(buffer);
+        }
+        if (buffer->cursor_row >= buffer->rows || buffer->cursor_column >= buffer->columns) {
+            return;
+        }
+        size_t count = buffer->columns - buffer->cursor_column;
+        if (count > length) {
+            count = length;
+        }
+        struct terminal_cell *cell = &terminal_buffer_line(buffer, buffer->cursor_row)[buffer->cursor_column];
+        for (size_t i = 0u; i < count; i++) {
+            cell[i].ch = (uint32_t)text[i];
+            cell[i].fg = fg;
+            cell[i].bg = bg;
+            cell[i].style = style;
+        }
+        buffer->last_emitted = (uint32_t)text[count - 1u];
+        buffer->last_emitted_valid = 1;
+        buffer->cursor_column += count;
+        text += count;
+        length -= count;
+    }
+}
+
 static void ansi_parser_reset_parameters(struct ansi_parser *parser) {
     if (!parser) {
         return;
@@ -5740,6 +8995,215 @@ static int terminal_base64_decode(const char *input, uint8_t **out_data, size_t
     return 0;
 }
 
+/* Decodes base64 RGBA and checks it holds exactly width x height pixels. */
+static int terminal_sprite_decode(const char *encoded, long width, long height, uint8_t **out_pixels) {
+    uint8_t *pixels = NULL;
+    size_t bytes = 0u;
+
+    *out_pixels = NULL;
+    if (width <= 0 || height <= 0 || width > INT_MAX || height > INT_MAX) {
+        fprintf(stderr, "terminal: Invalid sprite parameters.\n");
+        return -1;
+    }
+    if (terminal_base64_decode(encoded, &pixels, &bytes) != 0) {
+        fprintf(stderr, "terminal: Failed to decode sprite data.\n");
+        return -1;
+    }
+    size_t width_sz = (size_t)width;
+    size_t height_sz = (size_t)height;
+    if (height_sz > SIZE_MAX / width_sz || width_sz * height_sz > SIZE_MAX / 4u) {
+        fprintf(stderr, "terminal: Sprite dimensions too large.\n");
+        free(pixels);
+        return -1;
+    }
+    if (width_sz * height_sz * 4u != bytes) {
+        fprintf(stderr, "terminal: Sprite data size mismatch.\n");
+        free(pixels);
+        return -1;
+    }
+    *out_pixels = pixels;
+    return 0;
+}
+
+/* FNV-1a over "<w>x<h>:" and the base64 text; must match termgfx_sprite_id(). */
+static uint64_t terminal_sprite_content_id(long width, long height, const char *encoded) {
+    char prefix[48];
+    int length = snprintf(prefix, sizeof(prefix), "%ldx%ld:", width, height);
+    uint64_t hash = 1469598103934665603ull;
+    for (int i = 0; i < length && (size_t)i < sizeof(prefix); i++) {
+        hash ^= (unsigned char)prefix[i];
+        hash *= 1099511628211ull;
+    }
+    for (const unsigned char *p = (const unsigned char *)encoded; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static int terminal_sprite_parse_id(const char *text, uint64_t *out_id) {
+    uint64_t id = 0u;
+    size_t length = 0u;
+
+    if (!text || text[0] != 's') {
+        return -1;
+    }
+    text++;
+    for (; text[length] != '\0'; length++) {
+        char ch = text[length];
+        unsigned int digit;
+        if (ch >= '0' && ch <= '9') {
+            digit = (unsigned int)(ch - '0');
+        } else if (ch >= 'a' && ch <= 'f') {
+            digit = (unsigned int)(ch - 'a') + 10u;
+        } else if (ch >= 'A' && ch <= 'F') {
+            digit = (unsigned int)(ch - 'A') + 10u;
+        } else {
+            return -1;
+        }
+        if (length >= 16u) {
+            return -1;
+        }
+        id = (id << 4) | digit;
+    }
+    if (length != 16u) {
+        return -1;
+    }
+    *out_id = id;
+    return 0;
+}
+
+static size_t terminal_sprite_cache_home(uint64_t id) {
+    return (size_t)(id ^ (id >> 32)) & (TERMINAL_SPRITE_CACHE_SLOTS - 1u);
+}
+
+static const struct terminal_sprite_cache_entry *terminal_sprite_cache_find(uint64_t id) {
+    size_t slot = terminal_sprite_cache_home(id);
+    while (terminal_sprite_cache[slot].rgba) {
+        if (terminal_sprite_cache[slot].id == id) {
+            terminal_sprite_cache[slot].last_used = ++terminal_sprite_cache_clock;
+            return &terminal_sprite_cache[slot];
+        }
+        slot = (slot + 1u) & (TERMINAL_SPRITE_CACHE_SLOTS - 1u);
+    }
+    return NULL;
+}
+
+static size_t terminal_sprite_cache_entry_bytes(const struct terminal_sprite_cache_entry *entry) {
+    return (size_t)entry->width * (size_t)entry->height * 4u + entry->encoded_length + 1u;
+}
+
+static int terminal_sprite_cache_matches(const struct terminal_sprite_cache_entry *entry,
+                                         long width,
+                                         long height,
+                                         const char *encoded) {
+    return entry->width == width &&
+           entry->height == height &&
+           strlen(encoded) == entry->encoded_length &&
+           memcmp(entry->encoded, encoded, entry->encoded_length) == 0;
+}
+
+static void terminal_sprite_cache_remove(uint64_t id);
+
+static int terminal_sprite_cache_evict_oldest(void) {
+    size_t oldest = TERMINAL_SPRITE_CACHE_SLOTS;
+    for (size_t slot = 0u; slot < TERMINAL_SPRITE_CACHE_SLOTS; slot++) {
+        if (terminal_sprite_cache[slot].rgba &&
+            (oldest == TERMINAL_SPRITE_CACHE_SLOTS ||
+             terminal_sprite_cache[slot].last_used < terminal_sprite_cache[oldest].last_used)) {
+            oldest = slot;
+        }
+    }
+    if (oldest == TERMINAL_SPRITE_CACHE_SLOTS) {
+        return -1;
+    }
+    terminal_sprite_cache_remove(terminal_sprite_cache[oldest].id);
+    return 0;
+}
+
+/* Takes ownership of rgba on success; encoded is copied. Fails only for a
+ * sprite larger than the whole cache or when memory runs out. */
+static int terminal_sprite_cache_store(uint64_t id, int width, int height, uint8_t *rgba, const char *encoded) {
+    size_t encoded_length = strlen(encoded);
+    size_t bytes = (size_t)width * (size_t)height * 4u + encoded_length + 1u;
+    if (bytes > TERMINAL_SPRITE_CACHE_MAX_BYTES) {
+        return -1;
+    }
+    while (terminal_sprite_cache_count >= TERMINAL_SPRITE_CACHE_MAX_ENTRIES ||
+           bytes > TERMINAL_SPRITE_CACHE_MAX_BYTES - terminal_sprite_cache_bytes) {
+        if (terminal_sprite_cache_evict_oldest() != 0) {
+            return -1;
+        }
+    }
+    size_t slot = terminal_sprite_cache_home(id);
+    while (terminal_sprite_cache[slot].rgba) {
+        if (terminal_sprite_cache[slot].id == id) {
+            return -1;
+        }
+        slot = (slot + 1u) & (TERMINAL_SPRITE_CACHE_SLOTS - 1u);
+    }
+    char *encoded_copy = malloc(encoded_length + 1u);
+    if (!encoded_copy) {
+        return -1;
+    }
+    memcpy(encoded_copy, encoded, encoded_length + 1u);
+    terminal_sprite_cache[slot].id = id;
+    terminal_sprite_cache[slot].width = width;
+    terminal_sprite_cache[slot].height = height;
+    terminal_sprite_cache[slot].rgba = rgba;
+    terminal_sprite_cache[slot].encoded = encoded_copy;
+    terminal_sprite_cache[slot].encoded_length = encoded_length;
+    terminal_sprite_cache[slot].last_used = ++terminal_sprite_cache_clock;
+    terminal_sprite_cache_count++;
+    terminal_sprite_cache_bytes += bytes;
+    return 0;
+}
+
+static void terminal_sprite_cache_remove(uint64_t id) {
+    size_t slot = terminal_sprite_cache_home(id);
+    while (terminal_sprite_cache[slot].rgba && terminal_sprite_cache[slot].id != id) {
+        slot = (slot + 1u) & (TERMINAL_SPRITE_CACHE_SLOTS - 1u);
+    }
+    if (!terminal_sprite_cache[slot].rgba) {
+        return;
+    }
+    struct terminal_sprite_cache_entry *entry = &terminal_sprite_cache[slot];
+    terminal_sprite_cache_bytes -= terminal_sprite_cache_entry_bytes(entry);
+    terminal_sprite_cache_count--;
+    free(entry->rgba);
+    free(entry->encoded);
+    entry->rgba = NULL;
+    entry->encoded = NULL;
+
+    /* Shift later members of the probe chain back so lookups never stop
+     * early at the hole. */
+    size_t hole = slot;
+    size_t next = (slot + 1u) & (TERMINAL_SPRITE_CACHE_SLOTS - 1u);
+    while (terminal_sprite_cache[next].rgba) {
+        size_t home = terminal_sprite_cache_home(terminal_sprite_cache[next].id);
+        size_t distance_next = (next - home) & (TERMINAL_SPRITE_CACHE_SLOTS - 1u);
+        size_t distance_hole = (hole - home) & (TERMINAL_SPRITE_CACHE_SLOTS - 1u);
+        if (distance_hole <= distance_next) {
+            terminal_sprite_cache[hole] = terminal_sprite_cache[next];
+            terminal_sprite_cache[next].rgba = NULL;
+            terminal_sprite_cache[next].encoded = NULL;
+            hole = next;
+        }
+        next = (next + 1u) & (TERMINAL_SPRITE_CACHE_SLOTS - 1u);
+    }
+}
+
+static void terminal_sprite_cache_clear(void) {
+    for (size_t slot = 0u; slot < TERMINAL_SPRITE_CACHE_SLOTS; slot++) {
+        free(terminal_sprite_cache[slot].rgba);
+        free(terminal_sprite_cache[slot].encoded);
+        terminal_sprite_cache[slot].rgba = NULL;
+        terminal_sprite_cache[slot].encoded = NULL;
+    }
+    terminal_sprite_cache_count = 0u;
+    terminal_sprite_cache_bytes = 0u;
+}
+
 static int terminal_utf8_next(const uint8_t *data, size_t length, size_t *offset, uint32_t *out_codepoint) {
     if (!data || !offset || !out_codepoint || *offset >= length) {
         return -1;
@@ -5967,6 +9431,14 @@ static void terminal_handle_osc_777(struct terminal_buffer *buffer, const char *
     int overlay_toggle_requested = 0;
     int overlay_enable_requested = 1;
     int overlay_query_requested = 0;
+    int perf_toggle_requested = 0;
+    int perf_enable_requested = 0;
+    int perf_dump_requested = 0;
+    const char *perf_file_value = NULL;
+    int tabs_query_requested = 0;
+    const char *search_query_value = NULL;
+    long layer_map_requested = 0;
+    long layer_unmap_requested = 0;
 
     if (args && args[0] != '\0') {
         char *copy = strdup(args);
@@ -5995,7 +9467,9 @@ static void terminal_handle_osc_777(struct terminal_buffer *buffer, const char *
             enum terminal_sprite_action {
                 TERMINAL_SPRITE_ACTION_NONE = 0,
                 TERMINAL_SPRITE_ACTION_DRAW = 1,
-                TERMINAL_SPRITE_ACTION_CLEAR = 2
+                TERMINAL_SPRITE_ACTION_CLEAR = 2,
+                TERMINAL_SPRITE_ACTION_UPLOAD = 3,
+                TERMINAL_SPRITE_ACTION_FORGET = 4
             };
             enum terminal_sprite_action sprite_action = TERMINAL_SPRITE_ACTION_NONE;
             enum terminal_text_action {
@@ -6021,9 +9495,10 @@ static void terminal_handle_osc_777(struct terminal_buffer *buffer, const char *
             long text_layer = 1;
             long text_color = -1;
             char *sprite_data_value = NULL;
+            char *sprite_id_value = NULL;
+            int sprite_reply = 0;
             char *text_data_value = NULL;
             uint8_t *sprite_pixels = NULL;
-            size_t sprite_bytes = 0u;
             uint8_t *text_bytes = NULL;
             size_t text_length = 0u;
             while (token) {
@@ -6173,6 +9648,34 @@ static void terminal_handle_osc_777(struct terminal_buffer *buffer, const char *
                         } else if (strcmp(value, "query") == 0) {
                             overlay_query_requested = 1;
                         }
+                    } else if (strcmp(key, "perf") == 0 && value && *value != '\0') {
+                        if (strcmp(value, "enable") == 0) {
+                            perf_toggle_requested = 1;
+                            perf_enable_requested = 1;
+                        } else if (strcmp(value, "disable") == 0) {
+                            perf_toggle_requested = 1;
+                            perf_enable_requested = 0;
+                        } else if (strcmp(value, "dump") == 0) {
+                            perf_dump_requested = 1;
+                        }
+                    } else if (strcmp(key, "perf_file") == 0 && value && *value != '\0') {
+                        perf_file_value = value;
+                    } else if (strcmp(key, "tabs") == 0 && value && strcmp(value, "query") == 0) {
+                        tabs_query_requested = 1;
+                    } else if ((strcmp(key, "layer_map") == 0 || strcmp(key, "layer_unmap") == 0) &&
+                               value && *value != '\0') {
+                        char *endptr = NULL;
+                        errno = 0;
+                        long parsed = strtol(value, &endptr, 10);
+                        if (errno == 0 && endptr && *endptr == '\0' && parsed >= 1 && parsed <= 16) {
+                            if (strcmp(key, "layer_map") == 0) {
+                                layer_map_requested = parsed;
+                            } else {
+                                layer_unmap_requested = parsed;
+                            }
+                        }
+                    } else if (strcmp(key, "search") == 0 && value) {
+                        search_query_value = value;
 #if BUDOSTACK_HAVE_SDL2
                     } else if (strcmp(key, "sound") == 0 && value && *value != '\0') {
                         sound_action = value;
@@ -6283,6 +9786,10 @@ static void terminal_handle_osc_777(struct terminal_buffer *buffer, const char *
                             sprite_action = TERMINAL_SPRITE_ACTION_DRAW;
                         } else if (strcmp(value, "clear") == 0) {
                             sprite_action = TERMINAL_SPRITE_ACTION_CLEAR;
+                        } else if (strcmp(value, "upload") == 0) {
+                            sprite_action = TERMINAL_SPRITE_ACTION_UPLOAD;
+                        } else if (strcmp(value, "forget") == 0) {
+                            sprite_action = TERMINAL_SPRITE_ACTION_FORGET;
                         }
                     } else if (strcmp(key, "sprite_x") == 0 && value && *value != '\0') {
                         char *endptr = NULL;
@@ -6321,6 +9828,10 @@ static void terminal_handle_osc_777(struct terminal_buffer *buffer, const char *
                         }
                     } else if (strcmp(key, "sprite_data") == 0 && value) {
                         sprite_data_value = value;
+                    } else if (strcmp(key, "sprite_id") == 0 && value && *value != '\0') {
+                        sprite_id_value = value;
+                    } else if (strcmp(key, "sprite_reply") == 0 && value) {
+                        sprite_reply = strcmp(value, "1") == 0;
                     } else if (strcmp(key, "text") == 0 && value && *value != '\0') {
                         if (strcmp(value, "draw") == 0) {
                             text_action = TERMINAL_TEXT_ACTION_DRAW;
@@ -6387,6 +9898,16 @@ static void terminal_handle_osc_777(struct terminal_buffer *buffer, const char *
                     } else {
                         fprintf(stderr, "terminal: Sound stop requires a valid channel.\n");
                     }
+                } else if (strcmp(sound_action, "stats") == 0) {
+                    terminal_sound_report_stats();
+                } else if (strcmp(sound_action, "preload") == 0) {
+                    if (sound_path && sound_path[0] != '\0') {
+                        if (terminal_sound_preload(sound_path) != 0) {
+                            fprintf(stderr, "terminal: Failed to preload sound '%s'.\n", sound_path);
+                        }
+                    } else {
+                        fprintf(stderr, "terminal: Sound preload requires a path.\n");
+                    }
                 }
             }
 
@@ -6419,38 +9940,100 @@ static void terminal_handle_osc_777(struct terminal_buffer *buffer, const char *
             }
 #endif
 
-            if (sprite_action == TERMINAL_SPRITE_ACTION_DRAW) {
-                if (sprite_x < 0 || sprite_y < 0 || sprite_w <= 0 || sprite_h <= 0 ||
-                    sprite_x > INT_MAX || sprite_y > INT_MAX || sprite_w > INT_MAX || sprite_h > INT_MAX) {
-                    fprintf(stderr, "terminal: Invalid sprite parameters.\n");
-                } else if (!sprite_data_value) {
-                    fprintf(stderr, "terminal: Missing sprite data.\n");
-                } else if (terminal_base64_decode(sprite_data_value, &sprite_pixels, &sprite_bytes) != 0) {
-                    fprintf(stderr, "terminal: Failed to decode sprite data.\n");
+            uint64_t sprite_id = 0u;
+            int sprite_id_valid = 0;
+            if (sprite_id_value) {
+                if (terminal_sprite_parse_id(sprite_id_value, &sprite_id) == 0) {
+                    sprite_id_valid = 1;
                 } else {
-                    size_t width_sz = (size_t)sprite_w;
-                    size_t height_sz = (size_t)sprite_h;
-                    if (width_sz != 0u && height_sz > SIZE_MAX / width_sz) {
-                        fprintf(stderr, "terminal: Sprite dimensions overflow.\n");
+                    fprintf(stderr, "terminal: Invalid sprite id.\n");
+                }
+            }
+
+            if ((sprite_action == TERMINAL_SPRITE_ACTION_DRAW || sprite_action == TERMINAL_SPRITE_ACTION_UPLOAD) &&
+                (!sprite_id_value || sprite_id_valid)) {
+                /* A cached ID skips the decode entirely; on a miss the
+                 * attached data is decoded, checked against the ID and kept.
+                 * Attached data that differs from the cached text replaces
+                 * the entry instead of being drawn from it. */
+                const struct terminal_sprite_cache_entry *cached = sprite_id_valid ? terminal_sprite_cache_find(sprite_id) : NULL;
+                int replace = 0;
+                if (cached && sprite_data_value &&
+                    !terminal_sprite_cache_matches(cached, sprite_w, sprite_h, sprite_data_value)) {
+                    cached = NULL;
+                    replace = 1;
+                }
+                const uint8_t *source = NULL;
+                int source_w = 0;
+                int source_h = 0;
+                const char *sprite_status = "error";
+                int sprite_stored = 0;
+                if (cached) {
+                    source = cached->rgba;
+                    source_w = cached->width;
+                    source_h = cached->height;
+                    sprite_stored = 1;
+                } else if (!sprite_data_value) {
+                    if (sprite_id_valid) {
+                        fprintf(stderr, "terminal: Unknown sprite id.\n");
+                        sprite_status = "missing";
                     } else {
-                        size_t expected_pixels = width_sz * height_sz;
-                        if (expected_pixels > SIZE_MAX / 4u) {
-                            fprintf(stderr, "terminal: Sprite dimensions too large.\n");
+                        fprintf(stderr, "terminal: Missing sprite data.\n");
+                    }
+                } else if (sprite_id_valid && terminal_sprite_content_id(sprite_w, sprite_h, sprite_data_value) != sprite_id) {
+                    fprintf(stderr, "terminal: Sprite id does not match sprite data.\n");
+                } else if (terminal_sprite_decode(sprite_data_value, sprite_w, sprite_h, &sprite_pixels) == 0) {
+                    source = sprite_pixels;
+                    source_w = (int)sprite_w;
+                    source_h = (int)sprite_h;
+                    if (sprite_id_valid) {
+                        if (replace) {
+                            terminal_sprite_cache_remove(sprite_id);
+                        }
+                        if (terminal_sprite_cache_store(sprite_id, source_w, source_h, sprite_pixels, sprite_data_value) == 0) {
+                            sprite_pixels = NULL;
+                            sprite_stored = 1;
                         } else {
-                            size_t expected_bytes = expected_pixels * 4u;
-                            if (expected_bytes != sprite_bytes) {
-                                fprintf(stderr, "terminal: Sprite data size mismatch.\n");
-                            } else if (terminal_custom_pixels_draw_sprite((int)sprite_x,
-                                                                           (int)sprite_y,
-                                                                           sprite_pixels,
-                                                                           (int)sprite_w,
-                                                                           (int)sprite_h,
-                                                                           (uint8_t)sprite_layer) != 0) {
-                                fprintf(stderr, "terminal: Failed to draw sprite.\n");
-                            }
+                            fprintf(stderr, "terminal: Failed to store sprite %016llx in the sprite cache.\n",
+                                    (unsigned long long)sprite_id);
                         }
                     }
                 }
+
+                if (source && sprite_action == TERMINAL_SPRITE_ACTION_DRAW) {
+                    if (sprite_x < 0 || sprite_y < 0 || sprite_x > INT_MAX || sprite_y > INT_MAX) {
+                        fprintf(stderr, "terminal: Invalid sprite parameters.\n");
+                    } else if (terminal_custom_pixels_draw_sprite((int)sprite_x,
+                                                                  (int)sprite_y,
+                                                                  source,
+                                                                  source_w,
+                                                                  source_h,
+                                                                  (uint8_t)sprite_layer) != 0) {
+                        fprintf(stderr, "terminal: Failed to draw sprite.\n");
+                    } else {
+                        sprite_status = "drawn";
+                    }
+                } else if (sprite_stored && sprite_action == TERMINAL_SPRITE_ACTION_UPLOAD) {
+                    sprite_status = "stored";
+                }
+
+                /* Only requests that ask for it get an answer, so plain
+                 * draws never leave stray input on the PTY. A "missing"
+                 * reply tells the client to upload the sprite again; an
+                 * upload answers "stored" or "error". */
+                if (sprite_reply) {
+                    char response[48];
+                    int written = snprintf(response, sizeof(response), "_TERM_SPRITE %s\n", sprite_status);
+                    if (written > 0 && (size_t)written < sizeof(response)) {
+                        terminal_send_response(response);
+                    }
+                }
+            } else if (sprite_action == TERMINAL_SPRITE_ACTION_FORGET) {
+                if (!sprite_id_value) {
+                    terminal_sprite_cache_clear();
+                } else if (sprite_id_valid) {
+                    terminal_sprite_cache_remove(sprite_id);
+                }
             } else if (sprite_action == TERMINAL_SPRITE_ACTION_CLEAR) {
                 if (sprite_x < 0 || sprite_y < 0 || sprite_w <= 0 || sprite_h <= 0 ||
                     sprite_x > INT_MAX || sprite_y > INT_MAX || sprite_w > INT_MAX || sprite_h > INT_MAX) {
@@ -6574,28 +10157,16 @@ static void terminal_handle_osc_777(struct terminal_buffer *buffer, const char *
             } else if (pixel_action == TERMINAL_PIXEL_ACTION_CLEAR) {
                 terminal_custom_pixels_clear();
             } else if (pixel_action == TERMINAL_PIXEL_ACTION_RENDER) {
-                int modified = 0;
                 if (pixel_layer == 0) {
-                    modified = terminal_custom_pixels_apply_pending_clears(0u);
-                    if (terminal_custom_pixels_pending_layers != 0u) {
-                        terminal_custom_pixels_pending_layers = 0u;
-                        terminal_custom_pixels_active = (terminal_custom_pixel_count > 0u);
-                        terminal_custom_pixels_dirty = 1;
-                    } else if (modified) {
-                        terminal_custom_pixels_active = (terminal_custom_pixel_count > 0u);
-                        terminal_custom_pixels_dirty = 1;
+                    for (uint8_t layer = 1u; layer <= TERMINAL_CUSTOM_LAYER_COUNT; layer++) {
+                        terminal_shared_layer_sync(layer, 0, 0, 0, 0);
                     }
+                    terminal_custom_pixels_commit(0xFFFFu);
                 } else if (pixel_layer >= 1 && pixel_layer <= 16) {
-                    modified = terminal_custom_pixels_apply_pending_clears((uint8_t)pixel_layer);
-                    uint16_t layer_mask = terminal_custom_layer_mask((uint8_t)pixel_layer);
-                    if ((terminal_custom_pixels_pending_layers & layer_mask) != 0u) {
-                        terminal_custom_pixels_pending_layers &= (uint16_t)(~layer_mask);
-                        terminal_custom_pixels_active = (terminal_custom_pixel_count > 0u);
-                        terminal_custom_pixels_dirty = 1;
-                    } else if (modified) {
-                        terminal_custom_pixels_active = (terminal_custom_pixel_count > 0u);
-                        terminal_custom_pixels_dirty = 1;
+                    if (terminal_shared_layer_sync((uint8_t)pixel_layer, pixel_x, pixel_y, pixel_w, pixel_h) != 0) {
+                        fprintf(stderr, "terminal: Failed to sync shared layer.\n");
                     }
+                    terminal_custom_pixels_commit(terminal_custom_layer_mask((uint8_t)pixel_layer));
                 }
             }
 
@@ -6632,6 +10203,79 @@ static void terminal_handle_osc_777(struct terminal_buffer *buffer, const char *
                 }
             }
 
+            if (perf_dump_requested) {
+                char dump_path[PATH_MAX];
+                long frames = terminal_perf_dump_csv(perf_file_value, dump_path, sizeof(dump_path));
+                char response[PATH_MAX + 48];
+                int written = frames >= 0
+                    ? snprintf(response, sizeof(response), "_TERM_PERF %ld %s\n", frames, dump_path)
+                    : snprintf(response, sizeof(response), "_TERM_PERF error\n");
+                if (written > 0 && (size_t)written < sizeof(response)) {
+                    terminal_send_response(response);
+                }
+            }
+
+            if (perf_toggle_requested) {
+                terminal_perf_set_enabled(perf_enable_requested);
+                terminal_mark_full_redraw();
+            }
+
+            if (tabs_query_requested) {
+                terminal_tab_stats_report();
+            }
+
+            if (layer_unmap_requested > 0) {
+                terminal_shared_layer_release((uint8_t)layer_unmap_requested);
+            }
+
+            if (layer_map_requested > 0) {
+                char response[128];
+                int written;
+                if (terminal_shared_layer_map((uint8_t)layer_map_requested,
+                                              terminal_logical_width,
+                                              terminal_logical_height) == 0) {
+                    const struct terminal_shared_layer *shared = &terminal_shared_layers[layer_map_requested - 1];
+                    written = snprintf(response,
+                                       sizeof(response),
+                                       "_TERM_LAYER %s %d %d\n",
+                                       shared->name,
+                                       shared->width,
+                                       shared->height);
+                } else {
+                    written = snprintf(response, sizeof(response), "_TERM_LAYER none\n");
+                }
+                if (written > 0 && (size_t)written < sizeof(response)) {
+                    terminal_send_response(response);
+                }
+            }
+
+            if (search_query_value) {
+                if (terminal_search_active && terminal_search_buffer != buffer) {
+                    terminal_search_end(terminal_search_buffer);
+                }
+                if (!terminal_search_active) {
+                    terminal_search_begin(buffer);
+                }
+                if (terminal_search_set_query(search_query_value, strlen(search_query_value)) == 0) {
+                    terminal_search_update(buffer, 0);
+                }
+                char response[160];
+                int written = 0;
+                if (terminal_search_regex_error != 0) {
+                    char message[128];
+                    regerror(terminal_search_regex_error, &terminal_search_regex, message, sizeof(message));
+                    written = snprintf(response, sizeof(response), "_TERM_SEARCH error: %s\n", message);
+                } else {
+                    written = snprintf(response,
+                                       sizeof(response),
+                                       "_TERM_SEARCH %zu\n",
+                                       terminal_search_match_count);
+                }
+                if (written > 0 && (size_t)written < sizeof(response)) {
+                    terminal_send_response(response);
+                }
+            }
+
             free(copy);
         }
 
@@ -6668,6 +10312,63 @@ static void terminal_handle_osc_777(struct terminal_buffer *buffer, const char *
     }
 }
 
+/* OSC 777 from a tab that is not on screen. Pixel layers, sprites, sound,
+ * shaders and the window are shared by every tab, so nothing a hidden tab
+ * asks for takes effect. Requests that wait for an answer still get one on
+ * that tab's PTY: read-only queries are answered as usual, the rest report
+ * that they were not carried out. */
+static void terminal_handle_osc_777_hidden(const char *args) {
+    if (!args || args[0] == '\0') {
+        return;
+    }
+    char *copy = strdup(args);
+    if (!copy) {
+        return;
+    }
+    int sprite_request = 0;
+    int sprite_reply = 0;
+    char *saveptr = NULL;
+    for (char *token = strtok_r(copy, ";", &saveptr); token; token = strtok_r(NULL, ";", &saveptr)) {
+        char *value = strchr(token, '=');
+        if (!value) {
+            continue;
+        }
+        *value++ = '\0';
+        const char *key = token;
+        char response[96];
+        int written = 0;
+        if (strcmp(key, "tabs") == 0 && strcmp(value, "query") == 0) {
+            terminal_tab_stats_report();
+        } else if (strcmp(key, "overlay") == 0 && strcmp(value, "query") == 0) {
+            written = snprintf(response, sizeof(response), "_TERM_OVERLAY %d\n", terminal_overlay_enabled);
+        } else if (strcmp(key, "mouse") == 0 && strcmp(value, "query") == 0) {
+            /* Clicks belong to the visible tab; leave them to be collected there. */
+            written = snprintf(response, sizeof(response), "_TERM_MOUSE %d %d 0 0\n", terminal_mouse_x, terminal_mouse_y);
+        } else if (strcmp(key, "perf") == 0 && strcmp(value, "dump") == 0) {
+            written = snprintf(response, sizeof(response), "_TERM_PERF error\n");
+        } else if (strcmp(key, "layer_map") == 0) {
+            written = snprintf(response, sizeof(response), "_TERM_LAYER none\n");
+        } else if (strcmp(key, "search") == 0) {
+            written = snprintf(response, sizeof(response), "_TERM_SEARCH error: tab is not visible\n");
+#if BUDOSTACK_HAVE_SDL2
+        } else if (strcmp(key, "sound") == 0 && strcmp(value, "stats") == 0) {
+            terminal_sound_report_stats();
+#endif
+        } else if (strcmp(key, "sprite") == 0) {
+            sprite_request = strcmp(value, "draw") == 0 || strcmp(value, "upload") == 0;
+        } else if (strcmp(key, "sprite_reply") == 0) {
+            sprite_reply = strcmp(value, "1") == 0;
+        }
+        if (written > 0 && (size_t)written < sizeof(response)) {
+            terminal_send_response(response);
+        }
+    }
+    if (sprite_request && sprite_reply) {
+        terminal_send_response("_TERM_SPRITE error\n");
+    }
+    free(copy);
+}
+
 static void ansi_handle_osc(struct ansi_parser *parser, struct terminal_buffer *buffer) {
     if (!parser || !buffer) {
         return;
@@ -6771,7 +10472,11 @@ static void ansi_handle_osc(struct ansi_parser *parser, struct terminal_buffer *
         break;
     }
     case 777:
-        terminal_handle_osc_777(buffer, args);
+        if (terminal_feeding_hidden_tab) {
+            terminal_handle_osc_777_hidden(args);
+        } else {
+            terminal_handle_osc_777(buffer, args);
+        }
         break;
     case 104: /* Reset palette */
         if (!args || args[0] == '\0') {
@@ -7287,6 +10992,60 @@ static void ansi_parser_feed(struct ansi_parser *parser, struct terminal_buffer
     }
 }
 
+/* Length of the leading run of bytes in 0x20..0x7E. Eight bytes are
+ * tested per step with word-wide bit tricks: a lane is flagged when it
+ * is below 0x20, equals 0x7F or has the high bit set. */
+static size_t ansi_printable_ascii_span(const unsigned char *data, size_t length) {
+    const uint64_t ones = UINT64_C(0x0101010101010101);
+    const uint64_t highs = UINT64_C(0x8080808080808080);
+    size_t offset = 0u;
+    while (length - offset >= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + offset, sizeof(word));
+        uint64_t below_space = (word - ones * 0x20u) & ~word & highs;
+        uint64_t del = word ^ (ones * 0x7Fu);
+        uint64_t is_del = (del - ones) & ~del & highs;
+        if ((below_space | is_del | (word & highs)) != 0u) {
+            break;
+        }
+        offset += sizeof(uint64_t);
+    }
+    while (offset < length && data[offset] >= 0x20u && data[offset] < 0x7Fu) {
+        offset++;
+    }
+    return offset;
+}
+
+/* Feeds a block of PTY output. Printable ASCII in the ground state skips
+ * the per-byte state machine and goes straight into the row; everything
+ * else, including DEC line drawing and partial UTF-8, takes the byte
+ * path. */
+static void ansi_parser_feed_bytes(struct ansi_parser *parser,
+                                   struct terminal_buffer *buffer,
+                                   const unsigned char *data,
+                                   size_t length) {
+    if (!parser || !data) {
+        return;
+    }
+
+    size_t i = 0u;
+    while (i < length) {
+        if (parser->state == ANSI_STATE_GROUND &&
+            parser->utf8_bytes_expected == 0u &&
+            buffer &&
+            (parser->charset_use_g1 ? parser->charset_g1 : parser->charset_g0) != '0') {
+            size_t run = ansi_printable_ascii_span(data + i, length - i);
+            if (run > 0u) {
+                terminal_put_ascii_run(buffer, data + i, run);
+                i += run;
+                continue;
+            }
+        }
+        ansi_parser_feed(parser, buffer, data[i]);
+        i++;
+    }
+}
+
 static int compute_root_directory(const char *argv0, char *out_path, size_t out_size) {
     if (!argv0 || !out_path || out_size == 0u) {
         return -1;
@@ -7684,96 +11443,668 @@ static int terminal_send_string(int fd, const char *str) {
     return terminal_send_bytes(fd, str, strlen(str));
 }
 
-static int terminal_mod_state_has_altgr(SDL_Keymod mod) {
-    if ((mod & KMOD_MODE) != 0) {
-        return 1;
-    }
+static int terminal_mod_state_has_altgr(SDL_Keymod mod) {
+    if ((mod & KMOD_MODE) != 0) {
+        return 1;
+    }
+
+    if ((mod & KMOD_RALT) != 0) {
+        SDL_Keymod ctrl_mask = (SDL_Keymod)(KMOD_LCTRL | KMOD_RCTRL);
+        if ((mod & ctrl_mask) != 0) {
+            return 1;
+        }
+        if ((mod & KMOD_LALT) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static SDL_Keymod terminal_normalize_modifiers(SDL_Keymod mod) {
+    if (terminal_mod_state_has_altgr(mod)) {
+        mod = (SDL_Keymod)(mod & ~(KMOD_CTRL | KMOD_ALT));
+    }
+    return mod;
+}
+
+static unsigned int terminal_modifier_param(SDL_Keymod mod) {
+    SDL_Keymod normalized = terminal_normalize_modifiers(mod);
+    unsigned int value = 1u;
+    if ((normalized & KMOD_SHIFT) != 0) {
+        value += 1u;
+    }
+    if ((normalized & KMOD_ALT) != 0) {
+        value += 2u;
+    }
+    if ((normalized & KMOD_CTRL) != 0) {
+        value += 4u;
+    }
+    return value;
+}
+
+static int terminal_send_csi_final(int fd, SDL_Keymod mod, char final_char) {
+    unsigned int modifier = terminal_modifier_param(mod);
+    char sequence[32];
+    if (modifier == 1u) {
+        sequence[0] = '\x1b';
+        sequence[1] = '[';
+        sequence[2] = final_char;
+        sequence[3] = '\0';
+    } else {
+        if (snprintf(sequence, sizeof(sequence), "\x1b[1;%u%c", modifier, final_char) < 0) {
+            return -1;
+        }
+    }
+    return terminal_send_string(fd, sequence);
+}
+
+static int terminal_send_csi_number(int fd, SDL_Keymod mod, unsigned int number) {
+    unsigned int modifier = terminal_modifier_param(mod);
+    char sequence[32];
+    if (modifier == 1u) {
+        if (snprintf(sequence, sizeof(sequence), "\x1b[%u~", number) < 0) {
+            return -1;
+        }
+    } else {
+        if (snprintf(sequence, sizeof(sequence), "\x1b[%u;%u~", number, modifier) < 0) {
+            return -1;
+        }
+    }
+    return terminal_send_string(fd, sequence);
+}
+
+static int terminal_send_ss3_final(int fd, SDL_Keymod mod, char final_char) {
+    unsigned int modifier = terminal_modifier_param(mod);
+    char sequence[32];
+    if (modifier == 1u) {
+        sequence[0] = '\x1b';
+        sequence[1] = 'O';
+        sequence[2] = final_char;
+        sequence[3] = '\0';
+    } else {
+        if (snprintf(sequence, sizeof(sequence), "\x1b[1;%u%c", modifier, final_char) < 0) {
+            return -1;
+        }
+    }
+    return terminal_send_string(fd, sequence);
+}
+
+static int terminal_send_escape_prefix(int fd) {
+    const unsigned char esc = 0x1Bu;
+    return terminal_send_bytes(fd, &esc, 1u);
+}
+
+static void terminal_tab_stats_record(size_t tab, size_t bytes) {
+    if (tab >= TERMINAL_TAB_COUNT) {
+        return;
+    }
+    terminal_tab_stats[tab].bytes_total += (uint64_t)bytes;
+    terminal_tab_stats[tab].window_bytes += (uint64_t)bytes;
+}
+
+static void terminal_tab_stats_tick(Uint32 now) {
+    for (size_t tab = 0u; tab < TERMINAL_TAB_COUNT; tab++) {
+        struct terminal_tab_stats *stats = &terminal_tab_stats[tab];
+        Uint32 elapsed = now - stats->window_start;
+        if (elapsed < 1000u) {
+            continue;
+        }
+        stats->bytes_per_second = stats->window_bytes * 1000u / (uint64_t)elapsed;
+        stats->window_bytes = 0u;
+        stats->window_start = now;
+    }
+}
+
+static void terminal_tab_stats_report(void) {
+    char response[256];
+    /* The loop may have slept through the last window; close it now. */
+    terminal_tab_stats_tick(SDL_GetTicks());
+    int written = snprintf(response, sizeof(response), "_TERM_TABS %zu", terminal_active_tab + 1u);
+    for (size_t tab = 0u; tab < TERMINAL_TAB_COUNT && written > 0 && (size_t)written < sizeof(response); tab++) {
+        written += snprintf(response + written,
+                            sizeof(response) - (size_t)written,
+                            " %llu/%llu",
+                            (unsigned long long)terminal_tab_stats[tab].bytes_per_second,
+                            (unsigned long long)terminal_tab_stats[tab].bytes_total);
+    }
+    if (written > 0 && (size_t)written + 1u < sizeof(response)) {
+        response[written++] = '\n';
+        response[written] = '\0';
+        terminal_send_response(response);
+    }
+}
+
+static size_t terminal_pty_ring_used(struct terminal_pty_ring *ring) {
+    unsigned int head = (unsigned int)SDL_AtomicGet(&ring->head);
+    unsigned int tail = (unsigned int)SDL_AtomicGet(&ring->tail);
+    return (size_t)((head - tail) & (TERMINAL_PTY_RING_WRAP - 1u));
+}
+
+/* Returns the contiguous run of unread bytes starting at the tail. */
+static size_t terminal_pty_ring_peek(struct terminal_pty_ring *ring, const unsigned char **data) {
+    size_t used = terminal_pty_ring_used(ring);
+    if (used == 0u) {
+        *data = NULL;
+        return 0u;
+    }
+    size_t offset = (size_t)SDL_AtomicGet(&ring->tail) & (TERMINAL_PTY_RING_SIZE - 1u);
+    size_t contiguous = TERMINAL_PTY_RING_SIZE - offset;
+    *data = ring->data + offset;
+    return used < contiguous ? used : contiguous;
+}
+
+static void terminal_pty_ring_consume(struct terminal_pty_ring *ring, size_t count) {
+    unsigned int tail = (unsigned int)SDL_AtomicGet(&ring->tail);
+    tail = (tail + (unsigned int)count) & (TERMINAL_PTY_RING_WRAP - 1u);
+    SDL_AtomicSet(&ring->tail, (int)tail);
+}
+
+/* The ring is drained once it is closed and empty. Check closed first:
+ * the reader publishes its last bytes before it flags the ring. */
+static int terminal_pty_ring_finished(struct terminal_pty_ring *ring) {
+    return SDL_AtomicGet(&ring->closed) && terminal_pty_ring_used(ring) == 0u;
+}
+
+/* One poll/read pass over every tab that still has room in its ring.
+ * A full ring is left out of the poll so the child blocks on its PTY
+ * instead of the terminal buffering without bound. */
+static int terminal_pty_reader_pump(int timeout_ms) {
+    struct pollfd polls[TERMINAL_TAB_COUNT + 1u];
+    int waiting = 0;
+    for (size_t tab = 0u; tab < TERMINAL_TAB_COUNT; tab++) {
+        struct terminal_pty_ring *ring = &terminal_pty_rings[tab];
+        polls[tab].fd = -1;
+        polls[tab].events = POLLIN;
+        polls[tab].revents = 0;
+        if (ring->fd < 0 || SDL_AtomicGet(&ring->closed)) {
+            continue;
+        }
+        if (terminal_pty_ring_used(ring) >= TERMINAL_PTY_RING_SIZE) {
+            waiting = 1;
+            continue;
+        }
+        polls[tab].fd = ring->fd;
+    }
+    polls[TERMINAL_TAB_COUNT].fd = terminal_pty_reader_wake_fds[0];
+    polls[TERMINAL_TAB_COUNT].events = POLLIN;
+    polls[TERMINAL_TAB_COUNT].revents = 0;
+    if (waiting && (timeout_ms < 0 || timeout_ms > 1)) {
+        timeout_ms = 1;
+    }
+
+    int ready = poll(polls, TERMINAL_TAB_COUNT + 1u, timeout_ms);
+    if (ready < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    if (polls[TERMINAL_TAB_COUNT].fd >= 0 && polls[TERMINAL_TAB_COUNT].revents != 0) {
+        return 0;
+    }
+    int woke = 0;
+    for (size_t tab = 0u; tab < TERMINAL_TAB_COUNT && ready > 0; tab++) {
+        if (polls[tab].fd < 0 || polls[tab].revents == 0) {
+            continue;
+        }
+        struct terminal_pty_ring *ring = &terminal_pty_rings[tab];
+        unsigned int head = (unsigned int)SDL_AtomicGet(&ring->head);
+        size_t offset = (size_t)head & (TERMINAL_PTY_RING_SIZE - 1u);
+        size_t space = TERMINAL_PTY_RING_SIZE - terminal_pty_ring_used(ring);
+        size_t contiguous = TERMINAL_PTY_RING_SIZE - offset;
+        if (space < contiguous) {
+            contiguous = space;
+        }
+        ssize_t count = read(ring->fd, ring->data + offset, contiguous);
+        if (count > 0) {
+            head = (head + (unsigned int)count) & (TERMINAL_PTY_RING_WRAP - 1u);
+            SDL_AtomicSet(&ring->head, (int)head);
+            woke = 1;
+        } else if (count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            SDL_AtomicSet(&ring->closed, 1);
+            woke = 1;
+        }
+    }
+    /* One wake event in flight at a time; the render loop clears the flag
+     * before it drains the rings. */
+    if (woke && terminal_pty_wake_event != (Uint32)-1 && SDL_AtomicCAS(&terminal_pty_wake_pending, 0, 1)) {
+        SDL_Event wake;
+        SDL_zero(wake);
+        wake.type = terminal_pty_wake_event;
+        if (SDL_PushEvent(&wake) < 1) {
+            SDL_AtomicSet(&terminal_pty_wake_pending, 0);
+        }
+    }
+    return 0;
+}
+
+static int SDLCALL terminal_pty_reader_main(void *userdata) {
+    (void)userdata;
+    int timeout_ms = terminal_pty_reader_wake_fds[0] >= 0 ? -1 : TERMINAL_PTY_POLL_TIMEOUT_MS;
+    while (!SDL_AtomicGet(&terminal_pty_reader_stop)) {
+        if (terminal_pty_reader_pump(timeout_ms) != 0) {
+            perror("terminal: poll");
+            for (size_t tab = 0u; tab < TERMINAL_TAB_COUNT; tab++) {
+                SDL_AtomicSet(&terminal_pty_rings[tab].closed, 1);
+            }
+            break;
+        }
+    }
+    return 0;
+}
+
+static void terminal_pty_reader_close_wake_fds(void) {
+    for (size_t i = 0u; i < 2u; i++) {
+        if (terminal_pty_reader_wake_fds[i] >= 0) {
+            close(terminal_pty_reader_wake_fds[i]);
+            terminal_pty_reader_wake_fds[i] = -1;
+        }
+    }
+}
+
+/* If the thread cannot be created the render loop pumps the rings itself,
+ * which keeps the old single-threaded behaviour. */
+static void terminal_pty_reader_start(const int *fds) {
+    for (size_t tab = 0u; tab < TERMINAL_TAB_COUNT; tab++) {
+        struct terminal_pty_ring *ring = &terminal_pty_rings[tab];
+        ring->data = terminal_pty_ring_storage[tab];
+        ring->fd = fds[tab];
+        SDL_AtomicSet(&ring->head, 0);
+        SDL_AtomicSet(&ring->tail, 0);
+        SDL_AtomicSet(&ring->closed, 0);
+    }
+    SDL_AtomicSet(&terminal_pty_reader_stop, 0);
+    if (pipe(terminal_pty_reader_wake_fds) == 0) {
+        fcntl(terminal_pty_reader_wake_fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(terminal_pty_reader_wake_fds[1], F_SETFD, FD_CLOEXEC);
+    } else {
+        /* Without the pipe the reader falls back to a timed poll. */
+        terminal_pty_reader_wake_fds[0] = -1;
+        terminal_pty_reader_wake_fds[1] = -1;
+    }
+    terminal_pty_reader_thread = SDL_CreateThread(terminal_pty_reader_main, "terminal-pty", NULL);
+    if (!terminal_pty_reader_thread) {
+        fprintf(stderr, "terminal: PTY reader thread unavailable (%s), reading on the render thread.\n", SDL_GetError());
+        terminal_pty_reader_close_wake_fds();
+    }
+}
+
+static void terminal_pty_reader_stop_thread(void) {
+    if (!terminal_pty_reader_thread) {
+        return;
+    }
+    SDL_AtomicSet(&terminal_pty_reader_stop, 1);
+    if (terminal_pty_reader_wake_fds[1] >= 0) {
+        const unsigned char wake = 1u;
+        (void)safe_write(terminal_pty_reader_wake_fds[1], &wake, 1u);
+    }
+    SDL_WaitThread(terminal_pty_reader_thread, NULL);
+    terminal_pty_reader_thread = NULL;
+    terminal_pty_reader_close_wake_fds();
+}
+
+/* Visible rows resolved before rasterising. History rows are expanded into
+ * their own staging rows: the buffer's history scratch row is reused by
+ * every lookup, so the bands could not share it. */
+static int terminal_raster_resolve_rows(const struct terminal_buffer *buffer, size_t top_index) {
+    size_t rows = buffer->rows;
+    size_t columns = buffer->columns;
+    if (rows > terminal_raster_row_capacity) {
+        const struct terminal_cell **new_rows = realloc(terminal_raster_row_cells, rows * sizeof(*new_rows));
+        if (!new_rows) {
+            return -1;
+        }
+        terminal_raster_row_cells = new_rows;
+        terminal_raster_row_capacity = rows;
+    }
+    size_t history_visible = 0u;
+    if (top_index < buffer->history_rows) {
+        history_visible = buffer->history_rows - top_index;
+        if (history_visible > rows) {
+            history_visible = rows;
+        }
+    }
+    if (history_visible > 0u) {
+        size_t cells = history_visible * columns;
+        if (cells > terminal_raster_history_capacity) {
+            struct terminal_cell *new_cells = realloc(terminal_raster_history_cells, cells * sizeof(*new_cells));
+            if (!new_cells) {
+                return -1;
+            }
+            terminal_raster_history_cells = new_cells;
+            terminal_raster_history_capacity = cells;
+        }
+    }
+    for (size_t row = 0u; row < rows; row++) {
+        size_t global_index = top_index + row;
+        if (row < history_visible) {
+            if (!buffer->history) {
+                terminal_raster_row_cells[row] = NULL;
+                continue;
+            }
+            struct terminal_cell *staged = terminal_raster_history_cells + row * columns;
+            size_t ring_index = (buffer->history_start + global_index) % buffer->history_capacity;
+            terminal_history_expand(buffer->history[ring_index], staged, columns);
+            terminal_raster_row_cells[row] = staged;
+        } else {
+            terminal_raster_row_cells[row] = terminal_buffer_row_at(buffer, global_index);
+        }
+    }
+    return 0;
+}
+
+/* Rasterises rows [row_begin, row_end) of the job and returns how many
+ * cells changed. A band only touches its own rows of terminal_render_cache,
+ * the framebuffer and job->damage, so bands run concurrently. Without a
+ * damage array (the serial pass) tiles are damaged directly and the glyph
+ * cache is filled; in a band the cache is only read. */
+static size_t terminal_raster_rows(const struct terminal_raster_job *job, size_t row_begin, size_t row_end) {
+    size_t redrawn = 0u;
+    size_t columns = job->columns;
+    size_t frame_pitch = (size_t)job->frame_width * 4u;
+    for (size_t row = row_begin; row < row_end; row++) {
+        size_t global_index = job->top_index + row;
+        const struct terminal_cell *row_cells = terminal_raster_row_cells[row];
+        if (!row_cells) {
+            continue;
+        }
+        int prompt_row = job->search_prompt && row + 1u == job->rows;
+        for (size_t col = 0u; col < columns; col++) {
+            const struct terminal_cell *cell = &row_cells[col];
+            uint32_t ch = cell->ch;
+            uint32_t fg = cell->fg;
+            uint32_t bg = cell->bg;
+            uint8_t style = cell->style;
+            if (prompt_row) {
+                ch = col < job->search_prompt_length ? job->search_prompt[col] : 0u;
+                fg = job->default_bg;
+                bg = job->default_fg;
+                style = 0u;
+            }
+            if ((style & TERMINAL_STYLE_REVERSE) != 0u) {
+                uint32_t tmp = fg;
+                fg = bg;
+                bg = tmp;
+            }
+            if ((style & TERMINAL_STYLE_BOLD) != 0u) {
+                fg = terminal_bold_variant(fg);
+            }
+
+            int cell_selected = !prompt_row && job->selection_has_range &&
+                terminal_selection_contains_cell(global_index, col, job->selection_start, job->selection_end, columns);
+            if (cell_selected) {
+                fg = job->default_bg;
+                bg = job->default_fg;
+            }
+
+            int is_cursor_cell = job->cursor_visible && !prompt_row &&
+                                 global_index == job->cursor_global_index &&
+                                 col == job->cursor_column;
+            uint32_t fill_color = bg;
+            uint32_t glyph_color = fg;
+            if (is_cursor_cell) {
+                fill_color = job->cursor_color;
+                glyph_color = bg;
+            }
+
+            int dest_x = job->margin + (int)(col * (size_t)job->glyph_width);
+            int dest_y = job->margin + (int)(row * (size_t)job->glyph_height);
+            int end_x = dest_x + job->glyph_width;
+            int end_y = dest_y + job->glyph_height;
+            if (dest_x < 0) {
+                dest_x = 0;
+            }
+            if (dest_y < 0) {
+                dest_y = 0;
+            }
+            if (end_x > job->frame_width) {
+                end_x = job->frame_width;
+            }
+            if (end_y > job->frame_height) {
+                end_y = job->frame_height;
+            }
+            if (dest_x >= end_x || dest_y >= end_y) {
+                continue;
+            }
+
+            size_t cache_index = row * columns + col;
+            if (cache_index >= terminal_render_cache_count) {
+                continue;
+            }
+            struct terminal_render_cache_entry *cache_entry = &terminal_render_cache[cache_index];
+            int needs_redraw = job->full_redraw;
+            if (!needs_redraw) {
+                if (cache_entry->ch != ch ||
+                    cache_entry->fg != glyph_color ||
+                    cache_entry->bg != fill_color ||
+                    cache_entry->style != style ||
+                    cache_entry->cursor != (uint8_t)is_cursor_cell ||
+                    cache_entry->selected != (uint8_t)cell_selected) {
+                    needs_redraw = 1;
+                }
+            }
+            if (!needs_redraw) {
+                continue;
+            }
+
+            cache_entry->ch = ch;
+            cache_entry->fg = glyph_color;
+            cache_entry->bg = fill_color;
+            cache_entry->style = style;
+            cache_entry->cursor = (uint8_t)is_cursor_cell;
+            cache_entry->selected = (uint8_t)cell_selected;
+            redrawn++;
 
-    if ((mod & KMOD_RALT) != 0) {
-        SDL_Keymod ctrl_mask = (SDL_Keymod)(KMOD_LCTRL | KMOD_RCTRL);
-        if ((mod & ctrl_mask) != 0) {
-            return 1;
-        }
-        if ((mod & KMOD_LALT) == 0) {
-            return 1;
+            if (terminal_gpu_text_active) {
+                terminal_gpu_text_set_cell(cache_index, ch, glyph_color, fill_color, style);
+                continue;
+            }
+
+            int cell_width = end_x - dest_x;
+            int cell_height = end_y - dest_y;
+            if (job->damage) {
+                job->damage[cache_index] = 1u;
+            } else {
+                terminal_frame_damage_rect(dest_x, dest_y, cell_width, cell_height, TERMINAL_FRAME_TILE_DIRTY);
+            }
+            uint32_t *cell_origin = (uint32_t *)(job->framebuffer +
+                                                 (size_t)dest_y * frame_pitch +
+                                                 (size_t)dest_x * 4u);
+            size_t frame_stride = (size_t)job->frame_width;
+            const uint32_t *cached_cell = NULL;
+            if (cell_width == job->glyph_width && cell_height == job->glyph_height) {
+                cached_cell = job->damage
+                    ? terminal_glyph_cache_peek(ch, glyph_color, fill_color, style, job->glyph_width, job->glyph_height)
+                    : terminal_glyph_cache_lookup(ch, glyph_color, fill_color, style, job->glyph_width, job->glyph_height);
+            }
+            if (cached_cell) {
+                size_t row_bytes = (size_t)cell_width * sizeof(uint32_t);
+                for (int py = 0; py < cell_height; py++) {
+                    memcpy(cell_origin + (size_t)py * frame_stride,
+                           cached_cell + (size_t)py * (size_t)cell_width,
+                           row_bytes);
+                }
+            } else {
+                terminal_render_glyph_cell(cell_origin,
+                                           frame_stride,
+                                           cell_width,
+                                           cell_height,
+                                           ch,
+                                           glyph_color,
+                                           fill_color,
+                                           style);
+            }
         }
     }
-
-    return 0;
+    return redrawn;
 }
 
-static SDL_Keymod terminal_normalize_modifiers(SDL_Keymod mod) {
-    if (terminal_mod_state_has_altgr(mod)) {
-        mod = (SDL_Keymod)(mod & ~(KMOD_CTRL | KMOD_ALT));
+static int SDLCALL terminal_raster_worker_main(void *userdata) {
+    struct terminal_raster_worker *worker = userdata;
+    for (;;) {
+        SDL_SemWait(worker->start);
+        if (SDL_AtomicGet(&terminal_raster_stopping)) {
+            break;
+        }
+        worker->redrawn = terminal_raster_rows(terminal_raster_current_job, worker->row_begin, worker->row_end);
+        SDL_SemPost(terminal_raster_done);
     }
-    return mod;
+    return 0;
 }
 
-static unsigned int terminal_modifier_param(SDL_Keymod mod) {
-    SDL_Keymod normalized = terminal_normalize_modifiers(mod);
-    unsigned int value = 1u;
-    if ((normalized & KMOD_SHIFT) != 0) {
-        value += 1u;
+/* One worker per spare core, capped. Without workers every frame takes
+ * the serial pass. */
+static void terminal_raster_pool_start(void) {
+    int cpus = SDL_GetCPUCount();
+    size_t wanted = cpus > 1 ? (size_t)(cpus - 1) : 0u;
+    if (wanted > TERMINAL_RASTER_MAX_WORKERS) {
+        wanted = TERMINAL_RASTER_MAX_WORKERS;
     }
-    if ((normalized & KMOD_ALT) != 0) {
-        value += 2u;
+    if (wanted == 0u) {
+        return;
     }
-    if ((normalized & KMOD_CTRL) != 0) {
-        value += 4u;
+    terminal_raster_done = SDL_CreateSemaphore(0u);
+    if (!terminal_raster_done) {
+        return;
     }
-    return value;
-}
-
-static int terminal_send_csi_final(int fd, SDL_Keymod mod, char final_char) {
-    unsigned int modifier = terminal_modifier_param(mod);
-    char sequence[32];
-    if (modifier == 1u) {
-        sequence[0] = '\x1b';
-        sequence[1] = '[';
-        sequence[2] = final_char;
-        sequence[3] = '\0';
-    } else {
-        if (snprintf(sequence, sizeof(sequence), "\x1b[1;%u%c", modifier, final_char) < 0) {
-            return -1;
+    SDL_AtomicSet(&terminal_raster_stopping, 0);
+    for (size_t i = 0u; i < wanted; i++) {
+        struct terminal_raster_worker *worker = &terminal_raster_workers[i];
+        worker->start = SDL_CreateSemaphore(0u);
+        if (!worker->start) {
+            break;
         }
-    }
-    return terminal_send_string(fd, sequence);
-}
-
-static int terminal_send_csi_number(int fd, SDL_Keymod mod, unsigned int number) {
-    unsigned int modifier = terminal_modifier_param(mod);
-    char sequence[32];
-    if (modifier == 1u) {
-        if (snprintf(sequence, sizeof(sequence), "\x1b[%u~", number) < 0) {
-            return -1;
+        worker->thread = SDL_CreateThread(terminal_raster_worker_main, "terminal-raster", worker);
+        if (!worker->thread) {
+            SDL_DestroySemaphore(worker->start);
+            worker->start = NULL;
+            break;
         }
-    } else {
-        if (snprintf(sequence, sizeof(sequence), "\x1b[%u;%u~", number, modifier) < 0) {
-            return -1;
+        terminal_raster_worker_count++;
+    }
+}
+
+static void terminal_raster_pool_stop(void) {
+    SDL_AtomicSet(&terminal_raster_stopping, 1);
+    for (size_t i = 0u; i < terminal_raster_worker_count; i++) {
+        struct terminal_raster_worker *worker = &terminal_raster_workers[i];
+        SDL_SemPost(worker->start);
+        SDL_WaitThread(worker->thread, NULL);
+        SDL_DestroySemaphore(worker->start);
+        worker->thread = NULL;
+        worker->start = NULL;
+    }
+    terminal_raster_worker_count = 0u;
+    if (terminal_raster_done) {
+        SDL_DestroySemaphore(terminal_raster_done);
+        terminal_raster_done = NULL;
+    }
+    free(terminal_raster_damage);
+    terminal_raster_damage = NULL;
+    terminal_raster_damage_capacity = 0u;
+    free(terminal_raster_row_cells);
+    terminal_raster_row_cells = NULL;
+    terminal_raster_row_capacity = 0u;
+    free(terminal_raster_history_cells);
+    terminal_raster_history_cells = NULL;
+    terminal_raster_history_capacity = 0u;
+}
+
+/* Full redraws of the CPU-rendered grid are split into row bands, one for
+ * the calling thread and one per worker. Cell damage is collected per cell
+ * and turned into tile damage afterwards, one rect per run of cells, so the
+ * shared tile map is only written here. Everything else runs serially. */
+static size_t terminal_raster_frame(struct terminal_raster_job *job) {
+    size_t bands = terminal_raster_worker_count + 1u;
+    if (!job->full_redraw || terminal_gpu_text_active || terminal_raster_worker_count == 0u ||
+        job->rows < bands * TERMINAL_RASTER_MIN_BAND_ROWS) {
+        job->damage = NULL;
+        return terminal_raster_rows(job, 0u, job->rows);
+    }
+
+    size_t cells = job->rows * job->columns;
+    if (cells > terminal_raster_damage_capacity) {
+        uint8_t *new_damage = calloc(cells, 1u);
+        if (!new_damage) {
+            job->damage = NULL;
+            return terminal_raster_rows(job, 0u, job->rows);
+        }
+        free(terminal_raster_damage);
+        terminal_raster_damage = new_damage;
+        terminal_raster_damage_capacity = cells;
+    }
+    job->damage = terminal_raster_damage;
+
+    terminal_raster_current_job = job;
+    for (size_t i = 0u; i < terminal_raster_worker_count; i++) {
+        struct terminal_raster_worker *worker = &terminal_raster_workers[i];
+        worker->row_begin = job->rows * (i + 1u) / bands;
+        worker->row_end = job->rows * (i + 2u) / bands;
+        worker->redrawn = 0u;
+        SDL_SemPost(worker->start);
+    }
+    size_t redrawn = terminal_raster_rows(job, 0u, job->rows / bands);
+    for (size_t i = 0u; i < terminal_raster_worker_count; i++) {
+        SDL_SemWait(terminal_raster_done);
+    }
+    for (size_t i = 0u; i < terminal_raster_worker_count; i++) {
+        redrawn += terminal_raster_workers[i].redrawn;
+    }
+    terminal_raster_current_job = NULL;
+
+    for (size_t row = 0u; row < job->rows; row++) {
+        uint8_t *flags = terminal_raster_damage + row * job->columns;
+        size_t col = 0u;
+        while (col < job->columns) {
+            if (!flags[col]) {
+                col++;
+                continue;
+            }
+            size_t run_start = col;
+            while (col < job->columns && flags[col]) {
+                flags[col] = 0u;
+                col++;
+            }
+            int x0 = job->margin + (int)(run_start * (size_t)job->glyph_width);
+            int y0 = job->margin + (int)(row * (size_t)job->glyph_height);
+            int x1 = job->margin + (int)(col * (size_t)job->glyph_width);
+            terminal_frame_damage_rect(x0, y0, x1 - x0, job->glyph_height, TERMINAL_FRAME_TILE_DIRTY);
         }
     }
-    return terminal_send_string(fd, sequence);
+    return redrawn;
 }
 
-static int terminal_send_ss3_final(int fd, SDL_Keymod mod, char final_char) {
-    unsigned int modifier = terminal_modifier_param(mod);
-    char sequence[32];
-    if (modifier == 1u) {
-        sequence[0] = '\x1b';
-        sequence[1] = 'O';
-        sequence[2] = final_char;
-        sequence[3] = '\0';
-    } else {
-        if (snprintf(sequence, sizeof(sequence), "\x1b[1;%u%c", modifier, final_char) < 0) {
-            return -1;
-        }
-    }
-    return terminal_send_string(fd, sequence);
-}
+/* Feeds bytes from a tab that is not on screen. The parser reaches the
+ * alternate screen and the PTY through globals, so point those at the
+ * background tab for the duration of the call. OSC 777 requests are routed
+ * to terminal_handle_osc_777_hidden() meanwhile. */
+static void terminal_feed_background_tab(struct ansi_parser *parser,
+                                         struct terminal_buffer *buffer,
+                                         struct terminal_buffer *alternate_buffer,
+                                         int *alternate_initialized,
+                                         int *using_alternate,
+                                         int fd,
+                                         const unsigned char *data,
+                                         size_t length) {
+    int saved_fd = terminal_master_fd_handle;
+    struct terminal_buffer *saved_alternate = terminal_alternate_buffer_handle;
+    int saved_initialized = terminal_alternate_initialized;
+    int saved_using = terminal_using_alternate;
 
-static int terminal_send_escape_prefix(int fd) {
-    const unsigned char esc = 0x1Bu;
-    return terminal_send_bytes(fd, &esc, 1u);
+    terminal_master_fd_handle = fd;
+    terminal_alternate_buffer_handle = alternate_buffer;
+    terminal_alternate_initialized = *alternate_initialized;
+    terminal_using_alternate = *using_alternate;
+    terminal_feeding_hidden_tab = 1;
+
+    ansi_parser_feed_bytes(parser, buffer, data, length);
+
+    terminal_feeding_hidden_tab = 0;
+
+    *alternate_initialized = terminal_alternate_initialized;
+    *using_alternate = terminal_using_alternate;
+    terminal_master_fd_handle = saved_fd;
+    terminal_alternate_buffer_handle = saved_alternate;
+    terminal_alternate_initialized = saved_initialized;
+    terminal_using_alternate = saved_using;
 }
 
 int main(int argc, char **argv) {
@@ -7829,6 +12160,46 @@ int main(int argc, char **argv) {
                 free(shader_args);
                 return EXIT_FAILURE;
             }
+        } else if (strcmp(arg, "--vsync") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing mode after %s.\n", arg);
+                terminal_print_usage(progname);
+                free(shader_args);
+                return EXIT_FAILURE;
+            }
+            const char *value = argv[++i];
+            if (terminal_parse_vsync_mode(value, &terminal_vsync_mode) != 0) {
+                fprintf(stderr, "Invalid --vsync mode '%s' (expected on, off or adaptive).\n", value);
+                free(shader_args);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(arg, "--fps-stats") == 0) {
+            terminal_frame_stats_enabled = 1;
+        } else if (strcmp(arg, "--perf-overlay") == 0) {
+            terminal_perf_set_enabled(1);
+        } else if (strcmp(arg, "--gpu-text") == 0) {
+            terminal_gpu_text_requested = 1;
+        } else if (strcmp(arg, "--scrollback") == 0 || strcmp(arg, "--scrollback-mb") == 0) {
+            int in_mb = strcmp(arg, "--scrollback-mb") == 0;
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing value after %s.\n", arg);
+                terminal_print_usage(progname);
+                free(shader_args);
+                return EXIT_FAILURE;
+            }
+            const char *value = argv[++i];
+            unsigned long max_value = in_mb ? TERMINAL_HISTORY_MAX_MB : TERMINAL_HISTORY_MAX_LINES;
+            size_t parsed = 0u;
+            if (terminal_parse_limit_value(value, max_value, &parsed) != 0) {
+                fprintf(stderr, "Invalid %s value '%s' (expected 0-%lu).\n", arg, value, max_value);
+                free(shader_args);
+                return EXIT_FAILURE;
+            }
+            if (in_mb) {
+                terminal_history_byte_limit = parsed * 1024u * 1024u;
+            } else {
+                terminal_history_line_limit = parsed;
+            }
         } else if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
             terminal_print_usage(progname);
             free(shader_args);
@@ -7848,6 +12219,10 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
+    if (build_path(terminal_perf_dump_dir, sizeof(terminal_perf_dump_dir), root_dir, "perf") != 0) {
+        terminal_perf_dump_dir[0] = '\0';
+    }
+
     char budostack_path[PATH_MAX];
     if (build_path(budostack_path, sizeof(budostack_path), root_dir, "budostack") != 0) {
         fprintf(stderr, "Failed to resolve budostack executable path.\n");
@@ -7958,9 +12333,11 @@ int main(int argc, char **argv) {
     struct ansi_parser tab_parsers[TERMINAL_TAB_COUNT];
     int tab_using_alternate[TERMINAL_TAB_COUNT];
     int tab_alternate_initialized[TERMINAL_TAB_COUNT];
+    int tab_closed[TERMINAL_TAB_COUNT];
     size_t active_tab_index = 0u;
     for (size_t tab_i = 0u; tab_i < TERMINAL_TAB_COUNT; tab_i++) {
         master_fds[tab_i] = -1;
+        tab_closed[tab_i] = 0;
         child_pids[tab_i] = -1;
         tab_using_alternate[tab_i] = 0;
         tab_alternate_initialized[tab_i] = 0;
@@ -8115,10 +12492,7 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
-    if (SDL_GL_SetSwapInterval(1) != 0) {
-        fprintf(stderr, "Warning: Unable to enable VSync: %s\n", SDL_GetError());
-    }
-    terminal_vsync_enabled = SDL_GL_GetSwapInterval() > 0 ? 1 : 0;
+    terminal_configure_frame_pacing(window);
 
     for (size_t i = 0; i < shader_path_count; i++) {
         if (terminal_initialize_gl_program(shader_paths[i].path) != 0) {
@@ -8141,6 +12515,10 @@ int main(int argc, char **argv) {
     free(shader_paths);
     shader_paths = NULL;
 
+    if (terminal_gpu_text_requested && terminal_gpu_text_init() != 0) {
+        fprintf(stderr, "terminal: GPU text rendering unavailable; using the CPU renderer.\n");
+    }
+
     glDisable(GL_DEPTH_TEST);
     glDisable(GL_CULL_FACE);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -8245,33 +12623,30 @@ int main(int argc, char **argv) {
     }
     terminal_shader_last_frame_tick = SDL_GetTicks();
 
-    if (terminal_vsync_enabled) {
-        terminal_render_frame_interval_ms = 0u;
-    } else if (terminal_runtime_target_fps > 0u) {
-        terminal_render_frame_interval_ms = 1000u / (Uint32)terminal_runtime_target_fps;
-        if (terminal_render_frame_interval_ms == 0u) {
-            terminal_render_frame_interval_ms = 1u;
-        }
-    } else {
-        terminal_render_frame_interval_ms = 0u;
-    }
-    terminal_render_last_frame_tick = SDL_GetTicks();
-
     int status = 0;
     int child_exited = 0;
-    unsigned char input_buffer[4096];
     int running = 1;
     const Uint32 cursor_blink_interval = TERMINAL_CURSOR_BLINK_INTERVAL;
     Uint32 cursor_last_toggle = SDL_GetTicks();
     int cursor_phase_visible = 1;
     int suppress_textinput_once = 0;
 
+    terminal_pty_wake_event = SDL_RegisterEvents(1);
+    SDL_AtomicSet(&terminal_pty_wake_pending, 0);
+    terminal_pty_reader_start(master_fds);
+    terminal_raster_pool_start();
+
     while (running) {
+        /* Wait out the frame deadline before sampling input and output,
+         * so what gets drawn is as fresh as the pacing allows. */
+        terminal_frame_pacing_wait();
         terminal_selection_validate(buffer);
         SDL_Event event;
         while (SDL_PollEvent(&event)) {
             if (event.type == SDL_QUIT) {
                 running = 0;
+            } else if (event.type == terminal_pty_wake_event) {
+                SDL_AtomicSet(&terminal_pty_wake_pending, 0);
             } else if (event.type == SDL_WINDOWEVENT &&
                        (event.window.event == SDL_WINDOWEVENT_RESIZED ||
                         event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)) {
@@ -8583,9 +12958,13 @@ int main(int argc, char **argv) {
                     (mod & KMOD_GUI) == 0 && sym >= SDLK_1 && sym <= SDLK_5) {
                     size_t next_tab_index = (size_t)(sym - SDLK_1);
                     if (next_tab_index < TERMINAL_TAB_COUNT && next_tab_index != active_tab_index) {
+                        if (terminal_search_active) {
+                            terminal_search_end(buffer);
+                        }
                         tab_alternate_initialized[active_tab_index] = terminal_alternate_initialized;
                         tab_using_alternate[active_tab_index] = terminal_using_alternate;
                         active_tab_index = next_tab_index;
+                        terminal_active_tab = active_tab_index;
                         master_fd = master_fds[active_tab_index];
                         child_pid = child_pids[active_tab_index];
                         buffer = &tab_buffers[active_tab_index];
@@ -8602,6 +12981,49 @@ int main(int argc, char **argv) {
                     continue;
                 }
 
+                if ((mod & KMOD_CTRL) != 0 && (mod & KMOD_SHIFT) != 0 &&
+                    (mod & (KMOD_ALT | KMOD_GUI)) == 0 && sym == SDLK_f) {
+                    if (terminal_search_active) {
+                        terminal_search_end(buffer);
+                    } else {
+                        terminal_search_begin(buffer);
+                    }
+                    continue;
+                }
+                /* Search mode takes the keyboard until Escape: typed text
+                 * refines the query, Enter/Up step to older hits and
+                 * Shift+Enter/Down to newer ones. */
+                if (terminal_search_active) {
+                    switch (sym) {
+                    case SDLK_ESCAPE:
+                        terminal_search_end(buffer);
+                        break;
+                    case SDLK_RETURN:
+                    case SDLK_KP_ENTER:
+                        terminal_search_step(buffer, (mod & KMOD_SHIFT) != 0 ? 1 : -1);
+                        break;
+                    case SDLK_UP:
+                        terminal_search_step(buffer, -1);
+                        break;
+                    case SDLK_DOWN:
+                        terminal_search_step(buffer, 1);
+                        break;
+                    case SDLK_BACKSPACE:
+                        if (terminal_search_query_length > 0u) {
+                            do {
+                                terminal_search_query_length--;
+                            } while (terminal_search_query_length > 0u &&
+                                     ((unsigned char)terminal_search_query[terminal_search_query_length] & 0xC0u) == 0x80u);
+                            terminal_search_query[terminal_search_query_length] = '\0';
+                            terminal_search_update(buffer, 0);
+                        }
+                        break;
+                    default:
+                        break;
+                    }
+                    continue;
+                }
+
                 int clipboard_handled = 0;
                 if ((mod & KMOD_CTRL) != 0 && (mod & KMOD_ALT) == 0 && (mod & KMOD_GUI) == 0) {
                     if (sym == SDLK_c) {
@@ -8991,6 +13413,15 @@ int main(int argc, char **argv) {
                 terminal_input_draw_requested = 1;
                 const char *text = event.text.text;
                 size_t len = strlen(text);
+                if (terminal_search_active) {
+                    if (len > 0u && terminal_search_query_length + len < TERMINAL_SEARCH_QUERY_MAX) {
+                        memcpy(terminal_search_query + terminal_search_query_length, text, len);
+                        terminal_search_query_length += len;
+                        terminal_search_query[terminal_search_query_length] = '\0';
+                        terminal_search_update(buffer, 1);
+                    }
+                    continue;
+                }
                 if (len > 0u) {
                     SDL_Keymod raw_mod_state = SDL_GetModState();
                     SDL_Keymod mod_state = terminal_normalize_modifiers(raw_mod_state);
@@ -9011,20 +13442,79 @@ int main(int argc, char **argv) {
             }
         }
 
-        ssize_t bytes_read;
-        do {
-            bytes_read = read(master_fds[active_tab_index], input_buffer, sizeof(input_buffer));
-            if (bytes_read > 0) {
-                for (ssize_t i = 0; i < bytes_read; i++) {
-                    ansi_parser_feed(parser, buffer, input_buffer[i]);
-                }
-                cursor_phase_visible = 1;
-                cursor_last_toggle = SDL_GetTicks();
-            } else if (bytes_read < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
-                running = 0;
+        if (!terminal_pty_reader_thread && terminal_pty_reader_pump(0) != 0) {
+            perror("terminal: poll");
+            running = 0;
+        }
+
+        /* Parse whatever the reader thread has queued for the visible tab,
+         * but stop once the frame budget is spent so input and rendering
+         * keep their pace during an output flood. Whatever is left is
+         * picked up next frame; intermediate screen states in between are
+         * never drawn. */
+        struct terminal_pty_ring *active_ring = &terminal_pty_rings[active_tab_index];
+        Uint64 perf_parse_start = terminal_perf_stage_begin();
+        Uint32 parse_start = SDL_GetTicks();
+        const unsigned char *pending = NULL;
+        size_t pending_length = 0u;
+        while ((pending_length = terminal_pty_ring_peek(active_ring, &pending)) > 0u) {
+            if (pending_length > TERMINAL_PTY_FEED_CHUNK) {
+                pending_length = TERMINAL_PTY_FEED_CHUNK;
+            }
+            ansi_parser_feed_bytes(parser, buffer, pending, pending_length);
+            terminal_pty_ring_consume(active_ring, pending_length);
+            terminal_tab_stats_record(active_tab_index, pending_length);
+            terminal_perf_current.bytes_parsed += pending_length;
+            cursor_phase_visible = 1;
+            cursor_last_toggle = SDL_GetTicks();
+            if ((Uint32)(SDL_GetTicks() - parse_start) >= TERMINAL_PTY_PARSE_BUDGET_MS) {
                 break;
             }
-        } while (bytes_read > 0);
+        }
+        if (terminal_pty_ring_finished(active_ring)) {
+            running = 0;
+        }
+
+        /* Hidden tabs share a smaller budget of their own. */
+        Uint32 background_start = SDL_GetTicks();
+        for (size_t tab_i = 0u; tab_i < TERMINAL_TAB_COUNT; tab_i++) {
+            if (tab_i == active_tab_index || tab_closed[tab_i]) {
+                continue;
+            }
+            struct terminal_pty_ring *tab_ring = &terminal_pty_rings[tab_i];
+            size_t tab_budget = TERMINAL_BACKGROUND_READ_BUDGET;
+            while (tab_budget > 0u &&
+                   (Uint32)(SDL_GetTicks() - background_start) < TERMINAL_BACKGROUND_PARSE_BUDGET_MS) {
+                const unsigned char *tab_pending = NULL;
+                size_t chunk = terminal_pty_ring_peek(tab_ring, &tab_pending);
+                if (chunk == 0u) {
+                    break;
+                }
+                if (chunk > TERMINAL_PTY_FEED_CHUNK) {
+                    chunk = TERMINAL_PTY_FEED_CHUNK;
+                }
+                if (chunk > tab_budget) {
+                    chunk = tab_budget;
+                }
+                terminal_feed_background_tab(&tab_parsers[tab_i],
+                                             &tab_buffers[tab_i],
+                                             &tab_alternate_buffers[tab_i],
+                                             &tab_alternate_initialized[tab_i],
+                                             &tab_using_alternate[tab_i],
+                                             master_fds[tab_i],
+                                             tab_pending,
+                                             chunk);
+                terminal_pty_ring_consume(tab_ring, chunk);
+                terminal_tab_stats_record(tab_i, chunk);
+                terminal_perf_current.bytes_parsed += chunk;
+                tab_budget -= chunk;
+            }
+            if (terminal_pty_ring_finished(tab_ring)) {
+                tab_closed[tab_i] = 1;
+            }
+        }
+        terminal_perf_stage_end(TERMINAL_PERF_PARSE, perf_parse_start);
+        terminal_tab_stats_tick(SDL_GetTicks());
 
         pid_t wait_result = waitpid(child_pids[active_tab_index], &status, WNOHANG);
         if (wait_result == child_pid) {
@@ -9074,6 +13564,11 @@ int main(int argc, char **argv) {
             running = 0;
             break;
         }
+        if (terminal_gpu_text_active && terminal_gpu_text_prepare_grid(buffer->columns, buffer->rows) != 0) {
+            fprintf(stderr, "terminal: Failed to prepare GPU text grid; using the CPU renderer.\n");
+            terminal_gpu_text_shutdown();
+            terminal_mark_background_dirty();
+        }
 
         int full_redraw = terminal_force_full_redraw;
         terminal_force_full_redraw = 0;
@@ -9092,184 +13587,130 @@ int main(int argc, char **argv) {
             margin_pixels = frame_height / 2;
         }
 
+        uint32_t margin_pixel = terminal_rgba_from_color(buffer->default_bg);
+        /* With GPU text the framebuffer only carries the custom pixel overlay. */
+        uint32_t base_pixel = terminal_gpu_text_active ? 0u : margin_pixel;
+        /* Pixel overlays would move with the text, so only reuse the
+         * rendered rows when no custom layer holds pixels. */
+        Uint64 perf_raster_start = terminal_perf_stage_begin();
+        size_t scrolled_lines = buffer->scrolled_lines;
+        buffer->scrolled_lines = 0u;
+        if (scrolled_lines > 0u &&
+            !full_redraw &&
+            !terminal_background_dirty &&
+            !terminal_gpu_text_active &&
+            clamped_scroll_offset == 0u &&
+            terminal_custom_tile_count == 0u) {
+            terminal_render_cache_scroll(framebuffer,
+                                         frame_width,
+                                         frame_height,
+                                         margin_pixels,
+                                         glyph_width,
+                                         glyph_height,
+                                         scrolled_lines);
+        }
         if (terminal_background_dirty) {
-            uint32_t margin_color_value = buffer->default_bg;
-            uint32_t margin_pixel = terminal_rgba_from_color(margin_color_value);
             for (int py = 0; py < frame_height; py++) {
                 uint32_t *row_ptr = (uint32_t *)(framebuffer + (size_t)py * (size_t)frame_pitch);
                 for (int px = 0; px < frame_width; px++) {
-                    row_ptr[px] = margin_pixel;
+                    row_ptr[px] = base_pixel;
                 }
             }
             terminal_background_dirty = 0;
+            terminal_frame_damage_all();
             frame_dirty = 1;
         }
-
-        for (size_t row = 0u; row < buffer->rows; row++) {
-            size_t global_index = top_index + row;
-            const struct terminal_cell *row_cells = terminal_buffer_row_at(buffer, global_index);
-            if (!row_cells) {
-                continue;
-            }
-            for (size_t col = 0u; col < buffer->columns; col++) {
-                const struct terminal_cell *cell = &row_cells[col];
-                uint32_t ch = cell->ch;
-                uint32_t fg = cell->fg;
-                uint32_t bg = cell->bg;
-                uint8_t style = cell->style;
-                if ((style & TERMINAL_STYLE_REVERSE) != 0u) {
-                    uint32_t tmp = fg;
-                    fg = bg;
-                    bg = tmp;
-                }
-                if ((style & TERMINAL_STYLE_BOLD) != 0u) {
-                    fg = terminal_bold_variant(fg);
-                }
-
-                int cell_selected = selection_has_range &&
-                    terminal_selection_contains_cell(global_index, col, selection_start, selection_end, buffer->columns);
-                if (cell_selected) {
-                    fg = buffer->default_bg;
-                    bg = buffer->default_fg;
-                }
-
-                int is_cursor_cell = cursor_render_visible &&
-                                     global_index == cursor_global_index &&
-                                     col == buffer->cursor_column;
-                uint32_t fill_color = bg;
-                uint32_t glyph_color = fg;
-                if (is_cursor_cell) {
-                    fill_color = buffer->cursor_color;
-                    glyph_color = bg;
-                }
-
-                int dest_x = margin_pixels + (int)(col * (size_t)glyph_width);
-                int dest_y = margin_pixels + (int)(row * (size_t)glyph_height);
-                int end_x = dest_x + glyph_width;
-                int end_y = dest_y + glyph_height;
-                if (dest_x < 0) {
-                    dest_x = 0;
-                }
-                if (dest_y < 0) {
-                    dest_y = 0;
-                }
-                if (end_x > frame_width) {
-                    end_x = frame_width;
-                }
-                if (end_y > frame_height) {
-                    end_y = frame_height;
-                }
-                if (dest_x >= end_x || dest_y >= end_y) {
-                    continue;
-                }
-
-                size_t cache_index = row * buffer->columns + col;
-                if (cache_index >= terminal_render_cache_count) {
-                    continue;
-                }
-                struct terminal_render_cache_entry *cache_entry = &terminal_render_cache[cache_index];
-                int needs_redraw = full_redraw;
-                if (!needs_redraw) {
-                    if (cache_entry->ch != ch ||
-                        cache_entry->fg != glyph_color ||
-                        cache_entry->bg != fill_color ||
-                        cache_entry->style != style ||
-                        cache_entry->cursor != (uint8_t)is_cursor_cell ||
-                        cache_entry->selected != (uint8_t)cell_selected) {
-                        needs_redraw = 1;
-                    }
-                }
-                if (!needs_redraw) {
-                    continue;
-                }
-
-                cache_entry->ch = ch;
-                cache_entry->fg = glyph_color;
-                cache_entry->bg = fill_color;
-                cache_entry->style = style;
-                cache_entry->cursor = (uint8_t)is_cursor_cell;
-                cache_entry->selected = (uint8_t)cell_selected;
-                frame_dirty = 1;
-
-                int cell_width = end_x - dest_x;
-                int cell_height = end_y - dest_y;
-                uint32_t fill_pixel = terminal_rgba_from_color(fill_color);
-                for (int py = 0; py < cell_height; py++) {
-                    uint32_t *dst32 = (uint32_t *)(framebuffer +
-                                                    (size_t)(dest_y + py) * (size_t)frame_pitch +
-                                                    (size_t)dest_x * 4u);
-                    for (int px = 0; px < cell_width; px++) {
-                        dst32[px] = fill_pixel;
-                    }
-                }
-
-                if (ch != 0u) {
-                    uint32_t glyph_index = psf_font_resolve_glyph(&terminal_font, ch);
-                    if (glyph_index >= terminal_font.glyph_count) {
-                        glyph_index = 0u;
-                    }
-                    const uint8_t *glyph_bitmap = terminal_font.glyphs + glyph_index * terminal_font.glyph_size;
-                    uint32_t glyph_pixel_value = terminal_rgba_from_color(glyph_color);
-                    int glyph_scale = TERMINAL_FONT_SCALE;
-                    if (glyph_scale <= 0) {
-                        glyph_scale = 1;
-                    }
-                    for (int py = 0; py < cell_height; py++) {
-                        uint32_t src_y = (uint32_t)(py / glyph_scale);
-                        if (src_y >= terminal_font.height) {
-                            break;
-                        }
-                        const uint8_t *glyph_row = glyph_bitmap + (size_t)src_y * terminal_font.stride;
-                        uint32_t *dst32 = (uint32_t *)(framebuffer +
-                                                        (size_t)(dest_y + py) * (size_t)frame_pitch +
-                                                        (size_t)dest_x * 4u);
-                        for (uint32_t src_x = 0; src_x < terminal_font.width; src_x++) {
-                            uint8_t mask = (uint8_t)(0x80u >> (src_x & 7u));
-                            if ((glyph_row[src_x / 8u] & mask) == 0u) {
-                                continue;
-                            }
-                            int start_px = (int)(src_x * (uint32_t)glyph_scale);
-                            int end_px = start_px + glyph_scale;
-                            if (start_px >= cell_width) {
-                                break;
-                            }
-                            if (end_px > cell_width) {
-                                end_px = cell_width;
-                            }
-                            for (int px = start_px; px < end_px; px++) {
-                                dst32[px] = glyph_pixel_value;
-                            }
-                        }
-                    }
-
-                    if ((style & TERMINAL_STYLE_UNDERLINE) != 0u) {
-                        int underline_y = end_y - 1;
-                        if (underline_y >= dest_y) {
-                            uint32_t *dst32 = (uint32_t *)(framebuffer +
-                                                            (size_t)underline_y * (size_t)frame_pitch +
-                                                            (size_t)dest_x * 4u);
-                            for (int px = 0; px < cell_width; px++) {
-                                dst32[px] = glyph_pixel_value;
-                            }
-                        }
-                    }
+        if (terminal_frame_dirty_tile_count > 0u) {
+            terminal_frame_restore_damage(framebuffer,
+                                          frame_width,
+                                          frame_height,
+                                          base_pixel,
+                                          margin_pixels,
+                                          glyph_width,
+                                          glyph_height);
+        }
+
+        uint32_t search_prompt[TERMINAL_SEARCH_QUERY_MAX + 48u];
+        size_t search_prompt_length = 0u;
+        int search_prompt_visible = terminal_search_active && terminal_search_buffer == buffer;
+        if (search_prompt_visible) {
+            char prompt_text[TERMINAL_SEARCH_QUERY_MAX + 48u];
+            int written = terminal_search_regex_error != 0
+                ? snprintf(prompt_text, sizeof(prompt_text), "search: %s  [invalid regex]", terminal_search_query)
+                : snprintf(prompt_text,
+                           sizeof(prompt_text),
+                           "search: %s  [%zu/%zu]",
+                           terminal_search_query,
+                           terminal_search_match_count > 0u ? terminal_search_current + 1u : 0u,
+                           terminal_search_match_count);
+            size_t prompt_bytes = written > 0 ? (size_t)written : 0u;
+            if (prompt_bytes >= sizeof(prompt_text)) {
+                prompt_bytes = sizeof(prompt_text) - 1u;
+            }
+            size_t offset = 0u;
+            while (offset < prompt_bytes &&
+                   search_prompt_length < sizeof(search_prompt) / sizeof(search_prompt[0])) {
+                uint32_t codepoint = 0u;
+                if (terminal_utf8_next((const uint8_t *)prompt_text, prompt_bytes, &offset, &codepoint) != 0) {
+                    break;
                 }
+                search_prompt[search_prompt_length++] = codepoint;
             }
         }
 
-        if (terminal_custom_pixel_count > 0u &&
-            (terminal_custom_pixels_dirty ||
-             (terminal_custom_pixels_active && frame_dirty))) {
-            terminal_custom_pixels_apply(framebuffer, frame_width, frame_height);
+        if (terminal_raster_resolve_rows(buffer, top_index) != 0) {
+            fprintf(stderr, "Failed to prepare terminal rows for rendering.\n");
+            running = 0;
+            break;
+        }
+        struct terminal_raster_job raster_job = {
+            .rows = buffer->rows,
+            .columns = buffer->columns,
+            .top_index = top_index,
+            .default_fg = buffer->default_fg,
+            .default_bg = buffer->default_bg,
+            .cursor_color = buffer->cursor_color,
+            .search_prompt = search_prompt_visible ? search_prompt : NULL,
+            .search_prompt_length = search_prompt_length,
+            .selection_has_range = selection_has_range,
+            .selection_start = selection_start,
+            .selection_end = selection_end,
+            .cursor_visible = cursor_render_visible,
+            .cursor_global_index = cursor_global_index,
+            .cursor_column = buffer->cursor_column,
+            .framebuffer = framebuffer,
+            .frame_width = frame_width,
+            .frame_height = frame_height,
+            .margin = margin_pixels,
+            .glyph_width = glyph_width,
+            .glyph_height = glyph_height,
+            .full_redraw = full_redraw,
+            .damage = NULL
+        };
+        size_t cells_redrawn = terminal_raster_frame(&raster_job);
+        if (cells_redrawn > 0u) {
             frame_dirty = 1;
+        }
+        terminal_perf_current.cells_redrawn += cells_redrawn;
+
+        if (terminal_custom_tile_count > 0u &&
+            (terminal_custom_pixels_dirty || terminal_custom_pixels_active) &&
+            terminal_frame_dirty_tile_count > 0u) {
+            terminal_perf_current.custom_pixels +=
+                terminal_custom_pixels_apply(framebuffer, frame_width, frame_height);
             terminal_custom_pixels_dirty = 0;
             terminal_custom_pixels_active = 1;
         } else if (terminal_custom_pixels_dirty) {
-            frame_dirty = 1;
             terminal_custom_pixels_dirty = 0;
-            terminal_custom_pixels_pending_layers = 0u;
-            terminal_custom_pixels_active = 0;
+            if (terminal_custom_tile_count == 0u) {
+                terminal_custom_pixels_pending_layers = 0u;
+                terminal_custom_pixels_active = 0;
+            }
+        }
+        if (terminal_frame_dirty_tile_count > 0u) {
+            frame_dirty = 1;
         }
+        terminal_perf_stage_end(TERMINAL_PERF_RASTER, perf_raster_start);
 
         shader_timing_enabled = (terminal_shaders_active() &&
                                  terminal_shader_frame_interval_ms > 0u &&
@@ -9284,55 +13725,51 @@ int main(int argc, char **argv) {
         int cursor_requires_draw = terminal_cursor_enabled && terminal_cursor_dirty;
         int need_input_draw = terminal_input_draw_requested && !terminal_shaders_active();
         int need_gpu_draw = frame_dirty || shader_requires_frame || cursor_requires_draw || need_input_draw;
-        if (need_gpu_draw && terminal_render_frame_interval_ms > 0u) {
-            Uint32 since_last_frame = now - terminal_render_last_frame_tick;
-            if (since_last_frame < terminal_render_frame_interval_ms) {
-                SDL_Delay(terminal_render_frame_interval_ms - since_last_frame);
-                now = SDL_GetTicks();
-            }
-        }
         if (!need_gpu_draw) {
-            Uint32 idle_delay_ms = terminal_render_frame_interval_ms > 0u
-                ? terminal_render_frame_interval_ms
-                : 50u;
-            if (terminal_render_frame_interval_ms > 0u) {
-                Uint32 since_last_frame = now - terminal_render_last_frame_tick;
-                if (since_last_frame < terminal_render_frame_interval_ms) {
-                    Uint32 remaining = terminal_render_frame_interval_ms - since_last_frame;
-                    if (remaining < idle_delay_ms) {
-                        idle_delay_ms = remaining;
-                    }
-                }
+            /* Input and PTY output both arrive as SDL events, so with
+             * nothing left to parse the loop sleeps until the next cursor
+             * blink or shader frame is due, or indefinitely. Only the
+             * render-thread fallback reader still needs a polling cap. */
+            int idle_timeout_ms = -1;
+            if (!terminal_pty_reader_thread) {
+                idle_timeout_ms = terminal_runtime_target_fps > 0u
+                    ? (int)(1000u / terminal_runtime_target_fps)
+                    : TERMINAL_PTY_POLL_TIMEOUT_MS;
             }
             if (shader_timing_enabled) {
                 Uint32 since_last_shader = now - terminal_shader_last_frame_tick;
-                if (since_last_shader < terminal_shader_frame_interval_ms) {
-                    Uint32 remaining = terminal_shader_frame_interval_ms - since_last_shader;
-                    if (remaining < idle_delay_ms) {
-                        idle_delay_ms = remaining;
-                    }
-                } else {
-                    idle_delay_ms = 0u;
+                int remaining = since_last_shader < terminal_shader_frame_interval_ms
+                    ? (int)(terminal_shader_frame_interval_ms - since_last_shader)
+                    : 1;
+                if (idle_timeout_ms < 0 || remaining < idle_timeout_ms) {
+                    idle_timeout_ms = remaining;
                 }
             }
-            if (terminal_cursor_blink_enabled && cursor_blink_interval > 0u) {
+            if (terminal_cursor_blink_enabled &&
+                cursor_blink_interval > 0u &&
+                buffer->cursor_visible &&
+                clamped_scroll_offset == 0u) {
                 Uint32 since_cursor_toggle = now - cursor_last_toggle;
-                if (since_cursor_toggle < cursor_blink_interval) {
-                    Uint32 remaining = cursor_blink_interval - since_cursor_toggle;
-                    if (remaining < idle_delay_ms) {
-                        idle_delay_ms = remaining;
-                    }
-                } else {
-                    idle_delay_ms = 0u;
+                int remaining = since_cursor_toggle < cursor_blink_interval
+                    ? (int)(cursor_blink_interval - since_cursor_toggle)
+                    : 1;
+                if (idle_timeout_ms < 0 || remaining < idle_timeout_ms) {
+                    idle_timeout_ms = remaining;
                 }
             }
-            if (idle_delay_ms == 0u) {
-                idle_delay_ms = 1u;
+            /* Output left over from an exhausted parse budget. */
+            for (size_t tab_i = 0u; tab_i < TERMINAL_TAB_COUNT; tab_i++) {
+                if (!tab_closed[tab_i] && terminal_pty_ring_used(&terminal_pty_rings[tab_i]) > 0u) {
+                    idle_timeout_ms = 0;
+                }
+            }
+            if (idle_timeout_ms != 0) {
+                SDL_WaitEventTimeout(NULL, idle_timeout_ms);
             }
-            SDL_Delay(idle_delay_ms);
             continue;
         }
 
+        Uint64 perf_upload_start = terminal_perf_stage_begin();
         if (frame_dirty) {
             if (terminal_upload_framebuffer(framebuffer, frame_width, frame_height) != 0) {
                 fprintf(stderr, "Failed to upload framebuffer to GPU.\n");
@@ -9341,6 +13778,30 @@ int main(int argc, char **argv) {
             }
         }
 
+        GLuint frame_texture = terminal_gl_texture;
+        if (terminal_gpu_text_active) {
+            if (frame_dirty &&
+                (terminal_gpu_text_upload_grid() != 0 ||
+                 terminal_gpu_text_render(frame_width,
+                                          frame_height,
+                                          margin_pixels,
+                                          glyph_width,
+                                          glyph_height,
+                                          margin_pixel) != 0)) {
+                /* terminal_gl_texture was rasterized without text; redraw
+                 * it on the CPU before anything is presented. */
+                fprintf(stderr, "terminal: GPU text pass failed; using the CPU renderer.\n");
+                terminal_gpu_text_shutdown();
+                terminal_mark_background_dirty();
+                terminal_force_full_redraw = 1;
+                continue;
+            } else {
+                frame_texture = terminal_gpu_text_target;
+            }
+        }
+        terminal_perf_stage_end(TERMINAL_PERF_UPLOAD, perf_upload_start);
+
+        Uint64 perf_shader_start = terminal_perf_stage_begin();
         glViewport(0, 0, drawable_width, drawable_height);
         glClear(GL_COLOR_BUFFER_BIT);
         if (terminal_overlay_available && terminal_overlay_enabled) {
@@ -9357,11 +13818,12 @@ int main(int argc, char **argv) {
         int display_w = 0;
         int display_h = 0;
         terminal_display_rect(drawable_width, drawable_height, &display_x, &display_y, &display_w, &display_h);
-        GLuint source_texture = terminal_gl_texture;
+        GLuint source_texture = frame_texture;
         GLfloat source_texture_width = (GLfloat)terminal_texture_width;
         GLfloat source_texture_height = (GLfloat)terminal_texture_height;
         GLfloat source_input_width = (GLfloat)frame_width;
         GLfloat source_input_height = (GLfloat)frame_height;
+        int source_cpu_order = 1;
         int cursor_composited_into_shader = 0;
         int cursor_ready_for_composition = terminal_cursor_enabled &&
                                            terminal_cursor_texture != 0 &&
@@ -9375,38 +13837,12 @@ int main(int argc, char **argv) {
                 if (composition_status == GL_FRAMEBUFFER_COMPLETE) {
                     glViewport(0, 0, display_w, display_h);
                     glClear(GL_COLOR_BUFFER_BIT);
-
-                    glUseProgram(0);
-                    glMatrixMode(GL_PROJECTION);
-                    glLoadIdentity();
-                    glMatrixMode(GL_MODELVIEW);
-                    glLoadIdentity();
-
-                    glActiveTexture(GL_TEXTURE0);
-                    terminal_bind_texture(terminal_gl_texture);
-                    glEnable(GL_TEXTURE_2D);
-
-                    glBegin(GL_TRIANGLE_STRIP);
-                    glTexCoord2f(0.0f, 1.0f);
-                    glVertex2f(-1.0f, -1.0f);
-                    glTexCoord2f(1.0f, 1.0f);
-                    glVertex2f(1.0f, -1.0f);
-                    glTexCoord2f(0.0f, 0.0f);
-                    glVertex2f(-1.0f, 1.0f);
-                    glTexCoord2f(1.0f, 0.0f);
-                    glVertex2f(1.0f, 1.0f);
-                    glEnd();
-
-                    glEnable(GL_BLEND);
-                    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                    terminal_blit_texture(frame_texture, 1, -1.0f, -1.0f, 1.0f, 1.0f);
                     terminal_cursor_render(frame_width, frame_height, display_w, display_h);
-                    glDisable(GL_BLEND);
-
-                    glDisable(GL_TEXTURE_2D);
-                    terminal_bind_texture(0);
 
                     cursor_composited_into_shader = 1;
                     source_texture = terminal_gl_intermediate_textures[1];
+                    source_cpu_order = 0;
                     source_texture_width = (GLfloat)display_w;
                     source_texture_height = (GLfloat)display_h;
                     source_input_width = (GLfloat)display_w;
@@ -9439,37 +13875,54 @@ int main(int argc, char **argv) {
                 GLuint target_texture = 0;
                 int using_intermediate = 0;
 
-                if (!last_pass) {
+                /* A pass that reads Prev0 always renders offscreen into its own
+                 * history pair, so next frame can sample it without a copy. */
+                int has_history = shader->uniform_prev_sampler >= 0 &&
+                                  budo_gl_history_prepare(&shader->history,
+                                                          &terminal_gl_framebuffer,
+                                                          &terminal_bound_texture,
+                                                          display_w,
+                                                          display_h,
+                                                          history_resized) == 0;
+                if (has_history) {
+                    target_texture = budo_gl_history_target(&shader->history);
+                } else if (!last_pass) {
                     if (terminal_prepare_intermediate_targets(display_w, display_h) != 0) {
                         fprintf(stderr, "Failed to prepare intermediate render targets; skipping remaining shader passes.\n");
                         multipass_failed = 1;
                         last_pass = 1;
                     } else {
                         target_texture = terminal_gl_intermediate_textures[shader_index % 2u];
-                        glBindFramebuffer(GL_FRAMEBUFFER, terminal_gl_framebuffer);
-                        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target_texture, 0);
-                        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-                        if (status != GL_FRAMEBUFFER_COMPLETE) {
-                            fprintf(stderr, "Framebuffer incomplete (0x%04x); skipping remaining shader passes.\n", (unsigned int)status);
-                            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-                            multipass_failed = 1;
-                            last_pass = 1;
-                        } else {
-                            using_intermediate = 1;
-                            glViewport(0, 0, display_w, display_h);
-                            glClear(GL_COLOR_BUFFER_BIT);
-                        }
                     }
                 }
 
-                if (last_pass && !using_intermediate) {
+                if (target_texture != 0) {
+                    glBindFramebuffer(GL_FRAMEBUFFER, terminal_gl_framebuffer);
+                    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target_texture, 0);
+                    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+                    if (status != GL_FRAMEBUFFER_COMPLETE) {
+                        fprintf(stderr, "Framebuffer incomplete (0x%04x); skipping remaining shader passes.\n", (unsigned int)status);
+                        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                        multipass_failed = 1;
+                        last_pass = 1;
+                        has_history = 0;
+                    } else {
+                        using_intermediate = 1;
+                        glViewport(0, 0, display_w, display_h);
+                        glClear(GL_COLOR_BUFFER_BIT);
+                    }
+                }
+
+                if (!using_intermediate) {
                     glBindFramebuffer(GL_FRAMEBUFFER, 0);
                     glViewport(display_x, display_y, display_w, display_h);
                 }
 
+                int flip_output = budo_gl_pass_flips(using_intermediate, source_cpu_order, shader->uniform_mvp);
+
                 glUseProgram(shader->program);
 
-                terminal_shader_set_vec2(shader->uniform_output_size,
+                budo_gl_set_vec2(shader->uniform_output_size,
                                          shader->cached_output_size,
                                          &shader->has_cached_output_size,
                                          (GLfloat)display_w,
@@ -9477,98 +13930,51 @@ int main(int argc, char **argv) {
                 if (shader->uniform_frame_count >= 0) {
                     glUniform1i(shader->uniform_frame_count, frame_value);
                 }
-                terminal_shader_set_vec2(shader->uniform_texture_size,
+                budo_gl_set_vec2(shader->uniform_texture_size,
                                          shader->cached_texture_size,
                                          &shader->has_cached_texture_size,
                                          source_texture_width,
                                          source_texture_height);
-                terminal_shader_set_vec2(shader->uniform_input_size,
+                budo_gl_set_vec2(shader->uniform_input_size,
                                          shader->cached_input_size,
                                          &shader->has_cached_input_size,
                                          source_input_width,
                                          source_input_height);
+                budo_gl_set_matrix(shader->uniform_mvp,
+                                           shader->cached_mvp,
+                                           &shader->has_cached_mvp,
+                                           flip_output ? budo_gl_flip_mvp : budo_gl_identity_mvp);
 
                 if (shader->uniform_prev_sampler >= 0) {
-                    GLuint history_texture = 0;
-                    if (terminal_prepare_shader_history(shader, display_w, display_h, history_resized) == 0) {
-                        history_texture = shader->history_texture;
-                        if (source_texture == terminal_gl_texture && shader->history_texture_flipped != 0) {
-                            history_texture = shader->history_texture_flipped;
-                        }
-                    }
                     glActiveTexture(GL_TEXTURE1);
-                    terminal_bind_texture(history_texture);
+                    terminal_bind_texture(has_history ? budo_gl_history_previous(&shader->history) : 0);
                     glActiveTexture(GL_TEXTURE0);
                 }
 
                 glActiveTexture(GL_TEXTURE0);
                 terminal_bind_texture(source_texture);
 
-                GLuint vao = (source_texture == terminal_gl_texture) ? shader->quad_vaos[0] : shader->quad_vaos[1];
-                int using_vao = 0;
-                if (vao != 0) {
-                    glBindVertexArray(vao);
-                    using_vao = 1;
-                } else {
-                    static const GLfloat fallback_quad_vertices[16] = {
-                        -1.0f, -1.0f, 0.0f, 1.0f,
-                         1.0f, -1.0f, 0.0f, 1.0f,
-                        -1.0f,  1.0f, 0.0f, 1.0f,
-                         1.0f,  1.0f, 0.0f, 1.0f
-                    };
-                    static const GLfloat fallback_texcoords_cpu[8] = {
-                        0.0f, 1.0f,
-                        1.0f, 1.0f,
-                        0.0f, 0.0f,
-                        1.0f, 0.0f
-                    };
-                    static const GLfloat fallback_texcoords_fbo[8] = {
-                        0.0f, 0.0f,
-                        1.0f, 0.0f,
-                        0.0f, 1.0f,
-                        1.0f, 1.0f
-                    };
-                    if (shader->attrib_vertex >= 0) {
-                        glEnableVertexAttribArray((GLuint)shader->attrib_vertex);
-                        glVertexAttribPointer((GLuint)shader->attrib_vertex, 4, GL_FLOAT, GL_FALSE, 0, fallback_quad_vertices);
-                    }
-                    if (shader->attrib_texcoord >= 0) {
-                        const GLfloat *quad_texcoords = (source_texture == terminal_gl_texture)
-                            ? fallback_texcoords_cpu
-                            : fallback_texcoords_fbo;
-                        glEnableVertexAttribArray((GLuint)shader->attrib_texcoord);
-                        glVertexAttribPointer((GLuint)shader->attrib_texcoord, 2, GL_FLOAT, GL_FALSE, 0, quad_texcoords);
-                    }
-                }
-                if (shader->attrib_color >= 0) {
-                    glDisableVertexAttribArray((GLuint)shader->attrib_color);
-                    glVertexAttrib4f((GLuint)shader->attrib_color, 1.0f, 1.0f, 1.0f, 1.0f);
-                }
-
-                glDrawArrays(GL_TRIANGLE_STRIP, 0, terminal_quad_vertex_count);
-
-                if (shader->uniform_prev_sampler >= 0) {
-                    terminal_update_shader_history(shader, display_w, display_h);
-                }
-
-                if (using_vao) {
-                    glBindVertexArray(0);
-                } else {
-                    if (shader->attrib_vertex >= 0) {
-                        glDisableVertexAttribArray((GLuint)shader->attrib_vertex);
-                    }
-                    if (shader->attrib_texcoord >= 0) {
-                        glDisableVertexAttribArray((GLuint)shader->attrib_texcoord);
-                    }
-                }
+                budo_gl_quad_draw(shader->quad_vaos,
+                                  source_cpu_order,
+                                  shader->attrib_vertex,
+                                  shader->attrib_texcoord,
+                                  shader->attrib_color);
 
                 if (using_intermediate) {
                     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                    if (has_history) {
+                        budo_gl_history_swap(&shader->history);
+                    }
+                    if (last_pass) {
+                        glViewport(display_x, display_y, display_w, display_h);
+                        terminal_blit_texture(target_texture, flip_output, -1.0f, -1.0f, 1.0f, 1.0f);
+                    }
                     source_texture = target_texture;
                     source_texture_width = (GLfloat)display_w;
                     source_texture_height = (GLfloat)display_h;
                     source_input_width = (GLfloat)display_w;
                     source_input_height = (GLfloat)display_h;
+                    source_cpu_order = flip_output;
                 }
 
                 if (multipass_failed) {
@@ -9577,41 +13983,24 @@ int main(int argc, char **argv) {
             }
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
         } else {
-            glUseProgram(0);
-            glMatrixMode(GL_PROJECTION);
-            glLoadIdentity();
-            glMatrixMode(GL_MODELVIEW);
-            glLoadIdentity();
-
-            glActiveTexture(GL_TEXTURE0);
-            terminal_bind_texture(terminal_gl_texture);
-            glEnable(GL_TEXTURE_2D);
-
-            glBegin(GL_TRIANGLE_STRIP);
-            glTexCoord2f(0.0f, 1.0f);
-            glVertex2f(-1.0f, -1.0f);
-            glTexCoord2f(1.0f, 1.0f);
-            glVertex2f(1.0f, -1.0f);
-            glTexCoord2f(0.0f, 0.0f);
-            glVertex2f(-1.0f, 1.0f);
-            glTexCoord2f(1.0f, 0.0f);
-            glVertex2f(1.0f, 1.0f);
-            glEnd();
-
-            glDisable(GL_TEXTURE_2D);
-            terminal_bind_texture(0);
+            terminal_blit_texture(frame_texture, 1, -1.0f, -1.0f, 1.0f, 1.0f);
         }
 
         if (!cursor_composited_into_shader) {
             terminal_cursor_render(frame_width, frame_height, display_w, display_h);
         }
+        terminal_perf_stage_end(TERMINAL_PERF_SHADER, perf_shader_start);
+        terminal_perf_render(frame_width, frame_height, display_w, display_h);
 
+        Uint64 perf_swap_start = terminal_perf_stage_begin();
         SDL_GL_SwapWindow(window);
+        terminal_perf_stage_end(TERMINAL_PERF_SWAP, perf_swap_start);
 
         terminal_input_draw_requested = 0;
         terminal_cursor_dirty = 0;
 
-        terminal_render_last_frame_tick = SDL_GetTicks();
+        terminal_frame_presented();
+        terminal_perf_frame_commit();
 
         if (shader_timing_enabled && need_gpu_draw) {
             terminal_shader_last_frame_tick = now;
@@ -9622,6 +14011,11 @@ int main(int argc, char **argv) {
         }
     }
 
+    terminal_pty_reader_stop_thread();
+    terminal_raster_pool_stop();
+    if (terminal_frame_stats_enabled) {
+        terminal_frame_stats_report();
+    }
     SDL_StopTextInput();
     SDL_ShowCursor(SDL_ENABLE);
 
@@ -9646,6 +14040,8 @@ int main(int argc, char **argv) {
     SDL_Quit();
 
     terminal_free_requested_shaders();
+    terminal_sprite_cache_clear();
+    terminal_shared_layers_shutdown();
     free_font(&terminal_font);
     for (size_t tab_i = 0u; tab_i < TERMINAL_TAB_COUNT; tab_i++) {
         ansi_parser_free(&tab_parsers[tab_i]);
@@ -43,6 +43,7 @@ build_demo() {
         lib/budo_graphics.c \
         lib/budo_audio.c \
         lib/budo_shader_stack.c \
+        lib/budo_gl_pass.c \
         "$source" \
         -o "$output" \
         $SDL_LIBS $SDL_IMAGE_LIBS $SDL_MIXER_LIBS $GL_LIBS -lm
@@ -0,0 +1,397 @@
+#include "budo_gl_pass.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const struct budo_gl_quad_vertex budo_gl_quad_vertices[BUDO_GL_QUAD_VERTEX_COUNT] = {
+    { { -1.0f, -1.0f, 0.0f, 1.0f }, { 0.0f, 1.0f }, { 0.0f, 0.0f } },
+    { {  1.0f, -1.0f, 0.0f, 1.0f }, { 1.0f, 1.0f }, { 1.0f, 0.0f } },
+    { { -1.0f,  1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f }, { 0.0f, 1.0f } },
+    { {  1.0f,  1.0f, 0.0f, 1.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f } }
+};
+
+const GLfloat budo_gl_identity_mvp[16] = {
+    1.0f, 0.0f, 0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f, 0.0f,
+    0.0f, 0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 1.0f
+};
+
+const GLfloat budo_gl_flip_mvp[16] = {
+    1.0f, 0.0f, 0.0f, 0.0f,
+    0.0f, -1.0f, 0.0f, 0.0f,
+    0.0f, 0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 1.0f
+};
+
+GLuint budo_gl_quad_vbo_create(void) {
+    GLuint vbo = 0;
+    glGenBuffers(1, &vbo);
+    if (vbo == 0) {
+        return 0;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(budo_gl_quad_vertices), budo_gl_quad_vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return vbo;
+}
+
+int budo_gl_quad_vaos_create(GLuint vbo,
+                             GLint attrib_position,
+                             GLint attrib_texcoord,
+                             GLint attrib_color,
+                             GLuint vaos[2]) {
+    if (vbo == 0 || !vaos) {
+        return -1;
+    }
+
+    vaos[0] = 0u;
+    vaos[1] = 0u;
+    glGenVertexArrays(2, vaos);
+    if (vaos[0] == 0u || vaos[1] == 0u) {
+        budo_gl_quad_vaos_destroy(vaos);
+        return -1;
+    }
+
+    const GLsizei stride = (GLsizei)sizeof(struct budo_gl_quad_vertex);
+    const void *position_offset = (const void *)offsetof(struct budo_gl_quad_vertex, position);
+    const void *texcoord_offsets[2] = {
+        (const void *)offsetof(struct budo_gl_quad_vertex, texcoord_cpu),
+        (const void *)offsetof(struct budo_gl_quad_vertex, texcoord_fbo)
+    };
+
+    for (size_t i = 0; i < 2; i++) {
+        glBindVertexArray(vaos[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        if (attrib_position >= 0) {
+            glEnableVertexAttribArray((GLuint)attrib_position);
+            glVertexAttribPointer((GLuint)attrib_position, 4, GL_FLOAT, GL_FALSE, stride, position_offset);
+        }
+        if (attrib_texcoord >= 0) {
+            glEnableVertexAttribArray((GLuint)attrib_texcoord);
+            glVertexAttribPointer((GLuint)attrib_texcoord, 2, GL_FLOAT, GL_FALSE, stride, texcoord_offsets[i]);
+        }
+        if (attrib_color >= 0) {
+            glDisableVertexAttribArray((GLuint)attrib_color);
+        }
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return 0;
+}
+
+void budo_gl_quad_vaos_destroy(GLuint vaos[2]) {
+    if (!vaos) {
+        return;
+    }
+    for (size_t i = 0; i < 2; i++) {
+        if (vaos[i] != 0) {
+            glDeleteVertexArrays(1, &vaos[i]);
+            vaos[i] = 0;
+        }
+    }
+}
+
+void budo_gl_quad_draw(const GLuint vaos[2],
+                       int source_cpu_order,
+                       GLint attrib_position,
+                       GLint attrib_texcoord,
+                       GLint attrib_color) {
+    GLuint vao = vaos ? vaos[source_cpu_order ? 0 : 1] : 0u;
+    if (vao != 0) {
+        glBindVertexArray(vao);
+    } else {
+        static const GLfloat fallback_positions[16] = {
+            -1.0f, -1.0f, 0.0f, 1.0f,
+             1.0f, -1.0f, 0.0f, 1.0f,
+            -1.0f,  1.0f, 0.0f, 1.0f,
+             1.0f,  1.0f, 0.0f, 1.0f
+        };
+        static const GLfloat fallback_texcoords_cpu[8] = {
+            0.0f, 1.0f,
+            1.0f, 1.0f,
+            0.0f, 0.0f,
+            1.0f, 0.0f
+        };
+        static const GLfloat fallback_texcoords_fbo[8] = {
+            0.0f, 0.0f,
+            1.0f, 0.0f,
+            0.0f, 1.0f,
+            1.0f, 1.0f
+        };
+        if (attrib_position >= 0) {
+            glEnableVertexAttribArray((GLuint)attrib_position);
+            glVertexAttribPointer((GLuint)attrib_position, 4, GL_FLOAT, GL_FALSE, 0, fallback_positions);
+        }
+        if (attrib_texcoord >= 0) {
+            glEnableVertexAttribArray((GLuint)attrib_texcoord);
+            glVertexAttribPointer((GLuint)attrib_texcoord,
+                                  2,
+                                  GL_FLOAT,
+                                  GL_FALSE,
+                                  0,
+                                  source_cpu_order ? fallback_texcoords_cpu : fallback_texcoords_fbo);
+        }
+    }
+    if (attrib_color >= 0) {
+        glDisableVertexAttribArray((GLuint)attrib_color);
+        glVertexAttrib4f((GLuint)attrib_color, 1.0f, 1.0f, 1.0f, 1.0f);
+    }
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, BUDO_GL_QUAD_VERTEX_COUNT);
+
+    if (vao != 0) {
+        glBindVertexArray(0);
+    } else {
+        if (attrib_position >= 0) {
+            glDisableVertexAttribArray((GLuint)attrib_position);
+        }
+        if (attrib_texcoord >= 0) {
+            glDisableVertexAttribArray((GLuint)attrib_texcoord);
+        }
+    }
+}
+
+void budo_gl_set_matrix(GLint location, GLfloat *cache, int *has_cache, const GLfloat *matrix) {
+    if (location < 0 || !cache || !has_cache || !matrix) {
+        return;
+    }
+    if (*has_cache && memcmp(cache, matrix, sizeof(GLfloat) * 16u) == 0) {
+        return;
+    }
+    memcpy(cache, matrix, sizeof(GLfloat) * 16u);
+    *has_cache = 1;
+    glUniformMatrix4fv(location, 1, GL_FALSE, matrix);
+}
+
+void budo_gl_set_vec2(GLint location, GLfloat *cache, int *has_cache, GLfloat x, GLfloat y) {
+    if (location < 0 || !cache || !has_cache) {
+        return;
+    }
+    if (*has_cache && cache[0] == x && cache[1] == y) {
+        return;
+    }
+    cache[0] = x;
+    cache[1] = y;
+    *has_cache = 1;
+    glUniform2f(location, x, y);
+}
+
+static void budo_gl_clear_texture(GLuint *framebuffer, GLuint texture, int width, int height) {
+    if (*framebuffer == 0) {
+        glGenFramebuffers(1, framebuffer);
+        if (*framebuffer == 0) {
+            return;
+        }
+    }
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, *framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
+        glViewport(0, 0, width, height);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+int budo_gl_history_prepare(struct budo_gl_history *history,
+                            GLuint *framebuffer,
+                            GLuint *bound_texture,
+                            int width,
+                            int height,
+                            int reallocate) {
+    if (!history || !framebuffer || !bound_texture || width <= 0 || height <= 0) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < 2; i++) {
+        int created = 0;
+        if (history->textures[i] == 0) {
+            glGenTextures(1, &history->textures[i]);
+            if (history->textures[i] == 0) {
+                return -1;
+            }
+            created = 1;
+        }
+        if (created || reallocate) {
+            glBindTexture(GL_TEXTURE_2D, history->textures[i]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            *bound_texture = 0;
+            budo_gl_clear_texture(framebuffer, history->textures[i], width, height);
+        }
+    }
+
+    return 0;
+}
+
+void budo_gl_history_release(struct budo_gl_history *history) {
+    if (!history) {
+        return;
+    }
+    for (size_t i = 0; i < 2; i++) {
+        if (history->textures[i] != 0) {
+            glDeleteTextures(1, &history->textures[i]);
+            history->textures[i] = 0;
+        }
+    }
+    history->index = 0;
+}
+
+GLuint budo_gl_history_target(const struct budo_gl_history *history) {
+    return history->textures[history->index];
+}
+
+GLuint budo_gl_history_previous(const struct budo_gl_history *history) {
+    return history->textures[1 - history->index];
+}
+
+void budo_gl_history_swap(struct budo_gl_history *history) {
+    history->index = 1 - history->index;
+}
+
+int budo_gl_pass_flips(int offscreen, int source_cpu_order, GLint uniform_mvp) {
+    return offscreen && source_cpu_order && uniform_mvp >= 0;
+}
+
+static const char budo_gl_blit_vertex_source[] =
+    "#version 110\n"
+    "attribute vec4 Position;\n"
+    "attribute vec2 TexCoord;\n"
+    "uniform vec4 Rect;\n"
+    "varying vec2 uv;\n"
+    "void main() {\n"
+    "    vec2 t = Position.xy * 0.5 + 0.5;\n"
+    "    gl_Position = vec4(mix(Rect.xy, Rect.zw, t), 0.0, 1.0);\n"
+    "    uv = TexCoord;\n"
+    "}\n";
+
+static const char budo_gl_blit_fragment_source[] =
+    "#version 110\n"
+    "uniform sampler2D Source;\n"
+    "varying vec2 uv;\n"
+    "void main() {\n"
+    "    gl_FragColor = texture2D(Source, uv);\n"
+    "}\n";
+
+static GLuint budo_gl_compile_blit_shader(GLenum type, const char *source) {
+    GLuint shader = glCreateShader(type);
+    if (shader == 0) {
+        return 0;
+    }
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    GLint status = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE) {
+        fprintf(stderr, "budo: Failed to compile blit %s shader.\n",
+                type == GL_VERTEX_SHADER ? "vertex" : "fragment");
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+int budo_gl_blit_init(struct budo_gl_blit *blit, GLuint vbo) {
+    if (!blit || vbo == 0) {
+        return -1;
+    }
+    GLuint vertex_shader = budo_gl_compile_blit_shader(GL_VERTEX_SHADER, budo_gl_blit_vertex_source);
+    GLuint fragment_shader = budo_gl_compile_blit_shader(GL_FRAGMENT_SHADER, budo_gl_blit_fragment_source);
+    if (vertex_shader == 0 || fragment_shader == 0) {
+        if (vertex_shader != 0) {
+            glDeleteShader(vertex_shader);
+        }
+        if (fragment_shader != 0) {
+            glDeleteShader(fragment_shader);
+        }
+        return -1;
+    }
+
+    GLuint program = glCreateProgram();
+    if (program == 0) {
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+        return -1;
+    }
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glBindAttribLocation(program, BUDO_GL_BLIT_ATTRIB_POSITION, "Position");
+    glBindAttribLocation(program, BUDO_GL_BLIT_ATTRIB_TEXCOORD, "TexCoord");
+    glLinkProgram(program);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+
+    GLint link_status = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+    if (link_status != GL_TRUE) {
+        fprintf(stderr, "budo: Failed to link blit program.\n");
+        glDeleteProgram(program);
+        return -1;
+    }
+
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "Source"), 0);
+    glUseProgram(0);
+    blit->program = program;
+    blit->rect_location = glGetUniformLocation(program, "Rect");
+
+    if (budo_gl_quad_vaos_create(vbo,
+                                 (GLint)BUDO_GL_BLIT_ATTRIB_POSITION,
+                                 (GLint)BUDO_GL_BLIT_ATTRIB_TEXCOORD,
+                                 -1,
+                                 blit->vaos) != 0) {
+        budo_gl_blit_destroy(blit);
+        return -1;
+    }
+    return 0;
+}
+
+void budo_gl_blit_destroy(struct budo_gl_blit *blit) {
+    if (!blit) {
+        return;
+    }
+    budo_gl_quad_vaos_destroy(blit->vaos);
+    if (blit->program != 0) {
+        glDeleteProgram(blit->program);
+        blit->program = 0;
+    }
+    blit->rect_location = -1;
+}
+
+void budo_gl_blit_draw(const struct budo_gl_blit *blit,
+                       GLuint *bound_texture,
+                       GLuint texture,
+                       int cpu_order,
+                       GLfloat x0,
+                       GLfloat y0,
+                       GLfloat x1,
+                       GLfloat y1) {
+    if (!blit || !bound_texture || texture == 0 || blit->program == 0) {
+        return;
+    }
+    glUseProgram(blit->program);
+    glUniform4f(blit->rect_location, x0, y0, x1, y1);
+    glActiveTexture(GL_TEXTURE0);
+    if (*bound_texture != texture) {
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
+    glBindVertexArray(blit->vaos[cpu_order ? 0 : 1]);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, BUDO_GL_QUAD_VERTEX_COUNT);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    *bound_texture = 0;
+    glUseProgram(0);
+}
@@ -0,0 +1,121 @@
+#ifndef BUDO_GL_PASS_H
+#define BUDO_GL_PASS_H
+
+#include <SDL_opengl.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* FULL-SCREEN PASS HELPERS SHARED BY THE BUDO SHADER STACK AND apps/terminal.
+*  TEXTURES ARE EITHER "CPU ORDER" (TOP ROW FIRST: UPLOADS, IMAGES) OR
+*  "FBO ORDER" (BOTTOM ROW FIRST: RENDERED INTO A FRAMEBUFFER). THE QUAD
+*  CARRIES ONE TEXCOORD SET FOR EACH, SO NOTHING IS EVER COPIED TO FLIP IT.
+*/
+
+struct budo_gl_quad_vertex {
+    GLfloat position[4];
+    GLfloat texcoord_cpu[2];
+    GLfloat texcoord_fbo[2];
+};
+
+#define BUDO_GL_QUAD_VERTEX_COUNT 4
+
+extern const GLfloat budo_gl_identity_mvp[16];
+/* MIRRORS Y IN THE VERTEX STAGE SO AN OFFSCREEN PASS WRITES ROWS IN THE
+*  SAME ORDER AS ITS SOURCE.
+*/
+extern const GLfloat budo_gl_flip_mvp[16];
+
+/* CREATE A STATIC VBO HOLDING THE FULL-SCREEN QUAD. RETURNS 0 ON FAILURE. */
+GLuint budo_gl_quad_vbo_create(void);
+
+/* CREATE TWO VAOS OVER vbo: vaos[0] SAMPLES CPU-ORDER TEXTURES, vaos[1]
+*  FBO-ORDER ONES. NEGATIVE ATTRIBUTE LOCATIONS ARE SKIPPED; attrib_color IS
+*  LEFT DISABLED. RETURNS 0 ON SUCCESS, -1 ON FAILURE.
+*/
+int budo_gl_quad_vaos_create(GLuint vbo,
+                             GLint attrib_position,
+                             GLint attrib_texcoord,
+                             GLint attrib_color,
+                             GLuint vaos[2]);
+void budo_gl_quad_vaos_destroy(GLuint vaos[2]);
+
+/* DRAW THE QUAD WITH THE CURRENT PROGRAM, PICKING THE VAO FOR THE SOURCE ROW
+*  ORDER. FALLS BACK TO CLIENT ARRAYS WHEN THE VAOS COULD NOT BE CREATED.
+*/
+void budo_gl_quad_draw(const GLuint vaos[2],
+                       int source_cpu_order,
+                       GLint attrib_position,
+                       GLint attrib_texcoord,
+                       GLint attrib_color);
+
+/* SET A UNIFORM ONLY WHEN IT DIFFERS FROM THE CACHED VALUE. */
+void budo_gl_set_matrix(GLint location, GLfloat *cache, int *has_cache, const GLfloat *matrix);
+void budo_gl_set_vec2(GLint location, GLfloat *cache, int *has_cache, GLfloat x, GLfloat y);
+
+/* PING-PONG HISTORY FOR A PASS THAT SAMPLES ITS OWN PREVIOUS OUTPUT (Prev0).
+*  THE PASS RENDERS INTO target, READS previous, THEN SWAPS; NO COPIES.
+*/
+struct budo_gl_history {
+    GLuint textures[2];
+    int index;
+};
+
+/* ALLOCATE (OR WITH reallocate SET, RESIZE AND CLEAR) BOTH TEXTURES.
+*  *framebuffer IS CREATED ON DEMAND FOR CLEARING. *bound_texture IS THE
+*  CALLER'S TEXTURE-BINDING CACHE AND IS LEFT AT 0.
+*  RETURNS 0 ON SUCCESS, -1 ON FAILURE.
+*/
+int budo_gl_history_prepare(struct budo_gl_history *history,
+                            GLuint *framebuffer,
+                            GLuint *bound_texture,
+                            int width,
+                            int height,
+                            int reallocate);
+void budo_gl_history_release(struct budo_gl_history *history);
+GLuint budo_gl_history_target(const struct budo_gl_history *history);
+GLuint budo_gl_history_previous(const struct budo_gl_history *history);
+void budo_gl_history_swap(struct budo_gl_history *history);
+
+/* WHETHER A PASS SHOULD MIRROR ITS OUTPUT THROUGH MVPMatrix. OFFSCREEN PASSES
+*  OVER A CPU-ORDER SOURCE FLIP SO PREV0 LINES UP WITH SOURCE; A SHADER
+*  WITHOUT MVPMatrix CANNOT, AND ITS OUTPUT IS FBO ORDER INSTEAD. THE OUTPUT
+*  OF AN OFFSCREEN PASS IS CPU ORDER EXACTLY WHEN THIS RETURNS 1.
+*/
+int budo_gl_pass_flips(int offscreen, int source_cpu_order, GLint uniform_mvp);
+
+/* TEXTURED-QUAD PROGRAM FOR PLAIN DRAWS AND FOR PRESENTING AN OFFSCREEN
+*  FINAL PASS. OTHER PROGRAMS THAT BIND Position TO THE SAME LOCATION CAN
+*  DRAW THROUGH ITS VAOS.
+*/
+#define BUDO_GL_BLIT_ATTRIB_POSITION 0u
+#define BUDO_GL_BLIT_ATTRIB_TEXCOORD 1u
+
+struct budo_gl_blit {
+    GLuint program;
+    GLint rect_location;
+    GLuint vaos[2];
+};
+
+/* RETURNS 0 ON SUCCESS, -1 ON FAILURE. vbo IS A budo_gl_quad_vbo_create() VBO. */
+int budo_gl_blit_init(struct budo_gl_blit *blit, GLuint vbo);
+void budo_gl_blit_destroy(struct budo_gl_blit *blit);
+
+/* DRAW texture OVER THE NDC RECTANGLE WHOSE (-1,-1) CORNER LANDS ON (x0,y0)
+*  AND (1,1) CORNER ON (x1,y1). *bound_texture IS THE CALLER'S BINDING CACHE.
+*/
+void budo_gl_blit_draw(const struct budo_gl_blit *blit,
+                       GLuint *bound_texture,
+                       GLuint texture,
+                       int cpu_order,
+                       GLfloat x0,
+                       GLfloat y0,
+                       GLfloat x1,
+                       GLfloat y1);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
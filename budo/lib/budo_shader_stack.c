@@ -1,4 +1,5 @@
 #include "budo_shader_stack.h"
+#include "budo_gl_pass.h"
 
 #include <ctype.h>
 #include <errno.h>
@@ -42,8 +43,7 @@ struct budo_gl_shader {
     GLint uniform_interlace_detect;
     GLint uniform_saturation;
     GLint uniform_inv_gamma;
-    GLuint history_texture;
-    GLuint history_texture_flipped;
+    struct budo_gl_history history;
     GLuint quad_vaos[2];
     int has_cached_mvp;
     GLfloat cached_mvp[16];
@@ -59,6 +59,7 @@ struct budo_shader_stack {
     struct budo_gl_shader *shaders;
     size_t shader_count;
     GLuint quad_vbo;
+    struct budo_gl_blit blit;
     GLuint bound_texture;
     GLuint framebuffer;
     GLuint intermediate_textures[2];
@@ -68,28 +69,6 @@ struct budo_shader_stack {
     int history_height;
 };
 
-struct budo_quad_vertex {
-    GLfloat position[4];
-    GLfloat texcoord_cpu[2];
-    GLfloat texcoord_fbo[2];
-};
-
-static const struct budo_quad_vertex budo_quad_vertices[4] = {
-    { { -1.0f, -1.0f, 0.0f, 1.0f }, { 0.0f, 1.0f }, { 0.0f, 0.0f } },
-    { {  1.0f, -1.0f, 0.0f, 1.0f }, { 1.0f, 1.0f }, { 1.0f, 0.0f } },
-    { { -1.0f,  1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f }, { 0.0f, 1.0f } },
-    { {  1.0f,  1.0f, 0.0f, 1.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f } }
-};
-
-static const GLsizei budo_quad_vertex_count = 4;
-
-static const GLfloat budo_identity_mvp[16] = {
-    1.0f, 0.0f, 0.0f, 0.0f,
-    0.0f, 1.0f, 0.0f, 0.0f,
-    0.0f, 0.0f, 1.0f, 0.0f,
-    0.0f, 0.0f, 0.0f, 1.0f
-};
-
 static char *budo_read_text_file(const char *path, size_t *out_size) {
     if (!path) {
         return NULL;
@@ -349,41 +328,11 @@ static void budo_shader_reset_uniform_cache(struct budo_gl_shader *shader) {
     shader->has_cached_input_size = 0;
 }
 
-static void budo_shader_set_matrix(GLint location, GLfloat *cache, int *has_cache, const GLfloat *matrix) {
-    if (location < 0 || !cache || !has_cache || !matrix) {
-        return;
-    }
-    if (*has_cache && memcmp(cache, matrix, sizeof(GLfloat) * 16u) == 0) {
-        return;
-    }
-    memcpy(cache, matrix, sizeof(GLfloat) * 16u);
-    *has_cache = 1;
-    glUniformMatrix4fv(location, 1, GL_FALSE, matrix);
-}
-
-static void budo_shader_set_vec2(GLint location, GLfloat *cache, int *has_cache, GLfloat x, GLfloat y) {
-    if (location < 0 || !cache || !has_cache) {
-        return;
-    }
-    if (*has_cache && cache[0] == x && cache[1] == y) {
-        return;
-    }
-    cache[0] = x;
-    cache[1] = y;
-    *has_cache = 1;
-    glUniform2f(location, x, y);
-}
-
 static void budo_shader_clear_vaos(struct budo_gl_shader *shader) {
     if (!shader) {
         return;
     }
-    for (size_t i = 0; i < 2; i++) {
-        if (shader->quad_vaos[i] != 0) {
-            glDeleteVertexArrays(1, &shader->quad_vaos[i]);
-            shader->quad_vaos[i] = 0;
-        }
-    }
+    budo_gl_quad_vaos_destroy(shader->quad_vaos);
     budo_shader_reset_uniform_cache(shader);
 }
 
@@ -394,20 +343,18 @@ static int budo_initialize_quad_geometry(struct budo_shader_stack *stack) {
     if (stack->quad_vbo != 0) {
         return 0;
     }
-    glGenBuffers(1, &stack->quad_vbo);
+    stack->quad_vbo = budo_gl_quad_vbo_create();
     if (stack->quad_vbo == 0) {
         return -1;
     }
-    glBindBuffer(GL_ARRAY_BUFFER, stack->quad_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(budo_quad_vertices), budo_quad_vertices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    return 0;
+    return budo_gl_blit_init(&stack->blit, stack->quad_vbo);
 }
 
 static void budo_destroy_quad_geometry(struct budo_shader_stack *stack) {
     if (!stack) {
         return;
     }
+    budo_gl_blit_destroy(&stack->blit);
     if (stack->quad_vbo != 0) {
         glDeleteBuffers(1, &stack->quad_vbo);
         stack->quad_vbo = 0;
@@ -418,51 +365,11 @@ static int budo_shader_configure_vaos(struct budo_shader_stack *stack, struct bu
     if (!stack || !shader) {
         return -1;
     }
-    if (stack->quad_vbo == 0) {
-        return -1;
-    }
-
-    GLuint vaos[2] = {0u, 0u};
-    glGenVertexArrays(2, vaos);
-    if (vaos[0] == 0u || vaos[1] == 0u) {
-        if (vaos[0] != 0u) {
-            glDeleteVertexArrays(1, &vaos[0]);
-        }
-        if (vaos[1] != 0u) {
-            glDeleteVertexArrays(1, &vaos[1]);
-        }
-        return -1;
-    }
-
-    const GLsizei stride = (GLsizei)sizeof(struct budo_quad_vertex);
-    const void *position_offset = (const void *)offsetof(struct budo_quad_vertex, position);
-    const void *cpu_offset = (const void *)offsetof(struct budo_quad_vertex, texcoord_cpu);
-    const void *fbo_offset = (const void *)offsetof(struct budo_quad_vertex, texcoord_fbo);
-
-    GLuint *targets[2] = {&vaos[0], &vaos[1]};
-    const void *texcoord_offsets[2] = {cpu_offset, fbo_offset};
-
-    for (size_t i = 0; i < 2; i++) {
-        glBindVertexArray(*targets[i]);
-        glBindBuffer(GL_ARRAY_BUFFER, stack->quad_vbo);
-        if (shader->attrib_vertex >= 0) {
-            glEnableVertexAttribArray((GLuint)shader->attrib_vertex);
-            glVertexAttribPointer((GLuint)shader->attrib_vertex, 4, GL_FLOAT, GL_FALSE, stride, position_offset);
-        }
-        if (shader->attrib_texcoord >= 0) {
-            glEnableVertexAttribArray((GLuint)shader->attrib_texcoord);
-            glVertexAttribPointer((GLuint)shader->attrib_texcoord, 2, GL_FLOAT, GL_FALSE, stride, texcoord_offsets[i]);
-        }
-        if (shader->attrib_color >= 0) {
-            glDisableVertexAttribArray((GLuint)shader->attrib_color);
-        }
-    }
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    shader->quad_vaos[0] = vaos[0];
-    shader->quad_vaos[1] = vaos[1];
-    return 0;
+    return budo_gl_quad_vaos_create(stack->quad_vbo,
+                                    shader->attrib_vertex,
+                                    shader->attrib_texcoord,
+                                    shader->attrib_color,
+                                    shader->quad_vaos);
 }
 
 static void budo_bind_texture(struct budo_shader_stack *stack, GLuint texture) {
@@ -720,10 +627,10 @@ static int budo_initialize_gl_program(struct budo_shader_stack *stack, const cha
         glUniform1i(shader_info.uniform_frame_direction, 1);
     }
     if (shader_info.uniform_mvp >= 0) {
-        budo_shader_set_matrix(shader_info.uniform_mvp,
+        budo_gl_set_matrix(shader_info.uniform_mvp,
                                shader_info.cached_mvp,
                                &shader_info.has_cached_mvp,
-                               budo_identity_mvp);
+                               budo_gl_identity_mvp);
     }
 
     for (size_t i = 0; i < parameter_count; i++) {
@@ -895,184 +802,6 @@ static int budo_prepare_intermediate_targets(struct budo_shader_stack *stack, in
     return 0;
 }
 
-static void budo_clear_history_texture(struct budo_shader_stack *stack, GLuint texture, int width, int height) {
-    if (!stack || texture == 0 || width <= 0 || height <= 0) {
-        return;
-    }
-    if (stack->framebuffer == 0) {
-        glGenFramebuffers(1, &stack->framebuffer);
-        if (stack->framebuffer == 0) {
-            return;
-        }
-    }
-
-    GLint viewport[4];
-    glGetIntegerv(GL_VIEWPORT, viewport);
-    glBindFramebuffer(GL_FRAMEBUFFER, stack->framebuffer);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                           GL_TEXTURE_2D, texture, 0);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
-        glViewport(0, 0, width, height);
-        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-    }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
-}
-
-static int budo_prepare_shader_history(struct budo_shader_stack *stack,
-                                       struct budo_gl_shader *shader,
-                                       int width,
-                                       int height,
-                                       int resized) {
-    if (!stack || !shader || width <= 0 || height <= 0) {
-        return -1;
-    }
-
-    int created_history = 0;
-    int created_flipped = 0;
-
-    if (shader->history_texture == 0) {
-        glGenTextures(1, &shader->history_texture);
-        if (shader->history_texture != 0) {
-            created_history = 1;
-        }
-    }
-    if (shader->history_texture == 0) {
-        return -1;
-    }
-
-    if (shader->history_texture_flipped == 0) {
-        glGenTextures(1, &shader->history_texture_flipped);
-        if (shader->history_texture_flipped == 0) {
-            fprintf(stderr, "budo: Failed to create flipped history texture.\n");
-        } else {
-            created_flipped = 1;
-        }
-    }
-
-    if (created_history || resized || stack->history_width == 0 || stack->history_height == 0) {
-        budo_bind_texture(stack, shader->history_texture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
-                     GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-        budo_bind_texture(stack, 0);
-        budo_clear_history_texture(stack, shader->history_texture, width, height);
-
-        if (shader->history_texture_flipped != 0 &&
-            (created_flipped || resized || stack->history_width == 0 || stack->history_height == 0)) {
-            budo_bind_texture(stack, shader->history_texture_flipped);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
-                         GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-            budo_bind_texture(stack, 0);
-            budo_clear_history_texture(stack, shader->history_texture_flipped, width, height);
-        }
-    }
-
-    return 0;
-}
-
-static void budo_update_flipped_history_texture(struct budo_shader_stack *stack,
-                                                GLuint history_texture,
-                                                GLuint history_texture_flipped,
-                                                int width,
-                                                int height) {
-    if (!stack || history_texture == 0 || history_texture_flipped == 0 || width <= 0 || height <= 0) {
-        return;
-    }
-
-    if (stack->framebuffer == 0) {
-        glGenFramebuffers(1, &stack->framebuffer);
-        if (stack->framebuffer == 0) {
-            return;
-        }
-    }
-
-    GLint viewport[4];
-    glGetIntegerv(GL_VIEWPORT, viewport);
-    glBindFramebuffer(GL_FRAMEBUFFER, stack->framebuffer);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                           GL_TEXTURE_2D, history_texture_flipped, 0);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        return;
-    }
-
-    glViewport(0, 0, width, height);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    glUseProgram(0);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-
-    glActiveTexture(GL_TEXTURE0);
-    budo_bind_texture(stack, history_texture);
-    glEnable(GL_TEXTURE_2D);
-
-    glBegin(GL_TRIANGLE_STRIP);
-    glTexCoord2f(0.0f, 1.0f);
-    glVertex2f(-1.0f, -1.0f);
-    glTexCoord2f(1.0f, 1.0f);
-    glVertex2f(1.0f, -1.0f);
-    glTexCoord2f(0.0f, 0.0f);
-    glVertex2f(-1.0f, 1.0f);
-    glTexCoord2f(1.0f, 0.0f);
-    glVertex2f(1.0f, 1.0f);
-    glEnd();
-
-    glDisable(GL_TEXTURE_2D);
-    budo_bind_texture(stack, 0);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
-}
-
-static void budo_update_shader_history(struct budo_shader_stack *stack,
-                                       struct budo_gl_shader *shader,
-                                       int width,
-                                       int height) {
-    if (!stack || !shader || shader->history_texture == 0 || width <= 0 || height <= 0) {
-        return;
-    }
-
-    glActiveTexture(GL_TEXTURE1);
-    budo_bind_texture(stack, shader->history_texture);
-    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
-    budo_bind_texture(stack, 0);
-    glActiveTexture(GL_TEXTURE0);
-
-    budo_update_flipped_history_texture(stack,
-                                        shader->history_texture,
-                                        shader->history_texture_flipped,
-                                        width,
-                                        height);
-}
-
-static void budo_clear_shader_history(struct budo_gl_shader *shader) {
-    if (!shader) {
-        return;
-    }
-    if (shader->history_texture != 0) {
-        glDeleteTextures(1, &shader->history_texture);
-        shader->history_texture = 0;
-    }
-    if (shader->history_texture_flipped != 0) {
-        glDeleteTextures(1, &shader->history_texture_flipped);
-        shader->history_texture_flipped = 0;
-    }
-}
-
 int budo_shader_stack_init(struct budo_shader_stack **out_stack) {
     if (!out_stack) {
         return -1;
@@ -1148,7 +877,7 @@ void budo_shader_stack_clear(struct budo_shader_stack *stack) {
             if (stack->shaders[i].program != 0) {
                 glDeleteProgram(stack->shaders[i].program);
             }
-            budo_clear_shader_history(&stack->shaders[i]);
+            budo_gl_history_release(&stack->shaders[i].history);
             budo_shader_clear_vaos(&stack->shaders[i]);
         }
         free(stack->shaders);
@@ -1200,37 +929,54 @@ int budo_shader_stack_render(struct budo_shader_stack *stack,
         GLuint target_texture = 0;
         int using_intermediate = 0;
 
-        if (!last_pass) {
+        /* A pass that reads Prev0 always renders offscreen into its own
+         * history pair, so next frame can sample it without a copy. */
+        int has_history = shader->uniform_prev_sampler >= 0 &&
+                          budo_gl_history_prepare(&shader->history,
+                                                  &stack->framebuffer,
+                                                  &stack->bound_texture,
+                                                  output_width,
+                                                  output_height,
+                                                  history_resized) == 0;
+        if (has_history) {
+            target_texture = budo_gl_history_target(&shader->history);
+        } else if (!last_pass) {
             if (budo_prepare_intermediate_targets(stack, output_width, output_height) != 0) {
                 fprintf(stderr, "budo: Failed to prepare intermediate targets; skipping remaining shader passes.\n");
                 multipass_failed = 1;
                 last_pass = 1;
             } else {
                 target_texture = stack->intermediate_textures[shader_index % 2u];
-                glBindFramebuffer(GL_FRAMEBUFFER, stack->framebuffer);
-                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target_texture, 0);
-                GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-                if (status != GL_FRAMEBUFFER_COMPLETE) {
-                    fprintf(stderr, "budo: Framebuffer incomplete (0x%04x); skipping remaining shader passes.\n", (unsigned int)status);
-                    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-                    multipass_failed = 1;
-                    last_pass = 1;
-                } else {
-                    using_intermediate = 1;
-                    glViewport(0, 0, output_width, output_height);
-                    glClear(GL_COLOR_BUFFER_BIT);
-                }
             }
         }
 
-        if (last_pass && !using_intermediate) {
+        if (target_texture != 0) {
+            glBindFramebuffer(GL_FRAMEBUFFER, stack->framebuffer);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target_texture, 0);
+            GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+            if (status != GL_FRAMEBUFFER_COMPLETE) {
+                fprintf(stderr, "budo: Framebuffer incomplete (0x%04x); skipping remaining shader passes.\n", (unsigned int)status);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                multipass_failed = 1;
+                last_pass = 1;
+                has_history = 0;
+            } else {
+                using_intermediate = 1;
+                glViewport(0, 0, output_width, output_height);
+                glClear(GL_COLOR_BUFFER_BIT);
+            }
+        }
+
+        if (!using_intermediate) {
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
             glViewport(0, 0, output_width, output_height);
         }
 
+        int flip_output = budo_gl_pass_flips(using_intermediate, !current_from_fbo, shader->uniform_mvp);
+
         glUseProgram(shader->program);
 
-        budo_shader_set_vec2(shader->uniform_output_size,
+        budo_gl_set_vec2(shader->uniform_output_size,
                              shader->cached_output_size,
                              &shader->has_cached_output_size,
                              (GLfloat)output_width,
@@ -1238,97 +984,53 @@ int budo_shader_stack_render(struct budo_shader_stack *stack,
         if (shader->uniform_frame_count >= 0) {
             glUniform1i(shader->uniform_frame_count, frame_value);
         }
-        budo_shader_set_vec2(shader->uniform_texture_size,
+        budo_gl_set_vec2(shader->uniform_texture_size,
                              shader->cached_texture_size,
                              &shader->has_cached_texture_size,
                              current_texture_width,
                              current_texture_height);
-        budo_shader_set_vec2(shader->uniform_input_size,
+        budo_gl_set_vec2(shader->uniform_input_size,
                              shader->cached_input_size,
                              &shader->has_cached_input_size,
                              current_input_width,
                              current_input_height);
+        budo_gl_set_matrix(shader->uniform_mvp,
+                               shader->cached_mvp,
+                               &shader->has_cached_mvp,
+                               flip_output ? budo_gl_flip_mvp : budo_gl_identity_mvp);
 
         if (shader->uniform_prev_sampler >= 0) {
-            GLuint history_texture = 0;
-            if (budo_prepare_shader_history(stack, shader, output_width, output_height, history_resized) == 0) {
-                history_texture = shader->history_texture;
-                if (!current_from_fbo && shader->history_texture_flipped != 0) {
-                    history_texture = shader->history_texture_flipped;
-                }
-            }
             glActiveTexture(GL_TEXTURE1);
-            budo_bind_texture(stack, history_texture);
+            budo_bind_texture(stack, has_history ? budo_gl_history_previous(&shader->history) : 0);
             glActiveTexture(GL_TEXTURE0);
         }
 
         glActiveTexture(GL_TEXTURE0);
         budo_bind_texture(stack, current_texture);
 
-        GLuint vao = current_from_fbo ? shader->quad_vaos[1] : shader->quad_vaos[0];
-        int using_vao = 0;
-        if (vao != 0) {
-            glBindVertexArray(vao);
-            using_vao = 1;
-        } else {
-            static const GLfloat fallback_quad_vertices[16] = {
-                -1.0f, -1.0f, 0.0f, 1.0f,
-                 1.0f, -1.0f, 0.0f, 1.0f,
-                -1.0f,  1.0f, 0.0f, 1.0f,
-                 1.0f,  1.0f, 0.0f, 1.0f
-            };
-            static const GLfloat fallback_texcoords_cpu[8] = {
-                0.0f, 1.0f,
-                1.0f, 1.0f,
-                0.0f, 0.0f,
-                1.0f, 0.0f
-            };
-            static const GLfloat fallback_texcoords_fbo[8] = {
-                0.0f, 0.0f,
-                1.0f, 0.0f,
-                0.0f, 1.0f,
-                1.0f, 1.0f
-            };
-            if (shader->attrib_vertex >= 0) {
-                glEnableVertexAttribArray((GLuint)shader->attrib_vertex);
-                glVertexAttribPointer((GLuint)shader->attrib_vertex, 4, GL_FLOAT, GL_FALSE, 0, fallback_quad_vertices);
-            }
-            if (shader->attrib_texcoord >= 0) {
-                const GLfloat *quad_texcoords = current_from_fbo ? fallback_texcoords_fbo : fallback_texcoords_cpu;
-                glEnableVertexAttribArray((GLuint)shader->attrib_texcoord);
-                glVertexAttribPointer((GLuint)shader->attrib_texcoord, 2, GL_FLOAT, GL_FALSE, 0, quad_texcoords);
-            }
-        }
-        if (shader->attrib_color >= 0) {
-            glDisableVertexAttribArray((GLuint)shader->attrib_color);
-            glVertexAttrib4f((GLuint)shader->attrib_color, 1.0f, 1.0f, 1.0f, 1.0f);
-        }
-
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, budo_quad_vertex_count);
-
-        if (shader->uniform_prev_sampler >= 0) {
-            budo_update_shader_history(stack, shader, output_width, output_height);
-        }
-
-        if (using_vao) {
-            glBindVertexArray(0);
-        } else {
-            if (shader->attrib_vertex >= 0) {
-                glDisableVertexAttribArray((GLuint)shader->attrib_vertex);
-            }
-            if (shader->attrib_texcoord >= 0) {
-                glDisableVertexAttribArray((GLuint)shader->attrib_texcoord);
-            }
-        }
+        budo_gl_quad_draw(shader->quad_vaos,
+                          !current_from_fbo,
+                          shader->attrib_vertex,
+                          shader->attrib_texcoord,
+                          shader->attrib_color);
 
         if (using_intermediate) {
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            if (last_pass) {
+                /* A final pass with history rendered offscreen; present it
+                 * through the blit program, which undoes the flip if it had one. */
+                budo_gl_blit_draw(&stack->blit, &stack->bound_texture, target_texture, flip_output,
+                                  -1.0f, -1.0f, 1.0f, 1.0f);
+            }
+            if (has_history) {
+                budo_gl_history_swap(&shader->history);
+            }
             current_texture = target_texture;
             current_texture_width = (GLfloat)output_width;
             current_texture_height = (GLfloat)output_height;
             current_input_width = (GLfloat)output_width;
             current_input_height = (GLfloat)output_height;
-            current_from_fbo = 1;
+            current_from_fbo = !flip_output;
         }
 
         if (multipass_failed) {
@@ -5,7 +5,9 @@
 #include <stdlib.h>
 #include <unistd.h>
 
-int main(void) {
+int main(int argc, char *argv[]) {
+    (void)argc;
+    (void)argv;
     static const char clear_sequence[] = "\x1b[2J\x1b[H";
     size_t offset = 0u;
     const size_t total = sizeof(clear_sequence) - 1u;
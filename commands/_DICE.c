@@ -136,8 +136,13 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    unsigned int seed = (unsigned int)time(NULL) ^ (unsigned int)getpid();
-    srand(seed);
+    // Seed once: runtask calls this entry point repeatedly within one process.
+    static int seeded = 0;
+    if (!seeded) {
+        unsigned int seed = (unsigned int)time(NULL) ^ (unsigned int)getpid();
+        srand(seed);
+        seeded = 1;
+    }
 
     unsigned int total = 0U;
     for (unsigned int i = 0U; i < count; ++i) {
@@ -6,7 +6,9 @@
 #include <sys/ioctl.h>
 #include <unistd.h>
 
-int main(void) {
+int main(int argc, char *argv[]) {
+    (void)argc;
+    (void)argv;
     struct winsize ws;
     int fds[] = {STDOUT_FILENO, STDIN_FILENO, STDERR_FILENO};
     size_t count = sizeof(fds) / sizeof(fds[0]);
@@ -1,6 +1,8 @@
 #include <stdio.h>
 
-int main(void) {
+int main(int argc, char *argv[]) {
+    (void)argc;
+    (void)argv;
     printf("hello world!\n");
     return 0;
 }
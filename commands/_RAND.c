@@ -67,8 +67,13 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
-    unsigned long seed = (unsigned long)time(NULL) ^ (unsigned long)getpid();
-    srand((unsigned int)seed);
+    // Seed once: runtask calls this entry point repeatedly within one process.
+    static int seeded = 0;
+    if (!seeded) {
+        unsigned long seed = (unsigned long)time(NULL) ^ (unsigned long)getpid();
+        srand((unsigned int)seed);
+        seeded = 1;
+    }
 
     if (min == max) {
         printf("%ld\n", min);
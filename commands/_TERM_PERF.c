@@ -0,0 +1,167 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+
+#define DUMP_NAME_MAX 64u
+
+static void print_usage(void) {
+    fprintf(stderr, "Usage: _TERM_PERF <enable|disable>\n");
+    fprintf(stderr, "       _TERM_PERF dump <name.csv>\n");
+    fprintf(stderr, "  Shows or hides the terminal performance overlay, or writes the\n");
+    fprintf(stderr, "  recorded frames to a new CSV file in the terminal's perf/ directory\n");
+    fprintf(stderr, "  and prints how many were written and where.\n");
+}
+
+static int send_request(int fd, const char *action, const char *path) {
+    char request[PATH_MAX + 64];
+    int length = path
+        ? snprintf(request, sizeof(request), "\x1b]777;perf=%s;perf_file=%s\a", action, path)
+        : snprintf(request, sizeof(request), "\x1b]777;perf=%s\a", action);
+    if (length < 0 || (size_t)length >= sizeof(request)) {
+        fprintf(stderr, "_TERM_PERF: failed to create terminal request\n");
+        return -1;
+    }
+
+    size_t written = 0u;
+    while (written < (size_t)length) {
+        ssize_t result = write(fd, request + written, (size_t)length - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("_TERM_PERF: write");
+            return -1;
+        }
+        written += (size_t)result;
+    }
+    return 0;
+}
+
+static int read_response(int fd) {
+    char buffer[PATH_MAX + 64];
+    size_t offset = 0u;
+
+    while (offset + 1u < sizeof(buffer)) {
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(fd, &read_fds);
+
+        struct timeval timeout;
+        timeout.tv_sec = 1;
+        timeout.tv_usec = 0;
+        int ready = select(fd + 1, &read_fds, NULL, NULL, &timeout);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("_TERM_PERF: select");
+            return -1;
+        }
+        if (ready == 0) {
+            fprintf(stderr, "_TERM_PERF: timed out waiting for terminal response\n");
+            return -1;
+        }
+
+        ssize_t count = read(fd, buffer + offset, sizeof(buffer) - offset - 1u);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("_TERM_PERF: read");
+            return -1;
+        }
+        if (count == 0) {
+            fprintf(stderr, "_TERM_PERF: unexpected EOF waiting for terminal response\n");
+            return -1;
+        }
+        offset += (size_t)count;
+        buffer[offset] = '\0';
+
+        char *newline = memchr(buffer, '\n', offset);
+        if (newline) {
+            *newline = '\0';
+            const char prefix[] = "_TERM_PERF ";
+            if (strncmp(buffer, prefix, sizeof(prefix) - 1u) != 0) {
+                fprintf(stderr, "_TERM_PERF: unexpected response '%s'\n", buffer);
+                return -1;
+            }
+            const char *value = buffer + sizeof(prefix) - 1u;
+            if (strcmp(value, "error") == 0) {
+                fprintf(stderr, "_TERM_PERF: terminal failed to write the dump (does the file already exist?)\n");
+                return -1;
+            }
+            printf("%s\n", value);
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "_TERM_PERF: terminal response was too long\n");
+    return -1;
+}
+
+/* The terminal only creates new files in its own perf/ directory, so a
+ * dump is named by a plain file name. */
+static int check_name(const char *name) {
+    if (name[0] == '\0' || name[0] == '.' || strlen(name) > DUMP_NAME_MAX) {
+        fprintf(stderr, "_TERM_PERF: invalid dump name '%s'\n", name);
+        return -1;
+    }
+    for (const char *p = name; *p != '\0'; p++) {
+        unsigned char ch = (unsigned char)*p;
+        if (!isalnum(ch) && ch != '.' && ch != '_' && ch != '-') {
+            fprintf(stderr, "_TERM_PERF: dump name may only contain letters, digits, '.', '_' and '-'\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3 || !argv || !argv[1]) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    const char *action = argv[1];
+    int dump = strcmp(action, "dump") == 0;
+    if (dump ? argc != 3 : (argc != 2 || (strcmp(action, "enable") != 0 && strcmp(action, "disable") != 0))) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    if (dump && check_name(argv[2]) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    int tty_fd = open("/dev/tty", O_RDWR);
+    int write_fd = tty_fd >= 0 ? tty_fd : STDOUT_FILENO;
+    int read_fd = tty_fd >= 0 ? tty_fd : STDIN_FILENO;
+    if (send_request(write_fd, action, dump ? argv[2] : NULL) != 0) {
+        if (tty_fd >= 0) {
+            close(tty_fd);
+        }
+        return EXIT_FAILURE;
+    }
+
+    int result = 0;
+    if (dump) {
+        result = read_response(read_fd);
+    }
+    if (tty_fd >= 0 && close(tty_fd) != 0) {
+        perror("_TERM_PERF: close");
+        return EXIT_FAILURE;
+    }
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
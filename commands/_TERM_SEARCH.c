@@ -0,0 +1,153 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define SEARCH_QUERY_MAX 127u
+
+static void print_usage(void) {
+    fprintf(stderr, "Usage: _TERM_SEARCH <regex>\n");
+    fprintf(stderr, "  Searches the scrollback for a case-insensitive POSIX extended regex,\n");
+    fprintf(stderr, "  highlights the newest hit and prints the hit count.\n");
+}
+
+static int build_query(int argc, char **argv, char *query, size_t capacity) {
+    size_t length = 0u;
+    for (int i = 1; i < argc; i++) {
+        size_t part = strlen(argv[i]);
+        size_t needed = part + (i > 1 ? 1u : 0u);
+        if (length + needed >= capacity) {
+            fprintf(stderr, "_TERM_SEARCH: search text is too long\n");
+            return -1;
+        }
+        if (i > 1) {
+            query[length++] = ' ';
+        }
+        for (size_t j = 0u; j < part; j++) {
+            unsigned char ch = (unsigned char)argv[i][j];
+            if (ch < 0x20u || ch == 0x7Fu || ch == ';') {
+                fprintf(stderr, "_TERM_SEARCH: search text may not contain ';' or control characters\n");
+                return -1;
+            }
+            query[length++] = (char)ch;
+        }
+    }
+    query[length] = '\0';
+    return length > 0u ? 0 : -1;
+}
+
+static int send_request(int fd, const char *query) {
+    char request[SEARCH_QUERY_MAX + 32u];
+    int length = snprintf(request, sizeof(request), "\x1b]777;search=%s\a", query);
+    if (length < 0 || (size_t)length >= sizeof(request)) {
+        fprintf(stderr, "_TERM_SEARCH: failed to create terminal request\n");
+        return -1;
+    }
+
+    size_t written = 0u;
+    while (written < (size_t)length) {
+        ssize_t result = write(fd, request + written, (size_t)length - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("_TERM_SEARCH: write");
+            return -1;
+        }
+        written += (size_t)result;
+    }
+    return 0;
+}
+
+static int read_response(int fd) {
+    char buffer[192];
+    size_t offset = 0u;
+
+    while (offset + 1u < sizeof(buffer)) {
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(fd, &read_fds);
+
+        struct timeval timeout;
+        timeout.tv_sec = 1;
+        timeout.tv_usec = 0;
+        int ready = select(fd + 1, &read_fds, NULL, NULL, &timeout);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("_TERM_SEARCH: select");
+            return -1;
+        }
+        if (ready == 0) {
+            fprintf(stderr, "_TERM_SEARCH: timed out waiting for terminal response\n");
+            return -1;
+        }
+
+        ssize_t count = read(fd, buffer + offset, sizeof(buffer) - offset - 1u);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("_TERM_SEARCH: read");
+            return -1;
+        }
+        if (count == 0) {
+            fprintf(stderr, "_TERM_SEARCH: unexpected EOF waiting for terminal response\n");
+            return -1;
+        }
+        offset += (size_t)count;
+        buffer[offset] = '\0';
+
+        char *newline = memchr(buffer, '\n', offset);
+        if (newline) {
+            *newline = '\0';
+            const char prefix[] = "_TERM_SEARCH ";
+            if (strncmp(buffer, prefix, sizeof(prefix) - 1u) != 0) {
+                fprintf(stderr, "_TERM_SEARCH: unexpected response '%s'\n", buffer);
+                return -1;
+            }
+            const char *reply = buffer + sizeof(prefix) - 1u;
+            if (strncmp(reply, "error: ", 7u) == 0) {
+                fprintf(stderr, "_TERM_SEARCH: %s\n", reply + 7u);
+                return -1;
+            }
+            printf("%s\n", reply);
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "_TERM_SEARCH: terminal response was too long\n");
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    char query[SEARCH_QUERY_MAX + 1u];
+    if (argc < 2 || !argv || build_query(argc, argv, query, sizeof(query)) != 0) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    int tty_fd = open("/dev/tty", O_RDWR);
+    int write_fd = tty_fd >= 0 ? tty_fd : STDOUT_FILENO;
+    int read_fd = tty_fd >= 0 ? tty_fd : STDIN_FILENO;
+    if (send_request(write_fd, query) != 0) {
+        if (tty_fd >= 0) {
+            close(tty_fd);
+        }
+        return EXIT_FAILURE;
+    }
+
+    int result = read_response(read_fd);
+    if (tty_fd >= 0 && close(tty_fd) != 0) {
+        perror("_TERM_SEARCH: close");
+        return EXIT_FAILURE;
+    }
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
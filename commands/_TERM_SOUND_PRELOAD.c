@@ -0,0 +1,54 @@
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void print_usage(void) {
+    fprintf(stderr, "Usage: _TERM_SOUND_PRELOAD <audiofile> [audiofile...]\n");
+    fprintf(stderr, "  Decodes the files into the terminal sound cache so later plays start at once.\n");
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    for (int i = 1; i < argc; i++) {
+        const char *path = argv[i];
+        if (!path || path[0] == '\0') {
+            fprintf(stderr, "_TERM_SOUND_PRELOAD: audio file path cannot be empty.\n");
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        char resolved[PATH_MAX];
+        if (!realpath(path, resolved)) {
+            perror("_TERM_SOUND_PRELOAD: realpath");
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        if (access(resolved, R_OK) != 0) {
+            perror("_TERM_SOUND_PRELOAD: access");
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        if (printf("\x1b]777;sound=preload;path=%s\a", resolved) < 0) {
+            perror("_TERM_SOUND_PRELOAD: printf");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (fflush(stdout) != 0) {
+        perror("_TERM_SOUND_PRELOAD: fflush");
+        return EXIT_FAILURE;
+    }
+
+    return status;
+}
@@ -2,18 +2,28 @@
 
 #include "../lib/termgfx.h"
 
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <unistd.h>
 
 static void print_usage(void) {
     fprintf(stderr,
-            "Usage: _TERM_SPRITE -x <pixels> -y <pixels> (-file <path> | -sprite {w,h,\"data\"} | -data <base64> -width <px> -height <px>) [-layer <1-16>]\n");
+            "Usage: _TERM_SPRITE -x <pixels> -y <pixels> (-file <path> | -sprite {w,h,\"data\"} | -data <base64> -width <px> -height <px>) [-layer <1-16>]\n"
+            "       _TERM_SPRITE -x <pixels> -y <pixels> -id <id> [-check] [-layer <1-16>]\n"
+            "       _TERM_SPRITE (-upload | -print-id) (-file <path> | -sprite {w,h,\"data\"} | -data <base64> -width <px> -height <px>)\n");
     fprintf(stderr, "  Draws a PNG/BMP file, sprite literal, or raw base64 RGBA block onto the terminal pixel surface.\n");
     fprintf(stderr, "  Layers are numbered 1 (top) through 16 (bottom). Defaults to 1.\n");
     fprintf(stderr, "  Use -sprite with the literal produced by _TERM_SPRITE_LOAD to avoid re-reading image files.\n");
+    fprintf(stderr, "  -upload stores the sprite in the terminal; -print-id prints its id without contacting the terminal.\n");
+    fprintf(stderr, "  -id draws a stored sprite. With -check it prints 'drawn', or 'missing' when the terminal\n");
+    fprintf(stderr, "  no longer holds the sprite and it has to be uploaded again.\n");
 }
 
 static int parse_long(const char *arg, const char *name, long min_value, long max_value, long *out_value) {
@@ -37,6 +47,137 @@ static int parse_long(const char *arg, const char *name, long min_value, long ma
     return 0;
 }
 
+static int valid_sprite_id(const char *id) {
+    if (strlen(id) != TERMGFX_SPRITE_ID_LENGTH || id[0] != 's') {
+        return 0;
+    }
+    for (const char *p = id + 1; *p != '\0'; p++) {
+        if (!isxdigit((unsigned char)*p)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int write_request(int fd, const char *request, size_t length) {
+    size_t written = 0u;
+    while (written < length) {
+        ssize_t result = write(fd, request + written, length - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("_TERM_SPRITE: write");
+            return -1;
+        }
+        written += (size_t)result;
+    }
+    return 0;
+}
+
+/* Reads the terminal's "_TERM_SPRITE <status>" reply line. */
+static int read_status(int fd, char *status, size_t status_size) {
+    char buffer[64];
+    size_t offset = 0u;
+
+    while (offset + 1u < sizeof(buffer)) {
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(fd, &read_fds);
+
+        struct timeval timeout;
+        timeout.tv_sec = 1;
+        timeout.tv_usec = 0;
+        int ready = select(fd + 1, &read_fds, NULL, NULL, &timeout);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("_TERM_SPRITE: select");
+            return -1;
+        }
+        if (ready == 0) {
+            fprintf(stderr, "_TERM_SPRITE: timed out waiting for terminal response\n");
+            return -1;
+        }
+
+        ssize_t count = read(fd, buffer + offset, sizeof(buffer) - offset - 1u);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("_TERM_SPRITE: read");
+            return -1;
+        }
+        if (count == 0) {
+            fprintf(stderr, "_TERM_SPRITE: unexpected EOF waiting for terminal response\n");
+            return -1;
+        }
+        offset += (size_t)count;
+        buffer[offset] = '\0';
+
+        char *newline = memchr(buffer, '\n', offset);
+        if (newline) {
+            *newline = '\0';
+            const char prefix[] = "_TERM_SPRITE ";
+            if (strncmp(buffer, prefix, sizeof(prefix) - 1u) != 0) {
+                fprintf(stderr, "_TERM_SPRITE: unexpected response '%s'\n", buffer);
+                return -1;
+            }
+            snprintf(status, status_size, "%s", buffer + sizeof(prefix) - 1u);
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "_TERM_SPRITE: terminal response was too long\n");
+    return -1;
+}
+
+/* Draws a stored sprite and waits for the terminal to say whether it
+ * still had it. The exchange goes through the controlling terminal so
+ * that the status can be captured from stdout. Returns 0 when drawn, 1
+ * when the sprite is missing and -1 on error. */
+static int draw_id_checked(long x, long y, const char *id, long layer) {
+    char request[160];
+    int length = snprintf(request,
+                          sizeof(request),
+                          "\x1b]777;sprite=draw;sprite_x=%ld;sprite_y=%ld;sprite_layer=%ld;sprite_id=%s;sprite_reply=1\a",
+                          x,
+                          y,
+                          layer,
+                          id);
+    if (length < 0 || (size_t)length >= sizeof(request)) {
+        fprintf(stderr, "_TERM_SPRITE: failed to create terminal request\n");
+        return -1;
+    }
+
+    int tty_fd = open("/dev/tty", O_RDWR);
+    int write_fd = tty_fd >= 0 ? tty_fd : STDOUT_FILENO;
+    int read_fd = tty_fd >= 0 ? tty_fd : STDIN_FILENO;
+    char status[32];
+    int rc = write_request(write_fd, request, (size_t)length);
+    if (rc == 0) {
+        rc = read_status(read_fd, status, sizeof(status));
+    }
+    if (tty_fd >= 0 && close(tty_fd) != 0) {
+        perror("_TERM_SPRITE: close");
+        rc = -1;
+    }
+    if (rc != 0) {
+        return -1;
+    }
+
+    printf("%s\n", status);
+    if (strcmp(status, "drawn") == 0) {
+        return 0;
+    }
+    if (strcmp(status, "missing") == 0) {
+        return 1;
+    }
+    fprintf(stderr, "_TERM_SPRITE: terminal failed to draw sprite '%s'.\n", id);
+    return -1;
+}
+
 int main(int argc, char **argv) {
     if (argc == 1) {
         print_usage();
@@ -51,6 +192,10 @@ int main(int argc, char **argv) {
     const char *file = NULL;
     const char *data = NULL;
     const char *sprite_literal = NULL;
+    const char *sprite_id = NULL;
+    int upload = 0;
+    int print_id = 0;
+    int check = 0;
 
     for (int i = 1; i < argc; ++i) {
         const char *arg = argv[i];
@@ -84,6 +229,18 @@ int main(int argc, char **argv) {
                 return EXIT_FAILURE;
             }
             data = argv[i];
+        } else if (strcmp(arg, "-id") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "_TERM_SPRITE: missing value for -id.\n");
+                return EXIT_FAILURE;
+            }
+            sprite_id = argv[i];
+        } else if (strcmp(arg, "-upload") == 0) {
+            upload = 1;
+        } else if (strcmp(arg, "-print-id") == 0) {
+            print_id = 1;
+        } else if (strcmp(arg, "-check") == 0) {
+            check = 1;
         } else if (strcmp(arg, "-width") == 0) {
             if (++i >= argc || parse_long(argv[i], "-width", 1, INT_MAX, &width) != 0) {
                 return EXIT_FAILURE;
@@ -99,24 +256,67 @@ int main(int argc, char **argv) {
         }
     }
 
-    if (origin_x < 0 || origin_y < 0 || (file == NULL && data == NULL && sprite_literal == NULL)) {
+    int sources = (file != NULL) + (data != NULL) + (sprite_literal != NULL) + (sprite_id != NULL);
+    if ((!upload && !print_id && (origin_x < 0 || origin_y < 0)) || sources == 0) {
         fprintf(stderr, "_TERM_SPRITE: missing required arguments.\n");
         print_usage();
         return EXIT_FAILURE;
     }
-    if ((file != NULL) + (data != NULL) + (sprite_literal != NULL) > 1) {
-        fprintf(stderr, "_TERM_SPRITE: specify only one of -file, -sprite, or -data.\n");
+    if (sources > 1) {
+        fprintf(stderr, "_TERM_SPRITE: specify only one of -file, -sprite, -data, or -id.\n");
+        return EXIT_FAILURE;
+    }
+    if (upload && print_id) {
+        fprintf(stderr, "_TERM_SPRITE: specify only one of -upload or -print-id.\n");
+        return EXIT_FAILURE;
+    }
+    if ((upload || print_id) && sprite_id) {
+        fprintf(stderr, "_TERM_SPRITE: %s needs -file, -sprite, or -data.\n", upload ? "-upload" : "-print-id");
+        return EXIT_FAILURE;
+    }
+    if (check && !sprite_id) {
+        fprintf(stderr, "_TERM_SPRITE: -check is only valid with -id.\n");
+        return EXIT_FAILURE;
+    }
+    if (data && (width <= 0 || height <= 0)) {
+        fprintf(stderr, "_TERM_SPRITE: -width and -height are required when using -data.\n");
         return EXIT_FAILURE;
     }
 
     int rc;
-    if (sprite_literal) {
+    if (upload) {
+        char id[TERMGFX_SPRITE_ID_LENGTH + 1u];
+        if (sprite_literal) {
+            rc = termgfx_sprite_upload_literal(sprite_literal, id, sizeof(id));
+        } else if (data) {
+            rc = termgfx_sprite_upload_data(width, height, data, id, sizeof(id));
+        } else {
+            rc = termgfx_sprite_upload_file(file, id, sizeof(id));
+        }
+    } else if (print_id) {
+        char id[TERMGFX_SPRITE_ID_LENGTH + 1u];
+        if (sprite_literal) {
+            rc = termgfx_sprite_id_literal(sprite_literal, id, sizeof(id));
+        } else if (data) {
+            rc = termgfx_sprite_id(width, height, data, id, sizeof(id));
+        } else {
+            rc = termgfx_sprite_id_file(file, id, sizeof(id));
+        }
+        if (rc == 0) {
+            printf("%s\n", id);
+        }
+    } else if (sprite_id) {
+        if (!valid_sprite_id(sprite_id)) {
+            fprintf(stderr, "_TERM_SPRITE: invalid sprite id '%s'.\n", sprite_id);
+            rc = -1;
+        } else if (check) {
+            rc = draw_id_checked(origin_x, origin_y, sprite_id, layer);
+        } else {
+            rc = termgfx_sprite_draw_id(origin_x, origin_y, sprite_id, layer);
+        }
+    } else if (sprite_literal) {
         rc = termgfx_sprite_literal(origin_x, origin_y, sprite_literal, layer);
     } else if (data) {
-        if (width <= 0 || height <= 0) {
-            fprintf(stderr, "_TERM_SPRITE: -width and -height are required when using -data.\n");
-            return EXIT_FAILURE;
-        }
         rc = termgfx_sprite_data(origin_x, origin_y, width, height, data, layer);
     } else {
         rc = termgfx_sprite_file(origin_x, origin_y, file, layer);
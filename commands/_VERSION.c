@@ -18,7 +18,9 @@ static int is_only_whitespace(const char *s) {
     return 1;
 }
 
-int main(void) {
+int main(int argc, char *argv[]) {
+    (void)argc;
+    (void)argv;
     long long commit_count = 0;
     int have_value = 0;
     FILE *pipe = popen("git rev-list --count HEAD 2>/dev/null", "r");
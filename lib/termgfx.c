@@ -7,11 +7,17 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <unistd.h>
 
 static long clamp_layer(long layer) {
     if (layer < 1) {
@@ -373,17 +379,49 @@ int termgfx_render(long layer) {
     return 0;
 }
 
+int termgfx_sprite_id(long width, long height, const char *encoded_rgba, char *id_out, size_t id_size) {
+    if (width <= 0 || height <= 0 || !encoded_rgba || !id_out || id_size < TERMGFX_SPRITE_ID_LENGTH + 1u) {
+        return -1;
+    }
+
+    /* FNV-1a over "<w>x<h>:" and the base64 text; apps/terminal checks
+     * uploads against the same hash. */
+    char prefix[48];
+    int length = snprintf(prefix, sizeof(prefix), "%ldx%ld:", width, height);
+    if (length < 0 || (size_t)length >= sizeof(prefix)) {
+        return -1;
+    }
+    uint64_t hash = 1469598103934665603ull;
+    for (int i = 0; i < length; i++) {
+        hash ^= (unsigned char)prefix[i];
+        hash *= 1099511628211ull;
+    }
+    for (const unsigned char *p = (const unsigned char *)encoded_rgba; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ull;
+    }
+
+    snprintf(id_out, id_size, "s%016llx", (unsigned long long)hash);
+    return 0;
+}
+
 int termgfx_sprite_data(long x, long y, long width, long height, const char *encoded_rgba, long layer) {
-    if (x < 0 || y < 0 || width <= 0 || height <= 0 || !encoded_rgba || *encoded_rgba == '\0') {
+    char id[TERMGFX_SPRITE_ID_LENGTH + 1u];
+
+    if (x < 0 || y < 0 || termgfx_sprite_id(width, height, encoded_rgba, id, sizeof(id)) != 0 ||
+        *encoded_rgba == '\0') {
         return -1;
     }
 
-    if (printf("\x1b]777;sprite=draw;sprite_x=%ld;sprite_y=%ld;sprite_w=%ld;sprite_h=%ld;sprite_layer=%ld;sprite_data=%s\a",
+    /* The ID lets the terminal reuse its decoded copy when the same
+     * sprite is drawn again. */
+    if (printf("\x1b]777;sprite=draw;sprite_x=%ld;sprite_y=%ld;sprite_w=%ld;sprite_h=%ld;sprite_layer=%ld;sprite_id=%s;sprite_data=%s\a",
                x,
                y,
                width,
                height,
                clamp_layer(layer),
+               id,
                encoded_rgba) < 0) {
         return -1;
     }
@@ -455,3 +493,255 @@ int termgfx_sprite_load_literal(const char *path, char **literal_out) {
     *literal_out = literal;
     return 0;
 }
+
+int termgfx_sprite_id_literal(const char *literal, char *id_out, size_t id_size) {
+    int width = 0;
+    int height = 0;
+    char *encoded = NULL;
+
+    if (parse_sprite_literal(literal, &width, &height, &encoded) != 0) {
+        return -1;
+    }
+
+    int rc = termgfx_sprite_id(width, height, encoded, id_out, id_size);
+    free(encoded);
+    return rc;
+}
+
+int termgfx_sprite_id_file(const char *path, char *id_out, size_t id_size) {
+    int width = 0;
+    int height = 0;
+    char *encoded = NULL;
+
+    if (load_file_as_encoded_rgba(path, &width, &height, &encoded) != 0) {
+        return -1;
+    }
+
+    int rc = termgfx_sprite_id(width, height, encoded, id_out, id_size);
+    free(encoded);
+    return rc;
+}
+
+int termgfx_sprite_upload_data(long width, long height, const char *encoded_rgba, char *id_out, size_t id_size) {
+    if (termgfx_sprite_id(width, height, encoded_rgba, id_out, id_size) != 0 || *encoded_rgba == '\0') {
+        return -1;
+    }
+
+    if (printf("\x1b]777;sprite=upload;sprite_w=%ld;sprite_h=%ld;sprite_id=%s;sprite_data=%s\a",
+               width,
+               height,
+               id_out,
+               encoded_rgba) < 0) {
+        return -1;
+    }
+
+    return fflush(stdout) == 0 ? 0 : -1;
+}
+
+int termgfx_sprite_upload_literal(const char *literal, char *id_out, size_t id_size) {
+    int width = 0;
+    int height = 0;
+    char *encoded = NULL;
+
+    if (parse_sprite_literal(literal, &width, &height, &encoded) != 0) {
+        return -1;
+    }
+
+    int rc = termgfx_sprite_upload_data(width, height, encoded, id_out, id_size);
+    free(encoded);
+    return rc;
+}
+
+int termgfx_sprite_upload_file(const char *path, char *id_out, size_t id_size) {
+    int width = 0;
+    int height = 0;
+    char *encoded = NULL;
+
+    if (load_file_as_encoded_rgba(path, &width, &height, &encoded) != 0) {
+        return -1;
+    }
+
+    int rc = termgfx_sprite_upload_data(width, height, encoded, id_out, id_size);
+    free(encoded);
+    return rc;
+}
+
+int termgfx_sprite_draw_id(long x, long y, const char *id, long layer) {
+    if (x < 0 || y < 0 || !id || strlen(id) != TERMGFX_SPRITE_ID_LENGTH) {
+        return -1;
+    }
+    if (id[0] != 's') {
+        return -1;
+    }
+    for (const char *p = id + 1; *p != '\0'; p++) {
+        if (!isxdigit((unsigned char)*p)) {
+            return -1;
+        }
+    }
+
+    if (printf("\x1b]777;sprite=draw;sprite_x=%ld;sprite_y=%ld;sprite_layer=%ld;sprite_id=%s\a",
+               x,
+               y,
+               clamp_layer(layer),
+               id) < 0) {
+        return -1;
+    }
+
+    return fflush(stdout) == 0 ? 0 : -1;
+}
+
+static int write_all(int fd, const char *data, size_t length) {
+    size_t written = 0u;
+    while (written < length) {
+        ssize_t result = write(fd, data + written, length - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        written += (size_t)result;
+    }
+    return 0;
+}
+
+/* Reads one '\n'-terminated reply, waiting at most a second for each chunk. */
+static int read_reply_line(int fd, char *buffer, size_t size) {
+    size_t offset = 0u;
+    while (offset + 1u < size) {
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(fd, &read_fds);
+        struct timeval timeout;
+        timeout.tv_sec = 1;
+        timeout.tv_usec = 0;
+        int ready = select(fd + 1, &read_fds, NULL, NULL, &timeout);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (ready == 0) {
+            return -1;
+        }
+        ssize_t count = read(fd, buffer + offset, 1u);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (count == 0) {
+            return -1;
+        }
+        if (buffer[offset] == '\n') {
+            buffer[offset] = '\0';
+            return 0;
+        }
+        offset++;
+    }
+    return -1;
+}
+
+int termgfx_map_layer(long layer, struct termgfx_layer *out) {
+    if (!out || layer < 1 || layer > 16) {
+        return -1;
+    }
+    memset(out, 0, sizeof(*out));
+
+    int fd = open("/dev/tty", O_RDWR);
+    if (fd < 0) {
+        return -1;
+    }
+
+    /* Keep the reply off the screen and readable before the newline. */
+    struct termios saved;
+    int restore = 0;
+    if (tcgetattr(fd, &saved) == 0) {
+        struct termios raw = saved;
+        raw.c_lflag &= (tcflag_t)~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        if (tcsetattr(fd, TCSANOW, &raw) == 0) {
+            restore = 1;
+        }
+    }
+
+    char request[48];
+    char reply[160];
+    int length = snprintf(request, sizeof(request), "\x1b]777;layer_map=%ld\a", layer);
+    int rc = -1;
+    if (length > 0 && (size_t)length < sizeof(request) &&
+        write_all(fd, request, (size_t)length) == 0 &&
+        read_reply_line(fd, reply, sizeof(reply)) == 0) {
+        rc = 0;
+    }
+    if (restore) {
+        tcsetattr(fd, TCSANOW, &saved);
+    }
+    close(fd);
+    if (rc != 0) {
+        return -1;
+    }
+
+    char name[64];
+    int width = 0;
+    int height = 0;
+    if (sscanf(reply, "_TERM_LAYER %63s %d %d", name, &width, &height) != 3 || width <= 0 || height <= 0) {
+        return -1;
+    }
+
+    int shm_fd = shm_open(name, O_RDWR, 0);
+    if (shm_fd < 0) {
+        perror("termgfx: shm_open");
+        return -1;
+    }
+    size_t size = (size_t)width * (size_t)height * 4u;
+    void *pixels = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+    if (pixels == MAP_FAILED) {
+        perror("termgfx: mmap");
+        return -1;
+    }
+
+    out->pixels = pixels;
+    out->stride = (size_t)width * 4u;
+    out->size = size;
+    out->width = width;
+    out->height = height;
+    out->layer = layer;
+    return 0;
+}
+
+int termgfx_layer_present(const struct termgfx_layer *layer, long x, long y, long width, long height) {
+    if (!layer || !layer->pixels) {
+        return -1;
+    }
+
+    if (printf("\x1b]777;pixel=render;pixel_layer=%ld;pixel_x=%ld;pixel_y=%ld;pixel_w=%ld;pixel_h=%ld\a",
+               layer->layer,
+               x,
+               y,
+               width,
+               height) < 0) {
+        return -1;
+    }
+
+    return fflush(stdout) == 0 ? 0 : -1;
+}
+
+int termgfx_unmap_layer(struct termgfx_layer *layer, int release) {
+    if (!layer || !layer->pixels) {
+        return -1;
+    }
+
+    int rc = munmap(layer->pixels, layer->size);
+    if (release) {
+        if (printf("\x1b]777;layer_unmap=%ld\a", layer->layer) < 0 || fflush(stdout) != 0) {
+            rc = -1;
+        }
+    }
+    memset(layer, 0, sizeof(*layer));
+    return rc;
+}
@@ -1,8 +1,13 @@
 #ifndef BUDOSTACK_TERMGFX_H
 #define BUDOSTACK_TERMGFX_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+/* Sprite IDs are 's' followed by 16 hex digits naming the sprite content.
+ * The prefix keeps TASK from reading an all-digit ID back as a number. */
+#define TERMGFX_SPRITE_ID_LENGTH 17u
+
 int termgfx_color_from_index(int index, uint8_t *r_out, uint8_t *g_out, uint8_t *b_out);
 int termgfx_pixel(long x, long y, uint8_t r, uint8_t g, uint8_t b, long layer);
 int termgfx_rect(long x, long y, long width, long height, uint8_t r, uint8_t g, uint8_t b, long layer);
@@ -12,5 +17,28 @@ int termgfx_sprite_data(long x, long y, long width, long height, const char *enc
 int termgfx_sprite_literal(long x, long y, const char *literal, long layer);
 int termgfx_sprite_file(long x, long y, const char *path, long layer);
 int termgfx_sprite_load_literal(const char *path, char **literal_out);
+int termgfx_sprite_id(long width, long height, const char *encoded_rgba, char *id_out, size_t id_size);
+int termgfx_sprite_id_literal(const char *literal, char *id_out, size_t id_size);
+int termgfx_sprite_id_file(const char *path, char *id_out, size_t id_size);
+int termgfx_sprite_upload_data(long width, long height, const char *encoded_rgba, char *id_out, size_t id_size);
+int termgfx_sprite_upload_literal(const char *literal, char *id_out, size_t id_size);
+int termgfx_sprite_upload_file(const char *path, char *id_out, size_t id_size);
+int termgfx_sprite_draw_id(long x, long y, const char *id, long layer);
+
+/* A pixel layer shared with apps/terminal through POSIX shm. Write RGBA
+ * pixels (alpha 0 is transparent) and call termgfx_layer_present() with
+ * the changed rectangle; nothing is sent per pixel. */
+struct termgfx_layer {
+    uint8_t *pixels;
+    size_t stride;
+    size_t size;
+    int width;
+    int height;
+    long layer;
+};
+
+int termgfx_map_layer(long layer, struct termgfx_layer *out);
+int termgfx_layer_present(const struct termgfx_layer *layer, long x, long y, long width, long height);
+int termgfx_unmap_layer(struct termgfx_layer *layer, int release);
 
 #endif